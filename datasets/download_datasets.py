@@ -125,6 +125,10 @@ def download_dataset_cassandra():
             continue
         if not fname_gz[-3:].upper() == '.GZ':
             continue
+        # gembench reads gzip compressed models directly, only archives
+        # need unpacking
+        if not fname_gz[-7:].upper() == '.TAR.GZ':
+            continue
         print("\tUnzipping {} => {}".format(fname_gz, fname_gz[0:-3]))
 
         # Open and unzip the .gz file, extract contents
@@ -32,6 +32,7 @@
 MAX_RUNTIME_S=180
 SOLVER_NAME=spvi
 
-for filename in ../datasets/cassandra/*.POMDP; do 
+for filename in ../datasets/cassandra/*.POMDP ../datasets/cassandra/*.POMDP.gz; do 
+    [ -e "$filename" ] || continue
     ../src/build/gembench -m "$filename" -s "$SOLVER_NAME" -t "$MAX_RUNTIME_S"
 done
@@ -40,6 +40,16 @@ ENHANCEMENTS, OR MODIFICATIONS.
 // Solver interfaces
 #include "solver_vi.h"
 #include "solver_spvi.h"
+#include "solver_mtvi.h"
+#include "solver_csrvi.h"
+#include "solver_tvi.h"
+#include "solver_gsvi.h"
+#include "solver_pi.h"
+#include "solver_mpi.h"
+#include "solver_bvi.h"
+#include "solver_rvi.h"
+#include "backup_kernels.h"
+#include "sparse_mdp.h"
 
 // Misc files
 #include "utils.h"
@@ -47,15 +57,71 @@ ENHANCEMENTS, OR MODIFICATIONS.
 #define MAX_FILENAME_LEN (128)
 static int s_print_help_exit = 0;
 
+// Values returned by getopt_long for options that only have a long form
+enum
+{
+    LONG_OPT_OMEGA = 256,
+    LONG_OPT_SWEEP_ORDER,
+    LONG_OPT_MPI_SWEEPS,
+    LONG_OPT_ACTION_ELIM,
+    LONG_OPT_EPSILON,
+    LONG_OPT_SSP,
+    LONG_OPT_SCALAR_KERNELS,
+    LONG_OPT_DENSE_TILING,
+    LONG_OPT_SPARSE_LAYOUT,
+    LONG_OPT_COMPILE
+};
+
+// Counts absorbing goal states, i.e. states where every action loops back
+// to the same state with probability 1 at zero reward/cost
+static uint32_t count_goal_states(const PomdpCassandraWrapper* p_mdp)
+{
+    uint32_t num_goal_states = 0;
+    CassandraMatrix cassandra_RTranspose = p_mdp->getRTranspose();
+    for (int s_idx=0; s_idx<p_mdp->getNumStates(); s_idx++)
+    {
+        bool b_goal = true;
+        for (int a_idx=0; (a_idx<p_mdp->getNumActions()) && b_goal; a_idx++)
+        {
+            CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
+            int j = single_stm->row_start[s_idx];
+            b_goal = (single_stm->row_length[s_idx] == 1) &&
+                     (single_stm->col[j] == s_idx) &&
+                     (single_stm->mat_val[j] == 1.0f) &&
+                     (getEntryMatrix(cassandra_RTranspose, a_idx, s_idx) == 0.0);
+        }
+        if (b_goal)
+        {
+            num_goal_states++;
+        }
+    }
+    return num_goal_states;
+}
+
 static void print_usage(void)
 {
     printf("Example Usage:  gembench -m /path/to/my/foo.pomdp -s solver_name -o output_filename\n");
+    printf("                gembench --compile /path/to/my/foo.pomdp -o foo.gmdp\n");
     printf("  -t Maximum time to try and solve an MDP, in seconds\n");
-    printf("  -m Filename of the MDP to solve\n");
-    printf("  -s Name of the solver to use {e.g.- vi, spvi, tvi}\n");
+    printf("  -m Filename of the MDP to solve, either a text model (plain, gzip or zstd compressed) or one written by --compile\n");
+    printf("  -s Name of the solver to use {e.g.- vi, spvi, mtvi, csrvi, tvi, gsvi, sorvi, pi, mpi, bvi, rvi}\n");
     printf("  -o Filename of the output to write\n");
+    printf("  -j Number of CPU threads for parsing large models and for multithreaded solvers (default: one per core)\n");
+    printf("  --omega Relaxation factor in (0,2) for the sorvi solver (default: 1.0)\n");
+    printf("  --sweep-order State order for gsvi/sorvi sweeps {forward, backward, alternating} (default: forward)\n");
+    printf("  --mpi-sweeps Fixed-policy sweeps per mpi iteration (default: 0, adapt automatically)\n");
+    printf("  --action-elim Permanently drop provably suboptimal actions (csrvi solver)\n");
+    printf("  --epsilon Stopping tolerance of the bvi (bound gap, default: 0.5) and rvi (span, default: 0.001) solvers, and of --ssp (default: 0.001)\n");
+    printf("  --ssp Stochastic shortest path mode: stop on the sweep change alone, for undiscounted models with absorbing goal states (vi, spvi, csrvi solvers)\n");
+    printf("  --scalar-kernels Use the plain scalar backup loops instead of the SIMD ones picked for this CPU (CPU solvers)\n");
+    printf("  --dense-tiling Cache blocking of the vi and mtvi backups as states,columns, e.g. 4,2048, or auto to time candidates on the model, which makes results vary between runs (default: untiled)\n");
+    printf("  --sparse-layout Storage of the transition rows {csr, sell}, sell for the csrvi (without --action-elim), pi, mpi, bvi and rvi solvers (default: csr)\n");
+    printf("  --compile Read the given text model and write it to the -o file in compiled form, which -m loads without parsing\n");
     printf("  --help [-h] print this help message\n");
     printf("\n");
+    printf("Set GEMBENCH_CACHE_DIR to keep compiled copies of text models in that directory and load them from there on later runs.\n");
+    printf("GEMBENCH_CACHE_MAX_MB caps the size of the directory, least recently used models are removed first (default: 4096).\n");
+    printf("\n");
 }
 
 int  main( int argc, char **argv )
@@ -66,7 +132,19 @@ int  main( int argc, char **argv )
     char str_mdp_filename[MAX_FILENAME_LEN] = {'\0'};
     char str_solver_name[MAX_FILENAME_LEN] = {'\0'};
     char str_output_filename[MAX_FILENAME_LEN] = {'\0'};
+    char str_compile_filename[MAX_FILENAME_LEN] = {'\0'};
     int max_solver_time_s = 0;
+    int num_threads = 0;
+    float sor_omega = 1.0f;
+    enum gsvi_sweep_order sweep_order = GSVI_SWEEP_FORWARD;
+    int mpi_sweeps = 0;
+    bool b_action_elim = false;
+    float epsilon = 0.0f; // 0 means use the solver's default
+    bool b_ssp = false;
+    bool b_scalar_kernels = false;
+    unsigned int dense_block_states = 0; // 0 means an untiled dense backup
+    unsigned int dense_col_tile = 0;
+    uint8_t sparse_layout = SPARSE_LAYOUT_CSR;
 
     int c;
 
@@ -77,12 +155,22 @@ int  main( int argc, char **argv )
         {
                 // Usage:
                 {"help",                no_argument,       0, 'h'},
+                {"omega",               required_argument, 0, LONG_OPT_OMEGA},
+                {"sweep-order",         required_argument, 0, LONG_OPT_SWEEP_ORDER},
+                {"mpi-sweeps",          required_argument, 0, LONG_OPT_MPI_SWEEPS},
+                {"action-elim",         no_argument,       0, LONG_OPT_ACTION_ELIM},
+                {"epsilon",             required_argument, 0, LONG_OPT_EPSILON},
+                {"ssp",                 no_argument,       0, LONG_OPT_SSP},
+                {"scalar-kernels",      no_argument,       0, LONG_OPT_SCALAR_KERNELS},
+                {"dense-tiling",        required_argument, 0, LONG_OPT_DENSE_TILING},
+                {"sparse-layout",       required_argument, 0, LONG_OPT_SPARSE_LAYOUT},
+                {"compile",             required_argument, 0, LONG_OPT_COMPILE},
                 {0, 0, 0, 0}
         };
 
         /* getopt_long stores the option index here. */
         int option_index = 0;
-        c = getopt_long(argc, argv, "hm:s:t:o:", long_options, &option_index);
+        c = getopt_long(argc, argv, "hm:s:t:o:j:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -140,6 +228,124 @@ int  main( int argc, char **argv )
                 }
                 break;
 
+            case 'j':
+                {
+                     num_threads = atoi(optarg);
+                     if (num_threads < 0)
+                     {
+                         printf("Number of threads must not be negative\n");
+                         exit(EXIT_FAILURE);
+                     }
+                }
+                break;
+
+            case LONG_OPT_OMEGA:
+                {
+                     sor_omega = atof(optarg);
+                     if ((sor_omega <= 0.0f) || (sor_omega >= 2.0f))
+                     {
+                         printf("omega must be in the range (0,2)\n");
+                         exit(EXIT_FAILURE);
+                     }
+                }
+                break;
+
+            case LONG_OPT_SWEEP_ORDER:
+                if (strcmp(optarg, "forward")==0)
+                {
+                    sweep_order = GSVI_SWEEP_FORWARD;
+                }
+                else if (strcmp(optarg, "backward")==0)
+                {
+                    sweep_order = GSVI_SWEEP_BACKWARD;
+                }
+                else if (strcmp(optarg, "alternating")==0)
+                {
+                    sweep_order = GSVI_SWEEP_ALTERNATING;
+                }
+                else
+                {
+                    printf("Unknown sweep order %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case LONG_OPT_MPI_SWEEPS:
+                {
+                     mpi_sweeps = atoi(optarg);
+                     if (mpi_sweeps < 0)
+                     {
+                         printf("Number of mpi sweeps must not be negative\n");
+                         exit(EXIT_FAILURE);
+                     }
+                }
+                break;
+
+            case LONG_OPT_ACTION_ELIM:
+                b_action_elim = true;
+                break;
+
+            case LONG_OPT_EPSILON:
+                {
+                     epsilon = atof(optarg);
+                     if (epsilon <= 0.0f)
+                     {
+                         printf("epsilon must be greater than 0\n");
+                         exit(EXIT_FAILURE);
+                     }
+                }
+                break;
+
+            case LONG_OPT_SSP:
+                b_ssp = true;
+                break;
+
+            case LONG_OPT_SCALAR_KERNELS:
+                b_scalar_kernels = true;
+                break;
+
+            case LONG_OPT_DENSE_TILING:
+                if (strcmp(optarg, "auto")==0)
+                {
+                    dense_block_states = BACKUP_KERNELS_DENSE_TILING_AUTO;
+                    dense_col_tile = BACKUP_KERNELS_DENSE_TILING_AUTO;
+                }
+                else if ((sscanf(optarg, "%u,%u", &dense_block_states, &dense_col_tile) != 2) ||
+                         (dense_block_states == 0) || (dense_col_tile == 0))
+                {
+                    printf("Dense tiling must be auto or two positive numbers, states,columns\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case LONG_OPT_SPARSE_LAYOUT:
+                if (strcmp(optarg, "csr")==0)
+                {
+                    sparse_layout = SPARSE_LAYOUT_CSR;
+                }
+                else if (strcmp(optarg, "sell")==0)
+                {
+                    sparse_layout = SPARSE_LAYOUT_SELL;
+                }
+                else
+                {
+                    printf("Unknown sparse layout %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case LONG_OPT_COMPILE:
+                if (strlen(optarg) >= (MAX_FILENAME_LEN))
+                {
+                    printf("MDP file name must be less than %d characters\n", (MAX_FILENAME_LEN));
+                    exit(EXIT_FAILURE);
+                }
+                else
+                {
+                    strcpy(str_compile_filename, optarg);
+                }
+                break;
+
             case 'h':
                 s_print_help_exit = 1;
                 break;
@@ -151,6 +357,31 @@ int  main( int argc, char **argv )
         }
     }
 
+    // ------------------------------
+    // Compile an MDP File
+    // ------------------------------
+    if ((!s_print_help_exit) && (str_compile_filename[0] != '\0'))
+    {
+        if (str_output_filename[0] == '\0')
+        {
+            printf("--compile needs an output filename (-o)\n");
+            exit(EXIT_FAILURE);
+        }
+
+        PomdpCassandraWrapper p;
+        p.readFromFile(str_compile_filename, num_threads);
+
+        if (!p.writeToBinaryFile(str_output_filename))
+        {
+            printf("Cannot write the compiled MDP file %s\n", str_output_filename);
+            exit(EXIT_FAILURE);
+        }
+
+        printf("Compiled %s to %s\n", str_compile_filename, str_output_filename);
+        printf("\tNs=%d, Na=%d\n", p.getNumStates(), p.getNumActions());
+        return( 0 );
+    }
+
     if ((s_print_help_exit) || (str_mdp_filename[0] == '\0') || (str_solver_name[0] == '\0') )
     {
         print_usage();
@@ -168,11 +399,62 @@ int  main( int argc, char **argv )
     // Read in MDP File
     // ------------------------------
     PomdpCassandraWrapper p;
-    p.readFromFile(str_mdp_filename);
+    p.readFromFile(str_mdp_filename, num_threads);
 
     printf("MDP file parsing complete: %s\n", str_mdp_filename);
     printf("\tNs=%d, Na=%d\n", p.getNumStates(), p.getNumActions());
 
+    // Cost models and SSP mode are only handled by the value iteration solvers
+    bool b_minimizing_solver = (strcmp(str_solver_name, "vi")==0) ||
+                               (strcmp(str_solver_name, "spvi")==0) ||
+                               (strcmp(str_solver_name, "csrvi")==0);
+    if (p.isCost())
+    {
+        printf("\tvalues: cost (minimizing)\n");
+        if ((!b_minimizing_solver) || b_action_elim)
+        {
+            printf("%s solver does not support cost models\n", str_solver_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (b_ssp)
+    {
+        if (!b_minimizing_solver)
+        {
+            printf("%s solver does not support --ssp\n", str_solver_name);
+            exit(EXIT_FAILURE);
+        }
+
+        // Without a goal state no policy is proper, and the values never converge
+        uint32_t num_goal_states = count_goal_states(&p);
+        printf("\tSSP mode, %u goal states\n", num_goal_states);
+        if (num_goal_states == 0)
+        {
+            printf("--ssp needs at least one absorbing goal state\n");
+            exit(EXIT_FAILURE);
+        }
+        solver_set_ssp_mode(true, epsilon);
+    }
+
+    // The SELL copy is only read by the solvers that back up every state
+    // from one value vector, see sparse_mdp_prepare_sweep()
+    bool b_sell_solver = ((strcmp(str_solver_name, "csrvi")==0) && !b_action_elim) ||
+                         (strcmp(str_solver_name, "pi")==0) ||
+                         (strcmp(str_solver_name, "mpi")==0) ||
+                         (strcmp(str_solver_name, "bvi")==0) ||
+                         (strcmp(str_solver_name, "rvi")==0);
+    if ((sparse_layout == SPARSE_LAYOUT_SELL) && !b_sell_solver)
+    {
+        printf("%s solver does not support --sparse-layout sell%s\n", str_solver_name,
+               b_action_elim ? " with --action-elim" : "");
+        exit(EXIT_FAILURE);
+    }
+
+    backup_kernels_set_scalar(b_scalar_kernels);
+    backup_kernels_set_dense_tiling(dense_block_states, dense_col_tile);
+    sparse_mdp_set_layout(sparse_layout);
+
     // ------------------------------
     // Allocate storage for generated policy and value vectors
     // ------------------------------
@@ -182,6 +464,25 @@ int  main( int argc, char **argv )
     float* out_value_func = (float*)malloc(sizeof(float)*p.getNumStates());
     assert(out_value_func != NULL);
 
+    // Only the rvi solver produces gain estimates
+    float* out_gain = NULL;
+    if (strcmp(str_solver_name, "rvi")==0)
+    {
+        out_gain = (float*)malloc(sizeof(float)*p.getNumStates());
+        assert(out_gain != NULL);
+    }
+
+    // Only the bvi solver produces bounds on the value function
+    float* out_lower_bound = NULL;
+    float* out_upper_bound = NULL;
+    if (strcmp(str_solver_name, "bvi")==0)
+    {
+        out_lower_bound = (float*)malloc(sizeof(float)*p.getNumStates());
+        assert(out_lower_bound != NULL);
+        out_upper_bound = (float*)malloc(sizeof(float)*p.getNumStates());
+        assert(out_upper_bound != NULL);
+    }
+
     // ------------------------------
     // Call the desired MDP solver
     // ------------------------------
@@ -200,6 +501,67 @@ int  main( int argc, char **argv )
         printf("Running spvi solver...\n");
         solver_ret_arg = solver_spvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
     }
+    else if (strcmp(str_solver_name, "mtvi")==0)
+    {
+        printf("Running mtvi solver...\n");
+        solver_mtvi_set_num_threads((uint32_t)num_threads);
+        solver_ret_arg = solver_mtvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "csrvi")==0)
+    {
+        printf("Running csrvi solver...\n");
+        solver_csrvi_set_action_elimination(b_action_elim);
+        solver_ret_arg = solver_csrvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "tvi")==0)
+    {
+        printf("Running tvi solver...\n");
+        solver_ret_arg = solver_tvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "gsvi")==0)
+    {
+        printf("Running gsvi solver...\n");
+        solver_gsvi_set_sweep_order(sweep_order);
+        solver_ret_arg = solver_gsvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "sorvi")==0)
+    {
+        printf("Running sorvi solver...\n");
+        solver_gsvi_set_sweep_order(sweep_order);
+        solver_sorvi_set_omega(sor_omega);
+        solver_ret_arg = solver_sorvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "pi")==0)
+    {
+        printf("Running pi solver...\n");
+        solver_ret_arg = solver_pi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "mpi")==0)
+    {
+        printf("Running mpi solver...\n");
+        solver_mpi_set_num_sweeps((uint32_t)mpi_sweeps);
+        solver_ret_arg = solver_mpi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "bvi")==0)
+    {
+        printf("Running bvi solver...\n");
+        if (epsilon > 0.0f)
+        {
+            solver_bvi_set_epsilon(epsilon);
+        }
+        solver_bvi_set_bound_outputs(out_lower_bound, out_upper_bound);
+        solver_ret_arg = solver_bvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
+    else if (strcmp(str_solver_name, "rvi")==0)
+    {
+        printf("Running rvi solver...\n");
+        if (epsilon > 0.0f)
+        {
+            solver_rvi_set_epsilon(epsilon);
+        }
+        solver_rvi_set_gain_output(out_gain);
+        solver_ret_arg = solver_rvi_solve((void*)&p, out_policy, out_value_func, max_solver_time_s);
+    }
     else
     {
         printf("%s solver not supported\n", str_solver_name);
@@ -212,8 +574,15 @@ int  main( int argc, char **argv )
 
         float solver_elapsed_time = measure_elapsed_time(
                 (const struct timespec*)&solver_start_time, (const struct timespec*)&solver_end_time);
-        printf("Solver=%s, MDP=%s (Ns=%d,Na=%d), Time=%f[s]\n",
-                str_solver_name, str_mdp_filename, p.getNumStates(), p.getNumActions(), solver_elapsed_time);
+        printf("Solver=%s, MDP=%s (Ns=%d,Na=%d), Time=%f[s], Iterations=%u\n",
+                str_solver_name, str_mdp_filename, p.getNumStates(), p.getNumActions(), solver_elapsed_time,
+                solver_get_num_iterations());
+    }
+    else if (solver_ret_arg == 2)
+    {
+        // Only sorvi returns this, when over-relaxation makes the values blow up
+        printf("Solver=%s, MDP=%s, Diverged after %u iterations\n", str_solver_name, str_mdp_filename,
+                solver_get_num_iterations());
     }
     else
     {
@@ -234,16 +603,47 @@ int  main( int argc, char **argv )
         }
         else
         {
-            // The first row is a header row describing the columns
-            fprintf(fptr, "State, Optimal Control and Value\n");
-            // For each state in the state space
-            for (uint32_t n=0; n<p.getNumStates(); n++)
+            if (out_lower_bound != NULL)
+            {
+                // Bounded solvers add the lower and upper bound of each state,
+                // and the largest gap between them, to the output
+                fprintf(fptr, "State, Optimal Control, Value, Lower Bound and Upper Bound (Gap=%.6f)\n",
+                        solver_bvi_get_gap());
+                for (uint32_t n=0; n<p.getNumStates(); n++)
+                {
+                    fprintf(fptr, "%d %d %.6f %.6f %.6f \n", n, out_policy[n], out_value_func[n],
+                            out_lower_bound[n], out_upper_bound[n]);
+                }
+            }
+            else if (out_gain != NULL)
             {
-                // Print one row with the state index, the optimal action, and the value of the state
-                fprintf(fptr, "%d %d %.6f \n", n, out_policy[n], out_value_func[n]);
+                // Average-reward solvers write the bias in the value column,
+                // followed by the gain estimate of each state
+                fprintf(fptr, "State, Optimal Control, Bias and Gain (Gain=%.6f)\n", solver_rvi_get_gain());
+                for (uint32_t n=0; n<p.getNumStates(); n++)
+                {
+                    fprintf(fptr, "%d %d %.6f %.6f \n", n, out_policy[n], out_value_func[n], out_gain[n]);
+                }
+            }
+            else
+            {
+                // The first row is a header row describing the columns
+                fprintf(fptr, "State, Optimal Control and Value\n");
+                // For each state in the state space
+                for (uint32_t n=0; n<p.getNumStates(); n++)
+                {
+                    // Print one row with the state index, the optimal action, and the value of the state
+                    fprintf(fptr, "%d %d %.6f \n", n, out_policy[n], out_value_func[n]);
+                }
             }
             fclose(fptr);
         }
     }
+
+    // The values of a diverged solve are meaningless
+    if (solver_ret_arg == 2)
+    {
+        return( EXIT_FAILURE );
+    }
     return( 0 );
 }
@@ -69,6 +69,11 @@ struct DTNodeStruct {
 typedef struct DTNodeStruct DTNode;
 typedef struct DTTableStruct DTTable;
 
+struct DTTreeStruct {
+  int tableSizes[DT_TABLE_DEPTH];
+  DTNode* root;
+};
+
 /**********************************************************************
  * FUNCTION PROTOTYPES
  **********************************************************************/
@@ -85,13 +90,6 @@ static void dtSpaces(int indent);
 static void dtDebugPrintNode(DTNode* n, int indent);
 static void dtDebugPrintTable(DTTable* t, int indent);
 
-/**********************************************************************
- * GLOBAL VARIABLES
- **********************************************************************/
-
-static int* gTableSizes = NULL;
-static DTNode* gTree = NULL;
-
 /**********************************************************************
  * INTERNAL HELPER FUNCTIONS
  **********************************************************************/
@@ -219,7 +217,8 @@ static DTNode* dtConvertToTable(DTNode* in, int numEntries)
   return out;
 }
 
-DTNode* dtAddInternal(DTNode* node, int* vec, int index, REAL_VALUE val)
+static DTNode* dtAddInternal(const int* tableSizes, DTNode* node, int* vec, int index,
+			     REAL_VALUE val)
 {
   int i;
   int allWildcards;
@@ -245,26 +244,26 @@ DTNode* dtAddInternal(DTNode* node, int* vec, int index, REAL_VALUE val)
     /* this vec element is a wildcard but not all the rest are... make
        sure the node is a table and addInternal to both defaultEntry and
        all non-NULL entries in the table */
-    node = dtConvertToTable(node, gTableSizes[index]);
+    node = dtConvertToTable(node, tableSizes[index]);
     node->data.subTree.defaultEntry =
-      dtAddInternal(node->data.subTree.defaultEntry, vec, index+1, val);
-    for (i = 0; i < gTableSizes[index]; i++) {
+      dtAddInternal(tableSizes, node->data.subTree.defaultEntry, vec, index+1, val);
+    for (i = 0; i < tableSizes[index]; i++) {
       if (NULL != node->data.subTree.entries[i]) {
 	node->data.subTree.entries[i] =
-	  dtAddInternal(node->data.subTree.entries[i], vec, index+1, val);
+	  dtAddInternal(tableSizes, node->data.subTree.entries[i], vec, index+1, val);
       }
     }
   } else {
     /* this element of vec is not a wildcard... make sure the node is a
        table and modify just the appropriate entry */
-    node = dtConvertToTable(node, gTableSizes[index]);
+    node = dtConvertToTable(node, tableSizes[index]);
     entryP = &node->data.subTree.entries[vec[index]];
     if (NULL == *entryP) {
       /* the given entry is not set at all yet.. first copy the default before
          making modifications */
       *entryP = dtDeepCopyNode(node->data.subTree.defaultEntry);
     }
-    *entryP = dtAddInternal(*entryP, vec, index+1, val);
+    *entryP = dtAddInternal(tableSizes, *entryP, vec, index+1, val);
   }
 
   return node;
@@ -346,23 +345,22 @@ static void dtDebugPrintTable(DTTable* t, int indent)
  * EXPORTED FUNCTIONS
  **********************************************************************/
 
-void dtInit(int numActions, int numStates, int numObservations)
+DTTree* dtInit(int numActions, int numStates, int numObservations)
 {
-  /* guard to prevent REAL_VALUE initialization */
-  if (NULL != gTree) return;
+  DTTree* tree = (DTTree*) malloc(sizeof(DTTree));
+	checkAllocatedPointer((void *)tree );
 
-  gTableSizes = (int*) malloc(DT_TABLE_DEPTH*sizeof(int));
-	checkAllocatedPointer((void *)gTableSizes );
+  tree->tableSizes[0] = numActions;
+  tree->tableSizes[1] = numStates;
+  tree->tableSizes[2] = numStates;
+  tree->tableSizes[3] = numObservations;
 
-  gTableSizes[0] = numActions;
-  gTableSizes[1] = numStates;
-  gTableSizes[2] = numStates;
-  gTableSizes[3] = numObservations;
+  tree->root = dtNewNodeVal(0);
 
-  gTree = dtNewNodeVal(0);
+  return tree;
 }
 
-void dtAdd(int action, int cur_state, int next_state, int obs, REAL_VALUE val)
+void dtAdd(DTTree* tree, int action, int cur_state, int next_state, int obs, REAL_VALUE val)
 {
   int vec[DT_TABLE_DEPTH];
   vec[0] = action;
@@ -370,10 +368,10 @@ void dtAdd(int action, int cur_state, int next_state, int obs, REAL_VALUE val)
   vec[2] = next_state;
   vec[3] = obs;
 
-  gTree = dtAddInternal(gTree, vec, 0, val);
+  tree->root = dtAddInternal(tree->tableSizes, tree->root, vec, 0, val);
 }
 
-REAL_VALUE dtGet(int action, int cur_state, int next_state, int obs)
+REAL_VALUE dtGet(const DTTree* tree, int action, int cur_state, int next_state, int obs)
 {
   int vec[DT_TABLE_DEPTH];
   vec[0] = action;
@@ -381,21 +379,21 @@ REAL_VALUE dtGet(int action, int cur_state, int next_state, int obs)
   vec[2] = next_state;
   vec[3] = obs;
 
-  return dtGetInternal(gTree, vec, 0);
+  return dtGetInternal(tree->root, vec, 0);
 }
 
-void dtDeallocate(void)
+void dtDeallocate(DTTree* tree)
 {
-  dtDestroyNode(gTree);
-  gTree = NULL;
-  free(gTableSizes);
-  gTableSizes = NULL;
+  if (NULL == tree) return;
+
+  dtDestroyNode(tree->root);
+  free(tree);
 }
 
-void dtDebugPrint(const char* header)
+void dtDebugPrint(const DTTree* tree, const char* header)
 {
   printf("%s\n", header);
-  dtDebugPrintNode(gTree, 2);
+  dtDebugPrintNode(tree->root, 2);
 }
 
 
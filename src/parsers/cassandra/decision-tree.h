@@ -45,30 +45,34 @@ extern "C" {
 
 	* When finished, call dtDeallocate().
 
+	Each tree is separate; nothing is kept in globals.
+
 	The decision-tree library is intended to be used only by the
 	imm-reward library.  (The dtGet() function hides behind the
 	getImmediateReward() function in imm-reward.c).
 	**********************************************************************/
 
-	/* Initialize the decision-tree library--dimensionality of the model
-	must be specified so that tables in the decision tree can be
-	allocated appropriately later. */
-	extern void dtInit(int numActions, int numStates, int numObservations);
+	typedef struct DTTreeStruct DTTree;
+
+	/* Creates an empty tree--dimensionality of the model must be
+	specified so that tables in the decision tree can be allocated
+	appropriately later. */
+	extern DTTree* dtInit(int numActions, int numStates, int numObservations);
 
 	/* Adds an entry to the decision tree.  Any of the first four arguments
 	can be given the value -1 (== WILDCARD_SPEC), indicating a wildcard.
 	Later calls to dtAdd() overwrite earlier calls. */
-	extern void dtAdd(int action, int cur_state, int next_state, int obs, REAL_VALUE val);
+	extern void dtAdd(DTTree* tree, int action, int cur_state, int next_state, int obs, REAL_VALUE val);
 
 	/* Returns the immediate reward for a particular [a,s,s',o] tuple. */
-	extern REAL_VALUE dtGet(int action, int cur_state, int next_state, int obs);
+	extern REAL_VALUE dtGet(const DTTree* tree, int action, int cur_state, int next_state, int obs);
 
-	/* Cleans up all decision tree data structures on the heap. */
-	extern void dtDeallocate(void);
+	/* Frees the tree and everything in it.  tree may be NULL. */
+	extern void dtDeallocate(DTTree* tree);
 
 	/* Print a textual representation of the decision tree data structure to
 	stdout.  Intended for debugging. */
-	extern void dtDebugPrint(const char* header);
+	extern void dtDebugPrint(const DTTree* tree, const char* header);
 
 #ifdef __cplusplus
 }
@@ -55,7 +55,8 @@ type of problem we have loaded.
 However, even for the MDP case we would like to take advantage of any 
 wildcard character shortcuts, so we use this module for both the MDP 
 and POMDP case.  However, things will be slightly different depending 
-upon the type of problem being parsed (in gProblemType).
+upon the type of problem being parsed (the problem_type of the
+Imm_Rewards).
 
 Here's how this module interacts with the parser: When the Parser sees
 a line that begins with R: it will call the newImmReward() routine.
@@ -99,29 +100,54 @@ that was specified in the file.  */
 #define USE_DECISION_TREE (1)
 
 /* As we parse the file, we will encounter only one R : * : *.... line
-   at a time, so we will keep the intermediate matrix as a global
-   variable.  When we start to enter a line we will initial it and
-   when we are finished we will convert it and store the sparse matrix
-   into the node of the linked list.  */ 
-I_Matrix gCurIMatrix = NULL;
+   at a time, so we keep the intermediate matrix of that line, and the
+   node we will put it in, in the Imm_Rewards (see imm-reward.h).  When
+   we start to enter a line we will initialize them and when we are
+   finished we will convert the matrix and add the node to the list. */
 
-/* We will have most of the information we need when we first start to
-  parse the line, so we will create the node and put that information
-  there.  After we have read all of the values, we will put it into
-  the linked list.  */
-Imm_Reward_List gCurImmRewardNode = NULL;
+/**********************************************************************/
+void initImmRewards( Imm_Rewards *rewards, Problem_Type problem_type,
+		     int num_states, int num_actions, int num_observations ) {
+  /* Starts an empty set of rewards for a model of the given size */
+
+  memset( rewards, 0, sizeof( *rewards ));
 
-/* This is the actual list of immediate reward lines */
-Imm_Reward_List gImmRewardList = NULL;
+  rewards->problem_type = problem_type;
+  rewards->num_states = num_states;
+  rewards->num_actions = num_actions;
+  rewards->num_observations = num_observations;
 
+}  /* initImmRewards */
 /**********************************************************************/
-void destroyImmRewards() {
+void destroyImmRewards( Imm_Rewards *rewards ) {
   Imm_Reward_List temp;
 
-  while( gImmRewardList != NULL ) {
+  /* A line that was abandoned part way through is not in the list */
+  if( rewards->cur_node != NULL ) {
+    if( rewards->cur_node->type == ir_vector )
+      free( rewards->cur_node->rep.vector );
+    free( rewards->cur_node );
+    rewards->cur_node = NULL;
+  }
+
+  if( rewards->cur_i_matrix != NULL ) {
+    destroyIMatrix( rewards->cur_i_matrix );
+    rewards->cur_i_matrix = NULL;
+  }
+
+  rewards->list_tail = NULL;
+
+  if( rewards->table != NULL ) {
+    free( rewards->table->value );
+    free( rewards->table );
+    rewards->table = NULL;
+  }
+  rewards->compiled = 0;
 
-    temp = gImmRewardList;
-    gImmRewardList = gImmRewardList->next;
+  while( rewards->list != NULL ) {
+
+    temp = rewards->list;
+    rewards->list = rewards->list->next;
 
     switch( temp->type ) {
     case ir_vector:
@@ -145,39 +171,37 @@ void destroyImmRewards() {
   }  /* while */
 
 #if USE_DECISION_TREE
-  dtDeallocate();
+  dtDeallocate( rewards->tree );
+  rewards->tree = NULL;
 #endif
 
 }  /* destroyImmRewardList */
 /**********************************************************************/
-Imm_Reward_List appendImmRewardList( Imm_Reward_List list, Imm_Reward_List node ) {
-  Imm_Reward_List temp = list;
-
-  if( temp == NULL )
-    return( node );
-
-  while( temp->next != NULL ) 
-    temp = temp->next;
+static void appendImmReward( Imm_Rewards *rewards, Imm_Reward_List node ) {
 
-  temp->next = node;
+  if( rewards->list == NULL )
+    rewards->list = node;
+  else
+    rewards->list_tail->next = node;
 
-  return( list );
+  rewards->list_tail = node;
 
-}  /* appendImmRewardList */
+}  /* appendImmReward */
 /**********************************************************************/
-void newImmReward( int action, int cur_state, int next_state, int obs ) {
+void newImmReward( Imm_Rewards *rewards, int action, int cur_state,
+		   int next_state, int obs ) {
   
   /* First we will allocate a new node for this entry */
-  gCurImmRewardNode = (Imm_Reward_List) malloc( sizeof(*gCurImmRewardNode ));
-  checkAllocatedPointer((void *)gCurImmRewardNode );
+  rewards->cur_node = (Imm_Reward_List) malloc( sizeof(*rewards->cur_node ));
+  checkAllocatedPointer((void *)rewards->cur_node );
 
-  gCurImmRewardNode->action = action;
-  gCurImmRewardNode->cur_state = cur_state;
-  gCurImmRewardNode->next_state = next_state;
-  gCurImmRewardNode->obs = obs;
-  gCurImmRewardNode->next = NULL;
+  rewards->cur_node->action = action;
+  rewards->cur_node->cur_state = cur_state;
+  rewards->cur_node->next_state = next_state;
+  rewards->cur_node->obs = obs;
+  rewards->cur_node->next = NULL;
 
-  switch( gProblemType ) {
+  switch( rewards->problem_type ) {
 
   case POMDP_problem_type:
     if( obs == NOT_PRESENT) {
@@ -185,19 +209,19 @@ void newImmReward( int action, int cur_state, int next_state, int obs ) {
       if( next_state == NOT_PRESENT ) {
        
 	/* This is the situation where we will need to keep a sparse 
-	   matrix, so let us initialize the global I_Matrix variable */
+	   matrix, so let us initialize the I_Matrix of the line */
 	
-       gCurIMatrix = newIMatrix( gNumStates );
-       gCurImmRewardNode->rep.matrix = NULL;
-       gCurImmRewardNode->type = ir_matrix;
+       rewards->cur_i_matrix = newIMatrix( rewards->num_states );
+       rewards->cur_node->rep.matrix = NULL;
+       rewards->cur_node->type = ir_matrix;
        
      } /* next_state == NOT_PRESENT */
       
       else { /* we will need a vector of numbers, not a matrix */
 	
-	gCurImmRewardNode->rep.vector = (REAL_VALUE *) calloc( gNumObservations,
+	rewards->cur_node->rep.vector = (REAL_VALUE *) calloc( rewards->num_observations,
 							  sizeof(REAL_VALUE));
-	gCurImmRewardNode->type = ir_vector;
+	rewards->cur_node->type = ir_vector;
 	
       }  /* else need vector, not matrix */
       
@@ -206,8 +230,8 @@ void newImmReward( int action, int cur_state, int next_state, int obs ) {
     else {  /* We only need a single value, so let us just initialize it */
       /* to zero */
       
-      gCurImmRewardNode->rep.value = 0.0;
-      gCurImmRewardNode->type = ir_value;
+      rewards->cur_node->rep.value = 0.0;
+      rewards->cur_node->type = ir_value;
     }
     break;
 
@@ -218,20 +242,20 @@ void newImmReward( int action, int cur_state, int next_state, int obs ) {
        
       if( cur_state == NOT_PRESENT ) {
 	/* This is the situation where we will need to keep a sparse 
-	   matrix, so let us initialize the global I_Matrix variable.
+	   matrix, so let us initialize the I_Matrix of the line.
 	   */
 	
-	gCurIMatrix = newIMatrix( gNumStates );
-	gCurImmRewardNode->rep.matrix = NULL;
-	gCurImmRewardNode->type = ir_matrix;
+	rewards->cur_i_matrix = newIMatrix( rewards->num_states );
+	rewards->cur_node->rep.matrix = NULL;
+	rewards->cur_node->type = ir_matrix;
 	
       } /* cur_state == NOT_PRESENT */
       
       else { /* we will need a vector of numbers, not a matrix */
 	
-	gCurImmRewardNode->rep.vector = (REAL_VALUE *) calloc( gNumStates,
+	rewards->cur_node->rep.vector = (REAL_VALUE *) calloc( rewards->num_states,
 							  sizeof(REAL_VALUE));
-	gCurImmRewardNode->type = ir_vector;
+	rewards->cur_node->type = ir_vector;
 	
       }  /* else need vector, not matrix */
       
@@ -240,8 +264,8 @@ void newImmReward( int action, int cur_state, int next_state, int obs ) {
     else {  /* We only need a single value, so let us just initialize it */
       /* to zero */
       
-      gCurImmRewardNode->rep.value = 0.0;
-      gCurImmRewardNode->type = ir_value;
+      rewards->cur_node->rep.value = 0.0;
+      rewards->cur_node->type = ir_value;
     }
     break;
     
@@ -254,30 +278,30 @@ void newImmReward( int action, int cur_state, int next_state, int obs ) {
 
 }  /* newImmReward */
 /**********************************************************************/
-void enterImmReward( int cur_state, int next_state, int obs, 
-		    REAL_VALUE value ) {
+void enterImmReward( Imm_Rewards *rewards, int cur_state, int next_state,
+		     int obs, REAL_VALUE value ) {
 
 /* cur_state is ignored for a POMDP, and obs is ignored for an MDP */
 
-  assert( gCurImmRewardNode != NULL );
+  assert( rewards->cur_node != NULL );
 
-  switch( gCurImmRewardNode->type ) {
+  switch( rewards->cur_node->type ) {
   case ir_value:
-    gCurImmRewardNode->rep.value = value;
+    rewards->cur_node->rep.value = value;
     break;
 
   case ir_vector:
-    if( gProblemType == POMDP_problem_type )
-      gCurImmRewardNode->rep.vector[obs] = value;
+    if( rewards->problem_type == POMDP_problem_type )
+      rewards->cur_node->rep.vector[obs] = value;
     else
-      gCurImmRewardNode->rep.vector[next_state] = value;
+      rewards->cur_node->rep.vector[next_state] = value;
     break;
 
   case ir_matrix:
-    if( gProblemType == POMDP_problem_type )
-      addEntryToIMatrix( gCurIMatrix, next_state, obs, value );
+    if( rewards->problem_type == POMDP_problem_type )
+      addEntryToIMatrix( rewards->cur_i_matrix, next_state, obs, value );
     else
-      addEntryToIMatrix( gCurIMatrix, cur_state, next_state, value );
+      addEntryToIMatrix( rewards->cur_i_matrix, cur_state, next_state, value );
     break;
 
   default:
@@ -288,33 +312,35 @@ void enterImmReward( int cur_state, int next_state, int obs,
 
 }  /* enterImmReward */
 /**********************************************************************/
-void irAddToDecisionTree(Imm_Reward_List node)
+static void irVisitEntries(Imm_Rewards *rewards, Imm_Reward_List node,
+			   void (*visit)(Imm_Rewards *rewards, int action,
+					 int cur_state, int next_state,
+					 int obs, REAL_VALUE value))
 {
+  /* Calls visit() for each [a,s,s',o] pattern the node sets, in the
+     order the decision tree would be given them by dtAdd() */
   int i, j, k;
   Matrix m;
 
   assert( node != NULL );
 
-  /* ensure the decision tree is initialized (ok to call dtInit() more than once) */
-  dtInit(gNumActions, gNumStates, gNumObservations);
-
   switch( node->type ) {
   case ir_value:
-    if ( gProblemType == POMDP_problem_type ) { /* pomdp */
-      dtAdd(node->action, node->cur_state, node->next_state, node->obs, node->rep.value);
+    if ( rewards->problem_type == POMDP_problem_type ) { /* pomdp */
+      visit(rewards, node->action, node->cur_state, node->next_state, node->obs, node->rep.value);
     } else { /* mdp */
-      dtAdd(node->action, node->cur_state, node->next_state, WILDCARD_SPEC, node->rep.value);
+      visit(rewards, node->action, node->cur_state, node->next_state, WILDCARD_SPEC, node->rep.value);
     }
     break;
     
   case ir_vector:
-    if ( gProblemType == POMDP_problem_type ) { /* pomdp */
-      for (i=0; i < gNumObservations; i++) {
-	dtAdd(node->action, node->cur_state, node->next_state, i, node->rep.vector[i]);
+    if ( rewards->problem_type == POMDP_problem_type ) { /* pomdp */
+      for (i=0; i < rewards->num_observations; i++) {
+	visit(rewards, node->action, node->cur_state, node->next_state, i, node->rep.vector[i]);
       }
     } else { /* mdp */
-      for (i=0; i < gNumStates; i++) {
-	dtAdd(node->action, node->cur_state, i, WILDCARD_SPEC, node->rep.vector[i]);
+      for (i=0; i < rewards->num_states; i++) {
+	visit(rewards, node->action, node->cur_state, i, WILDCARD_SPEC, node->rep.vector[i]);
       }
     }
     break;
@@ -324,10 +350,10 @@ void irAddToDecisionTree(Imm_Reward_List node)
     for (i=0; i < m->num_rows; i++) {
       for (j=0; j < m->row_length[i]; j++) {
 	k = m->row_start[i] + j;
-	if( gProblemType == POMDP_problem_type )  { /* pomdp */
-	  dtAdd(node->action, node->cur_state, i, m->col[k], m->mat_val[k]);
+	if( rewards->problem_type == POMDP_problem_type )  { /* pomdp */
+	  visit(rewards, node->action, node->cur_state, i, m->col[k], m->mat_val[k]);
 	} else { /* mdp */
-	  dtAdd(node->action, i, m->col[k], WILDCARD_SPEC, m->mat_val[k]);
+	  visit(rewards, node->action, i, m->col[k], WILDCARD_SPEC, m->mat_val[k]);
 	}
       }
     }
@@ -338,21 +364,148 @@ void irAddToDecisionTree(Imm_Reward_List node)
   }  /* switch */
 }
 /**********************************************************************/
-void doneImmReward() {
+static void irMarkIndicesUsed( Imm_Rewards *rewards, int action, int cur_state, int next_state,
+			       int obs, REAL_VALUE value ) {
+  /* Only which indices are given matters here, not the value */
+  (void) value;
+
+  if( action != WILDCARD_SPEC )
+    rewards->index_used[0] = 1;
+  if( cur_state != WILDCARD_SPEC )
+    rewards->index_used[1] = 1;
+  if( next_state != WILDCARD_SPEC )
+    rewards->index_used[2] = 1;
+  if( obs != WILDCARD_SPEC )
+    rewards->index_used[3] = 1;
+
+}  /* irMarkIndicesUsed */
+/**********************************************************************/
+static void irFillTable( Imm_Rewards *rewards, int action, int cur_state, int next_state,
+			 int obs, REAL_VALUE value ) {
+  /* Sets every entry of the table that the pattern covers.  An index
+     the table does not depend on is always a wildcard, and covers
+     just the one entry. */
+  Imm_Reward_Table *table = rewards->table;
+  int a, s, t, o;
+  int a_end, s_end, t_end, o_end;
+  int a_begin = ( action == WILDCARD_SPEC ) ? 0 : action;
+  int s_begin = ( cur_state == WILDCARD_SPEC ) ? 0 : cur_state;
+  int t_begin = ( next_state == WILDCARD_SPEC ) ? 0 : next_state;
+  int o_begin = ( obs == WILDCARD_SPEC ) ? 0 : obs;
+
+  a_end = ( action == WILDCARD_SPEC ) ? rewards->num_actions : action + 1;
+  s_end = ( cur_state != WILDCARD_SPEC ) ? cur_state + 1
+    : ( table->cur_state_stride == 0 ) ? 1 : rewards->num_states;
+  t_end = ( next_state != WILDCARD_SPEC ) ? next_state + 1
+    : ( table->next_state_stride == 0 ) ? 1 : rewards->num_states;
+  o_end = ( obs != WILDCARD_SPEC ) ? obs + 1
+    : ( table->obs_stride == 0 ) ? 1 : rewards->num_observations;
+
+  for( a = a_begin; a < a_end; a++ )
+    for( s = s_begin; s < s_end; s++ )
+      for( t = t_begin; t < t_end; t++ )
+	for( o = o_begin; o < o_end; o++ )
+	  table->value[a * table->action_stride
+		       + s * table->cur_state_stride
+		       + t * table->next_state_stride
+		       + o * table->obs_stride] = value;
+
+}  /* irFillTable */
+/**********************************************************************/
+static void irAddToDecisionTree( Imm_Rewards *rewards, int action, int cur_state, int next_state,
+				 int obs, REAL_VALUE value ) {
+
+  dtAdd( rewards->tree, action, cur_state, next_state, obs, value );
+
+}  /* irAddToDecisionTree */
+/**********************************************************************/
+Imm_Reward_Table *compileImmRewards( Imm_Rewards *rewards ) {
+  /*
+    Called once all of the R: lines have been read, to build what
+    getImmediateReward() looks the rewards up in.  Most models only
+    give rewards for some of the action, current state, next state and
+    observation indices (often just the action and the current state),
+    so the rewards go in a dense table over only those indices.  The
+    lines are applied to it in order, so later ones override earlier
+    ones exactly as in the decision tree, and entries no line sets are
+    zero.  If that table would be too large, the decision tree is
+    built instead.  Returns the table, or NULL if there is none.
+  */
+  Imm_Reward_List node;
+  size_t num_entries, max_entries;
+  int num_cur_states, num_next_states, num_obs;
+
+  if( rewards->compiled )
+    return( rewards->table );
+
+  rewards->compiled = 1;
+
+#if ! USE_DECISION_TREE
+  /* The list itself is searched, which does not treat zeroes in a
+     matrix the way the table does */
+  return( NULL );
+#endif
+
+  rewards->index_used[0] = rewards->index_used[1] = 0;
+  rewards->index_used[2] = rewards->index_used[3] = 0;
+  for( node = rewards->list; node != NULL; node = node->next )
+    irVisitEntries( rewards, node, irMarkIndicesUsed );
+
+  num_cur_states = rewards->index_used[1] ? rewards->num_states : 1;
+  num_next_states = rewards->index_used[2] ? rewards->num_states : 1;
+  num_obs = rewards->index_used[3] ? rewards->num_observations : 1;
+
+  /* Always allow one value per action-state pair, as that is the size
+     of Q anyway */
+  max_entries = (size_t) rewards->num_actions * rewards->num_states;
+  if( max_entries < IMM_REWARD_TABLE_MAX_ENTRIES )
+    max_entries = IMM_REWARD_TABLE_MAX_ENTRIES;
+
+  if(( (double) rewards->num_actions * num_cur_states * num_next_states * num_obs )
+     > (double) max_entries ) {
+
+    rewards->tree = dtInit( rewards->num_actions, rewards->num_states, rewards->num_observations );
+    for( node = rewards->list; node != NULL; node = node->next )
+      irVisitEntries( rewards, node, irAddToDecisionTree );
+
+    return( NULL );
+  }
+
+  num_entries = (size_t) rewards->num_actions * num_cur_states * num_next_states * num_obs;
+
+  rewards->table = (Imm_Reward_Table *) malloc( sizeof( *rewards->table ));
+  checkAllocatedPointer((void *) rewards->table );
+
+  rewards->table->value = (REAL_VALUE *) calloc( num_entries, sizeof( REAL_VALUE ));
+  checkAllocatedPointer((void *) rewards->table->value );
+
+  rewards->table->obs_stride = rewards->index_used[3] ? 1 : 0;
+  rewards->table->next_state_stride = rewards->index_used[2] ? num_obs : 0;
+  rewards->table->cur_state_stride = rewards->index_used[1]
+    ? (size_t) num_next_states * num_obs : 0;
+  rewards->table->action_stride = (size_t) num_cur_states * num_next_states * num_obs;
+
+  for( node = rewards->list; node != NULL; node = node->next )
+    irVisitEntries( rewards, node, irFillTable );
+
+  return( rewards->table );
+
+}  /* compileImmRewards */
+/**********************************************************************/
+void doneImmReward( Imm_Rewards *rewards ) {
   
-  if( gCurImmRewardNode == NULL )
+  if( rewards->cur_node == NULL )
     return;
 
-  switch( gCurImmRewardNode->type ) {
+  switch( rewards->cur_node->type ) {
   case ir_value:
   case ir_vector:
     /* Do nothing for these cases */
     break;
     
   case ir_matrix:
-    gCurImmRewardNode->rep.matrix = transformIMatrix( gCurIMatrix );
-    destroyIMatrix( gCurIMatrix );
-    gCurIMatrix = NULL;
+    rewards->cur_node->rep.matrix = transformAndDestroyIMatrix( rewards->cur_i_matrix );
+    rewards->cur_i_matrix = NULL;
     break;
 
   default:
@@ -361,27 +514,32 @@ void doneImmReward() {
     break;
   }  /* switch */
 
-#if USE_DECISION_TREE
-  irAddToDecisionTree(gCurImmRewardNode);
-#endif
-
-  gImmRewardList = appendImmRewardList( gImmRewardList,
-				       gCurImmRewardNode );
-  gCurImmRewardNode = NULL;
+  /* The decision tree, or the table that replaces it, is only built
+     once every line has been read (see compileImmRewards()) */
+  appendImmReward( rewards, rewards->cur_node );
+  rewards->cur_node = NULL;
 
 }  /* doneImmReward */
 /**********************************************************************/
-REAL_VALUE getImmediateReward( int action, int cur_state, int next_state,
-			   int obs ) {
+REAL_VALUE getImmediateReward( Imm_Rewards *rewards, int action,
+			       int cur_state, int next_state, int obs ) {
 #if USE_DECISION_TREE
-  return dtGet(action, cur_state, next_state, obs);
+  Imm_Reward_Table *table = compileImmRewards( rewards );
+
+  if( table != NULL )
+    return( table->value[action * table->action_stride
+			 + cur_state * table->cur_state_stride
+			 + next_state * table->next_state_stride
+			 + obs * table->obs_stride] );
+
+  return dtGet(rewards->tree, action, cur_state, next_state, obs);
 #else
-  Imm_Reward_List temp = gImmRewardList;
+  Imm_Reward_List temp = rewards->list;
   REAL_VALUE return_value = 0.0;
 
-  assert(( action >= 0) && (action < gNumActions)
-	 && (cur_state >= 0) && (cur_state < gNumStates)
-	 && (next_state >= 0) && (next_state < gNumStates));
+  assert(( action >= 0) && (action < rewards->num_actions)
+	 && (cur_state >= 0) && (cur_state < rewards->num_states)
+	 && (next_state >= 0) && (next_state < rewards->num_states));
 
   while( temp != NULL ) {
     
@@ -391,7 +549,7 @@ REAL_VALUE getImmediateReward( int action, int cur_state, int next_state,
       switch( temp->type ) {
       case ir_value:
 
-	if( gProblemType == POMDP_problem_type ) {
+	if( rewards->problem_type == POMDP_problem_type ) {
 	  if((( temp->next_state == WILDCARD_SPEC )
 	      || ( temp->next_state == next_state))
 	     && ((temp->obs == WILDCARD_SPEC)
@@ -419,7 +577,7 @@ REAL_VALUE getImmediateReward( int action, int cur_state, int next_state,
     
       case ir_vector:
 
-	if( gProblemType == POMDP_problem_type ) {
+	if( rewards->problem_type == POMDP_problem_type ) {
 	  if((( temp->next_state == WILDCARD_SPEC )
 	      || ( temp->next_state == next_state))
 	     && ((temp->cur_state == WILDCARD_SPEC)
@@ -440,7 +598,7 @@ REAL_VALUE getImmediateReward( int action, int cur_state, int next_state,
 	break;
     
       case ir_matrix:
-	if( gProblemType == POMDP_problem_type )  {
+	if( rewards->problem_type == POMDP_problem_type )  {
 	  if(( temp->cur_state == WILDCARD_SPEC )
 	     || (temp->cur_state == cur_state ))
 	    return_value = getEntryMatrix( temp->rep.matrix, next_state,
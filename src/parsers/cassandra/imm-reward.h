@@ -28,7 +28,11 @@
 
 #define IMM_REWARD_H
 
+#include <stddef.h>
+
 #include "sparse-matrix.h"
+#include "mdpCassandra.h"
+#include "decision-tree.h"
 
 
 /*
@@ -82,17 +86,70 @@ struct Imm_Reward_Node_Struct {
   Imm_Reward_List next;
 };
 
+/* The rewards as a dense table over only the indices some R: line
+   gives a specific value for.  The stride of every other index is
+   zero, so the reward for (a, s, s', o) is always
+
+     value[a * action_stride + s * cur_state_stride
+           + s' * next_state_stride + o * obs_stride]
+*/
+typedef struct {
+  REAL_VALUE *value;
+  size_t action_stride;
+  size_t cur_state_stride;
+  size_t next_state_stride;
+  size_t obs_stride;
+} Imm_Reward_Table;
+
+/* Rewards that need a larger table than this, and than one value per
+   action-state pair, stay in the decision tree */
+#define IMM_REWARD_TABLE_MAX_ENTRIES     (1 << 22)
+
+/* The immediate rewards of one model: the R: lines as they are read,
+   and what getImmediateReward() looks them up in once they all have
+   been.  Everything is in here rather than in globals, so each parse
+   has a set of its own. */
+typedef struct {
+  Problem_Type problem_type;
+  int num_states;
+  int num_actions;
+  int num_observations;
+
+  /* The line being read, and its intermediate matrix if it needs one */
+  Imm_Reward_List cur_node;
+  I_Matrix cur_i_matrix;
+
+  /* The lines read so far, oldest first */
+  Imm_Reward_List list;
+  Imm_Reward_List list_tail;
+
+  /* Built by compileImmRewards(): the table, or the decision tree if
+     the table would be too large */
+  int compiled;
+  Imm_Reward_Table *table;
+  DTTree *tree;
+
+  /* Which of the action, current state, next state and observation
+     some line gives a specific value for, in compileImmRewards() */
+  int index_used[4];
+} Imm_Rewards;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern void destroyImmRewards();
-extern void newImmReward( int action, int cur_state, int next_state, int obs );
-extern void enterImmReward( int cur_state, int next_state, int obs, 
-			   REAL_VALUE value );
-extern void doneImmReward();
-extern REAL_VALUE getImmediateReward( int action, int cur_state, int
-				 next_state, int obs );
+extern void initImmRewards( Imm_Rewards *rewards, Problem_Type problem_type,
+			    int num_states, int num_actions,
+			    int num_observations );
+extern void destroyImmRewards( Imm_Rewards *rewards );
+extern void newImmReward( Imm_Rewards *rewards, int action, int cur_state,
+			  int next_state, int obs );
+extern void enterImmReward( Imm_Rewards *rewards, int cur_state,
+			    int next_state, int obs, REAL_VALUE value );
+extern void doneImmReward( Imm_Rewards *rewards );
+extern Imm_Reward_Table *compileImmRewards( Imm_Rewards *rewards );
+extern REAL_VALUE getImmediateReward( Imm_Rewards *rewards, int action,
+				      int cur_state, int next_state, int obs );
 				 
 #ifdef __cplusplus
 }  /* extern "C" */
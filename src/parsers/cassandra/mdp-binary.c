@@ -0,0 +1,488 @@
+/*  mdp-binary.c
+
+    Reads and writes the compiled form of a model.  See mdp-binary.h
+    for the layout of the file.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mdpCassandra.h"
+#include "sparse-matrix.h"
+#include "mdp-binary.h"
+
+/**********************************************************************/
+static uint64_t alignOffset( uint64_t offset ) {
+	return(( offset + BINARY_MDP_ALIGNMENT - 1 )
+		/ BINARY_MDP_ALIGNMENT * BINARY_MDP_ALIGNMENT );
+}  /* alignOffset */
+/**********************************************************************/
+static uint64_t countMatrices( MDP_Model *model ) {
+	/* P for each action, R for each action of a POMDP, and Q */
+
+	if( model->problem_type == POMDP_problem_type )
+		return( 2 * (uint64_t) model->num_actions + 1 );
+
+	return( (uint64_t) model->num_actions + 1 );
+}  /* countMatrices */
+/**********************************************************************/
+/* The arrays of a matrix, whatever the precision of its values */
+typedef struct {
+	int num_rows;
+	int num_non_zero;
+	void *mat_val;
+	size_t value_size;
+	int *row_start;
+	int *row_length;
+	int *col;
+} Matrix_Arrays;
+/**********************************************************************/
+static void getMatrixArrays( MDP_Model *model, uint64_t index,
+							Matrix_Arrays *arrays ) {
+	/* The matrices in the order they are stored in the file */
+	Matrix matrix;
+	Single_Matrix single;
+
+	if( index < (uint64_t) model->num_actions ) {
+		single = model->P[index];
+		arrays->num_rows = single->num_rows;
+		arrays->num_non_zero = single->num_non_zero;
+		arrays->mat_val = single->mat_val;
+		arrays->value_size = sizeof( float );
+		arrays->row_start = single->row_start;
+		arrays->row_length = single->row_length;
+		arrays->col = single->col;
+		return;
+	}
+
+	if(( model->problem_type == POMDP_problem_type )
+		&& ( index < 2 * (uint64_t) model->num_actions ))
+		matrix = model->R[index - model->num_actions];
+	else
+		matrix = model->Q;
+
+	arrays->num_rows = matrix->num_rows;
+	arrays->num_non_zero = matrix->num_non_zero;
+	arrays->mat_val = matrix->mat_val;
+	arrays->value_size = sizeof( REAL_VALUE );
+	arrays->row_start = matrix->row_start;
+	arrays->row_length = matrix->row_length;
+	arrays->col = matrix->col;
+}  /* getMatrixArrays */
+/**********************************************************************/
+static uint64_t layoutMatrix( Binary_Matrix_Header *header,
+							 Matrix_Arrays *matrix, uint64_t offset ) {
+	/*
+	Places the arrays of the matrix starting at offset and returns the
+	offset just past them.
+	*/
+
+	header->num_rows = matrix->num_rows;
+	header->num_non_zero = matrix->num_non_zero;
+
+	header->mat_val = offset;
+	offset = alignOffset( offset
+		+ (uint64_t) matrix->num_non_zero * matrix->value_size );
+
+	header->row_start = offset;
+	offset = alignOffset( offset + (uint64_t) matrix->num_rows * sizeof( int ));
+
+	header->row_length = offset;
+	offset = alignOffset( offset + (uint64_t) matrix->num_rows * sizeof( int ));
+
+	header->col = offset;
+	offset = alignOffset( offset
+		+ (uint64_t) matrix->num_non_zero * sizeof( int ));
+
+	return( offset );
+}  /* layoutMatrix */
+/**********************************************************************/
+static int writeAt( FILE *file, uint64_t *position, uint64_t offset,
+				   void *data, size_t size ) {
+	/*
+	Pads the file with zeroes up to offset and writes the data there.
+	*/
+
+	while( *position < offset ) {
+		if( fputc( 0, file ) == EOF )
+			return( 0 );
+		(*position)++;
+	}
+
+	if(( size > 0 ) && ( fwrite( data, 1, size, file ) != size ))
+		return( 0 );
+
+	*position += size;
+
+	return( 1 );
+}  /* writeAt */
+/**********************************************************************/
+static int writeMatrix( FILE *file, uint64_t *position,
+					   Binary_Matrix_Header *header, Matrix_Arrays *matrix ) {
+
+	return( writeAt( file, position, header->mat_val, matrix->mat_val,
+			header->num_non_zero * matrix->value_size )
+		&& writeAt( file, position, header->row_start, matrix->row_start,
+			header->num_rows * sizeof( int ))
+		&& writeAt( file, position, header->row_length, matrix->row_length,
+			header->num_rows * sizeof( int ))
+		&& writeAt( file, position, header->col, matrix->col,
+			header->num_non_zero * sizeof( int )));
+}  /* writeMatrix */
+/**********************************************************************/
+int writeBinaryMDPModel( MDP_Model *model, char *filename ) {
+	/*
+	Writes the model as a compiled file.  Returns 1 if successful and 0
+	if the file could not be written.
+	*/
+	FILE *file;
+	Binary_MDP_Header header;
+	Binary_Matrix_Header *matrices;
+	Matrix_Arrays arrays;
+	uint64_t num_matrices, i, offset, position = 0;
+	int result;
+
+	num_matrices = countMatrices( model );
+	matrices = (Binary_Matrix_Header *) calloc( num_matrices, sizeof( *matrices ));
+	checkAllocatedPointer((void *) matrices );
+
+	memset( &header, 0, sizeof( header ));
+	strcpy( header.magic, BINARY_MDP_MAGIC );
+	header.version = BINARY_MDP_VERSION;
+	header.byte_order = BINARY_MDP_BYTE_ORDER;
+	header.int_size = sizeof( int );
+	header.real_size = sizeof( REAL_VALUE );
+	header.problem_type = model->problem_type;
+	header.value_type = model->value_type;
+	header.num_states = model->num_states;
+	header.num_actions = model->num_actions;
+	header.num_observations = model->num_observations;
+	header.initial_state = model->initial_state;
+	header.discount = model->discount;
+
+	offset = alignOffset( sizeof( header ) + num_matrices * sizeof( *matrices ));
+
+	for( i = 0; i < num_matrices; i++ ) {
+		getMatrixArrays( model, i, &arrays );
+		offset = layoutMatrix( &matrices[i], &arrays, offset );
+	}
+
+	if( model->problem_type == POMDP_problem_type ) {
+		header.initial_belief = offset;
+		offset = alignOffset( offset
+			+ (uint64_t) model->num_states * sizeof( REAL_VALUE ));
+	}
+
+	header.file_size = offset;
+
+	if(( file = fopen( filename, "wb" )) == NULL ) {
+		free( matrices );
+		return( 0 );
+	}
+
+	result = writeAt( file, &position, 0, &header, sizeof( header ))
+		&& writeAt( file, &position, sizeof( header ), matrices,
+			num_matrices * sizeof( *matrices ));
+
+	for( i = 0; result && ( i < num_matrices ); i++ ) {
+		getMatrixArrays( model, i, &arrays );
+		result = writeMatrix( file, &position, &matrices[i], &arrays );
+	}
+
+	if( result && ( model->problem_type == POMDP_problem_type ))
+		result = writeAt( file, &position, header.initial_belief,
+			model->initial_belief, model->num_states * sizeof( REAL_VALUE ));
+
+	/* Pad the end so the file is exactly file_size bytes */
+	if( result )
+		result = writeAt( file, &position, header.file_size, NULL, 0 );
+
+	if( fclose( file ) != 0 )
+		result = 0;
+
+	free( matrices );
+
+	return( result );
+}  /* writeBinaryMDPModel */
+/**********************************************************************/
+static void freeMatrixViews( MDP_Model *model ) {
+	/*
+	Frees the Matrix structures that point into a mapping, but not the
+	arrays, which belong to the mapping.
+	*/
+	int a;
+
+	for( a = 0; a < model->num_actions; a++ ) {
+		if( model->P != NULL )
+			free( model->P[a] );
+		if( model->R != NULL )
+			free( model->R[a] );
+	}
+
+	free( model->P );
+	free( model->R );
+	free( model->Q );
+
+	model->P = NULL;
+	model->R = NULL;
+	model->Q = NULL;
+	model->initial_belief = NULL;
+
+}  /* freeMatrixViews */
+/**********************************************************************/
+#ifndef _MSC_VER
+static int checkArray( uint64_t offset, uint64_t count, uint64_t element_size,
+					  uint64_t size ) {
+	return(( offset % BINARY_MDP_ALIGNMENT == 0 )
+		&& ( offset <= size )
+		&& ( count <= ( size - offset ) / element_size ));
+}  /* checkArray */
+/**********************************************************************/
+static int viewMatrix( Binary_Matrix_Header *header, int num_rows,
+					  int num_cols, size_t value_size, char *mapping,
+					  size_t size, Matrix_Arrays *matrix ) {
+	/*
+	Points the arrays at the matrix in the mapping.  Returns 0 if the
+	header does not describe a valid matrix inside it.  The column
+	indices are checked too, as the solvers index vectors with them.
+	That reads the whole column array, which the solvers are about to
+	read anyway.
+	*/
+	int *row_start, *row_length, *col;
+	int i;
+
+	if(( header->num_rows != num_rows )
+		|| ( header->num_non_zero < 0 )
+		|| ! checkArray( header->mat_val, header->num_non_zero,
+			value_size, size )
+		|| ! checkArray( header->row_start, num_rows, sizeof( int ), size )
+		|| ! checkArray( header->row_length, num_rows, sizeof( int ), size )
+		|| ! checkArray( header->col, header->num_non_zero, sizeof( int ), size ))
+		return( 0 );
+
+	row_start = (int *)( mapping + header->row_start );
+	row_length = (int *)( mapping + header->row_length );
+
+	for( i = 0; i < num_rows; i++ )
+		if(( row_start[i] < 0 ) || ( row_length[i] < 0 )
+			|| ( row_length[i] > header->num_non_zero - row_start[i] ))
+			return( 0 );
+
+	col = (int *)( mapping + header->col );
+	for( i = 0; i < header->num_non_zero; i++ )
+		if(( col[i] < 0 ) || ( col[i] >= num_cols ))
+			return( 0 );
+
+	matrix->num_rows = header->num_rows;
+	matrix->num_non_zero = header->num_non_zero;
+	matrix->mat_val = mapping + header->mat_val;
+	matrix->value_size = value_size;
+	matrix->row_start = row_start;
+	matrix->row_length = row_length;
+	matrix->col = col;
+
+	return( 1 );
+}  /* viewMatrix */
+/**********************************************************************/
+static int setModelFromMapping( MDP_Model *model, char *mapping,
+							   size_t size ) {
+	/*
+	Points the model into the mapping.  Returns 0, with nothing left
+	allocated, if the file is not consistent.
+	*/
+	Binary_MDP_Header *header = (Binary_MDP_Header *) mapping;
+	Binary_Matrix_Header *matrices;
+	Matrix_Arrays arrays;
+	uint64_t num_matrices, i;
+	Single_Matrix single;
+	Matrix matrix;
+
+	if((( header->problem_type != MDP_problem_type )
+			&& ( header->problem_type != POMDP_problem_type ))
+		|| (( header->value_type != REWARD_value_type )
+			&& ( header->value_type != COST_value_type ))
+		|| ( header->num_states < 1 )
+		|| ( header->num_actions < 1 )
+		|| ( header->num_observations < 0 ))
+		return( 0 );
+
+	memset( model, 0, sizeof( *model ));
+	model->problem_type = (Problem_Type) header->problem_type;
+	model->value_type = (Value_Type) header->value_type;
+	model->discount = header->discount;
+	model->num_states = header->num_states;
+	model->num_actions = header->num_actions;
+	model->num_observations = header->num_observations;
+	model->initial_state = header->initial_state;
+
+	num_matrices = countMatrices( model );
+	if( num_matrices > ( size - sizeof( *header )) / sizeof( *matrices ))
+		return( 0 );
+	matrices = (Binary_Matrix_Header *)( mapping + sizeof( *header ));
+
+	model->P = (Single_Matrix *) calloc( model->num_actions, sizeof( *model->P ));
+	checkAllocatedPointer((void *) model->P );
+
+	if( model->problem_type == POMDP_problem_type ) {
+		model->R = (Matrix *) calloc( model->num_actions, sizeof( *model->R ));
+		checkAllocatedPointer((void *) model->R );
+	}
+
+	/* P[a] is states x states with float values */
+	for( i = 0; i < (uint64_t) model->num_actions; i++ ) {
+		if( ! viewMatrix( &matrices[i], model->num_states,
+				model->num_states, sizeof( float ), mapping, size, &arrays )) {
+			freeMatrixViews( model );
+			return( 0 );
+		}
+
+		single = (Single_Matrix) malloc( sizeof( *single ));
+		checkAllocatedPointer((void *) single );
+		single->num_rows = arrays.num_rows;
+		single->num_non_zero = arrays.num_non_zero;
+		single->mat_val = (float *) arrays.mat_val;
+		single->row_start = arrays.row_start;
+		single->row_length = arrays.row_length;
+		single->col = arrays.col;
+		model->P[i] = single;
+	}
+
+	/* The R[a] of a POMDP are next states x observations, and Q is
+	   actions x states */
+	for( ; i < num_matrices; i++ ) {
+		if( ! viewMatrix( &matrices[i], ( i + 1 == num_matrices )
+				? model->num_actions : model->num_states,
+				( i + 1 == num_matrices )
+				? model->num_states : model->num_observations,
+				sizeof( REAL_VALUE ), mapping, size, &arrays )) {
+			freeMatrixViews( model );
+			return( 0 );
+		}
+
+		matrix = (Matrix) malloc( sizeof( *matrix ));
+		checkAllocatedPointer((void *) matrix );
+		matrix->num_rows = arrays.num_rows;
+		matrix->num_non_zero = arrays.num_non_zero;
+		matrix->mat_val = (REAL_VALUE *) arrays.mat_val;
+		matrix->row_start = arrays.row_start;
+		matrix->row_length = arrays.row_length;
+		matrix->col = arrays.col;
+
+		if( i + 1 == num_matrices )
+			model->Q = matrix;
+		else
+			model->R[i - model->num_actions] = matrix;
+	}
+
+	if( model->problem_type == POMDP_problem_type ) {
+		if( ! checkArray( header->initial_belief, model->num_states,
+				sizeof( REAL_VALUE ), size )) {
+			freeMatrixViews( model );
+			return( 0 );
+		}
+		model->initial_belief =
+			(REAL_VALUE *)( mapping + header->initial_belief );
+	}
+
+	return( 1 );
+}  /* setModelFromMapping */
+#endif
+/**********************************************************************/
+int readBinaryMDP( MDP_Model *model, char *filename ) {
+	/*
+	Loads a compiled model by mapping the file into memory.  Returns 1
+	if the model was loaded, 0 if the file is a compiled model that
+	cannot be used, and -1 if it is not a compiled model at all.  The
+	model is only filled in when it was loaded, and keeps the mapping
+	until freeMDPModel().  The mapping is private, so a solver that
+	writes to the matrices does not change the file.
+	*/
+#ifdef _MSC_VER
+	return( -1 );
+#else
+	int fd;
+	struct stat file_stat;
+	Binary_MDP_Header header;
+	MDP_Model loaded;
+	size_t size;
+	char *mapping;
+
+	if(( fd = open( filename, O_RDONLY )) < 0 )
+		return( -1 );
+
+	/* Only regular files: reading the magic number from a pipe would
+	   lose those bytes for the text parser. */
+	if(( fstat( fd, &file_stat ) != 0 )
+		|| ( ! S_ISREG( file_stat.st_mode ))
+		|| ( file_stat.st_size < (off_t) sizeof( header ))
+		|| ( read( fd, &header, sizeof( header )) != (ssize_t) sizeof( header ))
+		|| ( memcmp( header.magic, BINARY_MDP_MAGIC, sizeof( header.magic )) != 0 )) {
+		close( fd );
+		return( -1 );
+	}
+
+	if(( header.version != BINARY_MDP_VERSION )
+		|| ( header.byte_order != BINARY_MDP_BYTE_ORDER )
+		|| ( header.int_size != sizeof( int ))
+		|| ( header.real_size != sizeof( REAL_VALUE ))) {
+		fprintf( stderr, "Compiled MDP file '%s' was written by another "
+			"version of the program or another kind of machine.  "
+			"Compile it again.\n", filename );
+		close( fd );
+		return( 0 );
+	}
+
+	if( header.file_size != (uint64_t) file_stat.st_size ) {
+		fprintf( stderr, "Compiled MDP file '%s' is truncated.\n", filename );
+		close( fd );
+		return( 0 );
+	}
+
+	size = (size_t) file_stat.st_size;
+	mapping = (char *) mmap( NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if( mapping == MAP_FAILED ) {
+		fprintf( stderr, "Cannot map the compiled MDP file: %s.\n", filename );
+		return( 0 );
+	}
+
+	if( ! setModelFromMapping( &loaded, mapping, size )) {
+		fprintf( stderr, "Compiled MDP file '%s' is damaged.\n", filename );
+		munmap( mapping, size );
+		return( 0 );
+	}
+
+	loaded.mapping = mapping;
+	loaded.mapping_size = size;
+	*model = loaded;
+
+	return( 1 );
+#endif
+}  /* readBinaryMDP */
+/**********************************************************************/
+void releaseBinaryMDPModel( MDP_Model *model ) {
+	/*
+	Frees a model that was loaded from a compiled file and unmaps the
+	file.
+	*/
+
+	freeMatrixViews( model );
+
+#ifndef _MSC_VER
+	munmap( model->mapping, model->mapping_size );
+#endif
+
+	model->mapping = NULL;
+	model->mapping_size = 0;
+
+}  /* releaseBinaryMDPModel */
@@ -0,0 +1,74 @@
+/*  mdp-binary.h
+
+    Header file for mdp-binary.c, which reads and writes the compiled
+    form of a model (".gmdp" files).
+
+    A compiled file holds the final sparse matrices exactly as
+    convertMatrices() leaves them, so loading one needs no parsing at
+    all: the file is mapped into memory and the P, R, Q and
+    initial_belief of the MDP_Model point straight into the mapping.
+
+    Layout, all in the byte order of the machine that wrote it:
+
+      Binary_MDP_Header
+      Binary_Matrix_Header for P[0] .. P[num_actions-1]
+      Binary_Matrix_Header for R[0] .. R[num_actions-1]  (POMDP only)
+      Binary_Matrix_Header for Q
+      the arrays of every matrix, then initial_belief (POMDP only)
+
+    The values of P are floats, those of the other matrices and of
+    initial_belief REAL_VALUEs.  Every array starts at a multiple of
+    BINARY_MDP_ALIGNMENT bytes from the start of the file.  Offsets are
+    from the start of the file.
+*/
+#ifndef MDP_BINARY_H
+#define MDP_BINARY_H
+
+#include <stdint.h>
+#include "sparse-matrix.h"
+#include "mdpCassandra.h"
+
+#define BINARY_MDP_MAGIC                "GEMBMDP"
+#define BINARY_MDP_VERSION              2
+#define BINARY_MDP_BYTE_ORDER           0x01020304
+#define BINARY_MDP_ALIGNMENT            64
+
+typedef struct {
+  char magic[8];              /* BINARY_MDP_MAGIC, NUL terminated */
+  uint32_t version;           /* BINARY_MDP_VERSION */
+  uint32_t byte_order;        /* BINARY_MDP_BYTE_ORDER */
+  uint32_t int_size;          /* sizeof( int ) */
+  uint32_t real_size;         /* sizeof( REAL_VALUE ) */
+  int32_t problem_type;       /* Problem_Type */
+  int32_t value_type;         /* Value_Type */
+  int32_t num_states;
+  int32_t num_actions;
+  int32_t num_observations;
+  int32_t initial_state;      /* MDP only */
+  REAL_VALUE discount;
+  uint64_t file_size;
+  uint64_t initial_belief;    /* POMDP only, zero for an MDP */
+} Binary_MDP_Header;
+
+typedef struct {
+  int32_t num_rows;
+  int32_t num_non_zero;
+  uint64_t mat_val;
+  uint64_t row_start;
+  uint64_t row_length;
+  uint64_t col;
+} Binary_Matrix_Header;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int writeBinaryMDPModel( MDP_Model *model, char *filename );
+extern int readBinaryMDP( MDP_Model *model, char *filename );
+extern void releaseBinaryMDPModel( MDP_Model *model );
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* MDP_BINARY_H */
@@ -0,0 +1,290 @@
+/*  mdp-cache.c
+
+    An on-disk cache of compiled models.  See mdp-cache.h.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "mdpCassandra.h"
+#include "mdp-binary.h"
+#include "mdp-cache.h"
+
+#define CACHE_ENTRY_SUFFIX              ".gmdp"
+#define CACHE_TEMP_SUFFIX               ".tmp"
+#define CACHE_MAX_PATH                  4096
+
+/* The source file is hashed in chunks of this many bytes */
+#define CACHE_READ_SIZE                 (1 << 20)
+
+/* Temporary files older than this were left by a writer that died */
+#define CACHE_STALE_TEMP_SECONDS        (24 * 60 * 60)
+
+#ifndef _MSC_VER
+
+typedef struct {
+  char *name;
+  uint64_t size;
+  time_t last_used;
+} Cache_Entry;
+
+/**********************************************************************/
+static inline uint64_t rotateLeft( uint64_t value, int bits ) {
+	return(( value << bits ) | ( value >> ( 64 - bits )));
+}  /* rotateLeft */
+/**********************************************************************/
+static inline uint64_t mixWord( uint64_t hash, uint64_t word ) {
+	/* One step of a MurmurHash3 style hash, a word at a time */
+
+	word *= 0x87c37b91114253d5ULL;
+	word = rotateLeft( word, 31 );
+	word *= 0x4cf5ad432745937fULL;
+
+	hash ^= word;
+	return( rotateLeft( hash, 27 ) * 5 + 0x52dce729 );
+}  /* mixWord */
+/**********************************************************************/
+static uint64_t finishHash( uint64_t hash, uint64_t length ) {
+
+	hash ^= length;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return( hash );
+}  /* finishHash */
+/**********************************************************************/
+static int hashFile( int fd, uint64_t *hash, uint64_t *length ) {
+	/*
+	Hashes the whole file.  Returns 0 if it could not be read.
+	*/
+	char *buffer;
+	size_t filled, i;
+	ssize_t count;
+	uint64_t word, partial_hash = 0, total = 0;
+	int done = 0;
+
+	buffer = (char *) malloc( CACHE_READ_SIZE );
+	checkAllocatedPointer((void *) buffer );
+
+	while( ! done ) {
+
+		/* Fill the whole buffer, so that only the last chunk can end
+		   part way through a word */
+		filled = 0;
+		while( filled < CACHE_READ_SIZE ) {
+			count = read( fd, buffer + filled, CACHE_READ_SIZE - filled );
+			if(( count < 0 ) && ( errno == EINTR ))
+				continue;
+			if( count < 0 ) {
+				free( buffer );
+				return( 0 );
+			}
+			if( count == 0 ) {
+				done = 1;
+				break;
+			}
+			filled += count;
+		}
+
+		for( i = 0; i + sizeof( word ) <= filled; i += sizeof( word )) {
+			memcpy( &word, buffer + i, sizeof( word ));
+			partial_hash = mixWord( partial_hash, word );
+		}
+
+		if( i < filled ) {
+			word = 0;
+			memcpy( &word, buffer + i, filled - i );
+			partial_hash = mixWord( partial_hash, word );
+		}
+
+		total += filled;
+	}
+
+	free( buffer );
+
+	*hash = finishHash( partial_hash, total );
+	*length = total;
+
+	return( 1 );
+}  /* hashFile */
+/**********************************************************************/
+static int hasSuffix( const char *name, const char *suffix ) {
+	size_t name_length = strlen( name );
+	size_t suffix_length = strlen( suffix );
+
+	return(( name_length > suffix_length )
+		&& ( strcmp( name + name_length - suffix_length, suffix ) == 0 ));
+}  /* hasSuffix */
+/**********************************************************************/
+static int compareLastUsed( const void *first, const void *second ) {
+	const Cache_Entry *a = (const Cache_Entry *) first;
+	const Cache_Entry *b = (const Cache_Entry *) second;
+
+	if( a->last_used < b->last_used )
+		return( -1 );
+	if( a->last_used > b->last_used )
+		return( 1 );
+	return( 0 );
+}  /* compareLastUsed */
+/**********************************************************************/
+static void evictEntries( char *cache_dir, uint64_t max_bytes,
+						 char *keep_path ) {
+	/*
+	Removes the least recently used entries until the cache is no
+	larger than max_bytes.  The entry at keep_path, which was just
+	used, is never removed.  Entries are used by mapping them, and a
+	mapping stays valid after its file has been removed, so this is
+	safe while other processes are reading the cache.
+	*/
+	DIR *dir;
+	struct dirent *dir_entry;
+	struct stat entry_stat;
+	Cache_Entry *entries = NULL;
+	int num_entries = 0, max_entries = 0, i;
+	uint64_t total_size = 0;
+	char path[CACHE_MAX_PATH];
+	time_t now = time( NULL );
+
+	if(( dir = opendir( cache_dir )) == NULL )
+		return;
+
+	while(( dir_entry = readdir( dir )) != NULL ) {
+
+		if( snprintf( path, sizeof( path ), "%s/%s", cache_dir,
+				dir_entry->d_name ) >= (int) sizeof( path ))
+			continue;
+
+		if( stat( path, &entry_stat ) != 0 )
+			continue;
+
+		if( hasSuffix( dir_entry->d_name, CACHE_TEMP_SUFFIX )) {
+			if( now - entry_stat.st_mtime > CACHE_STALE_TEMP_SECONDS )
+				unlink( path );
+			continue;
+		}
+
+		if( ! hasSuffix( dir_entry->d_name, CACHE_ENTRY_SUFFIX ))
+			continue;
+
+		total_size += (uint64_t) entry_stat.st_size;
+
+		if( strcmp( path, keep_path ) == 0 )
+			continue;
+
+		if( num_entries == max_entries ) {
+			max_entries = ( max_entries == 0 ) ? 64 : 2 * max_entries;
+			entries = (Cache_Entry *) realloc( entries,
+				max_entries * sizeof( *entries ));
+			checkAllocatedPointer((void *) entries );
+		}
+
+		entries[num_entries].name = strdup( path );
+		checkAllocatedPointer((void *) entries[num_entries].name );
+		entries[num_entries].size = (uint64_t) entry_stat.st_size;
+		entries[num_entries].last_used = entry_stat.st_mtime;
+		num_entries++;
+	}
+
+	closedir( dir );
+
+	if( total_size > max_bytes ) {
+
+		qsort( entries, num_entries, sizeof( *entries ), compareLastUsed );
+
+		for( i = 0; ( i < num_entries ) && ( total_size > max_bytes ); i++ )
+			if( unlink( entries[i].name ) == 0 )
+				total_size -= entries[i].size;
+	}
+
+	for( i = 0; i < num_entries; i++ )
+		free( entries[i].name );
+	free( entries );
+
+}  /* evictEntries */
+#endif
+/**********************************************************************/
+int readMDPCached( MDP_Model *model, char *filename, int num_threads,
+				   char *cache_dir, uint64_t max_bytes ) {
+	/*
+	Same as readMDP(), but first looks for a compiled copy of the model
+	in cache_dir, and adds one after parsing the model if there was
+	none.  Problems with the cache itself only mean that the model gets
+	parsed as usual.
+	*/
+#ifdef _MSC_VER
+	return( readMDP( model, filename, num_threads ));
+#else
+	int fd, result;
+	struct stat file_stat;
+	uint64_t hash, length;
+	char magic[sizeof( BINARY_MDP_MAGIC )];
+	char entry_path[CACHE_MAX_PATH], temp_path[CACHE_MAX_PATH];
+
+	if(( fd = open( filename, O_RDONLY )) < 0 )
+		return( readMDP( model, filename, num_threads ));
+
+	/* Pipes cannot be read twice, and compiled models are already as
+	   fast to load as a cache entry */
+	if(( fstat( fd, &file_stat ) != 0 )
+		|| ( ! S_ISREG( file_stat.st_mode ))
+		|| (( pread( fd, magic, sizeof( magic ), 0 ) == (ssize_t) sizeof( magic ))
+			&& ( memcmp( magic, BINARY_MDP_MAGIC, sizeof( magic )) == 0 ))
+		|| ( ! hashFile( fd, &hash, &length ))) {
+		close( fd );
+		return( readMDP( model, filename, num_threads ));
+	}
+
+	close( fd );
+
+	if(( snprintf( entry_path, sizeof( entry_path ),
+			"%s/%016llx-%llx-v%d" CACHE_ENTRY_SUFFIX, cache_dir,
+			(unsigned long long) hash, (unsigned long long) length,
+			BINARY_MDP_VERSION ) >= (int) sizeof( entry_path ))
+		|| ( snprintf( temp_path, sizeof( temp_path ), "%s.%ld" CACHE_TEMP_SUFFIX,
+			entry_path, (long) getpid() ) >= (int) sizeof( temp_path )))
+		return( readMDP( model, filename, num_threads ));
+
+	result = readBinaryMDP( model, entry_path );
+
+	if( result == 1 ) {
+		/* The modification time is what eviction goes by */
+		utimes( entry_path, NULL );
+		return( 1 );
+	}
+
+	/* A damaged entry is replaced below */
+	if( result == 0 )
+		unlink( entry_path );
+
+	if( ! readMDP( model, filename, num_threads ))
+		return( 0 );
+
+	/* Usually fails because the directory already exists */
+	mkdir( cache_dir, 0777 );
+
+	/* Writers never touch the entry itself, so readers only ever see
+	   complete files, and concurrent writers of the same model just
+	   replace each other's identical copies. */
+	if( writeBinaryMDPModel( model, temp_path ) && ( rename( temp_path, entry_path ) == 0 ))
+		evictEntries( cache_dir, max_bytes, entry_path );
+	else
+		unlink( temp_path );
+
+	return( 1 );
+#endif
+}  /* readMDPCached */
@@ -0,0 +1,35 @@
+/*  mdp-cache.h
+
+    Header file for mdp-cache.c, an on-disk cache of compiled models.
+
+    Entries are compiled models (see mdp-binary.h) named after a hash
+    of the text model they were made from, so an edited model simply
+    misses the cache and old entries age out.  New entries are written
+    to a temporary file and renamed into place, which lets any number of
+    processes share one cache directory.  When the directory grows past
+    its size cap the least recently used entries are removed.
+*/
+#ifndef MDP_CACHE_H
+#define MDP_CACHE_H
+
+#include <stdint.h>
+#include "mdpCassandra.h"
+
+/* Environment variables read by PomdpCassandraWrapper::readFromFile() */
+#define MDP_CACHE_DIR_ENV               "GEMBENCH_CACHE_DIR"
+#define MDP_CACHE_MAX_MB_ENV            "GEMBENCH_CACHE_MAX_MB"
+
+#define MDP_CACHE_DEFAULT_MAX_MB        4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int readMDPCached( MDP_Model *model, char *filename, int num_threads,
+                          char *cache_dir, uint64_t max_bytes );
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* MDP_CACHE_H */
@@ -0,0 +1,342 @@
+/*  mdp-decompress.c
+
+    Reads gzip and zstd compressed models.  See mdp-decompress.h.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "mdpCassandra.h"
+#include "mdp-decompress.h"
+
+/* The output buffer starts at this many times the compressed size,
+   unless the file says how large it is, and doubles when full */
+#define DECOMPRESS_GUESS_RATIO          4
+
+/* The scanner needs two NUL bytes after the text */
+#define DECOMPRESS_PADDING              2
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+typedef enum {
+  none_compression,
+  gzip_compression,
+  zstd_compression
+} Compression_Type;
+
+#ifndef _MSC_VER
+
+typedef struct {
+  char *text;
+  size_t size;        /* bytes of text so far */
+  size_t capacity;    /* bytes allocated, including the padding */
+} Text_Buffer;
+
+#if defined( HAVE_ZLIB ) || defined( HAVE_ZSTD )
+/**********************************************************************/
+static ssize_t readChunk( int fd, unsigned char *buffer ) {
+	/*
+	Fills the buffer unless the file ends first.  Returns the number of
+	bytes read, or -1 on an error.
+	*/
+	size_t filled = 0;
+	ssize_t count;
+
+	while( filled < DECOMPRESS_READ_SIZE ) {
+		count = read( fd, buffer + filled, DECOMPRESS_READ_SIZE - filled );
+		if(( count < 0 ) && ( errno == EINTR ))
+			continue;
+		if( count < 0 )
+			return( -1 );
+		if( count == 0 )
+			break;
+		filled += count;
+	}
+
+	return( (ssize_t) filled );
+}  /* readChunk */
+/**********************************************************************/
+static size_t makeRoom( Text_Buffer *buffer ) {
+	/*
+	Grows the buffer if it is full.  Returns the number of bytes that
+	can be added.
+	*/
+	if( buffer->capacity - buffer->size <= DECOMPRESS_PADDING ) {
+		buffer->capacity *= 2;
+		buffer->text = (char *) realloc( buffer->text, buffer->capacity );
+		checkAllocatedPointer((void *) buffer->text );
+	}
+
+	return( buffer->capacity - buffer->size - DECOMPRESS_PADDING );
+}  /* makeRoom */
+#endif
+/**********************************************************************/
+#ifdef HAVE_ZLIB
+static int inflateGzip( int fd, Text_Buffer *buffer ) {
+	/*
+	Returns 0 if the data is not valid gzip or ends early.  A file may
+	hold several gzip members one after the other (as "cat a.gz b.gz"
+	makes), and, like gzip itself, anything but another member after
+	the first one is ignored.
+	*/
+	z_stream stream;
+	unsigned char *in;
+	ssize_t count;
+	size_t room;
+	int status, at_member_end = 0, num_members = 0, result;
+
+	memset( &stream, 0, sizeof( stream ));
+
+	/* 15 + 32 accepts both gzip and zlib headers */
+	if( inflateInit2( &stream, 15 + 32 ) != Z_OK )
+		return( 0 );
+
+	in = (unsigned char *) malloc( DECOMPRESS_READ_SIZE );
+	checkAllocatedPointer((void *) in );
+
+	/* Anything but zero, so that the first pass reads input */
+	stream.avail_out = 1;
+
+	for(;;) {
+
+		/* When the last call filled the output, there may be more to
+		   come without any new input */
+		if(( stream.avail_in == 0 ) && ( stream.avail_out > 0 )) {
+			if(( count = readChunk( fd, in )) < 0 ) {
+				result = 0;
+				break;
+			}
+			if( count == 0 ) {
+				result = at_member_end;
+				break;
+			}
+			stream.next_in = in;
+			stream.avail_in = (uInt) count;
+		}
+
+		room = makeRoom( buffer );
+		if( room > UINT32_MAX )
+			room = UINT32_MAX;
+
+		stream.next_out = (Bytef *) buffer->text + buffer->size;
+		stream.avail_out = (uInt) room;
+		status = inflate( &stream, Z_NO_FLUSH );
+		buffer->size += room - stream.avail_out;
+
+		if(( status != Z_OK ) && ( status != Z_STREAM_END )) {
+			result = ( num_members > 0 ) && at_member_end;
+			break;
+		}
+
+		at_member_end = ( status == Z_STREAM_END );
+		if( at_member_end ) {
+			num_members++;
+			inflateReset( &stream );
+		}
+	}
+
+	inflateEnd( &stream );
+	free( in );
+
+	return( result );
+}  /* inflateGzip */
+#endif
+/**********************************************************************/
+#ifdef HAVE_ZSTD
+static int inflateZstd( int fd, Text_Buffer *buffer ) {
+	/*
+	Returns 0 if the data is not valid zstd or ends early.  Several
+	frames one after the other are decompressed as one stream.
+	*/
+	ZSTD_DStream *stream;
+	ZSTD_inBuffer input;
+	ZSTD_outBuffer output;
+	unsigned char *in;
+	ssize_t count;
+	size_t status = 0;
+	int result;
+
+	if(( stream = ZSTD_createDStream()) == NULL )
+		return( 0 );
+	ZSTD_initDStream( stream );
+
+	in = (unsigned char *) malloc( DECOMPRESS_READ_SIZE );
+	checkAllocatedPointer((void *) in );
+
+	input.src = in;
+	input.size = input.pos = 0;
+
+	for(;;) {
+
+		/* When the last call filled the output, there may be more to
+		   flush without any new input */
+		if(( input.pos == input.size ) && ( buffer->capacity - buffer->size 
+			> DECOMPRESS_PADDING )) {
+			if(( count = readChunk( fd, in )) < 0 ) {
+				result = 0;
+				break;
+			}
+			if( count == 0 ) {
+				/* Zero means the last frame was complete */
+				result = ( status == 0 );
+				break;
+			}
+			input.size = (size_t) count;
+			input.pos = 0;
+		}
+
+		output.size = makeRoom( buffer );
+		output.dst = buffer->text + buffer->size;
+		output.pos = 0;
+
+		status = ZSTD_decompressStream( stream, &output, &input );
+		buffer->size += output.pos;
+
+		if( ZSTD_isError( status )) {
+			result = 0;
+			break;
+		}
+	}
+
+	ZSTD_freeDStream( stream );
+	free( in );
+
+	return( result );
+}  /* inflateZstd */
+#endif
+/**********************************************************************/
+static Compression_Type compressionType( int fd ) {
+	unsigned char magic[4];
+
+	if( pread( fd, magic, sizeof( magic ), 0 ) < (ssize_t) sizeof( magic ))
+		memset( magic, 0, sizeof( magic ));
+
+	if( memcmp( magic, gzip_magic, sizeof( gzip_magic )) == 0 )
+		return( gzip_compression );
+	if( memcmp( magic, zstd_magic, sizeof( zstd_magic )) == 0 )
+		return( zstd_compression );
+
+	return( none_compression );
+}  /* compressionType */
+/**********************************************************************/
+static size_t guessSize( int fd, Compression_Type type, size_t file_size ) {
+	/*
+	A gzip file ends with the size of its last member modulo 2^32,
+	which is the exact size for the usual single member file under
+	4 GiB.  Anything else gets a guess.
+	*/
+	unsigned char trailer[4];
+	size_t size;
+
+	size = file_size * DECOMPRESS_GUESS_RATIO;
+
+	if(( type == gzip_compression ) && ( file_size >= 18 )
+		&& ( pread( fd, trailer, sizeof( trailer ), 
+				   (off_t) file_size - sizeof( trailer )) 
+			== (ssize_t) sizeof( trailer ))) {
+		size = (size_t) trailer[0] | ((size_t) trailer[1] << 8)
+			| ((size_t) trailer[2] << 16) | ((size_t) trailer[3] << 24);
+		/* Leave room for the final empty call to inflate() */
+		size++;
+	}
+
+	return( size + DECOMPRESS_PADDING );
+}  /* guessSize */
+#endif
+/**********************************************************************/
+int readMDPCompressed( MDP_Model *model, char *filename, int num_threads ) {
+	/*
+	Returns 1 if the file is compressed and was successfully parsed, 0
+	if it is compressed but could not be read, and -1 if it is not
+	compressed, in which case the caller should read it as usual.  Only
+	regular files are checked, since a pipe cannot be looked at first.
+	*/
+#ifdef _MSC_VER
+	return( -1 );
+#else
+	int fd, result = 0;
+	struct stat file_stat;
+	Compression_Type type;
+	Text_Buffer buffer;
+
+	if(( fd = open( filename, O_RDONLY )) < 0 )
+		return( -1 );
+
+	if(( fstat( fd, &file_stat ) != 0 ) 
+		|| ( ! S_ISREG( file_stat.st_mode ))
+		|| (( type = compressionType( fd )) == none_compression )) {
+		close( fd );
+		return( -1 );
+	}
+
+	buffer.size = 0;
+	buffer.capacity = guessSize( fd, type, (size_t) file_stat.st_size );
+	buffer.text = (char *) malloc( buffer.capacity );
+	checkAllocatedPointer((void *) buffer.text );
+
+	switch( type ) {
+	case gzip_compression:
+#ifdef HAVE_ZLIB
+		result = inflateGzip( fd, &buffer );
+#else
+		fprintf( stderr, "MDP file '%s' is gzip compressed, "
+			"but this build has no zlib support.\n", filename );
+		close( fd );
+		free( buffer.text );
+		return( 0 );
+#endif
+		break;
+
+	case zstd_compression:
+#ifdef HAVE_ZSTD
+		result = inflateZstd( fd, &buffer );
+#else
+		fprintf( stderr, "MDP file '%s' is zstd compressed, "
+			"but this build has no zstd support.\n", filename );
+		close( fd );
+		free( buffer.text );
+		return( 0 );
+#endif
+		break;
+
+	default:
+		break;
+	}
+
+	close( fd );
+
+	if( ! result ) {
+		fprintf( stderr, "MDP file '%s' is not a valid %s file.\n", filename,
+			( type == gzip_compression ) ? "gzip" : "zstd" );
+		free( buffer.text );
+		return( 0 );
+	}
+
+	buffer.text[buffer.size] = '\0';
+	buffer.text[buffer.size + 1] = '\0';
+
+	result = readMDPBuffer( model, buffer.text, buffer.size + DECOMPRESS_PADDING,
+		num_threads, 0 );
+
+	free( buffer.text );
+
+	return( result );
+#endif
+}  /* readMDPCompressed */
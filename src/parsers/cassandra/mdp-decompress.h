@@ -0,0 +1,32 @@
+/*  mdp-decompress.h
+
+    Header file for mdp-decompress.c, which reads gzip and zstd
+    compressed models directly, without a decompressed copy on disk.
+
+    The model is inflated into memory in one pass and handed to the
+    parser as a single buffer, just like a memory mapped text file, so
+    it gets the hand written parser (see pomdp_spec_fast.cc) instead of
+    the much slower stream path.  gzip support needs zlib (HAVE_ZLIB)
+    and zstd support needs libzstd (HAVE_ZSTD); CMake enables each one
+    when it finds the library.
+*/
+#ifndef MDP_DECOMPRESS_H
+#define MDP_DECOMPRESS_H
+
+#include "mdpCassandra.h"
+
+/* Compressed bytes read per step */
+#define DECOMPRESS_READ_SIZE            (1 << 20)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int readMDPCompressed( MDP_Model *model, char *filename,
+                              int num_threads );
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* MDP_DECOMPRESS_H */
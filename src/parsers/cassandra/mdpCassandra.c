@@ -29,10 +29,20 @@ the global variables for the problem for use in all the other files.
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "mdpCassandra.h"
 #include "imm-reward.h"
 #include "sparse-matrix.h"
+#include "mdp-binary.h"
+#include "mdp-decompress.h"
+#include "pomdp_spec_actions.h"
 // #include "CPMemUtils.h"
 
 
@@ -40,109 +50,75 @@ the global variables for the problem for use in all the other files.
 
 #define EPSILON  0.00001  /* tolerance for sum of probs == 1 */
 
-/* To indicate whether we are using an MDP or POMDP. 
-*/
-Problem_Type gProblemType = UNKNOWN_problem_type;
-
-/* The discount factor to be used with the problem.  
-*/
-REAL_VALUE gDiscount = DEFAULT_DISCOUNT_FACTOR;
-
 char *value_type_str[] = VALUE_TYPE_STRINGS;
 
-Value_Type gValueType = DEFAULT_VALUE_TYPE;
-
-/* These specify the size of the problem.  The first two are always required.
-*/
-int gNumStates = 0;
-int gNumActions = 0;
-int gNumObservations = 0;   /* remains zero for MDPs */
-
-/*  We need two sets of variable for the probabilities and values.  The first
-is an intermediate representation which is filled in as the MDP file
-is parsed, and the other is the final sparse reprsentation which is
-found by converting the interemediate representation.  As aresult, we 
-only need to allocate the intermediate memory while parsing. After parsing
-is completed and we are ready to convert it into the final sparse 
-representation, then we allocate the rest of the memory.
+/*  Each model is read into an MDP_Parse_Context of its own (see
+pomdp_spec_actions.h).  It holds two sets of variables for the
+probabilities and values.  The first is an intermediate representation
+which is filled in as the MDP file is parsed, and the other is the final
+sparse reprsentation in the MDP_Model, which is found by converting the
+interemediate representation.  As aresult, we only need to allocate the
+intermediate memory while parsing. After parsing is completed and we are
+ready to convert it into the final sparse representation, then we
+allocate the rest of the memory.
 */
 
-/* Intermediate variables */
-
-I_Matrix *IP;  /* Transition Probabilities */
-
-I_Matrix *IR;  /* Observation Probabilities (POMDP only) */
-
-I_Matrix IQ;  /* Immediate action-state pair values (both MDP and POMDP) */
-
-/* Sparse variables */
-
-Matrix *P;  /* Transition Probabilities */
-
-Matrix *R;  /* Observation Probabilities */
-
-Matrix Q;  /* Immediate values for state action pairs.  These are
-		   expectations computed from immediate values. */
-
-/* Normal variables */
-
-/* Some type of algorithms want a place to start off the problem,
-especially when doing simulation type experiments.  The belief
-state is for POMDPs and the initial state for an MDP */
-
-REAL_VALUE *gInitialBelief; 
-int gInitialState = INVALID_STATE;
+#ifndef _MSC_VER
+/* Held while the grammar runs, see lockMDPParser() */
+static pthread_mutex_t gParserLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /***************************************************************************/
-REAL_VALUE *newBeliefState(  ) {
+REAL_VALUE *newBeliefState( MDP_Model *model ) {
 
-	return( (REAL_VALUE *) calloc( gNumStates, sizeof( REAL_VALUE )));
+	return( (REAL_VALUE *) calloc( model->num_states, sizeof( REAL_VALUE )));
 }  /* *newBeliefState */
 /***************************************************************************/
-int transformBeliefState( REAL_VALUE *pi,
+int transformBeliefState( MDP_Model *model,
+						 REAL_VALUE *pi,
 						 REAL_VALUE *pi_hat,
 						 int a,
 						 int obs ) {
 							 REAL_VALUE denom;
 							 int i, j, cur_state, next_state;
 
-							 if( gProblemType != POMDP_problem_type )
+							 if( model->problem_type != POMDP_problem_type )
 								 return ( 0 );
 
 							 /* zero out all elements since we will acumulate probabilities
 							 as we loop */
-							 for( i = 0; i < gNumStates; i++ )
+							 for( i = 0; i < model->num_states; i++ )
 								 pi_hat[i] = 0.0;
 
-							 for( cur_state = 0; cur_state < gNumStates; cur_state++ ) {
+							 for( cur_state = 0; cur_state < model->num_states; cur_state++ ) {
 
-								 for( j = P[a]->row_start[cur_state]; 
-									 j < P[a]->row_start[cur_state] +  P[a]->row_length[cur_state];
+								 for( j = model->P[a]->row_start[cur_state]; 
+									 j < model->P[a]->row_start[cur_state] +  model->P[a]->row_length[cur_state];
 									 j++ ) {
 
-										 next_state = P[a]->col[j];
+										 next_state = model->P[a]->col[j];
 
-										 pi_hat[next_state] += pi[cur_state] * P[a]->mat_val[j] 
-										 * getEntryMatrix( R[a], next_state, obs );
+										 pi_hat[next_state] += pi[cur_state] * model->P[a]->mat_val[j] 
+										 * getEntryMatrix( model->R[a], next_state, obs );
 
 								 } /* for j */
 							 }  /* for i */
 
 							 /* Normalize */
 							 denom = 0.0;
-							 for( i = 0; i < gNumStates; i++ )
+							 for( i = 0; i < model->num_states; i++ )
 								 denom += pi_hat[i];
 
 							 if( IS_ZERO( denom ))
 								 return( 0 );
 
-							 for( i = 0; i < gNumStates; i++ )
+							 for( i = 0; i < model->num_states; i++ )
 								 pi_hat[i] /= denom;
 
 							 return( 1 );
 }  /* transformBeliefState */
 /**********************************************************************/
-void copyBeliefState( REAL_VALUE *copy, REAL_VALUE *pi ) {
+void copyBeliefState( MDP_Model *model, REAL_VALUE *copy, REAL_VALUE *pi ) {
 	/*
 	*/
 	int i;
@@ -150,42 +126,140 @@ void copyBeliefState( REAL_VALUE *copy, REAL_VALUE *pi ) {
 	if(( pi == NULL) || (copy == NULL ))
 		return;
 
-	for( i = 0; i < gNumStates; i++ )
+	for( i = 0; i < model->num_states; i++ )
 		copy[i] = pi[i];
 
 }  /* copyBeliefState */
 /**********************************************************************/
-void displayBeliefState( FILE *file, REAL_VALUE *pi ) {
+void displayBeliefState( MDP_Model *model, FILE *file, REAL_VALUE *pi ) {
 	int i;
 
 	fprintf( file, "[%.*f", DOUBLE_DISPLAY_PRECISION, pi[0] );
-	for(i = 1; i < gNumStates; i++) {
+	for(i = 1; i < model->num_states; i++) {
 		fprintf(file, " ");
 		fprintf( file, "%.*f", DOUBLE_DISPLAY_PRECISION, pi[i] );
 	}  /* for i */
 	fprintf(file, "]");
 }  /* displayBeliefState */
 /***************************************************************************/
-int readMDP( char *filename ) {
+int readMDPMapped( MDP_Model *model, char *filename, int num_threads ) {
+	/*
+	Parses a regular file by mapping it into memory and handing the
+	whole thing to the scanner as one buffer, instead of reading it
+	through stdio.  Returns 1 if the file is successfully parsed, 0 if
+	not, and -1 if the file cannot be mapped (e.g. it is a pipe), in
+	which case the caller should read it as a stream instead.
+	*/
+#ifdef _MSC_VER
+	return( -1 );
+#else
+	int fd;
+	struct stat file_stat;
+	size_t file_size, buffer_size, map_size, page_size;
+	char *buffer;
+	int result;
+
+	if(( fd = open( filename, O_RDONLY )) < 0 )
+		return( -1 );
+
+	if(( fstat( fd, &file_stat ) != 0 ) 
+		|| ( ! S_ISREG( file_stat.st_mode ))
+		|| ( file_stat.st_size == 0 )) {
+		close( fd );
+		return( -1 );
+	}
+
+	/* The scanner needs two NUL bytes after the text.  Reserve room for
+	   them with an anonymous mapping, then map the file over the start
+	   of it.  Bytes past the end of the file read as zero either way. */
+	file_size = (size_t) file_stat.st_size;
+	buffer_size = file_size + 2;
+	page_size = (size_t) sysconf( _SC_PAGESIZE );
+	map_size = ( buffer_size + page_size - 1 ) / page_size * page_size;
+
+	buffer = (char *) mmap( NULL, map_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( buffer == MAP_FAILED ) {
+		close( fd );
+		return( -1 );
+	}
+
+	if( mmap( buffer, file_size, PROT_READ | PROT_WRITE, 
+		MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ) {
+		munmap( buffer, map_size );
+		close( fd );
+		return( -1 );
+	}
+	close( fd );
+
+	madvise( buffer, file_size, MADV_SEQUENTIAL );
+	buffer[file_size] = '\0';
+	buffer[file_size + 1] = '\0';
+
+	result = readMDPBuffer( model, buffer, buffer_size, num_threads, 1 );
+
+	munmap( buffer, map_size );
+
+	return( result );
+#endif
+}  /* readMDPMapped */
+/***************************************************************************/
+int readMDP( MDP_Model *model, char *filename, int num_threads ) {
 	/*
 	This routine returns 1 if the file is successfully parsed and 0 if not.
+	Compiled models (see mdp-binary.h) are loaded without parsing, and
+	gzip or zstd compressed files are decompressed as they are parsed.
+	Other regular files are memory mapped, anything else (pipes,
+	devices) is read as a stream.  The model is filled in only if the
+	file is read, and must then be freed with freeMDPModel().
+	num_threads is the number of threads the body of a text file may
+	be parsed with, 0 for one per core.
 	*/
 
 	FILE *file;
+	int result;
 
 	if( filename == NULL ) {
 		fprintf( stderr, "<NULL> MDP filename: %s.\n", filename );
 		return( 0 );
 	}
 
+	result = readBinaryMDP( model, filename );
+	if( result == 0 ) {
+		fprintf( stderr, 
+			"MDP file '%s' was not successfully loaded!\n", filename );
+		return( 0 );
+	}
+	if( result == 1 )
+		return( 1 );
+
+	result = readMDPCompressed( model, filename, num_threads );
+	if( result == 0 ) {
+		fprintf( stderr, 
+			"MDP file '%s' was not successfully parsed!\n", filename );
+		return( 0 );
+	}
+	if( result == 1 )
+		return( 1 );
+
+	result = readMDPMapped( model, filename, num_threads );
+	if( result == 0 ) {
+		fprintf( stderr, 
+			"MDP file '%s' was not successfully parsed!\n", filename );
+		return( 0 );
+	}
+	if( result == 1 )
+		return( 1 );
+
 	if(( file = fopen( filename, "r" )) == NULL ) {
 		fprintf( stderr, "Cannot open the MDP file: %s.\n", filename );
 		return( 0 );
 	}
 
-	if( readMDPFile( file ) == 0 ) {
+	if( readMDPFile( model, file ) == 0 ) {
 		fprintf( stderr, 
 			"MDP file '%s' was not successfully parsed!\n", filename );
+		fclose( file );
 		return( 0 );
 	}
 
@@ -197,39 +271,40 @@ int readMDP( char *filename ) {
 	return( 1 );
 }  /* readMDP */
 /**********************************************************************/
-void allocateIntermediateMDP() {
+void allocateIntermediateMDP( MDP_Parse_Context *context ) {
 	/*
-	Assumes that the gProblemType has been set and that the variables
-	gNumStates, gNumActions, and gNumObservation have the appropriate 
-	values.  It will allocate the memory that will be needed to store
-	the problem.  This allocates the space for the intermediate 
-	representation representation for the transitions and observations,
-	the latter for POMDPs only.
+	Assumes that the problem type has been set and that the number of
+	states, actions, and observations in the context's model have the
+	appropriate values.  It will allocate the memory that will be
+	needed to store the problem.  This allocates the space for the
+	intermediate representation representation for the transitions and
+	observations, the latter for POMDPs only.
 	*/
 
+	MDP_Model *model = &context->model;
 	int a;
 
 	/* We need an intermediate matrix for transition probs. for each
 	action.  */
-	IP = (I_Matrix *) malloc( gNumActions * sizeof( *IP ));
-	checkAllocatedPointer((void *) IP );
+	context->IP = (I_Matrix *) malloc( model->num_actions * sizeof( *context->IP ));
+	checkAllocatedPointer((void *) context->IP );
 
-	for( a = 0; a < gNumActions; a++ )
-		IP[a] = newIMatrix( gNumStates );
+	for( a = 0; a < model->num_actions; a++ )
+		context->IP[a] = newIMatrix( model->num_states );
 
 	/* Only need observation probabilities if it is a POMDP */
-	if( gProblemType == POMDP_problem_type ) {
+	if( model->problem_type == POMDP_problem_type ) {
 
 		/* We need an intermediate matrix for observation probs. for each
 		action.  */
-		IR = (I_Matrix *) malloc( gNumActions * sizeof( *IR ));
-		checkAllocatedPointer((void *) IR );
+		context->IR = (I_Matrix *) malloc( model->num_actions * sizeof( *context->IR ));
+		checkAllocatedPointer((void *) context->IR );
 
-		for( a = 0; a < gNumActions; a++ )
-			IR[a] = newIMatrix( gNumStates );
+		for( a = 0; a < model->num_actions; a++ )
+			context->IR[a] = newIMatrix( model->num_states );
 
 		/* Note that the immediate values are stored in a special way, so
-		we do not need to allocate anything at this time. */
+		we do not need to allocate anything for them at this time. */
 
 		/* For POMDPs, we will keep a starting belief state, since many */
 		/* type of algorithms use a simulation approach and would want to */
@@ -237,21 +312,22 @@ void allocateIntermediateMDP() {
 		/* way, so it is just a vector of the number of states. We */
 		/* initialize it to be all zeroes.  */
 
-		gInitialBelief = (REAL_VALUE *) calloc( gNumStates, sizeof( REAL_VALUE ));
+		model->initial_belief = (REAL_VALUE *) calloc( model->num_states, sizeof( REAL_VALUE ));
 
 	}  /* if POMDP */
 
 	/* Regardless of whether there is an MDP or POMDP, the immediate
 	rewards for action-state pairs will always exist as an expectation
-	over the next states and possibly actions.  These will be computed
-	after parsing from the special immediate reward representation.
+	over the next states and possibly actions.  These are computed
+	straight into Q by convertMatrices(), so they need no intermediate
+	form, only the R: lines they are computed from.
 	*/
-
-	IQ = newIMatrix( gNumActions );
+	initImmRewards( &context->rewards, model->problem_type, 
+		model->num_states, model->num_actions, model->num_observations );
 
 } /* allocateIntermediateMDP */
 /************************************************************************/
-int verifyIntermediateMDP() {
+int verifyIntermediateMDP( MDP_Parse_Context *context ) {
 	/*
 	This routine will make sure that the intermediate form for the MDP
 	is valid.  It will check to make sure that the transition and
@@ -262,21 +338,22 @@ int verifyIntermediateMDP() {
 	are creating the POMDP through a program.  In this case there
 	will be no parsing and thus no logging of errors.
 	*/
+	MDP_Model *model = &context->model;
 	int a,i,j;
 	REAL_VALUE sum;
 
-	for( a = 0; a < gNumActions; a++ )
-		for( i = 0; i < gNumStates; i++ ) {
-			sum = sumIMatrixRowValues( IP[a], i );
+	for( a = 0; a < model->num_actions; a++ )
+		for( i = 0; i < model->num_states; i++ ) {
+			sum = sumIMatrixRowValues( context->IP[a], i );
 			if((sum < ( 1.0 - EPSILON)) || (sum > (1.0 + EPSILON))) {
 				return( 0 );
 			}
 		} /* for i */
 
-		if( gProblemType == POMDP_problem_type )
-			for( a = 0; a < gNumActions; a++ )
-				for( j = 0; j < gNumStates; j++ ) {
-					sum = sumIMatrixRowValues( IR[a], j );
+		if( model->problem_type == POMDP_problem_type )
+			for( a = 0; a < model->num_actions; a++ )
+				for( j = 0; j < model->num_states; j++ ) {
+					sum = sumIMatrixRowValues( context->IR[a], j );
 					if((sum < ( 1.0 - EPSILON)) || (sum > (1.0 + EPSILON))) {
 						return( 0 );
 					} /* if sum not == 1 */
@@ -285,7 +362,7 @@ int verifyIntermediateMDP() {
 				return( 1 );
 }  /* verifyIntermediateMDP */
 /************************************************************************/
-void deallocateIntermediateMDP() {
+void deallocateIntermediateMDP( MDP_Parse_Context *context ) {
 	/*
 	This routine is made available in case something goes wrong
 	before converting the matrices from the intermediate form
@@ -294,77 +371,133 @@ void deallocateIntermediateMDP() {
 	to get rid of them before converting (especially if something
 	has gone wrong) so that things can be started over.
 	*/
+	MDP_Model *model = &context->model;
 	int a;
 
-	for( a = 0; a < gNumActions; a++ ) {
+	for( a = 0; a < model->num_actions; a++ ) {
 
-		destroyIMatrix( IP[a] );
+		destroyIMatrix( context->IP[a] );
 
-		if( gProblemType == POMDP_problem_type ) {
-			destroyIMatrix( IR[a] );
+		if( model->problem_type == POMDP_problem_type ) {
+			destroyIMatrix( context->IR[a] );
 		}
 
 	}
 
-	free( IP );
+	free( context->IP );
+	context->IP = NULL;
 
-	if( gProblemType == POMDP_problem_type ) {
-		free( IR );
-		free( gInitialBelief );
+	if( model->problem_type == POMDP_problem_type ) {
+		free( context->IR );
+		context->IR = NULL;
+		free( model->initial_belief );
+		model->initial_belief = NULL;
 	}
 
-	destroyIMatrix( IQ );
-
 }  /* deallocateIntermediateMDP */
 /**********************************************************************/
-void computeRewards() {
-	int a, i, j, z, next_state, obs;
-	REAL_VALUE sum, inner_sum;
+static void computeActionRewards( MDP_Model *model, 
+				  Imm_Rewards *imm_rewards, 
+				  int a, Matrix transitions,
+				  Imm_Reward_Table *table ) {
+	/*
+	Fills in row a of Q, the expected immediate reward of each state
+	for this action, from its transitions, which are still in double
+	precision (and R[a] for POMDPs).  The entries of a
+	row are added in state order, right after those of row a-1, and,
+	as with the intermediate form, entries that are zero are left out.
+	The rewards come straight from the table when there is one; the
+	sums are formed in the same order either way.
+
+	Rows that were reset to the same template share their entries
+	(see sparse-matrix.h).  When such a row follows another one and
+	their rewards are the same too, so is the sum, which makes a
+	"uniform" action O(Ns) rather than O(Ns^2).
+	*/
+	int i, j, z, next_state, obs;
+	int last_start = -1, last_length = 0;
+	REAL_VALUE sum, inner_sum, last_sum = 0.0;
+	REAL_VALUE *rewards = NULL, *last_rewards = NULL;
+	size_t next_state_stride = 0, obs_stride = 0;
+
+	model->Q->row_start[a] = ( a == 0 ) ? 0 : model->Q->row_start[a-1] + model->Q->row_length[a-1];
+
+	if( table != NULL ) {
+		next_state_stride = table->next_state_stride;
+		obs_stride = table->obs_stride;
+	}
 
 	/* Now do the expectation thing for action-state reward values */
 
-	for( a = 0; a < gNumActions; a++ )
-		for( i = 0; i < gNumStates; i++ ) {
+	for( i = 0; i < model->num_states; i++ ) {
+
+		if( table != NULL )
+			rewards = table->value + a * table->action_stride 
+				+ i * table->cur_state_stride;
 
+		if(( rewards != NULL ) && ( last_rewards != NULL )
+			&& ( transitions->row_start[i] == last_start )
+			&& ( transitions->row_length[i] == last_length )
+			&& (( rewards == last_rewards )
+				|| (( next_state_stride == 0 ) && ( obs_stride == 0 )
+					&& ( rewards[0] == last_rewards[0] )))) {
+			sum = last_sum;
+		}
+		else {
 			sum = 0.0;
 
 			/* Note: 'j' is not a state. It is an index into an array */
-			for( j = P[a]->row_start[i]; 
-				j < P[a]->row_start[i] +  P[a]->row_length[i];
+			for( j = transitions->row_start[i]; 
+				j < transitions->row_start[i] +  transitions->row_length[i];
 				j++ ) {
 
-					next_state = P[a]->col[j];
+					next_state = transitions->col[j];
 
-					if( gProblemType == POMDP_problem_type ) {
+					if( model->problem_type == POMDP_problem_type ) {
 
 						inner_sum = 0.0;
 
 						/* Note: 'z' is not a state. It is an index into an array */
-						for( z = R[a]->row_start[next_state]; 
-							z < (R[a]->row_start[next_state] +  R[a]->row_length[next_state]);
+						for( z = model->R[a]->row_start[next_state]; 
+							z < (model->R[a]->row_start[next_state] +  model->R[a]->row_length[next_state]);
 							z++ ) {
 
-								obs = R[a]->col[z];
+								obs = model->R[a]->col[z];
 
-								inner_sum += R[a]->mat_val[z] 
-								* getImmediateReward( a, i, next_state, obs );
+								inner_sum += model->R[a]->mat_val[z] * (( rewards != NULL )
+									? rewards[next_state * next_state_stride + obs * obs_stride]
+									: getImmediateReward( imm_rewards, a, i, next_state, obs ));
 						}  /* for z */
 					}  /* if POMDP */
 
 					else /* it is an MDP */
-						inner_sum = getImmediateReward( a, i, next_state, 0 );
+						inner_sum = ( rewards != NULL )
+							? rewards[next_state * next_state_stride]
+							: getImmediateReward( imm_rewards, a, i, next_state, 0 );
 
-					sum += P[a]->mat_val[j] * inner_sum;
+					sum += transitions->mat_val[j] * inner_sum;
 
 			}  /* for j */
 
-			addEntryToIMatrix( IQ, a, i, sum );
+			last_start = transitions->row_start[i];
+			last_length = transitions->row_length[i];
+			last_rewards = rewards;
+			last_sum = sum;
+		}
 
-		}  /* for i */
+		if( ! IS_ZERO( sum )) {
+			model->Q->col[model->Q->num_non_zero] = i;
+			model->Q->mat_val[model->Q->num_non_zero] = sum;
+			model->Q->num_non_zero++;
+		}
 
-}  /* computeRewards */
+	}  /* for i */
+
+	model->Q->row_length[a] = model->Q->num_non_zero - model->Q->row_start[a];
+
+}  /* computeActionRewards */
 /************************************************************************/
-void convertMatrices() {
+void convertMatrices( MDP_Parse_Context *context ) {
 	/*
 	This routine is called after the parsing has been succesfully done.
 	It will assume that the intermediate representations for the transition
@@ -379,210 +512,248 @@ void convertMatrices() {
 	observations from the special immediate reward representation.  This
 	will be the final step toward the use of the MDP/POMDP model in 
 	computation.
+
+	Both are done one action at a time.  The intermediate matrices of an
+	action become its sparse matrices without being copied, and its
+	rewards are computed while those are still in the cache, so no
+	second copy of the matrices is made here.  The immediate reward
+	representation is freed at the end, since Q is all that is needed
+	from it.  Once its rewards are computed, the transitions of an
+	action are narrowed in place to the single precision the solvers
+	use, so the solvers can use the arrays as they are.  Q comes out
+	the same as it would from the double precision matrices.
 	*/
 
+	MDP_Model *model = &context->model;
 	int a;
+	Matrix transitions;
+	Imm_Reward_Table *reward_table;
 #if USE_DEBUG_PRINT
 	struct timeval startTime, endTime;
 #endif
 
 	/* Allocate room for each action */
-	P = (Matrix *) malloc( gNumActions * sizeof( *P ) );
-	checkAllocatedPointer((void *) P );
+	model->P = (Single_Matrix *) malloc( model->num_actions * sizeof( *model->P ) );
+	checkAllocatedPointer((void *) model->P );
 
-	R = (Matrix *) malloc( gNumActions * sizeof( *R ) );
-	checkAllocatedPointer((void *) R );
+	model->R = (Matrix *) malloc( model->num_actions * sizeof( *model->R ) );
+	checkAllocatedPointer((void *) model->R );
 
+	/* Room for every action-state pair; what is not used is given back
+	   below */
+	model->Q = newMatrix( model->num_actions, model->num_actions * model->num_states );
+	checkAllocatedPointer((void *) model->Q->mat_val );
+	checkAllocatedPointer((void *) model->Q->col );
+	model->Q->num_non_zero = 0;
 
-	/* First convert the intermediate sparse matrices for trans. and obs. */
+	reward_table = compileImmRewards( &context->rewards );
 
-	for( a = 0; a < gNumActions; a++ ) {
+#if USE_DEBUG_PRINT
+	gettimeofday(&startTime, NULL);
+#endif
+
+	for( a = 0; a < model->num_actions; a++ ) {
 
 #if USE_DEBUG_PRINT
 		printf("pomdp_spec: transforming transition matrix [a=%d]\n", a);
 #endif
 
-		P[a] = transformIMatrix( IP[a] );
-		destroyIMatrix( IP[a] );
+		transitions = transformAndDestroyIMatrix( context->IP[a] );
 
 #if USE_DEBUG_PRINT
 		printf("pomdp_spec: transforming obs matrix [a=%d]\n", a);
 #endif
 
-		if( gProblemType == POMDP_problem_type ) {
-			R[a] = transformIMatrix( IR[a] );
-			destroyIMatrix( IR[a] );
-		}
-
-	}
-
-	free( IP );
+		if( model->problem_type == POMDP_problem_type )
+			model->R[a] = transformAndDestroyIMatrix( context->IR[a] );
 
-	if( gProblemType == POMDP_problem_type )
-		free( IR );
-
-	/* Calculate expected immediate rewards for action-state pairs, but
-	do it in the sparse matrix representation to eliminate zeroes */
+		/* Calculate expected immediate rewards for action-state pairs, but
+		do it in the sparse matrix representation to eliminate zeroes */
 
 #if USE_DEBUG_PRINT
-	printf("pomdp_spec: computing rewards\n");
-	gettimeofday(&startTime, NULL);
+		printf("pomdp_spec: computing rewards [a=%d]\n", a);
 #endif
 
-	computeRewards();
+		computeActionRewards( model, &context->rewards, a, transitions,
+			reward_table );
+
+		model->P[a] = transformAndDestroyMatrix( transitions );
+
+	}
 
 #if USE_DEBUG_PRINT
 	gettimeofday(&endTime, NULL);
 	printf("  (took %lf seconds)\n",
 		endTime.tv_sec - startTime.tv_sec + 1e-6 * (endTime.tv_usec - startTime.tv_usec));
-	printf("pomdp_spec: transforming reward matrix\n");
 #endif
 
-	/* Then convert it into the real representation */
-	Q = transformIMatrix( IQ );
-	destroyIMatrix( IQ );
+	free( context->IP );
+	context->IP = NULL;
+
+	if( model->problem_type == POMDP_problem_type ) {
+		free( context->IR );
+		context->IR = NULL;
+	}
+
+	if(( model->Q->num_non_zero > 0 ) 
+		&& ( model->Q->num_non_zero < model->num_actions * model->num_states )) {
+		model->Q->col = (int *) realloc( model->Q->col, model->Q->num_non_zero * sizeof( int ));
+		checkAllocatedPointer((void *) model->Q->col );
+		model->Q->mat_val = (REAL_VALUE *) 
+			realloc( model->Q->mat_val, model->Q->num_non_zero * sizeof( REAL_VALUE ));
+		checkAllocatedPointer((void *) model->Q->mat_val );
+	}
+
+	destroyImmRewards( &context->rewards );
 
 }  /* convertMatrices */
 /**********************************************************************/
-int writeMDP( char *filename ) {
+int writeMDP( MDP_Model *model, char *filename ) {
 	FILE *file;
 	int a, i, j, obs;
 
 	if( (file = fopen( filename, "w" )) == NULL )
 		return( 0 );
 
-	fprintf( file, "discount: %.6f\n", gDiscount );
+	fprintf( file, "discount: %.6f\n", model->discount );
 
-	if( gValueType == COST_value_type )
+	if( model->value_type == COST_value_type )
 		fprintf( file, "values: cost\n" );
 	else
 		fprintf( file, "values: reward\n" );
 
-	fprintf( file, "states: %d\n", gNumStates );
-	fprintf( file, "actions: %d\n", gNumActions );
+	fprintf( file, "states: %d\n", model->num_states );
+	fprintf( file, "actions: %d\n", model->num_actions );
 
-	if( gProblemType == POMDP_problem_type )
-		fprintf( file, "observations: %d\n", gNumObservations );
+	if( model->problem_type == POMDP_problem_type )
+		fprintf( file, "observations: %d\n", model->num_observations );
 
-	for( a = 0; a < gNumActions; a++ )
-		for( i = 0; i < gNumStates; i++ )
-			for( j = P[a]->row_start[i]; 
-				j < P[a]->row_start[i] +  P[a]->row_length[i];
+	for( a = 0; a < model->num_actions; a++ )
+		for( i = 0; i < model->num_states; i++ )
+			for( j = model->P[a]->row_start[i]; 
+				j < model->P[a]->row_start[i] +  model->P[a]->row_length[i];
 				j++ ) 
 				fprintf( file, "T: %d : %d : %d %.6f\n",
-				a, i, P[a]->col[j], P[a]->mat_val[j] );
+				a, i, model->P[a]->col[j], model->P[a]->mat_val[j] );
 
-	if( gProblemType == POMDP_problem_type )
-		for( a = 0; a < gNumActions; a++ )
-			for( j = 0; j < gNumStates; j++ )
-				for( obs = R[a]->row_start[j]; 
-					obs < R[a]->row_start[j] +  R[a]->row_length[j];
+	if( model->problem_type == POMDP_problem_type )
+		for( a = 0; a < model->num_actions; a++ )
+			for( j = 0; j < model->num_states; j++ )
+				for( obs = model->R[a]->row_start[j]; 
+					obs < model->R[a]->row_start[j] +  model->R[a]->row_length[j];
 					obs++ ) 
 					fprintf( file, "O: %d : %d : %d %.6f\n",
-					a, j, R[a]->col[obs], R[a]->mat_val[obs] );
+					a, j, model->R[a]->col[obs], model->R[a]->mat_val[obs] );
 
-	if( gProblemType == POMDP_problem_type )
-		for( a = 0; a < gNumActions; a++ )
-			for( i = Q->row_start[a]; 
-				i < Q->row_start[a] +  Q->row_length[a];
+	if( model->problem_type == POMDP_problem_type )
+		for( a = 0; a < model->num_actions; a++ )
+			for( i = model->Q->row_start[a]; 
+				i < model->Q->row_start[a] +  model->Q->row_length[a];
 				i++ ) 
 				fprintf( file, "R: %d : %d : * : * %.6f\n",
-				a, Q->col[i], Q->mat_val[i] );
+				a, model->Q->col[i], model->Q->mat_val[i] );
 
 	else
-		for( a = 0; a < gNumActions; a++ )
-			for( i = Q->row_start[a]; 
-				i < Q->row_start[a] +  Q->row_length[a];
+		for( a = 0; a < model->num_actions; a++ )
+			for( i = model->Q->row_start[a]; 
+				i < model->Q->row_start[a] +  model->Q->row_length[a];
 				i++ ) 
 				fprintf( file, "R: %d : %d : * %.6f\n",
-				a, Q->col[i], Q->mat_val[i] );
+				a, model->Q->col[i], model->Q->mat_val[i] );
 
 	fclose( file );
 	return( 1 );
 
 }  /* writeMDP */
 /**********************************************************************/
-void deallocateMDP() {
+void lockMDPParser( void ) {
+	/*
+	The grammar and its scanner are generated code that keep their
+	own state in globals, so only one thread at a time may parse with
+	them.  readMDPFile() and readMDPBuffer() hold this lock while they
+	do; the hand written parser needs no lock.
+	*/
+#ifndef _MSC_VER
+	pthread_mutex_lock( &gParserLock );
+#endif
+}  /* lockMDPParser */
+/**********************************************************************/
+void unlockMDPParser( void ) {
+#ifndef _MSC_VER
+	pthread_mutex_unlock( &gParserLock );
+#endif
+}  /* unlockMDPParser */
+/**********************************************************************/
+void freeMDPModel( MDP_Model *model ) {
 	int a;
 
-	for( a = 0; a < gNumActions; a++ ) 
-	{
-		if(P!=NULL)
-		{
-			destroyMatrix( P[a] );
-		}
+	/* A compiled model lives in its file mapping */
+	if( model->mapping != NULL ) {
+		releaseBinaryMDPModel( model );
+		return;
+	}
 
+	for( a = 0; a < model->num_actions; a++ ) {
 
-		if( gProblemType == POMDP_problem_type )
-		{
-			if(R!= NULL)
-			{
-				destroyMatrix( R[a] );
-			}
-		}
-	}  /* for a */
+		if( model->P != NULL )
+			destroySingleMatrix( model->P[a] );
 
-	if(P!=NULL)
-	{
-		free( P );
-	}
+		if(( model->problem_type == POMDP_problem_type ) 
+			&& ( model->R != NULL ))
+			destroyMatrix( model->R[a] );
 
+	}  /* for a */
 
-	if( gProblemType == POMDP_problem_type ) 
-	{
-		if(R!= NULL)
-		{
-			free( R );
-		}
-		if(gInitialBelief!= NULL)
-		{
-			free( gInitialBelief );
-		}
-		
-	}
+	/* convertMatrices() allocates R for MDPs too, but leaves it empty */
+	free( model->P );
+	free( model->R );
+	free( model->initial_belief );
 
-	destroyMatrix( Q );
+	destroyMatrix( model->Q );
 
-	destroyImmRewards();
+	model->P = NULL;
+	model->R = NULL;
+	model->Q = NULL;
+	model->initial_belief = NULL;
+	model->num_actions = 0;
 
-}  /* deallocateMDP */
+}  /* freeMDPModel */
 /**********************************************************************/
-void displayMDPSlice( int state ) {
+void displayMDPSlice( MDP_Model *model, int state ) {
 	/*
 	Shows the transition and observation probabilites (and rewards) for
 	the given state.
 	*/
 	int a, j, obs;
 
-	if(( state < 0 ) || ( state >= gNumStates ) || ( gNumStates < 1 ))
+	if(( state < 0 ) || ( state >= model->num_states ) || ( model->num_states < 1 ))
 		return;
 
 	printf( "MDP slice for state: %d\n", state );
 
-	for( a = 0; a < gNumActions; a++ )
-		for( j = P[a]->row_start[state]; 
-			j < P[a]->row_start[state] +  P[a]->row_length[state];
+	for( a = 0; a < model->num_actions; a++ )
+		for( j = model->P[a]->row_start[state]; 
+			j < model->P[a]->row_start[state] +  model->P[a]->row_length[state];
 			j++ ) 
 			printf( "\tP( s=%d | s=%d, a=%d ) = %.6f\n",
-			P[a]->col[j], state, a, P[a]->mat_val[j] );
+			model->P[a]->col[j], state, a, model->P[a]->mat_val[j] );
 
-	if( gProblemType == POMDP_problem_type )
-		for( a = 0; a < gNumActions; a++ )
-			for( obs = R[a]->row_start[state]; 
-				obs < R[a]->row_start[state] +  R[a]->row_length[state];
+	if( model->problem_type == POMDP_problem_type )
+		for( a = 0; a < model->num_actions; a++ )
+			for( obs = model->R[a]->row_start[state]; 
+				obs < model->R[a]->row_start[state] +  model->R[a]->row_length[state];
 				obs++ ) 
 				printf( "\tP( o=%d | s=%d, a=%d ) = %.6f\n",
-				R[a]->col[obs], state, a, R[a]->mat_val[obs] );
+				model->R[a]->col[obs], state, a, model->R[a]->mat_val[obs] );
 
-	for( a = 0; a < gNumActions; a++ )
+	for( a = 0; a < model->num_actions; a++ )
 		printf( "\tQ( s=%d, a=%d ) = %5.6f\n",
-		state, a, getEntryMatrix( Q, a, state ));
+		state, a, getEntryMatrix( model->Q, a, state ));
 
 }  /* displayMDPSlice */
 
 void memoryExhaustedErrorHandler()
 {
-	deallocateMDP();
 	printf("Not enough memory for parsing the POMDP file, exiting.\n");
 	exit(-1);
 }
@@ -66,58 +66,63 @@ typedef enum {REWARD_value_type, COST_value_type } Value_Type;
 
 /* Exported variables */
 extern char *value_type_str[];
-extern REAL_VALUE gDiscount;
-extern Problem_Type gProblemType;
-extern Value_Type gValueType;
-extern int gNumStates;
-extern int gNumActions;
-extern int gNumObservations;
-
-/* Intermediate variables */
-
-extern I_Matrix *IP;  /* Transition Probabilities */
-extern I_Matrix *IR;  /* Observation Probabilities */
-extern I_Matrix IQ;  /* Immediate values for MDP only */
-
-/* Sparse variables */
-
-extern Matrix *P;  /* Transition Probabilities */
-extern Matrix *R;  /* Observation Probabilities */
-extern Matrix *QI;  /* The immediate values, for MDPs only */
-extern Matrix Q;  /* Immediate values for state action pairs.  These
-		     are expectations computed from immediate values:
-		     either the QI for MDPs or the special
-		     representation for the POMDPs */
-
-extern REAL_VALUE *gInitialBelief;   /* For POMDPs */
-extern int gInitialState;        /* For MDPs   */
 
+/* A model as the parser leaves it, with the sparse form of the
+   transition and observation probabilities and the immediate values
+   for state action pairs.  Each read fills in a model of its own, so
+   several models can be read at the same time and held side by side;
+   the solvers, however, keep their working state in file statics and
+   solve one model at a time per process.  A model must be freed with
+   freeMDPModel(). */
+typedef struct MDP_Model_Struct {
+  Problem_Type problem_type;
+  Value_Type value_type;
+  REAL_VALUE discount;
+  int num_states;
+  int num_actions;
+  int num_observations;       /* zero for MDPs */
+  Single_Matrix *P;           /* Transition Probabilities, in the
+                                 single precision the solvers use */
+  Matrix *R;                  /* Observation Probabilities, POMDP only */
+  Matrix Q;                   /* Immediate values for state action
+                                 pairs.  These are expectations computed
+                                 from the immediate values of the R:
+                                 lines. */
+  REAL_VALUE *initial_belief; /* POMDP only */
+  int initial_state;          /* MDP only */
+  char *mapping;              /* compiled models only, see mdp-binary.h */
+  size_t mapping_size;
+} MDP_Model;
 
 
 /* Exported functions */
-extern REAL_VALUE *newBeliefState();
-extern int transformBeliefState( REAL_VALUE *pi,
+extern REAL_VALUE *newBeliefState( MDP_Model *model );
+extern int transformBeliefState( MDP_Model *model,
+                                REAL_VALUE *pi,
                                 REAL_VALUE *pi_hat,
                                 int a,
                                 int obs );
-extern void copyBeliefState( REAL_VALUE *copy, REAL_VALUE *pi );
-extern void displayBeliefState( FILE *file, REAL_VALUE *pi );
-extern int readMDP( char *filename );
-extern void convertMatrices();
-extern void deallocateMDP();
-extern void convertMatrices();
-extern int verifyIntermediateMDP();
-extern void deallocateIntermediateMDP();
-extern void allocateIntermediateMDP();
-extern int writeMDP( char *filename );
-extern void displayMDPSlice( int state );
+extern void copyBeliefState( MDP_Model *model, REAL_VALUE *copy, 
+                            REAL_VALUE *pi );
+extern void displayBeliefState( MDP_Model *model, FILE *file, 
+                               REAL_VALUE *pi );
+extern int readMDP( MDP_Model *model, char *filename, int num_threads );
+extern void freeMDPModel( MDP_Model *model );
+extern int writeMDP( MDP_Model *model, char *filename );
+extern void displayMDPSlice( MDP_Model *model, int state );
 
 extern void memoryExhaustedErrorHandler();
 extern void checkAllocatedPointer(void * ptr);
 
 
 /* from pomdp_spec.y */
-extern int readMDPFile( FILE *file );
+extern int readMDPFile( MDP_Model *model, FILE *file );
+extern int readMDPBuffer( MDP_Model *model, char *buffer, size_t size,
+                          int num_threads, int file_backed );
+
+/* from pomdp_spec.l */
+extern int lexScanBuffer( char *buffer, size_t size );
+extern void lexDeleteBuffer( void );
 
 extern unsigned long getPhysicalMemorySize();
 extern unsigned long getCurrentProcessMemoryUsage();
@@ -150,6 +150,8 @@ typedef struct enode
 extern "C" {
 #endif
 
+extern Err_node *Err_list;
+
 int ERR_dump(void);
 void ERR_enter(	char 	*source,
 			int	lineno,
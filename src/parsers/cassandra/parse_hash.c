@@ -29,21 +29,25 @@
 #include "mdpCassandra.h"
 #include "parse_hash.h"
 
-Node *Hash_Table;
-
 /**********************************************************************/
-void H_create() {
+Node *H_create() {
+   /* Each parse has its own table, so the names of one model never
+      meet those of another */
+   Node *Hash_Table;
 
    Hash_Table = (Node *) calloc( HASH_TABLE_SIZE , sizeof( *Hash_Table ));
+   checkAllocatedPointer((void *) Hash_Table );
 
-   /* Need these to start at zero! */
-   gNumStates = gNumActions = gNumObservations = 0;
+   return( Hash_Table );
 }  /* H_init */
 /**********************************************************************/
-void H_destroy() {
+void H_destroy( Node *Hash_Table ) {
    Node temp;
    int i;
 
+   if( Hash_Table == NULL )
+      return;
+
    for( i = 0; i < HASH_TABLE_SIZE; i++) 
       while( Hash_Table[i] != NULL ) {
          temp = Hash_Table[i];
@@ -94,7 +98,9 @@ int H_match( char *str, Mnemonic_Type type, Node node ) {
    return 1;
 }  /* H_match */
 /**********************************************************************/
-int H_enter( char *str, Mnemonic_Type type ) {
+int H_enter( Node *Hash_Table, char *str, Mnemonic_Type type, int number ) {
+   /* number is what H_lookup() will give for the name, the count of
+      names of this type entered so far */
    Node trail, temp;
    int hash;
 
@@ -126,21 +132,7 @@ int H_enter( char *str, Mnemonic_Type type ) {
 
    strcpy( temp->str, str );
 
-   /* Set number and increment appropriate value */
-   switch( type ) {
-   case nt_state:
-      temp->number = gNumStates++;
-      break;
-   case nt_action:      
-      temp->number = gNumActions++;
-      break;
-   case nt_observation:
-      temp->number = gNumObservations++;
-      break;
-   default:
-      fprintf( stderr, "**ERR: Bad type in H_enter()\n");
-      exit( -1);
-   }
+   temp->number = number;
 
    /* Add to hash table */
    if( trail == NULL ) 
@@ -151,7 +143,7 @@ int H_enter( char *str, Mnemonic_Type type ) {
    return 1;
 }  /* H_enterString */
 /**********************************************************************/
-int H_lookup( char *str, Mnemonic_Type type ) {
+int H_lookup( Node *Hash_Table, char *str, Mnemonic_Type type ) {
    int hash;
    Node temp;
 
@@ -44,10 +44,11 @@ struct Node_Struct {
 extern "C" {
 #endif
 
-extern void H_create();
-extern void H_destroy();
-extern int H_enter( char *str, Mnemonic_Type type );
-extern int H_lookup( char *str, Mnemonic_Type type );
+extern Node *H_create();
+extern void H_destroy( Node *Hash_Table );
+extern int H_enter( Node *Hash_Table, char *str, Mnemonic_Type type, 
+                    int number );
+extern int H_lookup( Node *Hash_Table, char *str, Mnemonic_Type type );
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -42,51 +42,85 @@ using namespace std;
 
 #include "pomdpCassandraWrapper.h"
 #include "mdpCassandra.h"
+#include "mdp-binary.h"
+#include "mdp-cache.h"
+
+PomdpCassandraWrapper::PomdpCassandraWrapper(void)
+{
+  model = (MDP_Model *) calloc(1, sizeof(*model));
+  checkAllocatedPointer((void *) model);
+}
 
 PomdpCassandraWrapper::~PomdpCassandraWrapper(void)
 {
-  deallocateMDP();
+  freeMDPModel(model);
+  free(model);
 }
 
 int PomdpCassandraWrapper::getNumStates(void) const {
-  return gNumStates;
+  return model->num_states;
 }
 
 int PomdpCassandraWrapper::getNumActions(void) const {
-  return gNumActions;
+  return model->num_actions;
 }
 
 int PomdpCassandraWrapper::getNumObservations(void) const {
-  return gNumObservations;
+  return model->num_observations;
 }
 
 ValueType PomdpCassandraWrapper::getDiscount(void) const {
-  return gDiscount;
+  return model->discount;
 }
 
 ValueType PomdpCassandraWrapper::getInitialBelief(StateType s) const {
-  return gInitialBelief[s];
+  return model->initial_belief[s];
+}
+
+bool PomdpCassandraWrapper::isCost(void) const {
+  return (model->value_type == COST_value_type);
 }
 
 CassandraMatrix PomdpCassandraWrapper::getRTranspose(void) const {
-  return Q;
+  return model->Q;
 }
 
-CassandraMatrix PomdpCassandraWrapper::getT(ActionType a) const {
-  return P[a];
+CassandraSingleMatrix PomdpCassandraWrapper::getT(ActionType a) const {
+  return model->P[a];
 }
 
 CassandraMatrix PomdpCassandraWrapper::getO(ActionType a) const {
-  return ::R[a];
+  return model->R[a];
 }
 
-void PomdpCassandraWrapper::readFromFile(const string& fileName) {
-  if (! readMDP(const_cast<char *>(fileName.c_str())) ) {
+void PomdpCassandraWrapper::readFromFile(const string& fileName, int numThreads) {
+  char *file_name = const_cast<char *>(fileName.c_str());
+  const char *cache_dir = getenv(MDP_CACHE_DIR_ENV);
+  const char *cache_max_mb = getenv(MDP_CACHE_MAX_MB_ENV);
+  uint64_t cache_max_bytes = (uint64_t) MDP_CACHE_DEFAULT_MAX_MB << 20;
+  int result;
+
+  freeMDPModel(model);
+
+  if ((cache_dir != NULL) && (cache_dir[0] != '\0')) {
+    if ((cache_max_mb != NULL) && (atol(cache_max_mb) > 0))
+      cache_max_bytes = (uint64_t) atol(cache_max_mb) << 20;
+    result = readMDPCached(model, file_name, numThreads,
+                           const_cast<char *>(cache_dir), cache_max_bytes);
+  }
+  else
+    result = readMDP(model, file_name, numThreads);
+
+  if (! result ) {
     //throw InputError();
     exit(EXIT_FAILURE);
   }
 }
 
+bool PomdpCassandraWrapper::writeToBinaryFile(const string& fileName) const {
+  return writeBinaryMDPModel(model, const_cast<char *>(fileName.c_str())) != 0;
+}
+
 /***************************************************************************
  * REVISION HISTORY:
  * $Log: pomdpCassandraWrapper.cc,v $
@@ -42,8 +42,16 @@ typedef REAL_VALUE ProbType;
 typedef REAL_VALUE ValueType;
 
 typedef Matrix CassandraMatrix;
+typedef Single_Matrix CassandraSingleMatrix;
 
+struct MDP_Model_Struct;
+
+// Each wrapper owns its own model, so several can be read at once from
+// different threads (only models that fall back to the generated
+// grammar are read one at a time).  The solvers keep their working
+// state in file statics, though, so a process solves one model at a time.
 struct PomdpCassandraWrapper {
+  PomdpCassandraWrapper(void);
   ~PomdpCassandraWrapper(void);
 
   int getNumStates(void) const;
@@ -52,16 +60,36 @@ struct PomdpCassandraWrapper {
   ValueType getDiscount(void) const;
   ValueType getInitialBelief(StateType s) const;
 
+  // true if the model was declared with "values: cost", in which case
+  // the entries of getRTranspose() are costs to be minimized
+  bool isCost(void) const;
+
   // rewards
   CassandraMatrix getRTranspose(void) const;
 
-  // transition probabilities
-  CassandraMatrix getT(ActionType a) const;
+  // transition probabilities, in single precision. The arrays belong
+  // to the model, so the solvers read them in place.
+  CassandraSingleMatrix getT(ActionType a) const;
 
   // observation probabilities
   CassandraMatrix getO(ActionType a) const;
 
-  void readFromFile(const string& fileName);
+  // reads either a text model or one compiled by writeToBinaryFile();
+  // text models go through the compiled model cache when
+  // GEMBENCH_CACHE_DIR is set (see mdp-cache.h).  Large text models
+  // are parsed on numThreads threads, 0 for one per core
+  void readFromFile(const string& fileName, int numThreads = 0);
+
+  // writes the model in the compiled form that readFromFile() can map
+  // directly; returns false if the file could not be written
+  bool writeToBinaryFile(const string& fileName) const;
+
+private:
+  struct MDP_Model_Struct *model;
+
+  // not copyable: the model is freed by the destructor
+  PomdpCassandraWrapper(const PomdpCassandraWrapper&);
+  PomdpCassandraWrapper& operator=(const PomdpCassandraWrapper&);
 };
 
 
@@ -150,6 +150,7 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "parse_err.h"
 #include "mdpCassandra.h"
 #include "parse_hash.h"
@@ -159,33 +160,16 @@
 
 #define YACCtrace(X)       /* printf(X);fflush(stdout) */
 
-/* When reading in matrices we need to know what type we are reading
-   and also we need to keep track of where in the matrix we are
-   including how to update the row and col after each entry is read. */
-typedef enum { mc_none, mc_trans_single, mc_trans_row, mc_trans_all,
-               mc_obs_single, mc_obs_row, mc_obs_all,
-               mc_reward_single, mc_reward_row, 
-               mc_reward_all, mc_reward_mdp_only,
-               mc_start_belief, mc_mdp_start, 
-               mc_start_include, mc_start_exclude } Matrix_Context;
+#include "pomdp_spec_actions.h"
 
 extern int yylex();
 
 /* Forward declaration for action routines which appear at end of file */
 void yyerror(char *string);
-void checkMatrix();
-void enterString( Constant_Block *block );
-void enterUniformMatrix( );
-void enterIdentityMatrix( );
-void enterResetMatrix( );
-void enterMatrix( REAL_VALUE value );
-void setMatrixContext( Matrix_Context context, 
-                      int a, int i, int j, int obs );
-void enterStartState( int i );
-void setStartStateUniform();
-void endStartStates();
-void verifyPreamble();
-void checkProbs();
+void enterString( MDP_Parse_Context *context, Constant_Block *block );
+void enterStartState( MDP_Parse_Context *context, int i );
+void setStartStateUniform( MDP_Parse_Context *context );
+void enterTransRowTemplate( MDP_Parse_Context *context );
 
 /*  Helps to give more meaningful error messages */
 long currentLineNumber = 1;
@@ -194,52 +178,15 @@ long currentLineNumber = 1;
    actions and/or observations */
 Mnemonic_Type curMnemonic = nt_unknown;
 
-Matrix_Context curMatrixContext = mc_none;
-
-/* These variable are used to keep track what type of matrix is being entered and
-   which element is currently being processed.  They are initialized by the
-   setMatrixContext() routine and updated by the enterMatrix() routine. */
-int curRow;
-int curCol;
-int minA, maxA;
-int minI, maxI;
-int minJ, maxJ;
-int minObs, maxObs;
-
-/*  These variables will keep the intermediate representation for the
-    matrices.  We cannot know how to set up the sparse matrices until
-    all entries are read in, so we must have this intermediate 
-    representation, which will will convert when it has all been read in.
-    We allocate this memory once we know how big they must be and we
-    will free all of this when we convert it to its final sparse format.
-    */
-I_Matrix *IP;   /* For transition matrices. */
-I_Matrix *IR;   /* For observation matrices. */
-I_Matrix **IW;  /* For reward matrices */
-
-/* These variables are used by the parser only, to keep some state
-   information. 
-*/
-/* These are set when the appropriate preamble line is encountered.  This will
-   allow us to check to make sure each is specified.  If observations are not
-   defined then we will assume it is a regular MDP, and otherwise assume it 
-   is a POMDP
-   */
-int discountDefined = 0;
-int valuesDefined = 0;
-int statesDefined = 0;
-int actionsDefined = 0;
-int observationsDefined = 0;
-
-/* We only want to check when observation probs. are specified, but
-   there was no observations in preamble. */
-int observationSpecDefined = 0;
+/* The parse the grammar is running for.  Everything else the grammar
+   works on is in there (see pomdp_spec_actions.h); yyparse() takes no
+   arguments, so its actions find it here.  Only set while the parser
+   lock is held. */
+static MDP_Parse_Context *gParseContext = NULL;
 
-/* When we encounter a matrix with too many entries.  We would like
-   to only generate one error message, instead of one for each entry.
-   This variable is cleared at the start of reading  a matrix and
-   set when there are too many entries. */
-int gTooManyEntries = 0;
+/* Passed to parseError() for an error in the line being read.  Only
+   the scanner keeps track of lines. */
+#define CURRENT_LINE    -2
 
 
 
@@ -1617,7 +1564,7 @@ yyreduce:
 		    /* absence is what first tells the parser whether */
 		    /* it is parsing an MDP or a POMDP. */
 
-		    verifyPreamble();  /* make sure all things are */
+		    verifyPreamble( gParseContext );  /* make sure all things are */
 				       /* defined */
 
 		    /* While we parse we use an intermediate */
@@ -1628,7 +1575,7 @@ yyreduce:
 		    /* problem is, so we allocate the space for the */
 		    /* intermediate forms */
 
-		    allocateIntermediateMDP();  
+		    allocateIntermediateMDP( gParseContext );  
 		  ;}
     break;
 
@@ -1646,7 +1593,7 @@ yyreduce:
 		    /* is specified for an MDP, then random states */
 		    /* will be assumed. */
 
-		    endStartStates(); 
+		    endStartStates( gParseContext ); 
 		  ;}
     break;
 
@@ -1664,7 +1611,7 @@ yyreduce:
 		    /* observation probabilities are specified in an */
 		    /* MDP problem, since this is illegal. */
 
-                     checkProbs();
+                     checkProbs( gParseContext );
 		     YACCtrace("pomdp_file -> preamble params\n");
                   ;}
     break;
@@ -1683,11 +1630,11 @@ yyreduce:
 		  /* range 0 to 1, so it is an error to specify */
 		  /* anything outside this range. */
 
-                   gDiscount = (yyvsp[(3) - (3)].f_num);
-                   if(( gDiscount < 0.0 ) || ( gDiscount > 1.0 ))
+                   gParseContext->model.discount = (yyvsp[(3) - (3)].f_num);
+                   if(( gParseContext->model.discount < 0.0 ) || ( gParseContext->model.discount > 1.0 ))
                       ERR_enter("Parser<ytab>:", currentLineNumber,
                                 BAD_DISCOUNT_VAL, "");
-                   discountDefined = 1;
+                   gParseContext->discount_defined = 1;
 		   YACCtrace("discount_param -> DISCOUNTTOK COLONTOK number\n");
 	        ;}
     break;
@@ -1695,7 +1642,7 @@ yyreduce:
   case 13:
 #line 229 "pomdp_spec.y"
     {
-                   valuesDefined = 1;
+                   gParseContext->values_defined = 1;
 		   YACCtrace("value_param -> VALUESTOK COLONTOK value_tail\n");
 	        ;}
     break;
@@ -1703,14 +1650,14 @@ yyreduce:
   case 14:
 #line 242 "pomdp_spec.y"
     {
-                   gValueType = REWARD_value_type;
+                   gParseContext->model.value_type = REWARD_value_type;
 		;}
     break;
 
   case 15:
 #line 246 "pomdp_spec.y"
     {
-                   gValueType = COST_value_type;
+                   gParseContext->model.value_type = COST_value_type;
 		;}
     break;
 
@@ -1732,7 +1679,7 @@ yyreduce:
   case 17:
 #line 263 "pomdp_spec.y"
     {
-                   statesDefined = 1;
+                   gParseContext->states_defined = 1;
                    curMnemonic = nt_unknown;
 		   YACCtrace("state_param -> STATETOK COLONTOK state_tail\n");
 		;}
@@ -1745,11 +1692,11 @@ yyreduce:
 		  /*  For the number of states, we can just have a */
 		  /*  number indicating how many there are, or ... */
 
-                   gNumStates = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
-                   if( gNumStates < 1 ) {
+                   gParseContext->model.num_states = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
+                   if( gParseContext->model.num_states < 1 ) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_NUM_STATES, "");
-                      gNumStates = 1;
+                      gParseContext->model.num_states = 1;
                    }
 
  		   /* Since we use some temporary storage to hold the
@@ -1772,7 +1719,7 @@ yyreduce:
   case 21:
 #line 298 "pomdp_spec.y"
     {
-                   actionsDefined = 1;
+                   gParseContext->actions_defined = 1;
                    curMnemonic = nt_unknown;
 		   YACCtrace("action_param -> ACTIONTOK COLONTOK action_tail\n");
 		;}
@@ -1785,11 +1732,11 @@ yyreduce:
 		  /*  For the number of actions, we can just have a */
 		  /*  number indicating how many there are, or ... */
 
-                   gNumActions = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
-                   if( gNumActions < 1 ) {
+                   gParseContext->model.num_actions = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
+                   if( gParseContext->model.num_actions < 1 ) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_NUM_ACTIONS, "" );
-                      gNumActions = 1;
+                      gParseContext->model.num_actions = 1;
                    }
 		   
 		   /* Since we use some temporary storage to hold the
@@ -1812,7 +1759,7 @@ yyreduce:
   case 25:
 #line 333 "pomdp_spec.y"
     {
-                   observationsDefined = 1;
+                   gParseContext->observations_defined = 1;
                    curMnemonic = nt_unknown;
 		   YACCtrace("obs_param -> OBSTOK COLONTOK obs_param_tail\n");
 		;}
@@ -1825,11 +1772,11 @@ yyreduce:
 		  /*  For the number of observation, we can just have a */
 		  /*  number indicating how many there are, or ... */
 
-                   gNumObservations = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
-                   if( gNumObservations < 1 ) {
+                   gParseContext->model.num_observations = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
+                   if( gParseContext->model.num_observations < 1 ) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_NUM_OBS, "" );
-                      gNumObservations = 1;
+                      gParseContext->model.num_observations = 1;
                    }
 
 		   /* Since we use some temporary storage to hold the
@@ -1851,10 +1798,10 @@ yyreduce:
 		  /* MDP there can be only a single integer */
 		  /* representing the starting state. */
 
-		  if( gProblemType == POMDP_problem_type )
-		    setMatrixContext(mc_start_belief, 0, 0, 0, 0); 
+		  if( gParseContext->model.problem_type == POMDP_problem_type )
+		    setMatrixContext( gParseContext, mc_start_belief, 0, 0, 0, 0); 
 		  else
-		    setMatrixContext(mc_mdp_start, 0, 0, 0, 0); 
+		    setMatrixContext( gParseContext, mc_mdp_start, 0, 0, 0, 0); 
 		;}
     break;
 
@@ -1863,16 +1810,16 @@ yyreduce:
     {
                    int num;
 
-		   num = H_lookup( (yyvsp[(3) - (3)].constBlk)->theValue.theString, nt_state );
-		   if(( num < 0 ) || (num >= gNumStates )) {
+		   num = H_lookup( gParseContext->names, (yyvsp[(3) - (3)].constBlk)->theValue.theString, nt_state );
+		   if(( num < 0 ) || (num >= gParseContext->model.num_states )) {
 		     ERR_enter("Parser<ytab>:", currentLineNumber, 
 				 BAD_STATE_STR, (yyvsp[(3) - (3)].constBlk)->theValue.theString );
                    }
                    else
-		     if( gProblemType == MDP_problem_type )
-		       gInitialState = num;
+		     if( gParseContext->model.problem_type == MDP_problem_type )
+		       gParseContext->model.initial_state = num;
 		     else
-		       gInitialBelief[num] = 1.0;
+		       gParseContext->model.initial_belief[num] = 1.0;
 
 
                    free( (yyvsp[(3) - (3)].constBlk)->theValue.theString );
@@ -1883,35 +1830,35 @@ yyreduce:
   case 31:
 #line 415 "pomdp_spec.y"
     { 
-		  setMatrixContext(mc_start_include, 0, 0, 0, 0); 
+		  setMatrixContext( gParseContext, mc_start_include, 0, 0, 0, 0); 
 		;}
     break;
 
   case 33:
 #line 421 "pomdp_spec.y"
     { 
-		  setMatrixContext(mc_start_exclude, 0, 0, 0, 0); 
+		  setMatrixContext( gParseContext, mc_start_exclude, 0, 0, 0, 0); 
 		;}
     break;
 
   case 35:
 #line 428 "pomdp_spec.y"
     { 
-		  setStartStateUniform(); 
+		  setStartStateUniform( gParseContext ); 
 		;}
     break;
 
   case 36:
 #line 433 "pomdp_spec.y"
     {
-		  enterStartState( (yyvsp[(2) - (2)].i_num) );
+		  enterStartState( gParseContext, (yyvsp[(2) - (2)].i_num) );
                 ;}
     break;
 
   case 37:
 #line 437 "pomdp_spec.y"
     {
-		  enterStartState( (yyvsp[(1) - (1)].i_num) );
+		  enterStartState( gParseContext, (yyvsp[(1) - (1)].i_num) );
                 ;}
     break;
 
@@ -1940,7 +1887,7 @@ yyreduce:
 		       and generate an error if needed.
 		       */
 
-		      observationSpecDefined = 1;
+		      gParseContext->observation_spec_defined = 1;
 		  ;}
     break;
 
@@ -1953,20 +1900,20 @@ yyreduce:
 
   case 44:
 #line 479 "pomdp_spec.y"
-    { setMatrixContext(mc_trans_single, (yyvsp[(1) - (5)].i_num), (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num), 0); ;}
+    { setMatrixContext( gParseContext, mc_trans_single, (yyvsp[(1) - (5)].i_num), (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num), 0); ;}
     break;
 
   case 45:
 #line 480 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(7) - (7)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(7) - (7)].f_num) );
 		   YACCtrace("trans_spec_tail -> action COLONTOK state COLONTOK state prob \n");
 		;}
     break;
 
   case 46:
 #line 485 "pomdp_spec.y"
-    { setMatrixContext(mc_trans_row, (yyvsp[(1) - (3)].i_num), (yyvsp[(3) - (3)].i_num), 0, 0); ;}
+    { setMatrixContext( gParseContext, mc_trans_row, (yyvsp[(1) - (3)].i_num), (yyvsp[(3) - (3)].i_num), 0, 0); ;}
     break;
 
   case 47:
@@ -1978,7 +1925,7 @@ yyreduce:
 
   case 48:
 #line 489 "pomdp_spec.y"
-    { setMatrixContext(mc_trans_all, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
+    { setMatrixContext( gParseContext, mc_trans_all, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
     break;
 
   case 49:
@@ -1997,20 +1944,20 @@ yyreduce:
 
   case 51:
 #line 500 "pomdp_spec.y"
-    { setMatrixContext(mc_obs_single, (yyvsp[(1) - (5)].i_num), 0, (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num)); ;}
+    { setMatrixContext( gParseContext, mc_obs_single, (yyvsp[(1) - (5)].i_num), 0, (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num)); ;}
     break;
 
   case 52:
 #line 501 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(7) - (7)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(7) - (7)].f_num) );
 		   YACCtrace("obs_spec_tail -> action COLONTOK state COLONTOK obs prob \n");
 		;}
     break;
 
   case 53:
 #line 506 "pomdp_spec.y"
-    { setMatrixContext(mc_obs_row, (yyvsp[(1) - (3)].i_num), 0, (yyvsp[(3) - (3)].i_num), 0); ;}
+    { setMatrixContext( gParseContext, mc_obs_row, (yyvsp[(1) - (3)].i_num), 0, (yyvsp[(3) - (3)].i_num), 0); ;}
     break;
 
   case 54:
@@ -2022,7 +1969,7 @@ yyreduce:
 
   case 55:
 #line 510 "pomdp_spec.y"
-    { setMatrixContext(mc_obs_all, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
+    { setMatrixContext( gParseContext, mc_obs_all, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
     break;
 
   case 56:
@@ -2041,55 +1988,55 @@ yyreduce:
 
   case 58:
 #line 523 "pomdp_spec.y"
-    { setMatrixContext(mc_reward_single, (yyvsp[(1) - (7)].i_num), (yyvsp[(3) - (7)].i_num), (yyvsp[(5) - (7)].i_num), (yyvsp[(7) - (7)].i_num)); ;}
+    { setMatrixContext( gParseContext, mc_reward_single, (yyvsp[(1) - (7)].i_num), (yyvsp[(3) - (7)].i_num), (yyvsp[(5) - (7)].i_num), (yyvsp[(7) - (7)].i_num)); ;}
     break;
 
   case 59:
 #line 524 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(9) - (9)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(9) - (9)].f_num) );
 
 		   /* Only need this for the call to doneImmReward */
-		   checkMatrix();  
+		   checkMatrix( gParseContext );  
 		   YACCtrace("reward_spec_tail -> action COLONTOK state COLONTOK state COLONTOK obs number\n");
 		;}
     break;
 
   case 60:
 #line 532 "pomdp_spec.y"
-    { setMatrixContext(mc_reward_row, (yyvsp[(1) - (5)].i_num), (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num), 0); ;}
+    { setMatrixContext( gParseContext, mc_reward_row, (yyvsp[(1) - (5)].i_num), (yyvsp[(3) - (5)].i_num), (yyvsp[(5) - (5)].i_num), 0); ;}
     break;
 
   case 61:
 #line 533 "pomdp_spec.y"
     {
-                   checkMatrix();
+                   checkMatrix( gParseContext );
 		   YACCtrace("reward_spec_tail -> action COLONTOK state COLONTOK state num_matrix\n");
 		 ;}
     break;
 
   case 62:
 #line 538 "pomdp_spec.y"
-    { setMatrixContext(mc_reward_all, (yyvsp[(1) - (3)].i_num), (yyvsp[(3) - (3)].i_num), 0, 0); ;}
+    { setMatrixContext( gParseContext, mc_reward_all, (yyvsp[(1) - (3)].i_num), (yyvsp[(3) - (3)].i_num), 0, 0); ;}
     break;
 
   case 63:
 #line 539 "pomdp_spec.y"
     {
-                   checkMatrix();
+                   checkMatrix( gParseContext );
 		   YACCtrace("reward_spec_tail -> action COLONTOK state num_matrix\n");
 		;}
     break;
 
   case 64:
 #line 545 "pomdp_spec.y"
-    { setMatrixContext(mc_reward_mdp_only, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
+    { setMatrixContext( gParseContext, mc_reward_mdp_only, (yyvsp[(1) - (1)].i_num), 0, 0, 0); ;}
     break;
 
   case 65:
 #line 546 "pomdp_spec.y"
     {
-                   checkMatrix();
+                   checkMatrix( gParseContext );
 		   YACCtrace("reward_spec_tail -> action num_matrix\n");
                 ;}
     break;
@@ -2097,70 +2044,70 @@ yyreduce:
   case 66:
 #line 552 "pomdp_spec.y"
     {
-                   enterUniformMatrix();
+                   enterUniformMatrix( gParseContext );
                 ;}
     break;
 
   case 67:
 #line 556 "pomdp_spec.y"
     {
-                   enterIdentityMatrix();
+                   enterIdentityMatrix( gParseContext );
                 ;}
     break;
 
   case 68:
 #line 560 "pomdp_spec.y"
     {
-                   checkMatrix();
+                   checkMatrix( gParseContext );
                 ;}
     break;
 
   case 69:
 #line 566 "pomdp_spec.y"
     {
-                   enterUniformMatrix();
+                   enterUniformMatrix( gParseContext );
                 ;}
     break;
 
   case 70:
 #line 570 "pomdp_spec.y"
     {
-		  enterResetMatrix();
+		  enterResetMatrix( gParseContext );
 		;}
     break;
 
   case 71:
 #line 574 "pomdp_spec.y"
     {
-                   checkMatrix();
+                   checkMatrix( gParseContext );
                 ;}
     break;
 
   case 72:
 #line 579 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(2) - (2)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(2) - (2)].f_num) );
                 ;}
     break;
 
   case 73:
 #line 583 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(1) - (1)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(1) - (1)].f_num) );
                 ;}
     break;
 
   case 74:
 #line 588 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(2) - (2)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(2) - (2)].f_num) );
                 ;}
     break;
 
   case 75:
 #line 592 "pomdp_spec.y"
     {
-                   enterMatrix( (yyvsp[(1) - (1)].f_num) );
+                   enterMatrix( gParseContext, (yyvsp[(1) - (1)].f_num) );
                 ;}
     break;
 
@@ -2168,7 +2115,7 @@ yyreduce:
 #line 597 "pomdp_spec.y"
     {
                    if(( (yyvsp[(1) - (1)].constBlk)->theValue.theInt < 0 ) 
-                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gNumStates )) {
+                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gParseContext->model.num_states )) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_STATE_VAL, "");
                       (yyval.i_num) = 0;
@@ -2183,8 +2130,8 @@ yyreduce:
 #line 609 "pomdp_spec.y"
     {
                    int num;
-                   num = H_lookup( (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_state );
-                   if(( num < 0 ) || (num >= gNumStates )) {
+                   num = H_lookup( gParseContext->names, (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_state );
+                   if(( num < 0 ) || (num >= gParseContext->model.num_states )) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_STATE_STR, (yyvsp[(1) - (1)].constBlk)->theValue.theString );
                       (yyval.i_num) = 0;
@@ -2208,7 +2155,7 @@ yyreduce:
     {
                    (yyval.i_num) = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
                    if(( (yyvsp[(1) - (1)].constBlk)->theValue.theInt < 0 ) 
-                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gNumActions )) {
+                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gParseContext->model.num_actions )) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_ACTION_VAL, "" );
                       (yyval.i_num) = 0;
@@ -2223,8 +2170,8 @@ yyreduce:
 #line 641 "pomdp_spec.y"
     {
                    int num;
-                   num = H_lookup( (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_action );
-                   if(( num < 0 ) || (num >= gNumActions )) {
+                   num = H_lookup( gParseContext->names, (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_action );
+                   if(( num < 0 ) || (num >= gParseContext->model.num_actions )) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_ACTION_STR, (yyvsp[(1) - (1)].constBlk)->theValue.theString );
                       (yyval.i_num) = 0;
@@ -2247,7 +2194,7 @@ yyreduce:
 #line 660 "pomdp_spec.y"
     {
                    if(( (yyvsp[(1) - (1)].constBlk)->theValue.theInt < 0 ) 
-                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gNumObservations )) {
+                      || ((yyvsp[(1) - (1)].constBlk)->theValue.theInt >= gParseContext->model.num_observations )) {
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_OBS_VAL, "");
                       (yyval.i_num) = 0;
@@ -2262,8 +2209,8 @@ yyreduce:
 #line 672 "pomdp_spec.y"
     {
                    int num;
-                   num = H_lookup( (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_observation );
-                   if(( num < 0 ) || (num >= gNumObservations )) { 
+                   num = H_lookup( gParseContext->names, (yyvsp[(1) - (1)].constBlk)->theValue.theString, nt_observation );
+                   if(( num < 0 ) || (num >= gParseContext->model.num_observations )) { 
                       ERR_enter("Parser<ytab>:", currentLineNumber, 
                                 BAD_OBS_STR, (yyvsp[(1) - (1)].constBlk)->theValue.theString);
                       (yyval.i_num) = 0;
@@ -2285,14 +2232,14 @@ yyreduce:
   case 85:
 #line 691 "pomdp_spec.y"
     {
-                   enterString( (yyvsp[(2) - (2)].constBlk) );
+                   enterString( gParseContext, (yyvsp[(2) - (2)].constBlk) );
                 ;}
     break;
 
   case 86:
 #line 695 "pomdp_spec.y"
     {
-                   enterString( (yyvsp[(1) - (1)].constBlk) );
+                   enterString( gParseContext, (yyvsp[(1) - (1)].constBlk) );
                 ;}
     break;
 
@@ -2300,7 +2247,7 @@ yyreduce:
 #line 700 "pomdp_spec.y"
     {
 		  (yyval.f_num) = (yyvsp[(1) - (1)].constBlk)->theValue.theInt;
-		  if( curMatrixContext != mc_mdp_start )
+		  if( gParseContext->matrix_context != mc_mdp_start )
 		    if(( (yyval.f_num) < 0 ) || ((yyval.f_num) > 1 ))
 		      ERR_enter("Parser<ytab>:", currentLineNumber, 
 				BAD_PROB_VAL, "");
@@ -2312,7 +2259,7 @@ yyreduce:
 #line 709 "pomdp_spec.y"
     {
                    (yyval.f_num) = (yyvsp[(1) - (1)].constBlk)->theValue.theFloat;
-		   if( curMatrixContext == mc_mdp_start )
+		   if( gParseContext->matrix_context == mc_mdp_start )
 		     ERR_enter("Parser<ytab>:", currentLineNumber, 
 			       BAD_START_STATE_TYPE, "" );
 		   else
@@ -2599,43 +2546,60 @@ void yyerror(char *string)
    ERR_enter("Parser<yyparse>", currentLineNumber, PARSE_ERR,"");
 }  /* yyerror */
 /******************************************************************************/
-void checkMatrix() {
+static void parseError( MDP_Parse_Context *context, char *source, long line,
+                        int error_code, char *str ) {
+/*
+   Counts an error found by an action routine, and logs it when the
+   grammar is running.  line is CURRENT_LINE for the line being read.
+   */
+   context->num_errors++;
+
+   if( ! context->report_errors )
+      return;
+
+   ERR_enter( source, ( line == CURRENT_LINE ) ? currentLineNumber : line,
+              error_code, str );
+}  /* parseError */
+/******************************************************************************/
+void checkMatrix( MDP_Parse_Context *context ) {
 /* When a matrix is finished being read for the exactly correct number of
-   values, curRow should be 0 and curCol should be -1.  For the cases
-   where we are only interested in a row of entries curCol should be -1.
+   values, cur_row should be 0 and cur_col should be -1.  For the cases
+   where we are only interested in a row of entries cur_col should be -1.
    If we get too many entries, then we will catch this as we parse the 
    extra entries.  Therefore, here we only need to check for too few 
    entries.
    */
 
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
    case mc_trans_row:
-      if( curCol < gNumStates )
-         ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+      if( context->cur_col < context->model.num_states )
+         parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
                    TOO_FEW_ENTRIES, "");
+      else if(( context->min_i < context->max_i ) && ! context->too_many_entries )
+         enterTransRowTemplate( context );
       break;
    case mc_trans_all:
-      if((curRow < (gNumStates-1) )
-	 || ((curRow == (gNumStates-1))
-	     && ( curCol < gNumStates ))) 
-	ERR_enter("Parser<checkMatrix>:", currentLineNumber,  
+      if((context->cur_row < (context->model.num_states-1) )
+	 || ((context->cur_row == (context->model.num_states-1))
+	     && ( context->cur_col < context->model.num_states ))) 
+	parseError( context, "Parser<checkMatrix>:", CURRENT_LINE,  
                    TOO_FEW_ENTRIES, "" );
       break;
    case mc_obs_row:
-      if( curCol < gNumObservations )
-         ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+      if( context->cur_col < context->model.num_observations )
+         parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
                    TOO_FEW_ENTRIES, "");
       break;
    case mc_obs_all:
-      if((curRow < (gNumStates-1) )
-	 || ((curRow == (gNumStates-1))
-	     && ( curCol < gNumObservations ))) 
-         ERR_enter("Parser<checkMatrix>:", currentLineNumber,  
+      if((context->cur_row < (context->model.num_states-1) )
+	 || ((context->cur_row == (context->model.num_states-1))
+	     && ( context->cur_col < context->model.num_observations ))) 
+         parseError( context, "Parser<checkMatrix>:", CURRENT_LINE,  
                    TOO_FEW_ENTRIES, "" );
       break;
    case mc_start_belief:
-      if( curCol < gNumStates )
-	ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+      if( context->cur_col < context->model.num_states )
+	parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
 		  TOO_FEW_ENTRIES, "");
       break;
 
@@ -2645,23 +2609,23 @@ void checkMatrix() {
       break;
 
     case mc_reward_row:
-      if( gProblemType == POMDP_problem_type )
-	if( curCol < gNumObservations )
-	  ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+      if( context->model.problem_type == POMDP_problem_type )
+	if( context->cur_col < context->model.num_observations )
+	  parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
 		    TOO_FEW_ENTRIES, "");
       break;
 
     case mc_reward_all:
-      if( gProblemType == POMDP_problem_type ) {
-	if((curRow < (gNumStates-1) )
-	   || ((curRow == (gNumStates-1))
-	       && ( curCol < gNumObservations ))) 
-	  ERR_enter("Parser<checkMatrix>:", currentLineNumber,  
+      if( context->model.problem_type == POMDP_problem_type ) {
+	if((context->cur_row < (context->model.num_states-1) )
+	   || ((context->cur_row == (context->model.num_states-1))
+	       && ( context->cur_col < context->model.num_observations ))) 
+	  parseError( context, "Parser<checkMatrix>:", CURRENT_LINE,  
 		    TOO_FEW_ENTRIES, "" );
       }
       else
-	if( curCol < gNumStates )
-	  ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+	if( context->cur_col < context->model.num_states )
+	  parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
 		    TOO_FEW_ENTRIES, "");
       
       break;
@@ -2670,149 +2634,201 @@ void checkMatrix() {
       break;
 
     case mc_reward_mdp_only:
-      if((curRow < (gNumStates-1) )
-	 || ((curRow == (gNumStates-1))
-	     && ( curCol < gNumStates ))) 
-	ERR_enter("Parser<checkMatrix>:", currentLineNumber,  
+      if((context->cur_row < (context->model.num_states-1) )
+	 || ((context->cur_row == (context->model.num_states-1))
+	     && ( context->cur_col < context->model.num_states ))) 
+	parseError( context, "Parser<checkMatrix>:", CURRENT_LINE,  
 		  TOO_FEW_ENTRIES, "" );
       break;
 
    default:
-      ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+      parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
                 BAD_MATRIX_CONTEXT, "" );
       break;
    }  /* switch */
 
-   if( gTooManyEntries )
-     ERR_enter("Parser<checkMatrix>:", currentLineNumber, 
+   if( context->too_many_entries )
+     parseError( context, "Parser<checkMatrix>:", CURRENT_LINE, 
 	       TOO_MANY_ENTRIES, "" );
 
    /* After reading a line for immediate rewards for a pomdp, we must tell
       the data structures for the special representation that we are done */
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
    case mc_reward_row:
    case mc_reward_all:
    case mc_reward_mdp_only:
-     doneImmReward();
+     doneImmReward( &context->rewards );
      break;
 
      /* This case is only valid for POMDPs, so if we have an MDP, we
 	never would have started a new immediate reward, so calling 
 	the doneImmReward will be in error.  */
    case mc_reward_single:
-     if( gProblemType == POMDP_problem_type )
-       doneImmReward();
+     if( context->model.problem_type == POMDP_problem_type )
+       doneImmReward( &context->rewards );
      break;
    default:
      break;
    }  /* switch */
    
 
-   curMatrixContext = mc_none;  /* reset this as a safety precaution */
+   context->matrix_context = mc_none;  /* reset this as a safety precaution */
 }  /* checkMatrix */
 /******************************************************************************/
-void enterString( Constant_Block *block ) {
-   
-   if( H_enter( block->theValue.theString, curMnemonic ) == 0 )
-      ERR_enter("Parser<enterString>:", currentLineNumber, 
+void enterString( MDP_Parse_Context *context, Constant_Block *block ) {
+   /* Names are numbered in the order they are given */
+   int *count;
+
+   switch( curMnemonic ) {
+   case nt_state:
+      count = &context->model.num_states;
+      break;
+   case nt_action:      
+      count = &context->model.num_actions;
+      break;
+   case nt_observation:
+      count = &context->model.num_observations;
+      break;
+   default:
+      fprintf( stderr, "**ERR: Bad type in enterString()\n");
+      exit( -1);
+   }
+
+   if( H_enter( context->names, block->theValue.theString, curMnemonic, 
+                *count ) == 0 )
+      parseError( context, "Parser<enterString>:", CURRENT_LINE, 
                 DUPLICATE_STRING, block->theValue.theString );
+   else
+      (*count)++;
 
    free( block->theValue.theString );
    free( block );
 }  /* enterString */
 /******************************************************************************/
-void enterUniformMatrix( ) {
-   int a, i, j, obs;
-   REAL_VALUE prob;
+void enterTransRowTemplate( MDP_Parse_Context *context ) {
+/*
+  Enters a complete row given for several rows at once, i.e. with a '*'
+  for the state, as a template of each transition matrix involved, and
+  resets the rows to it.  This gives the same matrices as entering the
+  values into every row, with one template entry per value instead of
+  one entry per value and row.
+  */
+   int a, i, t;
+
+   for( a = context->min_a; a <= context->max_a; a++ ) {
+      t = addRowTemplate( &context->IP[a]->templates, context->model.num_states, context->trans_row_values );
+      for( i = context->min_i; i <= context->max_i; i++ )
+         resetRowInIMatrix( context->IP[a], i, t );
+   }
+
+   free( context->trans_row_values );
+   context->trans_row_values = NULL;
+
+}  /* enterTransRowTemplate */
+/******************************************************************************/
+void enterUniformMatrix( MDP_Parse_Context *context ) {
+/*
+  Every row involved is reset to the uniform row template of its
+  matrix, rather than having each of its entries set.
+  */
+   int a, i, j, t;
 
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
    case mc_trans_row:
-      prob = 1.0/gNumStates;
-      for( a = minA; a <= maxA; a++ )
-         for( i = minI; i <= maxI; i++ )
-            for( j = 0; j < gNumStates; j++ )
-	       addEntryToIMatrix( IP[a], i, j, prob );
+      for( a = context->min_a; a <= context->max_a; a++ ) {
+         t = uniformRowTemplate( &context->IP[a]->templates, context->model.num_states );
+         for( i = context->min_i; i <= context->max_i; i++ )
+            resetRowInIMatrix( context->IP[a], i, t );
+      }
       break;
    case mc_trans_all:
-      prob = 1.0/gNumStates;
-      for( a = minA; a <= maxA; a++ )
-         for( i = 0; i < gNumStates; i++ )
-            for( j = 0; j < gNumStates; j++ )
- 	       addEntryToIMatrix( IP[a], i, j, prob );
+      for( a = context->min_a; a <= context->max_a; a++ ) {
+         t = uniformRowTemplate( &context->IP[a]->templates, context->model.num_states );
+         for( i = 0; i < context->model.num_states; i++ )
+            resetRowInIMatrix( context->IP[a], i, t );
+      }
       break;
    case mc_obs_row:
-      prob = 1.0/gNumObservations;
-      for( a = minA; a <= maxA; a++ )
-         for( j = minJ; j <= maxJ; j++ )
-            for( obs = 0; obs < gNumObservations; obs++ )
- 	       addEntryToIMatrix( IR[a], j, obs, prob );
+      for( a = context->min_a; a <= context->max_a; a++ ) {
+         t = uniformRowTemplate( &context->IR[a]->templates, context->model.num_observations );
+         for( j = context->min_j; j <= context->max_j; j++ )
+            resetRowInIMatrix( context->IR[a], j, t );
+      }
       break;
    case mc_obs_all:
-      prob = 1.0/gNumObservations;
-      for( a = minA; a <= maxA; a++ )
-         for( j = 0; j < gNumStates; j++ )
-            for( obs = 0; obs < gNumObservations; obs++ )
- 	       addEntryToIMatrix( IR[a], j, obs, prob );
+      for( a = context->min_a; a <= context->max_a; a++ ) {
+         t = uniformRowTemplate( &context->IR[a]->templates, context->model.num_observations );
+         for( j = 0; j < context->model.num_states; j++ )
+            resetRowInIMatrix( context->IR[a], j, t );
+      }
       break;
    case mc_start_belief:
-      setStartStateUniform();
+      setStartStateUniform( context );
       break;
    case mc_mdp_start:
       /* This is meaning less for an MDP */
-      ERR_enter("Parser<enterUniformMatrix>:", currentLineNumber, 
+      parseError( context, "Parser<enterUniformMatrix>:", CURRENT_LINE, 
                 BAD_START_STATE_TYPE, "" );
       break;
    default:
-      ERR_enter("Parser<enterUniformMatrix>:", currentLineNumber, 
+      parseError( context, "Parser<enterUniformMatrix>:", CURRENT_LINE, 
                 BAD_MATRIX_CONTEXT, "" );
       break;
    }  /* switch */
 }  /* enterUniformMatrix */
 /******************************************************************************/
-void enterIdentityMatrix( ) {
-   int a, i,j;
+void enterIdentityMatrix( MDP_Parse_Context *context ) {
+   int a, i;
 
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
    case mc_trans_all:
-      for( a = minA; a <= maxA; a++ )
-         for( i = 0; i < gNumStates; i++ )
-            for( j = 0; j < gNumStates; j++ )
-               if( i == j )
-		 addEntryToIMatrix( IP[a], i, j, 1.0 );
-               else
-		 addEntryToIMatrix( IP[a], i, j, 0.0 );
+      /* Emptying each row removes all of its other entries */
+      for( a = context->min_a; a <= context->max_a; a++ )
+         for( i = 0; i < context->model.num_states; i++ ) {
+            resetRowInIMatrix( context->IP[a], i, I_MATRIX_EMPTY_ROW );
+            addEntryToIMatrix( context->IP[a], i, i, 1.0 );
+         }
       break;
    default:
-      ERR_enter("Parser<enterIdentityMatrix>:", currentLineNumber, 
+      parseError( context, "Parser<enterIdentityMatrix>:", CURRENT_LINE, 
                 BAD_MATRIX_CONTEXT, "" );
       break;
    }  /* switch */
 }  /* enterIdentityMatrix */
 /******************************************************************************/
-void enterResetMatrix( ) {
-  int a, i, j;
+void enterResetMatrix( MDP_Parse_Context *context ) {
+  int a, i, j, t;
 
-  if( curMatrixContext != mc_trans_row ) {
-    ERR_enter("Parser<enterMatrix>:", currentLineNumber, 
+  if( context->matrix_context != mc_trans_row ) {
+    parseError( context, "Parser<enterMatrix>:", CURRENT_LINE, 
 	      BAD_RESET_USAGE, "" );
     return;
   }
 
-  if( gProblemType == POMDP_problem_type )
-    for( a = minA; a <= maxA; a++ )
-      for( i = minI; i <= maxI; i++ )
-	for( j = 0; j < gNumStates; j++ )
-	  addEntryToIMatrix( IP[a], i, j, gInitialBelief[j] );
+  /* The start distribution becomes a row template when it is used
+     for several rows */
+  if(( context->model.problem_type == POMDP_problem_type ) && ( context->min_i < context->max_i ))
+    for( a = context->min_a; a <= context->max_a; a++ ) {
+      t = addRowTemplate( &context->IP[a]->templates, context->model.num_states, context->model.initial_belief );
+      for( i = context->min_i; i <= context->max_i; i++ )
+	resetRowInIMatrix( context->IP[a], i, t );
+    }
+
+  else if( context->model.problem_type == POMDP_problem_type )
+    for( a = context->min_a; a <= context->max_a; a++ )
+      for( i = context->min_i; i <= context->max_i; i++ )
+	for( j = 0; j < context->model.num_states; j++ )
+	  addEntryToIMatrix( context->IP[a], i, j, context->model.initial_belief[j] );
   
   else  /* It is an MDP */
-    for( a = minA; a <= maxA; a++ )
-      for( i = minI; i <= maxI; i++ )
-	addEntryToIMatrix( IP[a], i, gInitialState, 1.0 );
+    for( a = context->min_a; a <= context->max_a; a++ )
+      for( i = context->min_i; i <= context->max_i; i++ )
+	addEntryToIMatrix( context->IP[a], i, context->model.initial_state, 1.0 );
   
 
 }  /* enterResetMatrix */
 /******************************************************************************/
-void enterMatrix( REAL_VALUE value ) {
+void enterMatrix( MDP_Parse_Context *context, REAL_VALUE value ) {
 /*
   For the '_single' context types we never have to worry about setting or 
   checking the bounds on the current row or col.  For all other we do and
@@ -2822,67 +2838,76 @@ void enterMatrix( REAL_VALUE value ) {
   */
    int a, i, j, obs;
 
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
    case mc_trans_single:
-      for( a = minA; a <= maxA; a++ )
-         for( i = minI; i <= maxI; i++ )
-            for( j = minJ; j <= maxJ; j++ )
-	      addEntryToIMatrix( IP[a], i, j, value );
+      for( a = context->min_a; a <= context->max_a; a++ )
+         for( i = context->min_i; i <= context->max_i; i++ )
+            for( j = context->min_j; j <= context->max_j; j++ )
+	      addEntryToIMatrix( context->IP[a], i, j, value );
       break;
    case mc_trans_row:
-      if( curCol < gNumStates ) {
-         for( a = minA; a <= maxA; a++ )
-            for( i = minI; i <= maxI; i++ )
-	      addEntryToIMatrix( IP[a], i, curCol, value );
-         curCol++;
+      if(( context->cur_col < context->model.num_states ) && ( context->min_i < context->max_i )) {
+         /* Entered by checkMatrix() once the row is complete */
+         if( context->cur_col == 0 ) {
+            context->trans_row_values = (REAL_VALUE *) realloc( context->trans_row_values,
+               context->model.num_states * sizeof( REAL_VALUE ));
+            checkAllocatedPointer((void *) context->trans_row_values );
+         }
+         context->trans_row_values[context->cur_col++] = value;
+      }
+      else if( context->cur_col < context->model.num_states ) {
+         for( a = context->min_a; a <= context->max_a; a++ )
+            for( i = context->min_i; i <= context->max_i; i++ )
+	      addEntryToIMatrix( context->IP[a], i, context->cur_col, value );
+         context->cur_col++;
       }
       else
-	gTooManyEntries = 1;
+	context->too_many_entries = 1;
 
       break;
    case mc_trans_all:
-      if( curCol >= gNumStates ) {
-         curRow++;
-         curCol = 0;;
+      if( context->cur_col >= context->model.num_states ) {
+         context->cur_row++;
+         context->cur_col = 0;;
       }
 
-      if( curRow < gNumStates ) {
-         for( a = minA; a <= maxA; a++ )
-	   addEntryToIMatrix( IP[a], curRow, curCol, value );
-         curCol++;
+      if( context->cur_row < context->model.num_states ) {
+         for( a = context->min_a; a <= context->max_a; a++ )
+	   addEntryToIMatrix( context->IP[a], context->cur_row, context->cur_col, value );
+         context->cur_col++;
       } else {
-	gTooManyEntries = 1;
+	context->too_many_entries = 1;
       }
 
       break;
 
    case mc_obs_single:
 
-     if( gProblemType == POMDP_problem_type ) {
+     if( context->model.problem_type == POMDP_problem_type ) {
        /* We ignore this if it is an MDP */
        
-       for( a = minA; a <= maxA; a++ )
-	 for( j = minJ; j <= maxJ; j++ )
-	   for( obs = minObs; obs <= maxObs; obs++ )
-	     addEntryToIMatrix( IR[a], j, obs, value );
+       for( a = context->min_a; a <= context->max_a; a++ )
+	 for( j = context->min_j; j <= context->max_j; j++ )
+	   for( obs = context->min_obs; obs <= context->max_obs; obs++ )
+	     addEntryToIMatrix( context->IR[a], j, obs, value );
      }
      break;
 
    case mc_obs_row:
      {
-       if( gProblemType == POMDP_problem_type ) {
+       if( context->model.problem_type == POMDP_problem_type ) {
 	 /* We ignore this if it is an MDP */
 	 
-	 if( curCol < gNumObservations ) {
+	 if( context->cur_col < context->model.num_observations ) {
 	   
-	   for( a = minA; a <= maxA; a++ ) {
-	     for( j = minJ; j <= maxJ; j++ ) {
-	       addEntryToIMatrix( IR[a], j, curCol, value );
+	   for( a = context->min_a; a <= context->max_a; a++ ) {
+	     for( j = context->min_j; j <= context->max_j; j++ ) {
+	       addEntryToIMatrix( context->IR[a], j, context->cur_col, value );
 	     }
 	   }
-	   curCol++;
+	   context->cur_col++;
 	 } else {
-	   gTooManyEntries = 1;
+	   context->too_many_entries = 1;
 	 }
        }
 
@@ -2890,21 +2915,21 @@ void enterMatrix( REAL_VALUE value ) {
      }
 
    case mc_obs_all:
-      if( curCol >= gNumObservations ) {
-         curRow++;
-         curCol = 0;
+      if( context->cur_col >= context->model.num_observations ) {
+         context->cur_row++;
+         context->cur_col = 0;
       }
 
-      if( gProblemType == POMDP_problem_type ) {
+      if( context->model.problem_type == POMDP_problem_type ) {
 	/* We ignore this if it is an MDP */
 	
-	if( curRow < gNumStates ) {
-	  for( a = minA; a <= maxA; a++ )
-	    addEntryToIMatrix( IR[a], curRow, curCol, value );
+	if( context->cur_row < context->model.num_states ) {
+	  for( a = context->min_a; a <= context->max_a; a++ )
+	    addEntryToIMatrix( context->IR[a], context->cur_row, context->cur_col, value );
 	  
-	  curCol++;
+	  context->cur_col++;
 	} else {
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 	}
       }
       break;
@@ -2915,41 +2940,41 @@ void enterMatrix( REAL_VALUE value ) {
    the matrix context, so we ignore the MDP case here.
    */
    case mc_reward_single:
-      if( gProblemType == POMDP_problem_type ) {
+      if( context->model.problem_type == POMDP_problem_type ) {
 
-	if( curCol == 0 ) {
-	  enterImmReward( 0, 0, 0, value );
-	  curCol++;
+	if( context->cur_col == 0 ) {
+	  enterImmReward( &context->rewards, 0, 0, 0, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
       }
      break;
 
     case mc_reward_row:
-      if( gProblemType == POMDP_problem_type ) {
+      if( context->model.problem_type == POMDP_problem_type ) {
 
 	/* This is a special case for POMDPs, since we need a special 
 	   representation for immediate rewards for POMDP's */
    
-	if( curCol < gNumObservations ) {
-	  enterImmReward( 0, 0, curCol, value );
-	  curCol++;
+	if( context->cur_col < context->model.num_observations ) {
+	  enterImmReward( &context->rewards, 0, 0, context->cur_col, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
       }  /* if POMDP problem */
 
       else /* we are dealing with an MDP, so there should only be 
 	      a single entry */
-	if( curCol == 0 ) {
-	  enterImmReward( 0, 0, 0, value );
-	  curCol++;
+	if( context->cur_col == 0 ) {
+	  enterImmReward( &context->rewards, 0, 0, 0, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
 
      break;
@@ -2959,17 +2984,17 @@ void enterMatrix( REAL_VALUE value ) {
       /* This is a special case for POMDPs, since we need a special 
 	 representation for immediate rewards for POMDP's */
 
-      if( gProblemType == POMDP_problem_type ) {
-	if( curCol >= gNumObservations ) {
-	  curRow++;
-	  curCol = 0;
+      if( context->model.problem_type == POMDP_problem_type ) {
+	if( context->cur_col >= context->model.num_observations ) {
+	  context->cur_row++;
+	  context->cur_col = 0;
 	}
-	if( curRow < gNumStates ) {
-	  enterImmReward( 0, curRow, curCol, value );
-	  curCol++;
+	if( context->cur_row < context->model.num_states ) {
+	  enterImmReward( &context->rewards, 0, context->cur_row, context->cur_col, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
       }  /* If POMDP problem */
 
@@ -2977,12 +3002,12 @@ void enterMatrix( REAL_VALUE value ) {
 	 row of rewards. */
 
       else  /* MDP */
-	if( curCol < gNumStates ) {
-	  enterImmReward( 0, curCol, 0, value );
-	  curCol++;
+	if( context->cur_col < context->model.num_states ) {
+	  enterImmReward( &context->rewards, 0, context->cur_col, 0, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
       break;
 
@@ -2993,17 +3018,17 @@ void enterMatrix( REAL_VALUE value ) {
 	 */
 
     case mc_reward_mdp_only:
-      if( gProblemType == MDP_problem_type ) {
-	if( curCol >= gNumStates ) {
-	  curRow++;
-	  curCol = 0;
+      if( context->model.problem_type == MDP_problem_type ) {
+	if( context->cur_col >= context->model.num_states ) {
+	  context->cur_row++;
+	  context->cur_col = 0;
 	}
-	if( curRow < gNumStates ) {
-	  enterImmReward( curRow, curCol, 0, value );
-	  curCol++;
+	if( context->cur_row < context->model.num_states ) {
+	  enterImmReward( &context->rewards, context->cur_row, context->cur_col, 0, value );
+	  context->cur_col++;
 	}
 	else
-	  gTooManyEntries = 1;
+	  context->too_many_entries = 1;
 
       }
       break;
@@ -3013,12 +3038,12 @@ void enterMatrix( REAL_VALUE value ) {
       /* For an MDP we only want to see a single value and */
       /* we want it to correspond to a valid state number. */
 
-      if( curCol > 0 )
-	gTooManyEntries = 1;
+      if( context->cur_col > 0 )
+	context->too_many_entries = 1;
 
       else {
-	gInitialState = (int) value;
-	curCol++;
+	context->model.initial_state = (int) value;
+	context->cur_col++;
       }
       break;
 	  
@@ -3026,28 +3051,29 @@ void enterMatrix( REAL_VALUE value ) {
 
       /* This will process the individual entries when a starting */
       /* belief state is fully specified.  When it is a POMDP, we need */
-      /* an entry for each state, so we keep the curCol variable */
+      /* an entry for each state, so we keep the cur_col variable */
       /* updated.  */
 
-      if( curCol < gNumStates ) {
-	gInitialBelief[curCol] = value;
-	curCol++;
+      if( context->cur_col < context->model.num_states ) {
+	context->model.initial_belief[context->cur_col] = value;
+	context->cur_col++;
       }
       else
-	gTooManyEntries = 1;
+	context->too_many_entries = 1;
 
       break;
 
    default:
-      ERR_enter("Parser<enterMatrix>:", currentLineNumber, 
+      parseError( context, "Parser<enterMatrix>:", CURRENT_LINE, 
                 BAD_MATRIX_CONTEXT, "");
       break;
    }  /* switch */
 
 }  /* enterMatrix */
 /******************************************************************************/
-void setMatrixContext( Matrix_Context context, 
-                      int a, int i, int j, int obs ) {
+void setMatrixContext( MDP_Parse_Context *context, 
+                       Matrix_Context matrix_context,
+                       int a, int i, int j, int obs ) {
 /* 
    Note that we must enter the matrix entries in reverse order because
    the matrices are defined with left-recursive rules.  Set the a, i,
@@ -3063,13 +3089,13 @@ void setMatrixContext( Matrix_Context context,
 */
   int state;
 
-   curMatrixContext = context;
-   gTooManyEntries = 0;  /* Clear this out before reading any */
+   context->matrix_context = matrix_context;
+   context->too_many_entries = 0;  /* Clear this out before reading any */
 
-   curRow = 0;  /* This is ignored for some contexts */
-   curCol = 0;
+   context->cur_row = 0;  /* This is ignored for some contexts */
+   context->cur_col = 0;
 
-   switch( curMatrixContext ) {
+   switch( context->matrix_context ) {
 
 #if 0
    mc_start_belief:
@@ -3084,12 +3110,12 @@ void setMatrixContext( Matrix_Context context,
      /* the states we will set that particular value to 1.0.  After it */
      /* is all done we can then just normalize the belief state */
 
-     if( gProblemType == POMDP_problem_type )
-       for( state = 0; state < gNumStates; state++ )
-	 gInitialBelief[state] = 0.0;
+     if( context->model.problem_type == POMDP_problem_type )
+       for( state = 0; state < context->model.num_states; state++ )
+	 context->model.initial_belief[state] = 0.0;
 
      else  /* It is an MDP which is not valid */
-       ERR_enter("Parser<setMatrixContext>:", currentLineNumber, 
+       parseError( context, "Parser<setMatrixContext>:", CURRENT_LINE, 
 		 BAD_START_STATE_TYPE, "");
       
      break;
@@ -3101,12 +3127,12 @@ void setMatrixContext( Matrix_Context context,
      /* in the list we clear it out to be zero.  fter it */
      /* is all done we can then just normalize the belief state */
 
-     if( gProblemType == POMDP_problem_type )
-       for( state = 0; state < gNumStates; state++ )
-	 gInitialBelief[state] = 1.0;
+     if( context->model.problem_type == POMDP_problem_type )
+       for( state = 0; state < context->model.num_states; state++ )
+	 context->model.initial_belief[state] = 1.0;
 
      else  /* It is an MDP which is not valid */
-       ERR_enter("Parser<setMatrixContext>:", currentLineNumber, 
+       parseError( context, "Parser<setMatrixContext>:", CURRENT_LINE, 
 		 BAD_START_STATE_TYPE, "");
 
      break;
@@ -3118,39 +3144,39 @@ void setMatrixContext( Matrix_Context context,
      MDP or POMDP.
      */
   case mc_reward_mdp_only:
-    if( gProblemType == POMDP_problem_type )  {
-       ERR_enter("Parser<setMatrixContext>:", currentLineNumber, 
+    if( context->model.problem_type == POMDP_problem_type )  {
+       parseError( context, "Parser<setMatrixContext>:", CURRENT_LINE, 
 		 BAD_REWARD_SYNTAX, "");
     }
     else {
-      newImmReward( a, NOT_PRESENT, NOT_PRESENT, 0 );
+      newImmReward( &context->rewards, a, NOT_PRESENT, NOT_PRESENT, 0 );
     } 
     break;
  
   case mc_reward_all:	
-    if( gProblemType == POMDP_problem_type ) 
-      newImmReward( a, i, NOT_PRESENT, NOT_PRESENT );
+    if( context->model.problem_type == POMDP_problem_type ) 
+      newImmReward( &context->rewards, a, i, NOT_PRESENT, NOT_PRESENT );
 
     else {
-      newImmReward( a, i, NOT_PRESENT, 0 );
+      newImmReward( &context->rewards, a, i, NOT_PRESENT, 0 );
     }
     break;
   case mc_reward_row:
-    if( gProblemType == POMDP_problem_type ) 
-      newImmReward( a, i, j, NOT_PRESENT );
+    if( context->model.problem_type == POMDP_problem_type ) 
+      newImmReward( &context->rewards, a, i, j, NOT_PRESENT );
     
     else {
-      newImmReward( a, i, j, 0 );
+      newImmReward( &context->rewards, a, i, j, 0 );
     } 
     break;
   case mc_reward_single:
 
-    if( gProblemType == MDP_problem_type ) {
-       ERR_enter("Parser<setMatrixContext>:", currentLineNumber, 
+    if( context->model.problem_type == MDP_problem_type ) {
+       parseError( context, "Parser<setMatrixContext>:", CURRENT_LINE, 
 		 BAD_REWARD_SYNTAX, "");
     }
     else {
-       newImmReward( a, i, j, obs );
+       newImmReward( &context->rewards, a, i, j, obs );
      }
     break;
 
@@ -3167,73 +3193,73 @@ void setMatrixContext( Matrix_Context context,
      will be a single number.
      */
    if( a < 0 ) {
-      minA = 0;
-      maxA = gNumActions - 1;
+      context->min_a = 0;
+      context->max_a = context->model.num_actions - 1;
    }
    else
-      minA = maxA = a;
+      context->min_a = context->max_a = a;
 
    if( i < 0 ) {
-      minI = 0;
-      maxI = gNumStates - 1;
+      context->min_i = 0;
+      context->max_i = context->model.num_states - 1;
    }
    else
-      minI = maxI = i;
+      context->min_i = context->max_i = i;
 
    if( j < 0 ) {
-      minJ = 0;
-      maxJ = gNumStates - 1;
+      context->min_j = 0;
+      context->max_j = context->model.num_states - 1;
    }
    else
-      minJ = maxJ = j;
+      context->min_j = context->max_j = j;
 
    if( obs < 0 ) {
-      minObs = 0;
-      maxObs = gNumObservations - 1;
+      context->min_obs = 0;
+      context->max_obs = context->model.num_observations - 1;
    }
    else
-      minObs = maxObs = obs;
+      context->min_obs = context->max_obs = obs;
 
 }  /* setMatrixContext */
 /******************************************************************************/
-void enterStartState( int i ) {
+void enterStartState( MDP_Parse_Context *context, int i ) {
 /*
    This is not valid for an MDP, but the error has already been flagged
    in the setMatrixContext() routine.  Therefore, if just igore this if 
    it is an MDP.
 */
 
-  if( gProblemType == MDP_problem_type )
+  if( context->model.problem_type == MDP_problem_type )
     return;
 
-  switch( curMatrixContext ) {
+  switch( context->matrix_context ) {
   case mc_start_include:
-    gInitialBelief[i] = 1.0;
+    context->model.initial_belief[i] = 1.0;
     break;
   case mc_start_exclude:
-    gInitialBelief[i] = 0.0;
+    context->model.initial_belief[i] = 0.0;
     break;
   default:
-    ERR_enter("Parser<enterStartState>:", currentLineNumber, 
+    parseError( context, "Parser<enterStartState>:", CURRENT_LINE, 
 	      BAD_MATRIX_CONTEXT, "");
       break;
   } /* switch */
 }  /* enterStartState */
 /******************************************************************************/
-void setStartStateUniform() {
+void setStartStateUniform( MDP_Parse_Context *context ) {
   int i;
   REAL_VALUE prob;
 
-  if( gProblemType != POMDP_problem_type )
+  if( context->model.problem_type != POMDP_problem_type )
     return;
 
-  prob = 1.0/gNumStates;
-  for( i = 0; i < gNumStates; i++ )
-    gInitialBelief[i] = prob;
+  prob = 1.0/context->model.num_states;
+  for( i = 0; i < context->model.num_states; i++ )
+    context->model.initial_belief[i] = prob;
 
 }  /*  setStartStateUniform*/
 /******************************************************************************/
-void endStartStates() {
+void endStartStates( MDP_Parse_Context *context ) {
 /*
    There are a few cases where the matrix context will not be
    set at this point.  When there is a list of probabilities
@@ -3242,45 +3268,45 @@ void endStartStates() {
   int i;
   REAL_VALUE prob;
 
-  if( gProblemType == MDP_problem_type ) {
-    curMatrixContext = mc_none;  /* just to be sure */
+  if( context->model.problem_type == MDP_problem_type ) {
+    context->matrix_context = mc_none;  /* just to be sure */
     return;
   }
     
-  switch( curMatrixContext ) {
+  switch( context->matrix_context ) {
   case mc_start_include:
   case mc_start_exclude:
-    /* At this point gInitialBelief should be a vector of 1.0's and 0.0's
+    /* At this point initial_belief should be a vector of 1.0's and 0.0's
        being set as each is either included or excluded.  Now we need to
        normalized them to make it a true probability distribution */
     prob = 0.0;
-    for( i = 0; i < gNumStates; i++ )
-      prob += gInitialBelief[i];
+    for( i = 0; i < context->model.num_states; i++ )
+      prob += context->model.initial_belief[i];
     if( prob <= 0.0 ) {
-      ERR_enter("Parser<endStartStates>:", currentLineNumber, 
+      parseError( context, "Parser<endStartStates>:", CURRENT_LINE, 
                 BAD_START_PROB_SUM, "" );
       return;
     }
-    for( i = 0; i < gNumStates; i++ )
-      gInitialBelief[i] /= prob;
+    for( i = 0; i < context->model.num_states; i++ )
+      context->model.initial_belief[i] /= prob;
     break;
 
   default:  /* Make sure we have a valid prob. distribution */
     prob = 0.0;
-    for( i = 0; i < gNumStates; i++ ) 
-      prob += gInitialBelief[i];
+    for( i = 0; i < context->model.num_states; i++ ) 
+      prob += context->model.initial_belief[i];
     if((prob < ( 1.0 - EPSILON)) || (prob > (1.0 + EPSILON))) {
-      ERR_enter("Parser<endStartStates>:", NO_LINE, 
+      parseError( context, "Parser<endStartStates>:", NO_LINE, 
 		BAD_START_PROB_SUM, "" );
     }
     break;
   }  /* switch */
 
-  curMatrixContext = mc_none;
+  context->matrix_context = mc_none;
 
 }  /* endStartStates */
 /******************************************************************************/
-void verifyPreamble() {
+void verifyPreamble( MDP_Parse_Context *context ) {
 /* 
    When a param is not defined, set these to non-zero so parsing can
    proceed even in the absence of specifying these values.  When an
@@ -3288,98 +3314,109 @@ void verifyPreamble() {
    but return 0 so that more errors can be detected 
    */
 
-   if( discountDefined == 0 )
-      ERR_enter("Parser<verifyPreamble>:", currentLineNumber, 
+   if( context->discount_defined == 0 )
+      parseError( context, "Parser<verifyPreamble>:", CURRENT_LINE, 
                 MISSING_DISCOUNT, "" );
-   if( valuesDefined == 0 )
-      ERR_enter("Parser<verifyPreamble>:", currentLineNumber,
+   if( context->values_defined == 0 )
+      parseError( context, "Parser<verifyPreamble>:", CURRENT_LINE,
                 MISSING_VALUES, "" );
-   if( statesDefined == 0 ) {
-      ERR_enter("Parser<verifyPreamble>:", currentLineNumber, 
+   if( context->states_defined == 0 ) {
+      parseError( context, "Parser<verifyPreamble>:", CURRENT_LINE, 
                 MISSING_STATES, "" );
-      gNumStates = 1;
+      context->model.num_states = 1;
    }
-   if( actionsDefined == 0 ) {
-      ERR_enter("Parser<verifyPreamble>:", currentLineNumber, 
+   if( context->actions_defined == 0 ) {
+      parseError( context, "Parser<verifyPreamble>:", CURRENT_LINE, 
                 MISSING_ACTIONS, "" );
-      gNumActions = 1;
+      context->model.num_actions = 1;
    }
 
    /* If we do not see this, them we must be parsing an MDP */
-   if( observationsDefined == 0 ) {
-     gNumObservations = 0;
-     gProblemType = MDP_problem_type;
+   if( context->observations_defined == 0 ) {
+     context->model.num_observations = 0;
+     context->model.problem_type = MDP_problem_type;
    }
 
    else
-     gProblemType = POMDP_problem_type;
+     context->model.problem_type = POMDP_problem_type;
 
 }  /* verifyPreamble */
 /******************************************************************************/
-void checkProbs() {
+void checkProbs( MDP_Parse_Context *context ) {
    int a,i,j;
    REAL_VALUE sum;
    char str[40];
 
    
-   for( a = 0; a < gNumActions; a++ )
-      for( i = 0; i < gNumStates; i++ ) {
-	 sum = sumIMatrixRowValues( IP[a], i );
+   for( a = 0; a < context->model.num_actions; a++ )
+      for( i = 0; i < context->model.num_states; i++ ) {
+	 sum = sumIMatrixRowValues( context->IP[a], i );
          if((sum < ( 1.0 - EPSILON)) || (sum > (1.0 + EPSILON))) {
             sprintf( str, "action=%d, state=%d (%.5lf)", a, i, sum );
-            ERR_enter("Parser<checkProbs>:", NO_LINE, 
+            parseError( context, "Parser<checkProbs>:", NO_LINE, 
                       BAD_TRANS_PROB_SUM, str );
          }
       } /* for i */
 
-   if( gProblemType == POMDP_problem_type )
-     for( a = 0; a < gNumActions; a++ )
-       for( j = 0; j < gNumStates; j++ ) {
-	 sum = sumIMatrixRowValues( IR[a], j );
+   if( context->model.problem_type == POMDP_problem_type )
+     for( a = 0; a < context->model.num_actions; a++ )
+       for( j = 0; j < context->model.num_states; j++ ) {
+	 sum = sumIMatrixRowValues( context->IR[a], j );
          if((sum < ( 1.0 - EPSILON)) || (sum > (1.0 + EPSILON))) {
 	   sprintf( str, "action=%d, state=%d (%.5lf)", a, j, sum );
-	   ERR_enter("Parser<checkProbs>:", NO_LINE, 
+	   parseError( context, "Parser<checkProbs>:", NO_LINE, 
 		     BAD_OBS_PROB_SUM, str );
          } /* if sum not == 1 */
        }  /* for j */
 
    /* Now see if we had observation specs defined in an MDP */
 
-   if( observationSpecDefined && (gProblemType == MDP_problem_type))
-     ERR_enter("Parser<checkProbs>:", NO_LINE, 
+   if( context->observation_spec_defined && (context->model.problem_type == MDP_problem_type))
+     parseError( context, "Parser<checkProbs>:", NO_LINE, 
 	       OBS_IN_MDP_PROBLEM, "" );
 
 }  /* checkProbs */
 /************************************************************************/
-void initParser() {
+void initParser( MDP_Parse_Context *context, int num_threads,
+                 int file_backed, int report_errors ) {
 /*
-   This routine will reset all the state variables used by the parser
-   in case it will parse multiple files.
+   Sets up an empty context for parsing one file.  num_threads and
+   file_backed are only used by the hand written parser (see
+   pomdp_spec_actions.h).  Errors are logged with ERR_enter() if
+   report_errors is set, and only counted otherwise.
 */
-   observationSpecDefined = 0;
-   discountDefined = 0;
-   valuesDefined = 0;
-   statesDefined = 0;
-   actionsDefined = 0;
-   observationsDefined = 0;
-   observationSpecDefined = 0;
-   currentLineNumber = 1;
-   curMnemonic = nt_unknown;
-   curMatrixContext = mc_none;
+   memset( context, 0, sizeof( *context ));
+
+   context->model.problem_type = UNKNOWN_problem_type;
+   context->model.value_type = DEFAULT_VALUE_TYPE;
+   context->model.discount = DEFAULT_DISCOUNT_FACTOR;
+   context->model.initial_state = INVALID_STATE;
+
+   context->matrix_context = mc_none;
+
+   context->num_threads = ( num_threads > 0 ) ? num_threads : 0;
+   context->file_backed = file_backed;
+   context->report_errors = report_errors;
 
 }  /* initParser */
 /************************************************************************/
-int readMDPFile( FILE *file ) {
+static int parseMDP( MDP_Parse_Context *context ) {
+   /*
+   Runs the parser on whatever input the scanner has been set up with,
+   and converts the result into the final representation in
+   context->model.  The parser lock must be held.
+   */
    int returnValue;
-   extern FILE *yyin;
 
-   initParser();
+   currentLineNumber = 1;
+   curMnemonic = nt_unknown;
 
    ERR_initialize();
-   H_create();
-   yyin = file;
+   context->names = H_create();
 
+   gParseContext = context;
    returnValue = yyparse();
+   gParseContext = NULL;
 #if USE_DEBUG_PRINT
      printf("pomdp_spec: done parsing, beginning conversion to sparse-matrix\n");
 #endif
@@ -3397,19 +3434,98 @@ int readMDPFile( FILE *file ) {
       printf("\nERROR: POMDP model file contains syntax errors!\n");
     }
 
-   if (ERR_dump() || returnValue ) 
+   H_destroy( context->names );
+   context->names = NULL;
+
+   /* Left over if there was a syntax error in such a row */
+   free( context->trans_row_values );
+   context->trans_row_values = NULL;
+
+   if (ERR_dump() || returnValue ) {
+      ERR_cleanUp();
+      if( context->IP != NULL )
+         deallocateIntermediateMDP( context );
+      destroyImmRewards( &context->rewards );
       return( 0 );
+   }
 
    ERR_cleanUp();
-   H_destroy();
 
    /* This is where intermediate matrix representation are
       converted into their final representation */
-   convertMatrices();
+   convertMatrices( context );
 
    return( 1 );
+}  /* parseMDP */
+/************************************************************************/
+int readMDPFile( MDP_Model *model, FILE *file ) {
+   /*
+   Parses a file read as a stream into model.  Returns 1 if the file
+   is successfully parsed and 0 if not.
+   */
+   extern FILE *yyin;
+   MDP_Parse_Context context;
+   int returnValue;
+
+   initParser( &context, 1, 0, 1 );
+
+   lockMDPParser();
+
+   yyin = file;
+   returnValue = parseMDP( &context );
+
+   unlockMDPParser();
+
+   if( returnValue )
+      *model = context.model;
+
+   return( returnValue );
 }  /* readPomdpFile */
 /************************************************************************/
+int readMDPBuffer( MDP_Model *model, char *buffer, size_t size,
+                   int num_threads, int file_backed ) {
+   /*
+   Same as readMDPFile(), but parses a file that is already in memory.
+   size includes the two NUL bytes the buffer must end with.
+   Large files are parsed on num_threads threads, 0 for one per core.
+   file_backed says the buffer is a private mapping of the file, whose
+   pages can be dropped once parsed and are read back if touched again.
+   */
+   MDP_Parse_Context context;
+   int returnValue = 0;
+
+   /* Most files stick to the part of the format that the hand written
+      parser understands.  It needs no lock, and leaves no trace when
+      it gives up, so the grammar can then start over on the same
+      buffer. */
+   initParser( &context, num_threads, file_backed, 0 );
+
+   if( fastParseMDP( &context, buffer, size )) {
+      *model = context.model;
+      return( 1 );
+   }
+
+   /* Said every time, as a file that the hand written parser should
+      read but does not would otherwise only show as a slow parse */
+   printf( "Parsing with the grammar, the fast parser does not read this model\n" );
+
+   initParser( &context, num_threads, file_backed, 1 );
+
+   lockMDPParser();
+
+   if( lexScanBuffer( buffer, size )) {
+      returnValue = parseMDP( &context );
+      lexDeleteBuffer();
+   }
+
+   unlockMDPParser();
+
+   if( returnValue )
+      *model = context.model;
+
+   return( returnValue );
+}  /* readMDPBuffer */
+/************************************************************************/
 #if 0
 int yywrap()
 {
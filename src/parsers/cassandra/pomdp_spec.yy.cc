@@ -1987,6 +1987,24 @@ int yywrap(void)
     return (1);
 }
 
+/* Makes the scanner read straight out of buffer[0..size-1] instead of
+   yyin, without copying it.  The last two bytes of the buffer must be
+   YY_END_OF_BUFFER_CHAR, and the buffer must be writable since the
+   scanner temporarily writes a NUL after each token.  Returns 0 if the
+   buffer cannot be used. */
+int lexScanBuffer( char *buffer, size_t size )
+{
+    return( yy_scan_buffer( buffer, (yy_size_t) size ) != 0 );
+}
+
+/* Releases the buffer state created by lexScanBuffer(), and makes the
+   next yylex() start over from yyin. */
+void lexDeleteBuffer( void )
+{
+    yy_delete_buffer( yy_current_buffer );
+    yy_init = 1;
+}
+
 
 
 
@@ -0,0 +1,140 @@
+/*  pomdp_spec_actions.h
+
+  The semantic action routines and parser state that live in
+  pomdp_spec.tab.cc.  They are shared with the hand written parser in
+  pomdp_spec_fast.cc, which calls them in the same order as the
+  grammar does, except for T: and O: statements, whose triples it
+  builds itself the same way, so that both build exactly the same
+  intermediate matrices.
+
+  Everything a parse builds, and all of the state of the action
+  routines, is kept in an MDP_Parse_Context that each parse has to
+  itself, so the hand written parser can read several models at the
+  same time.  Only the grammar and its scanner are generated code with
+  state of their own (the line number, the scanner buffer and the
+  error list of parse_err.c), so they are run under lockMDPParser().
+*/
+#ifndef POMDP_SPEC_ACTIONS_H
+#define POMDP_SPEC_ACTIONS_H
+
+#include <stddef.h>
+#include "sparse-matrix.h"
+#include "mdpCassandra.h"
+#include "imm-reward.h"
+#include "parse_hash.h"
+
+/* When reading in matrices we need to know what type we are reading
+   and also we need to keep track of where in the matrix we are
+   including how to update the row and col after each entry is read. */
+typedef enum { mc_none, mc_trans_single, mc_trans_row, mc_trans_all,
+               mc_obs_single, mc_obs_row, mc_obs_all,
+               mc_reward_single, mc_reward_row,
+               mc_reward_all, mc_reward_mdp_only,
+               mc_start_belief, mc_mdp_start,
+               mc_start_include, mc_start_exclude } Matrix_Context;
+
+typedef struct MDP_Parse_Context_Struct {
+
+   /* The model being built.  P, R and Q are only set by
+      convertMatrices(), at the end of a successful parse. */
+   MDP_Model model;
+
+   /*  These keep the intermediate representation for the matrices.
+       We cannot know how to set up the sparse matrices until all
+       entries are read in, so they are allocated once we know how big
+       they must be and converted to the final sparse format at the
+       end. */
+   I_Matrix *IP;   /* For transition matrices. */
+   I_Matrix *IR;   /* For observation matrices (POMDP only). */
+
+   /* The R: lines */
+   Imm_Rewards rewards;
+
+   /* Names given to the states, actions and observations (grammar
+      only) */
+   Node *names;
+
+   /* What type of matrix is being entered and which element is
+      currently being processed.  Set by setMatrixContext() and
+      updated by enterMatrix(). */
+   Matrix_Context matrix_context;
+   int cur_row;
+   int cur_col;
+   int min_a, max_a;
+   int min_i, max_i;
+   int min_j, max_j;
+   int min_obs, max_obs;
+
+   /* Set when a matrix has too many entries, so that only one error
+      is given for it instead of one for each entry */
+   int too_many_entries;
+
+   /* The values of a "T: a : *" row, which become a row template once
+      the row is complete instead of being entered into every row */
+   REAL_VALUE *trans_row_values;
+
+   /* Set when the appropriate preamble line is encountered, so we can
+      check that each is specified.  If observations are not defined
+      then it is a regular MDP, and otherwise a POMDP. */
+   int discount_defined;
+   int values_defined;
+   int states_defined;
+   int actions_defined;
+   int observations_defined;
+
+   /* Set when observation probs. are specified, which is an error if
+      there were no observations in the preamble */
+   int observation_spec_defined;
+
+   /* Errors found by the action routines.  They are only logged with
+      ERR_enter() if report_errors is set; the hand written parser just
+      gives up if there are any. */
+   int report_errors;
+   int num_errors;
+
+   /* Threads used for the body of the file by the hand written
+      parser, 0 for one per core */
+   int num_threads;
+
+   /* Set when the buffer being parsed is a private mapping of the
+      file, so the text of parsed chunks can be dropped from memory */
+   int file_backed;
+
+} MDP_Parse_Context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Action routines, from pomdp_spec.y */
+void initParser( MDP_Parse_Context *context, int num_threads,
+                 int file_backed, int report_errors );
+void checkMatrix( MDP_Parse_Context *context );
+void enterUniformMatrix( MDP_Parse_Context *context );
+void enterIdentityMatrix( MDP_Parse_Context *context );
+void enterResetMatrix( MDP_Parse_Context *context );
+void enterMatrix( MDP_Parse_Context *context, REAL_VALUE value );
+void setMatrixContext( MDP_Parse_Context *context,
+                       Matrix_Context matrix_context,
+                       int a, int i, int j, int obs );
+void setStartStateUniform( MDP_Parse_Context *context );
+void endStartStates( MDP_Parse_Context *context );
+void verifyPreamble( MDP_Parse_Context *context );
+void checkProbs( MDP_Parse_Context *context );
+
+/* from mdpCassandra.c */
+void allocateIntermediateMDP( MDP_Parse_Context *context );
+int verifyIntermediateMDP( MDP_Parse_Context *context );
+void deallocateIntermediateMDP( MDP_Parse_Context *context );
+void convertMatrices( MDP_Parse_Context *context );
+void lockMDPParser( void );
+void unlockMDPParser( void );
+
+/* from pomdp_spec_fast.cc */
+int fastParseMDP( MDP_Parse_Context *context, char *buffer, size_t size );
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* POMDP_SPEC_ACTIONS_H */
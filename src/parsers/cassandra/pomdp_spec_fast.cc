@@ -0,0 +1,1540 @@
+/*  pomdp_spec_fast.cc
+
+  A hand written scanner and recursive descent parser for the part of
+  the file format that nearly every large model uses: the preamble with
+  numeric sizes, an optional "start:" distribution, and T:, O: and R:
+  lines with numeric or '*' indices followed by a single value, a row,
+  a whole matrix, or one of the uniform/identity/reset keywords.
+
+  The preamble and start state go through the same action routines as
+  pomdp_spec.y.  The rest of the file is cut into chunks at lines that
+  start a T:, O: or R: statement, and the chunks are parsed on worker
+  threads.  Each chunk turns its T: and O: statements into triples for
+  the intermediate matrices, exactly as enterMatrix() and friends would,
+  and records its R: statements as calls to the action routines (the
+  immediate reward list has state of its own).  Chunks are merged in
+  file order, so later entries still overwrite earlier ones, and P, R
+  and Q come out exactly as they would from the grammar.
+
+  It never reports errors itself.  Named states, actions or
+  observations, "start include" or "start exclude", anything the
+  grammar would reject, and any error an action routine counts in the
+  context make it give up; everything it built is released and
+  readMDPBuffer() hands the buffer to the grammar, which then produces
+  the usual messages.
+
+  Everything it builds goes into the MDP_Parse_Context it is given and
+  its scanner state is per thread, so unlike the grammar it needs no
+  lock, and any number of threads can use it, each on a model of its
+  own.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <stdint.h>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define FAST_PARALLEL 1
+#define FAST_THREAD_LOCAL __thread
+#else
+#define FAST_PARALLEL 0
+#define FAST_THREAD_LOCAL
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define FAST_SCAN_SSE2 1
+#else
+#define FAST_SCAN_SSE2 0
+#endif
+
+#include "mdpCassandra.h"
+#include "parse_constant.h"
+#include "sparse-matrix.h"
+#include "imm-reward.h"
+#include "pomdp_spec_actions.h"
+
+/* The tokens of the subset, named after their pomdp_spec.l counterparts.
+   ft_unsupported covers identifiers, the keywords that are only used
+   with identifiers, and anything the scanner would treat differently. */
+typedef enum { ft_eof, ft_int, ft_float, ft_colon, ft_minus, ft_plus,
+               ft_asterick, ft_discount, ft_values, ft_states, ft_actions,
+               ft_observations, ft_trans, ft_obs, ft_reward_spec,
+               ft_uniform, ft_identity, ft_reward, ft_cost, ft_reset,
+               ft_start, ft_unsupported } Fast_Token;
+
+/* Integers with more digits than this might not fit in the int that
+   atoi() would produce for them. */
+#define MAX_INT_DIGITS                 9
+
+/* Decimal mantissas of up to 15 digits are exact in a double, as are
+   the powers of ten up to 1e22.  A single multiplication or division of
+   the two is then correctly rounded, which is exactly what atof() does. */
+#define MAX_FAST_FLOAT_DIGITS         15
+#define MAX_FAST_FLOAT_EXPONENT       22
+
+static const double gPowersOfTen[MAX_FAST_FLOAT_EXPONENT+1] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Chunks are about this large, and files with fewer chunks than there
+   are threads get fewer threads */
+#define FAST_CHUNK_SIZE                (4 << 20)
+
+/* Chunks parsed but not yet merged, per worker thread, which bounds
+   the memory held by chunks */
+#define FAST_CHUNKS_PER_THREAD         2
+
+/* Scanner state, one per thread.  The buffer ends with NUL bytes, so
+   looking one character past the end of the text is always safe;
+   gFastEnd is the end of the chunk being parsed and gFastLimit the end
+   of the whole buffer. */
+static FAST_THREAD_LOCAL char *gFastPos;
+static FAST_THREAD_LOCAL char *gFastEnd;
+static FAST_THREAD_LOCAL char *gFastLimit;
+
+/* The current token, where it starts, and its value */
+static FAST_THREAD_LOCAL Fast_Token gFastToken;
+static FAST_THREAD_LOCAL char *gFastTokenStart;
+static FAST_THREAD_LOCAL int gFastInt;
+static FAST_THREAD_LOCAL REAL_VALUE gFastFloat;
+
+/* The triples a chunk adds to one intermediate matrix, in the order
+   they would have been added to it.  Row resets refer to the chunk's
+   own templates until the chunk is merged.  Like the log of an
+   I_Matrix, the triples are compacted whenever they have doubled
+   since the last compaction, which left num_compacted of them. */
+typedef struct {
+   int num_entries;
+   int max_entries;
+   int num_compacted;
+   int *row;
+   int *col;
+   REAL_VALUE *value;
+   char *op;
+   Row_Templates templates;
+} Fast_Triples;
+
+/* What a chunk produced: triples for each P[a] and R[a], and its R:
+   statements as a list of (context, a, i, j, obs, number of values)
+   records with their values in reward_values. */
+typedef struct {
+   Fast_Triples *trans;
+   Fast_Triples *obs;
+   int num_rewards;
+   int max_rewards;
+   int *rewards;
+   int num_reward_values;
+   int max_reward_values;
+   REAL_VALUE *reward_values;
+   REAL_VALUE *row_values;      /* num_states values of a "T: a : *" row */
+} Fast_Chunk;
+
+#define FAST_REWARD_FIELDS             6
+
+/* The chunk the current thread is parsing into, and the model whose
+   sizes and start state it is parsed against */
+static FAST_THREAD_LOCAL Fast_Chunk *gFastChunk;
+static FAST_THREAD_LOCAL const MDP_Model *gFastModel;
+
+/**********************************************************************/
+static inline int isBlank( char c ) {
+   return(( c == ' ' ) || ( c == '\t' ) || ( c == '\r' ) || ( c == '\n' ));
+}  /* isBlank */
+/**********************************************************************/
+static inline int isDelimiter( char c ) {
+   /* Characters that end an integer, float or keyword for the scanner
+      without being part of a longer token. */
+   return( isBlank( c ) || ( c == ':' ) || ( c == '#' ) || ( c == '\0' ));
+}  /* isDelimiter */
+/**********************************************************************/
+static char *skipBlanks( char *p ) {
+   /*
+   Skips white space and comments.  Values are nearly always separated
+   by a single blank, so that case is handled before bothering with
+   the vector loop, which is there for indentation and blank lines.
+   */
+   for(;;) {
+
+      if( ! isBlank( *p )) {
+
+         if( *p != '#' )
+            return( p );
+
+         /* Comments run to the end of the line */
+         p = (char *) memchr( p, '\n', gFastEnd - p );
+         if( p == NULL )
+            return( gFastEnd );
+         continue;
+      }
+
+      p++;
+      if( ! isBlank( *p ))
+         continue;
+
+#if FAST_SCAN_SSE2
+      while( p + 16 <= gFastLimit ) {
+         __m128i chars = _mm_loadu_si128( (const __m128i *) p );
+         __m128i blanks = _mm_or_si128(
+            _mm_or_si128( _mm_cmpeq_epi8( chars, _mm_set1_epi8( ' ' )),
+                          _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\n' ))),
+            _mm_or_si128( _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\t' )),
+                          _mm_cmpeq_epi8( chars, _mm_set1_epi8( '\r' ))));
+         unsigned int others = ~_mm_movemask_epi8( blanks ) & 0xFFFF;
+
+         if( others != 0 ) {
+            p += __builtin_ctz( others );
+            break;
+         }
+         p += 16;
+      }
+#endif
+
+      while( isBlank( *p ))
+         p++;
+   }  /* for */
+
+}  /* skipBlanks */
+/**********************************************************************/
+static Fast_Token scanNumber( char *p ) {
+   /*
+   Accepts the same INT and FLOAT forms as pomdp_spec.l:
+   digits, digits '.' digits, and either of those followed by an
+   exponent.  The number must be followed by a delimiter; "5." or
+   "1e" are not a single token and are left to the grammar.
+   */
+   char *start = p;
+   uint64_t mantissa = 0;
+   int num_digits = 0;
+   int exponent = 0;
+   int exp_value, exp_negative;
+   int is_float = 0;
+
+   while(( *p >= '0' ) && ( *p <= '9' )) {
+      if(( mantissa != 0 ) || ( *p != '0' )) {
+         if( num_digits < 19 )
+            mantissa = mantissa * 10 + ( *p - '0' );
+         num_digits++;
+      }
+      p++;
+   }
+
+   if( *p == '.' ) {
+      p++;
+      if(( *p < '0' ) || ( *p > '9' ))
+         return( ft_unsupported );
+
+      while(( *p >= '0' ) && ( *p <= '9' )) {
+         if(( mantissa != 0 ) || ( *p != '0' )) {
+            if( num_digits < 19 )
+               mantissa = mantissa * 10 + ( *p - '0' );
+            num_digits++;
+         }
+         exponent--;
+         p++;
+      }
+      is_float = 1;
+   }
+
+   if((( *p == 'e' ) || ( *p == 'E' ))
+      && ((( p[1] >= '0' ) && ( p[1] <= '9' ))
+          || ((( p[1] == '+' ) || ( p[1] == '-' ))
+              && ( p[2] >= '0' ) && ( p[2] <= '9' )))) {
+      p++;
+      exp_negative = ( *p == '-' );
+      if(( *p == '+' ) || ( *p == '-' ))
+         p++;
+
+      exp_value = 0;
+      while(( *p >= '0' ) && ( *p <= '9' )) {
+         if( exp_value < 100000 )
+            exp_value = exp_value * 10 + ( *p - '0' );
+         p++;
+      }
+      exponent += exp_negative ? -exp_value : exp_value;
+      is_float = 1;
+   }
+
+   if( ! isDelimiter( *p ))
+      return( ft_unsupported );
+
+   gFastPos = p;
+
+   if( ! is_float ) {
+      if( num_digits > MAX_INT_DIGITS )
+         return( ft_unsupported );
+      gFastInt = (int) mantissa;
+      return( ft_int );
+   }
+
+#if FLT_EVAL_METHOD == 0
+   if(( num_digits <= MAX_FAST_FLOAT_DIGITS )
+      && ( exponent >= -MAX_FAST_FLOAT_EXPONENT )
+      && ( exponent <= MAX_FAST_FLOAT_EXPONENT )) {
+      if( exponent < 0 )
+         gFastFloat = (double) mantissa / gPowersOfTen[-exponent];
+      else
+         gFastFloat = (double) mantissa * gPowersOfTen[exponent];
+      return( ft_float );
+   }
+#endif
+
+   /* The token was checked above, so strtod() stops where it ends */
+   gFastFloat = strtod( start, NULL );
+   return( ft_float );
+
+}  /* scanNumber */
+/**********************************************************************/
+static Fast_Token scanKeyword( char *p ) {
+   char *start = p;
+   size_t length;
+
+   while((( *p >= 'a' ) && ( *p <= 'z' )) || (( *p >= 'A' ) && ( *p <= 'Z' )))
+      p++;
+
+   if( ! isDelimiter( *p ))
+      return( ft_unsupported );
+
+   gFastPos = p;
+   length = p - start;
+
+#define KEYWORD( str, token ) \
+   if(( length == sizeof( str ) - 1 ) && ( memcmp( start, str, length ) == 0 )) \
+      return( token )
+
+   KEYWORD( "T", ft_trans );
+   KEYWORD( "O", ft_obs );
+   KEYWORD( "R", ft_reward_spec );
+   KEYWORD( "uniform", ft_uniform );
+   KEYWORD( "identity", ft_identity );
+   KEYWORD( "reset", ft_reset );
+   KEYWORD( "discount", ft_discount );
+   KEYWORD( "values", ft_values );
+   KEYWORD( "states", ft_states );
+   KEYWORD( "actions", ft_actions );
+   KEYWORD( "observations", ft_observations );
+   KEYWORD( "reward", ft_reward );
+   KEYWORD( "cost", ft_cost );
+   KEYWORD( "start", ft_start );
+
+#undef KEYWORD
+
+   return( ft_unsupported );
+
+}  /* scanKeyword */
+/**********************************************************************/
+static void nextToken() {
+   char *p;
+
+   p = gFastPos = gFastTokenStart = skipBlanks( gFastPos );
+
+   if( p >= gFastEnd ) {
+      gFastToken = ft_eof;
+      return;
+   }
+
+   switch( *p ) {
+   case ':':
+      gFastPos++;
+      gFastToken = ft_colon;
+      return;
+   case '*':
+      gFastPos++;
+      gFastToken = ft_asterick;
+      return;
+   case '-':
+      gFastPos++;
+      gFastToken = ft_minus;
+      return;
+   case '+':
+      gFastPos++;
+      gFastToken = ft_plus;
+      return;
+   default:
+      break;
+   }  /* switch */
+
+   if(( *p >= '0' ) && ( *p <= '9' ))
+      gFastToken = scanNumber( p );
+   else
+      gFastToken = scanKeyword( p );
+
+}  /* nextToken */
+/**********************************************************************/
+static int expectColon() {
+   if( gFastToken != ft_colon )
+      return( 0 );
+   nextToken();
+   return( 1 );
+}  /* expectColon */
+/**********************************************************************/
+static int parseIndex( int limit, int *index ) {
+   /* state, action and obs from pomdp_spec.y, without the names */
+
+   if( gFastToken == ft_asterick )
+      *index = WILDCARD_SPEC;
+   else if(( gFastToken == ft_int ) && ( gFastInt < limit ))
+      *index = gFastInt;
+   else
+      return( 0 );
+
+   nextToken();
+   return( 1 );
+}  /* parseIndex */
+/**********************************************************************/
+static int parseCount( int *count ) {
+   /* The number of states, actions or observations */
+
+   if(( gFastToken != ft_int ) || ( gFastInt < 1 ))
+      return( 0 );
+
+   *count = gFastInt;
+   nextToken();
+   return( 1 );
+}  /* parseCount */
+/**********************************************************************/
+static int parseNumber( REAL_VALUE *value ) {
+   int negate = 0;
+
+   if(( gFastToken == ft_minus ) || ( gFastToken == ft_plus )) {
+      negate = ( gFastToken == ft_minus );
+      nextToken();
+   }
+
+   if( gFastToken == ft_int )
+      *value = gFastInt;
+   else if( gFastToken == ft_float )
+      *value = gFastFloat;
+   else
+      return( 0 );
+
+   if( negate )
+      *value = *value * -1.0;
+
+   nextToken();
+   return( 1 );
+}  /* parseNumber */
+/**********************************************************************/
+static int parseProb( REAL_VALUE *value, int mdp_start ) {
+   /* The start state of an MDP is a state number rather than a
+      probability */
+
+   if( gFastToken == ft_int ) {
+      *value = gFastInt;
+      if( ! mdp_start )
+         if(( *value < 0 ) || ( *value > 1 ))
+            return( 0 );
+   }
+   else if( gFastToken == ft_float ) {
+      *value = gFastFloat;
+      if( mdp_start || ( *value < 0.0 ) || ( *value > 1.0 ))
+         return( 0 );
+   }
+   else
+      return( 0 );
+
+   nextToken();
+   return( 1 );
+}  /* parseProb */
+/**********************************************************************/
+static int isNumberToken() {
+   return(( gFastToken == ft_int ) || ( gFastToken == ft_float ));
+}  /* isNumberToken */
+/**********************************************************************/
+static void indexRange( int index, int count, int *first, int *last ) {
+   /* The range setMatrixContext() sets up for an index or a wildcard */
+
+   if( index < 0 ) {
+      *first = 0;
+      *last = count - 1;
+   }
+   else
+      *first = *last = index;
+}  /* indexRange */
+/**********************************************************************/
+static int compareTripleKeys( const void *a, const void *b ) {
+   /* Orders keys holding a column in the high and a position in the
+      low 32 bits, as compareEntryKeys() in sparse-matrix.c does */
+   uint64_t x = *(const uint64_t *) a;
+   uint64_t y = *(const uint64_t *) b;
+
+   return(( x < y ) ? -1 : ( x > y ));
+}  /* compareTripleKeys */
+/**********************************************************************/
+static void compactTriples( Fast_Triples *triples, int num_rows ) {
+   /*
+   Drops the triples that a later triple of the chunk makes
+   irrelevant: everything logged for a row before its last reset, and
+   each set or remove of an entry that is set or removed again later.
+   A chunk has no accumulating triples, so what is left has the same
+   effect on the matrix it is merged into.  Unlike compactIMatrix() a
+   remove cannot be dropped, since it may remove an entry of an earlier
+   chunk.  The triples that are left keep their order.
+   */
+   int *last_reset, *row_start, *order;
+   char *keep;
+   uint64_t *keys;
+   int i, j, k, n, row, length, max_length;
+
+   n = triples->num_entries;
+
+   last_reset = (int *) malloc( num_rows * sizeof( int ));
+   checkAllocatedPointer((void *) last_reset );
+   row_start = (int *) calloc( num_rows + 1, sizeof( int ));
+   checkAllocatedPointer((void *) row_start );
+   order = (int *) malloc( n * sizeof( int ));
+   checkAllocatedPointer((void *) order );
+   keep = (char *) calloc( n, sizeof( char ));
+   checkAllocatedPointer((void *) keep );
+
+   for( row = 0; row < num_rows; row++ )
+      last_reset[row] = -1;
+   for( i = 0; i < n; i++ )
+      if( triples->op[i] == I_MATRIX_OP_RESET_ROW )
+         last_reset[triples->row[i]] = i;
+
+   for( row = 0; row < num_rows; row++ )
+      if( last_reset[row] >= 0 )
+         keep[last_reset[row]] = 1;
+
+   /* Counting sort by row of the triples after the last reset of
+      their row */
+   for( i = 0; i < n; i++ )
+      if( i > last_reset[triples->row[i]] )
+         row_start[triples->row[i] + 1]++;
+
+   max_length = 0;
+   for( row = 0; row < num_rows; row++ ) {
+      if( row_start[row + 1] > max_length )
+         max_length = row_start[row + 1];
+      row_start[row + 1] += row_start[row];
+   }  /* for row */
+
+   for( i = 0; i < n; i++ )
+      if( i > last_reset[triples->row[i]] )
+         order[row_start[triples->row[i]]++] = i;
+
+   /* row_start[row] is now where the next row starts. Sort each row by
+      column, and keep the last triple of each entry. */
+   keys = (uint64_t *) malloc(( max_length > 0 ? max_length : 1 )
+                              * sizeof( uint64_t ));
+   checkAllocatedPointer((void *) keys );
+
+   k = 0;
+   for( row = 0; row < num_rows; row++ ) {
+      length = row_start[row] - k;
+
+      for( j = 0; j < length; j++ )
+         keys[j] = ((uint64_t) triples->col[order[k + j]] << 32)
+            | (uint64_t) order[k + j];
+      if( length > 1 )
+         qsort( keys, length, sizeof( uint64_t ), compareTripleKeys );
+
+      for( j = 0; j < length; j++ )
+         if(( j == length - 1 ) || (( keys[j] >> 32 ) != ( keys[j + 1] >> 32 )))
+            keep[keys[j] & 0xffffffffu] = 1;
+
+      k = row_start[row];
+   }  /* for row */
+
+   k = 0;
+   for( i = 0; i < n; i++ )
+      if( keep[i] ) {
+         triples->row[k] = triples->row[i];
+         triples->col[k] = triples->col[i];
+         triples->value[k] = triples->value[i];
+         triples->op[k] = triples->op[i];
+         k++;
+      }
+
+   triples->num_entries = k;
+   triples->num_compacted = k;
+
+   free( keys );
+   free( keep );
+   free( order );
+   free( row_start );
+   free( last_reset );
+}  /* compactTriples */
+/**********************************************************************/
+static void appendTriple( Fast_Triples *triples, int row, int col,
+                          REAL_VALUE value, char op ) {
+   int n;
+
+   /* Compacted on the same terms as makeRoomInIMatrix() compacts the
+      log of an I_Matrix.  Only transition and observation triples are
+      logged, and both have a row per state. */
+   if(( triples->num_entries == triples->max_entries )
+      && ( triples->num_entries >= I_MATRIX_MIN_LOG_TO_COMPACT )
+      && ( triples->num_entries >= gFastModel->num_states )
+      && ( triples->num_entries / 2 >= triples->num_compacted ))
+      compactTriples( triples, gFastModel->num_states );
+
+   if( triples->num_entries == triples->max_entries ) {
+      n = growEntryCapacity( triples->max_entries,
+                             (long long) triples->num_entries + 1 );
+      triples->row = (int *) realloc( triples->row, n * sizeof( int ));
+      checkAllocatedPointer((void *) triples->row );
+      triples->col = (int *) realloc( triples->col, n * sizeof( int ));
+      checkAllocatedPointer((void *) triples->col );
+      triples->value = (REAL_VALUE *)
+         realloc( triples->value, n * sizeof( REAL_VALUE ));
+      checkAllocatedPointer((void *) triples->value );
+      triples->op = (char *) realloc( triples->op, n * sizeof( char ));
+      checkAllocatedPointer((void *) triples->op );
+      triples->max_entries = n;
+   }
+
+   n = triples->num_entries++;
+   triples->row[n] = row;
+   triples->col[n] = col;
+   triples->value[n] = value;
+   triples->op[n] = op;
+}  /* appendTriple */
+/**********************************************************************/
+static void addTriple( Fast_Triples *triples, int row, int col,
+                       REAL_VALUE value ) {
+   /* What addEntryToIMatrix() would append */
+
+   if( IS_ZERO( value ))
+      appendTriple( triples, row, col, 0.0, I_MATRIX_OP_REMOVE );
+   else
+      appendTriple( triples, row, col, value, I_MATRIX_OP_SET );
+}  /* addTriple */
+/**********************************************************************/
+static void resetRows( Fast_Triples *triples, int first, int last,
+                       int row_template ) {
+   /* What resetRowInIMatrix() would append for each row */
+   int i;
+
+   for( i = first; i <= last; i++ )
+      appendTriple( triples, i, row_template, 0.0, I_MATRIX_OP_RESET_ROW );
+}  /* resetRows */
+/**********************************************************************/
+static void setEntries( Fast_Triples *triples, int first_i, int last_i,
+                        int first_j, int last_j, int num_cols,
+                        REAL_VALUE value ) {
+   /* What addEntryToIMatrix() would append for each entry of the
+      block.  Zeroing every column of a row empties it, so that is
+      logged as one reset per row instead of a remove per entry. */
+   int i, j;
+
+   if( IS_ZERO( value ) && ( first_j == 0 ) && ( last_j == num_cols - 1 )) {
+      resetRows( triples, first_i, last_i, I_MATRIX_EMPTY_ROW );
+      return;
+   }
+
+   for( i = first_i; i <= last_i; i++ )
+      for( j = first_j; j <= last_j; j++ )
+         addTriple( triples, i, j, value );
+}  /* setEntries */
+/**********************************************************************/
+static int parseTransMatrix( int a ) {
+   /* The ui_matrix after "T: a", the mc_trans_all context */
+   int first, last, i, j;
+   REAL_VALUE value;
+
+   indexRange( a, gFastModel->num_actions, &first, &last );
+
+   switch( gFastToken ) {
+   case ft_uniform:
+      for( a = first; a <= last; a++ )
+         resetRows( &gFastChunk->trans[a], 0, gFastModel->num_states - 1,
+            uniformRowTemplate( &gFastChunk->trans[a].templates,
+                                gFastModel->num_states ));
+      break;
+
+   case ft_identity:
+      for( a = first; a <= last; a++ )
+         for( i = 0; i < gFastModel->num_states; i++ ) {
+            resetRows( &gFastChunk->trans[a], i, i, I_MATRIX_EMPTY_ROW );
+            addTriple( &gFastChunk->trans[a], i, i, 1.0 );
+         }
+      break;
+
+   default:
+      /* Exactly one probability per entry, row by row */
+      for( i = 0; i < gFastModel->num_states; i++ )
+         for( j = 0; j < gFastModel->num_states; j++ ) {
+            if( ! parseProb( &value, 0 ))
+               return( 0 );
+            for( a = first; a <= last; a++ )
+               addTriple( &gFastChunk->trans[a], i, j, value );
+         }
+      return( ! isNumberToken() );
+   }  /* switch */
+
+   nextToken();
+   return( 1 );
+}  /* parseTransMatrix */
+/**********************************************************************/
+static int parseTransRow( int a, int i ) {
+   /* The u_matrix after "T: a : i", the mc_trans_row context.  As
+      with the grammar, a row given for every state becomes a row
+      template. */
+   int first_a, last_a, first_i, last_i, j;
+   REAL_VALUE value;
+   Fast_Triples *triples;
+
+   indexRange( a, gFastModel->num_actions, &first_a, &last_a );
+   indexRange( i, gFastModel->num_states, &first_i, &last_i );
+
+   switch( gFastToken ) {
+   case ft_uniform:
+      for( a = first_a; a <= last_a; a++ )
+         resetRows( &gFastChunk->trans[a], first_i, last_i,
+            uniformRowTemplate( &gFastChunk->trans[a].templates,
+                                gFastModel->num_states ));
+      break;
+
+   case ft_reset:
+      if(( gFastModel->problem_type == POMDP_problem_type ) && ( first_i < last_i )) {
+         for( a = first_a; a <= last_a; a++ ) {
+            triples = &gFastChunk->trans[a];
+            resetRows( triples, first_i, last_i,
+               addRowTemplate( &triples->templates, gFastModel->num_states,
+                               gFastModel->initial_belief ));
+         }
+      }
+      else if( gFastModel->problem_type == POMDP_problem_type ) {
+         for( a = first_a; a <= last_a; a++ )
+            for( i = first_i; i <= last_i; i++ )
+               for( j = 0; j < gFastModel->num_states; j++ )
+                  addTriple( &gFastChunk->trans[a], i, j, gFastModel->initial_belief[j] );
+      }
+      else {
+         /* Without a start state there is nowhere to reset to */
+         if(( gFastModel->initial_state < 0 ) || ( gFastModel->initial_state >= gFastModel->num_states ))
+            return( 0 );
+         for( a = first_a; a <= last_a; a++ )
+            for( i = first_i; i <= last_i; i++ )
+               addTriple( &gFastChunk->trans[a], i, gFastModel->initial_state, 1.0 );
+      }
+      break;
+
+   default:
+      if( first_i < last_i ) {
+         if( gFastChunk->row_values == NULL ) {
+            gFastChunk->row_values = (REAL_VALUE *)
+               malloc( gFastModel->num_states * sizeof( REAL_VALUE ));
+            checkAllocatedPointer((void *) gFastChunk->row_values );
+         }
+
+         for( j = 0; j < gFastModel->num_states; j++ )
+            if( ! parseProb( &gFastChunk->row_values[j], 0 ))
+               return( 0 );
+         if( isNumberToken() )
+            return( 0 );
+
+         for( a = first_a; a <= last_a; a++ ) {
+            triples = &gFastChunk->trans[a];
+            resetRows( triples, first_i, last_i,
+               addRowTemplate( &triples->templates, gFastModel->num_states,
+                               gFastChunk->row_values ));
+         }
+         return( 1 );
+      }
+
+      for( j = 0; j < gFastModel->num_states; j++ ) {
+         if( ! parseProb( &value, 0 ))
+            return( 0 );
+         for( a = first_a; a <= last_a; a++ )
+            for( i = first_i; i <= last_i; i++ )
+               addTriple( &gFastChunk->trans[a], i, j, value );
+      }
+      return( ! isNumberToken() );
+   }  /* switch */
+
+   nextToken();
+   return( 1 );
+}  /* parseTransRow */
+/**********************************************************************/
+static int parseTransSpec() {
+   int a, i, j;
+   int first_a, last_a, first_i, last_i, first_j, last_j;
+   REAL_VALUE value;
+
+   nextToken();
+   if( ! expectColon() || ! parseIndex( gFastModel->num_actions, &a ))
+      return( 0 );
+
+   if( gFastToken != ft_colon )
+      return( parseTransMatrix( a ));
+
+   nextToken();
+   if( ! parseIndex( gFastModel->num_states, &i ))
+      return( 0 );
+
+   if( gFastToken != ft_colon )
+      return( parseTransRow( a, i ));
+
+   nextToken();
+   if( ! parseIndex( gFastModel->num_states, &j ) || ! parseProb( &value, 0 ))
+      return( 0 );
+
+   /* mc_trans_single */
+   indexRange( a, gFastModel->num_actions, &first_a, &last_a );
+   indexRange( i, gFastModel->num_states, &first_i, &last_i );
+   indexRange( j, gFastModel->num_states, &first_j, &last_j );
+
+   for( a = first_a; a <= last_a; a++ )
+      setEntries( &gFastChunk->trans[a], first_i, last_i, first_j, last_j,
+                  gFastModel->num_states, value );
+
+   return( 1 );
+}  /* parseTransSpec */
+/**********************************************************************/
+static int parseObsMatrix( int a ) {
+   /* The u_matrix after "O: a", the mc_obs_all context.  "reset" is an
+      error there. */
+   int first, last, j, obs;
+   REAL_VALUE value;
+
+   indexRange( a, gFastModel->num_actions, &first, &last );
+
+   if( gFastToken == ft_uniform ) {
+      for( a = first; a <= last; a++ )
+         resetRows( &gFastChunk->obs[a], 0, gFastModel->num_states - 1,
+            uniformRowTemplate( &gFastChunk->obs[a].templates,
+                                gFastModel->num_observations ));
+      nextToken();
+      return( 1 );
+   }
+
+   for( j = 0; j < gFastModel->num_states; j++ )
+      for( obs = 0; obs < gFastModel->num_observations; obs++ ) {
+         if( ! parseProb( &value, 0 ))
+            return( 0 );
+         for( a = first; a <= last; a++ )
+            addTriple( &gFastChunk->obs[a], j, obs, value );
+      }
+
+   return( ! isNumberToken() );
+}  /* parseObsMatrix */
+/**********************************************************************/
+static int parseObsRow( int a, int j ) {
+   /* The u_matrix after "O: a : j", the mc_obs_row context.  "reset"
+      is an error there. */
+   int first_a, last_a, first_j, last_j, obs;
+   REAL_VALUE value;
+
+   indexRange( a, gFastModel->num_actions, &first_a, &last_a );
+   indexRange( j, gFastModel->num_states, &first_j, &last_j );
+
+   if( gFastToken == ft_uniform ) {
+      for( a = first_a; a <= last_a; a++ )
+         resetRows( &gFastChunk->obs[a], first_j, last_j,
+            uniformRowTemplate( &gFastChunk->obs[a].templates,
+                                gFastModel->num_observations ));
+      nextToken();
+      return( 1 );
+   }
+
+   for( obs = 0; obs < gFastModel->num_observations; obs++ ) {
+      if( ! parseProb( &value, 0 ))
+         return( 0 );
+      for( a = first_a; a <= last_a; a++ )
+         for( j = first_j; j <= last_j; j++ )
+            addTriple( &gFastChunk->obs[a], j, obs, value );
+   }
+
+   return( ! isNumberToken() );
+}  /* parseObsRow */
+/**********************************************************************/
+static int parseObsSpec() {
+   int a, j, obs;
+   int first_a, last_a, first_j, last_j, first_obs, last_obs;
+   REAL_VALUE value;
+
+   /* Observations in an MDP are an error */
+   if( gFastModel->problem_type != POMDP_problem_type )
+      return( 0 );
+
+   nextToken();
+   if( ! expectColon() || ! parseIndex( gFastModel->num_actions, &a ))
+      return( 0 );
+
+   if( gFastToken != ft_colon )
+      return( parseObsMatrix( a ));
+
+   nextToken();
+   if( ! parseIndex( gFastModel->num_states, &j ))
+      return( 0 );
+
+   if( gFastToken != ft_colon )
+      return( parseObsRow( a, j ));
+
+   nextToken();
+   if( ! parseIndex( gFastModel->num_observations, &obs ) || ! parseProb( &value, 0 ))
+      return( 0 );
+
+   /* mc_obs_single */
+   indexRange( a, gFastModel->num_actions, &first_a, &last_a );
+   indexRange( j, gFastModel->num_states, &first_j, &last_j );
+   indexRange( obs, gFastModel->num_observations, &first_obs, &last_obs );
+
+   for( a = first_a; a <= last_a; a++ )
+      setEntries( &gFastChunk->obs[a], first_j, last_j, first_obs, last_obs,
+                  gFastModel->num_observations, value );
+
+   return( 1 );
+}  /* parseObsSpec */
+/**********************************************************************/
+static void beginReward( Matrix_Context matrix_context, int a, int i, int j,
+                         int obs ) {
+   /* Records the setMatrixContext() call of an R: statement */
+   Fast_Chunk *chunk = gFastChunk;
+   int *record;
+
+   if( chunk->num_rewards == chunk->max_rewards ) {
+      chunk->max_rewards = ( chunk->max_rewards < 64 )
+         ? 64 : 2 * chunk->max_rewards;
+      chunk->rewards = (int *) realloc( chunk->rewards,
+         chunk->max_rewards * FAST_REWARD_FIELDS * sizeof( int ));
+      checkAllocatedPointer((void *) chunk->rewards );
+   }
+
+   record = chunk->rewards + chunk->num_rewards * FAST_REWARD_FIELDS;
+   record[0] = matrix_context;
+   record[1] = a;
+   record[2] = i;
+   record[3] = j;
+   record[4] = obs;
+   record[5] = 0;
+
+   chunk->num_rewards++;
+}  /* beginReward */
+/**********************************************************************/
+static void addRewardValue( REAL_VALUE value ) {
+   /* Records an enterMatrix() call of the current R: statement */
+   Fast_Chunk *chunk = gFastChunk;
+
+   if( chunk->num_reward_values == chunk->max_reward_values ) {
+      chunk->max_reward_values = ( chunk->max_reward_values < 64 )
+         ? 64 : 2 * chunk->max_reward_values;
+      chunk->reward_values = (REAL_VALUE *) realloc( chunk->reward_values,
+         chunk->max_reward_values * sizeof( REAL_VALUE ));
+      checkAllocatedPointer((void *) chunk->reward_values );
+   }
+
+   chunk->reward_values[chunk->num_reward_values++] = value;
+   chunk->rewards[( chunk->num_rewards - 1 ) * FAST_REWARD_FIELDS + 5]++;
+}  /* addRewardValue */
+/**********************************************************************/
+static int parseNumMatrix() {
+   REAL_VALUE value;
+
+   do {
+      if( ! parseNumber( &value ))
+         return( 0 );
+      addRewardValue( value );
+   } while( isNumberToken()
+            || ( gFastToken == ft_minus ) || ( gFastToken == ft_plus ));
+
+   return( 1 );
+}  /* parseNumMatrix */
+/**********************************************************************/
+static int parseRewardSpec() {
+   int a, i, j, obs;
+   REAL_VALUE value;
+
+   nextToken();
+   if( ! expectColon() || ! parseIndex( gFastModel->num_actions, &a ))
+      return( 0 );
+
+   if( gFastToken != ft_colon ) {
+      beginReward( mc_reward_mdp_only, a, 0, 0, 0 );
+   }
+   else {
+      nextToken();
+      if( ! parseIndex( gFastModel->num_states, &i ))
+         return( 0 );
+
+      if( gFastToken != ft_colon ) {
+         beginReward( mc_reward_all, a, i, 0, 0 );
+      }
+      else {
+         nextToken();
+         if( ! parseIndex( gFastModel->num_states, &j ))
+            return( 0 );
+
+         if( gFastToken != ft_colon ) {
+            beginReward( mc_reward_row, a, i, j, 0 );
+         }
+         else {
+            nextToken();
+            if( ! parseIndex( gFastModel->num_observations, &obs ))
+               return( 0 );
+
+            beginReward( mc_reward_single, a, i, j, obs );
+            if( ! parseNumber( &value ))
+               return( 0 );
+            addRewardValue( value );
+            return( 1 );
+         }
+      }
+   }
+
+   return( parseNumMatrix() );
+}  /* parseRewardSpec */
+/**********************************************************************/
+static int parseStatements() {
+   /* The T:, O: and R: statements of the current chunk */
+
+   for(;;) {
+      switch( gFastToken ) {
+      case ft_trans:
+         if( ! parseTransSpec() )
+            return( 0 );
+         break;
+      case ft_obs:
+         if( ! parseObsSpec() )
+            return( 0 );
+         break;
+      case ft_reward_spec:
+         if( ! parseRewardSpec() )
+            return( 0 );
+         break;
+      case ft_eof:
+         return( 1 );
+      default:
+         return( 0 );
+      }  /* switch */
+   }  /* for */
+
+}  /* parseStatements */
+/**********************************************************************/
+static void initChunk( Fast_Chunk *chunk, const MDP_Model *model ) {
+   int a;
+
+   memset( chunk, 0, sizeof( *chunk ));
+
+   chunk->trans = (Fast_Triples *) calloc( model->num_actions, sizeof( Fast_Triples ));
+   checkAllocatedPointer((void *) chunk->trans );
+   for( a = 0; a < model->num_actions; a++ )
+      initRowTemplates( &chunk->trans[a].templates );
+
+   if( model->problem_type == POMDP_problem_type ) {
+      chunk->obs = (Fast_Triples *)
+         calloc( model->num_actions, sizeof( Fast_Triples ));
+      checkAllocatedPointer((void *) chunk->obs );
+      for( a = 0; a < model->num_actions; a++ )
+         initRowTemplates( &chunk->obs[a].templates );
+   }
+}  /* initChunk */
+/**********************************************************************/
+static void freeTriples( Fast_Triples *triples, int num_actions ) {
+   int a;
+
+   if( triples == NULL )
+      return;
+
+   for( a = 0; a < num_actions; a++ ) {
+      free( triples[a].row );
+      free( triples[a].col );
+      free( triples[a].value );
+      free( triples[a].op );
+      freeRowTemplates( &triples[a].templates );
+   }
+
+   free( triples );
+}  /* freeTriples */
+/**********************************************************************/
+static void freeChunk( Fast_Chunk *chunk, const MDP_Model *model ) {
+
+   freeTriples( chunk->trans, model->num_actions );
+   freeTriples( chunk->obs, model->num_actions );
+   free( chunk->rewards );
+   free( chunk->reward_values );
+   free( chunk->row_values );
+
+}  /* freeChunk */
+/**********************************************************************/
+static int parseChunk( Fast_Chunk *chunk, const MDP_Model *model,
+                       char *begin, char *end, char *limit ) {
+   /* Can run on any thread; only reads the model sizes and start
+      state, and writes nothing but the chunk. */
+
+   gFastChunk = chunk;
+   gFastModel = model;
+   gFastPos = begin;
+   gFastEnd = end;
+   gFastLimit = limit;
+
+   nextToken();
+   return( parseStatements() );
+}  /* parseChunk */
+/**********************************************************************/
+static void mergeTriples( I_Matrix i_matrix, Fast_Triples *triples ) {
+   /*
+   Appends the triples of one matrix, after moving the chunk's row
+   templates over and renumbering the resets that use them, and
+   empties them.
+   */
+   int base, n;
+
+   if( triples->templates.num_rows > 0 ) {
+      base = appendRowTemplates( &i_matrix->templates, &triples->templates );
+      for( n = 0; n < triples->num_entries; n++ )
+         if(( triples->op[n] == I_MATRIX_OP_RESET_ROW )
+            && ( triples->col[n] != I_MATRIX_EMPTY_ROW ))
+            triples->col[n] += base;
+      clearRowTemplates( &triples->templates );
+   }
+
+   appendEntriesToIMatrix( i_matrix, triples->num_entries, triples->row,
+                           triples->col, triples->value, triples->op );
+   triples->num_entries = 0;
+   triples->num_compacted = 0;
+}  /* mergeTriples */
+/**********************************************************************/
+static void mergeChunk( MDP_Parse_Context *context, Fast_Chunk *chunk ) {
+   /*
+   Adds a parsed chunk to the model and empties it.  Chunks must be
+   merged in file order.  Triples only ever meet triples of the same
+   matrix and R: statements only other R: statements, so each can go
+   in as a block.
+   */
+   int a, r, k, v = 0;
+   int *record;
+
+   for( a = 0; a < context->model.num_actions; a++ )
+      mergeTriples( context->IP[a], &chunk->trans[a] );
+
+   if( chunk->obs != NULL )
+      for( a = 0; a < context->model.num_actions; a++ )
+         mergeTriples( context->IR[a], &chunk->obs[a] );
+
+   for( r = 0; r < chunk->num_rewards; r++ ) {
+      record = chunk->rewards + r * FAST_REWARD_FIELDS;
+      setMatrixContext( context, (Matrix_Context) record[0],
+                        record[1], record[2], record[3], record[4] );
+      for( k = 0; k < record[5]; k++ )
+         enterMatrix( context, chunk->reward_values[v++] );
+      checkMatrix( context );
+   }
+
+   chunk->num_rewards = 0;
+   chunk->num_reward_values = 0;
+}  /* mergeChunk */
+/**********************************************************************/
+static char *nextStatement( char *p, char *end ) {
+   /*
+   Finds the first line after p that starts with a T:, O: or R:
+   statement.  Nothing else in the subset starts with those letters,
+   so a chunk that starts there parses just as it would as part of
+   the whole file.  Returns end if there is none.
+   */
+   while(( p = (char *) memchr( p, '\n', end - p )) != NULL ) {
+
+      p++;
+      while(( p < end ) && (( *p == ' ' ) || ( *p == '\t' )))
+         p++;
+
+      if(( p + 1 < end )
+         && (( *p == 'T' ) || ( *p == 'O' ) || ( *p == 'R' ))
+         && isDelimiter( p[1] ) && ( p[1] != '\0' ))
+         return( p );
+   }  /* while */
+
+   return( end );
+}  /* nextStatement */
+/**********************************************************************/
+static void releaseText( MDP_Parse_Context *context, char *begin,
+                         char *end ) {
+   /*
+   Drops the pages that lie wholly between begin and end, once the
+   chunk there has been merged.  The text of a large model is otherwise
+   the biggest thing in memory at the end of the parse.  The grammar
+   may still go over the buffer if a later chunk fails, and the pages
+   are then read back from the file.
+   */
+#ifndef _MSC_VER
+   uintptr_t page_size, first, last;
+
+   if( ! context->file_backed )
+      return;
+
+   page_size = (uintptr_t) sysconf( _SC_PAGESIZE );
+   first = ( (uintptr_t) begin + page_size - 1 ) / page_size * page_size;
+   last = (uintptr_t) end / page_size * page_size;
+
+   if( first < last )
+      madvise( (void *) first, last - first, MADV_DONTNEED );
+#endif
+}  /* releaseText */
+/**********************************************************************/
+static int parseChunksSerially( MDP_Parse_Context *context, char **bounds,
+                                int num_chunks ) {
+   Fast_Chunk chunk;
+   int k, result = 1;
+
+   initChunk( &chunk, &context->model );
+
+   for( k = 0; k < num_chunks; k++ ) {
+      if( ! parseChunk( &chunk, &context->model, bounds[k], bounds[k+1],
+                        gFastLimit )) {
+         result = 0;
+         break;
+      }
+      mergeChunk( context, &chunk );
+      releaseText( context, bounds[k], bounds[k+1] );
+   }
+
+   freeChunk( &chunk, &context->model );
+
+   return( result );
+}  /* parseChunksSerially */
+/**********************************************************************/
+#if FAST_PARALLEL
+
+/* Shared by the threads of a parallel parse.  Chunk k is parsed into
+   slot k % num_slots, once chunk k - num_slots has been merged. */
+typedef struct {
+   const MDP_Model *model;
+   char **bounds;
+   char *limit;
+   int num_chunks;
+   Fast_Chunk *slots;
+   int num_slots;
+   int *status;                 /* per chunk: 0 pending, 1 parsed,
+                                   -1 failed */
+   int next_chunk;
+   int num_merged;
+   int failed;
+   pthread_mutex_t lock;
+   pthread_cond_t changed;
+} Fast_Work;
+
+/**********************************************************************/
+static void *parseWorker( void *argument ) {
+   Fast_Work *work = (Fast_Work *) argument;
+   int k, result;
+
+   pthread_mutex_lock( &work->lock );
+
+   for(;;) {
+
+      while( ! work->failed
+             && ( work->next_chunk < work->num_chunks )
+             && ( work->next_chunk >= work->num_merged + work->num_slots ))
+         pthread_cond_wait( &work->changed, &work->lock );
+
+      if( work->failed || ( work->next_chunk >= work->num_chunks ))
+         break;
+
+      k = work->next_chunk++;
+      pthread_mutex_unlock( &work->lock );
+
+      result = parseChunk( &work->slots[k % work->num_slots], work->model,
+                           work->bounds[k], work->bounds[k+1], work->limit );
+
+      pthread_mutex_lock( &work->lock );
+      work->status[k] = result ? 1 : -1;
+      if( ! result )
+         work->failed = 1;
+      pthread_cond_broadcast( &work->changed );
+   }  /* for */
+
+   pthread_mutex_unlock( &work->lock );
+
+   return( NULL );
+}  /* parseWorker */
+/**********************************************************************/
+static int parseChunksInParallel( MDP_Parse_Context *context, char **bounds,
+                                  int num_chunks, int num_threads ) {
+   /*
+   Worker threads parse the chunks while this thread merges them in
+   order.  Returns -1 if no thread could be started.
+   */
+   Fast_Work work;
+   pthread_t *threads;
+   int k, t, num_started, status;
+
+   work.model = &context->model;
+   work.bounds = bounds;
+   work.limit = gFastLimit;
+   work.num_chunks = num_chunks;
+   work.num_slots = FAST_CHUNKS_PER_THREAD * num_threads;
+   work.next_chunk = 0;
+   work.num_merged = 0;
+   work.failed = 0;
+   pthread_mutex_init( &work.lock, NULL );
+   pthread_cond_init( &work.changed, NULL );
+
+   work.slots = (Fast_Chunk *) malloc( work.num_slots * sizeof( Fast_Chunk ));
+   checkAllocatedPointer((void *) work.slots );
+   for( k = 0; k < work.num_slots; k++ )
+      initChunk( &work.slots[k], &context->model );
+
+   work.status = (int *) calloc( num_chunks, sizeof( int ));
+   checkAllocatedPointer((void *) work.status );
+
+   threads = (pthread_t *) malloc( num_threads * sizeof( pthread_t ));
+   checkAllocatedPointer((void *) threads );
+
+   for( num_started = 0; num_started < num_threads; num_started++ )
+      if( pthread_create( &threads[num_started], NULL, parseWorker, &work ) != 0 )
+         break;
+
+   k = 0;
+   if( num_started > 0 )
+      for( ; k < num_chunks; k++ ) {
+
+         pthread_mutex_lock( &work.lock );
+         while(( work.status[k] == 0 ) && ! work.failed )
+            pthread_cond_wait( &work.changed, &work.lock );
+         status = work.status[k];
+         pthread_mutex_unlock( &work.lock );
+
+         if( status != 1 )
+            break;
+
+         mergeChunk( context, &work.slots[k % work.num_slots] );
+         releaseText( context, bounds[k], bounds[k+1] );
+
+         pthread_mutex_lock( &work.lock );
+         work.num_merged = k + 1;
+         pthread_cond_broadcast( &work.changed );
+         pthread_mutex_unlock( &work.lock );
+      }  /* for k */
+
+   /* Stops the workers early if a chunk failed */
+   pthread_mutex_lock( &work.lock );
+   if( k < num_chunks )
+      work.failed = 1;
+   pthread_cond_broadcast( &work.changed );
+   pthread_mutex_unlock( &work.lock );
+
+   for( t = 0; t < num_started; t++ )
+      pthread_join( threads[t], NULL );
+
+   for( k = 0; k < work.num_slots; k++ )
+      freeChunk( &work.slots[k], &context->model );
+   free( work.slots );
+   free( work.status );
+   free( threads );
+
+   pthread_mutex_destroy( &work.lock );
+   pthread_cond_destroy( &work.changed );
+
+   if( num_started == 0 )
+      return( -1 );
+
+   return( ! work.failed );
+}  /* parseChunksInParallel */
+#endif
+/**********************************************************************/
+static int parseBody( MDP_Parse_Context *context ) {
+   /*
+   Parses the statements after the start state, starting with the
+   current token.
+   */
+   char **bounds = NULL;
+   char *p = gFastTokenStart;
+   char *end = gFastEnd;
+   int num_chunks = 0, max_chunks = 0, num_threads = 1, result;
+
+   if( gFastToken == ft_eof )
+      return( 1 );
+
+   /* bounds[k] and bounds[k+1] enclose chunk k */
+   for(;;) {
+      if( num_chunks + 1 >= max_chunks ) {
+         max_chunks = ( max_chunks < 64 ) ? 64 : 2 * max_chunks;
+         bounds = (char **) realloc( bounds, max_chunks * sizeof( char * ));
+         checkAllocatedPointer((void *) bounds );
+      }
+
+      bounds[num_chunks] = p;
+      if( p >= end )
+         break;
+
+      num_chunks++;
+      p = ( end - p > FAST_CHUNK_SIZE )
+         ? nextStatement( p + FAST_CHUNK_SIZE, end ) : end;
+   }  /* for */
+
+#if FAST_PARALLEL
+   num_threads = context->num_threads;
+   if( num_threads <= 0 )
+      num_threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+   if( num_threads > num_chunks )
+      num_threads = num_chunks;
+#endif
+
+   result = -1;
+#if FAST_PARALLEL
+   if( num_threads > 1 )
+      result = parseChunksInParallel( context, bounds, num_chunks,
+                                      num_threads );
+#endif
+   if( result < 0 )
+      result = parseChunksSerially( context, bounds, num_chunks );
+
+   free( bounds );
+
+   return( result );
+}  /* parseBody */
+/**********************************************************************/
+static int parsePreamble( MDP_Parse_Context *context ) {
+   MDP_Model *model = &context->model;
+
+   for(;;) {
+      switch( gFastToken ) {
+      case ft_discount:
+         nextToken();
+         if( ! expectColon() || ! parseNumber( &model->discount ))
+            return( 0 );
+         if(( model->discount < 0.0 ) || ( model->discount > 1.0 ))
+            return( 0 );
+         context->discount_defined = 1;
+         break;
+
+      case ft_values:
+         nextToken();
+         if( ! expectColon() )
+            return( 0 );
+         if( gFastToken == ft_reward )
+            model->value_type = REWARD_value_type;
+         else if( gFastToken == ft_cost )
+            model->value_type = COST_value_type;
+         else
+            return( 0 );
+         nextToken();
+         context->values_defined = 1;
+         break;
+
+      case ft_states:
+         nextToken();
+         if( ! expectColon() || ! parseCount( &model->num_states ))
+            return( 0 );
+         context->states_defined = 1;
+         break;
+
+      case ft_actions:
+         nextToken();
+         if( ! expectColon() || ! parseCount( &model->num_actions ))
+            return( 0 );
+         context->actions_defined = 1;
+         break;
+
+      case ft_observations:
+         nextToken();
+         if( ! expectColon() || ! parseCount( &model->num_observations ))
+            return( 0 );
+         context->observations_defined = 1;
+         break;
+
+      default:
+         return( 1 );
+      }  /* switch */
+   }  /* for */
+
+}  /* parsePreamble */
+/**********************************************************************/
+static int parseStartState( MDP_Parse_Context *context ) {
+   /* Only the "start: u_matrix" form, through the action routines */
+   int mdp_start = ( context->model.problem_type != POMDP_problem_type );
+   REAL_VALUE value;
+
+   nextToken();
+   if( ! expectColon() )
+      return( 0 );
+
+   if( mdp_start )
+      setMatrixContext( context, mc_mdp_start, 0, 0, 0, 0 );
+   else
+      setMatrixContext( context, mc_start_belief, 0, 0, 0, 0 );
+
+   switch( gFastToken ) {
+   case ft_uniform:
+      enterUniformMatrix( context );
+      break;
+   case ft_reset:
+      enterResetMatrix( context );
+      break;
+   default:
+      if( ! isNumberToken() )
+         return( 0 );
+
+      while( isNumberToken() ) {
+         if( ! parseProb( &value, mdp_start ))
+            return( 0 );
+         enterMatrix( context, value );
+      }
+
+      checkMatrix( context );
+      return( 1 );
+   }  /* switch */
+
+   nextToken();
+   return( 1 );
+}  /* parseStartState */
+/**********************************************************************/
+static int parseFile( MDP_Parse_Context *context, int *allocated ) {
+   /* pomdp_file from pomdp_spec.y */
+
+   nextToken();
+
+   if( ! parsePreamble( context ) )
+      return( 0 );
+
+   verifyPreamble( context );
+   if( context->num_errors > 0 )
+      return( 0 );
+
+   allocateIntermediateMDP( context );
+   *allocated = 1;
+
+   /* start_state from pomdp_spec.y, which is uniform when left out */
+   if( gFastToken == ft_start ) {
+      if( ! parseStartState( context ) )
+         return( 0 );
+   }
+   else
+      setStartStateUniform( context );
+
+   endStartStates( context );
+
+   if( ! parseBody( context ) )
+      return( 0 );
+
+   checkProbs( context );
+   return( context->num_errors == 0 );
+
+}  /* parseFile */
+/**********************************************************************/
+int fastParseMDP( MDP_Parse_Context *context, char *buffer, size_t size ) {
+   /*
+   Parses a buffer laid out as for readMDPBuffer(), i.e. ending with two
+   NUL bytes, into a context set up by initParser(), and converts the
+   result into the final representation.  Returns 1 on success.
+   Returns 0 if the file has to be read by the grammar instead, in which
+   case nothing is left allocated.
+   */
+   int allocated = 0;
+
+   gFastPos = buffer;
+   gFastEnd = buffer + size - 2;
+   gFastLimit = buffer + size;
+
+   if( ! parseFile( context, &allocated )) {
+
+      if( allocated ) {
+         deallocateIntermediateMDP( context );
+         destroyImmRewards( &context->rewards );
+      }
+
+      return( 0 );
+   }
+
+   convertMatrices( context );
+
+   return( 1 );
+}  /* fastParseMDP */
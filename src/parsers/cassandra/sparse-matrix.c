@@ -29,183 +29,173 @@ manipulating a sparse representation of a matrix.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include "sparse-matrix.h"
 
+/* row_template[] value of a row that has not been reset */
+#define NO_ROW_TEMPLATE           -2
+
+/**********************************************************************/
+/********************  Routines for row templates    ******************/
 /**********************************************************************/
-/********************  Routines for row linked lists  *****************/
+void initRowTemplates( Row_Templates *templates ) {
+
+	memset( templates, 0, sizeof( *templates ));
+	templates->uniform = -1;
+
+}  /* initRowTemplates */
 /**********************************************************************/
-I_Matrix_Row_Node newRowNode( int col, REAL_VALUE value ) {
+void clearRowTemplates( Row_Templates *templates ) {
 	/*
-	Just allocates memory and sets the fields.
+	Forgets all templates, but keeps the memory for new ones.
 	*/
-	I_Matrix_Row_Node new_node;
-
-	new_node = (I_Matrix_Row_Node ) malloc( sizeof( *new_node ));
-	checkAllocatedPointer(new_node);
-
-	new_node->column = col;
-	new_node->value = value;
-	new_node->next = NULL;
-
-	return( new_node );
-
-}  /* newRowNode */
-/**********************************************************************/
-void destroyRow( I_Matrix_Row_Node row ) {
-	I_Matrix_Row_Node temp;
-
-	while( row != NULL ) {
-		temp = row;
-		row = row->next;
-		free( temp );
-	} /* while */
-}  /* destroyRow */
-/**********************************************************************/
-I_Matrix_Row_Node removeRowNode( I_Matrix_Row_Node row, 
-								int col, int *count ) {
-									/*
-									Remove the node with column == col, if it exists.  It decrements
-									the count if it is removed.  If there is no entry for this in the
-									list then we simply igore it and return the original list.
-									*/
-									I_Matrix_Row_Node temp_node, cur_node, trail_node;
-
-									/* Case if list is empty */
-									if( row == NULL )
-										return( NULL );
-
-									/* Case of removing first item in the list */
-									if( row->column == col ) {
-										temp_node = row;
-										row = row->next;
-										free( temp_node );
-										(*count)--;
-										return( row );
-									}  /* if we should remove first node */
-
-									trail_node = row;
-									cur_node = row->next;
-									while( cur_node != NULL ) {
-
-										/* Then bingo!  We found the one to remove */
-										if( cur_node->column == col ) {
-											trail_node->next = cur_node->next;
-											free( cur_node );
-											(*count)--;
-											return( row );
-										}  /* if we found the one to remove */
-
-										trail_node = cur_node;
-										cur_node = cur_node->next;
-									}  /* while */
-
-									/* Otherwise we did not find an entry with this column, so just */
-									/* return the list and do nothing. */
-									return( row );
-
-}  /* removeRowNode */
-/**********************************************************************/
-I_Matrix_Row_Node addEntryToRow( I_Matrix_Row_Node row, 
-								int col, REAL_VALUE value,
-								int *count, int accumulate ) {
-									/*
-									Will step through the linked list until either the column is found
-									or until we see a strictly smaller column number.  It will either
-									replace the current value (if the column already exists) or insert a
-									new node into the list just before the first column number that is
-									highest.  This way, the list always remains sorted by column
-									number.  The pointer to the int 'count' will be incremented only if
-									we add it to the list, not when we simply replace a value.  *count 
-									should be the length of the list sent in, but this routine does not
-									check to make sure it is.
-
-									The accumulate flag will specify whether we should replace the 
-									current value (if any) or add the value to the existing value.
-									This can be used to build up probabilities in a matrix piecemeal.
-									*/
-									I_Matrix_Row_Node new_node, cur_node, trail_node;
-									trail_node = 0; // avoid warning
-
-									/* Case if we attempt to add a zero entry.  We need to see if there */
-									/* is already a non-zero entry for it in the list, and if so remove */
-									/* it.  Otherwise we simply ignore this entry request, since we are */
-									/* using a sparse representation. */
-									if( IS_ZERO( value ) ) {
-										if ( accumulate )
-											return ( row );
-										else
-											return( removeRowNode( row, col, count ));
-									}
-
-									/* Case if the list is empty */
-									if( row == NULL ) {
-										new_node = newRowNode( col, value );
-										(*count)++;
-										return( new_node );
-									}  /* if row empty */
-
-									/* Case if it should be inserted into front of list */
-									if( row->column > col ) {
-										new_node = newRowNode( col, value );
-										new_node->next = row;
-										(*count)++;
-										return( new_node );
-									}  /* if should be inserted in front of list */
-
-									cur_node = row;
-									while( cur_node != NULL ) {
-
-										/* Case if we should simply replace (or accumulate) 
-										the current value */
-										if( cur_node->column == col ) {
-
-											if( accumulate )
-												cur_node->value += value;
-											else
-												cur_node->value = value;
-
-											return( row );
-										} /* if we should just replace value */
-
-										/* Case if this is the point we should insert it (i.e. between */
-										/* trail_node and cur_node */
-										if( cur_node->column > col ) {
-											new_node = newRowNode( col, value );
-											trail_node->next = new_node;
-											new_node->next = cur_node;
-											(*count)++;
-											return( row );
-										}  /* if we have found place to insert it */
-
-										trail_node = cur_node;
-										cur_node = cur_node->next;
-									}  /* while */
-
-									/* Case if it should be inserted at the end of the list.  This */
-									/* should be the only case where we exit the bottom of the loop, all */
-									/* other cases should exit the routine from within the loop */
-
-									new_node = newRowNode( col, value );
-									trail_node->next = new_node;
-									(*count)++;
-									return( row );
-
-}  /* addEntryToRow */
-/**********************************************************************/
-void displayRow( I_Matrix_Row_Node row ) {
-
-	if( row == NULL )
-		printf( "<empty>");
-
-	while( row != NULL ) {
-		printf("[%d] %.3f ", row->column, row->value );
-		row = row->next;
-	}  /* while */
+	templates->num_rows = 0;
+	templates->num_entries = 0;
+	templates->uniform = -1;
+
+}  /* clearRowTemplates */
+/**********************************************************************/
+void freeRowTemplates( Row_Templates *templates ) {
+
+	free( templates->start );
+	free( templates->length );
+	free( templates->sum );
+	free( templates->col );
+	free( templates->value );
+
+	initRowTemplates( templates );
+
+}  /* freeRowTemplates */
+/**********************************************************************/
+static int newRowTemplate( Row_Templates *templates, int max_length ) {
+	/*
+	Adds an empty template with room for max_length entries and
+	returns its number.
+	*/
+	int t, n;
+
+	if( templates->num_rows == templates->max_rows ) {
+		n = ( templates->max_rows < 16 ) ? 16 : 2 * templates->max_rows;
+		templates->start = (int *) 
+			realloc( templates->start, n * sizeof( int ));
+		checkAllocatedPointer(templates->start);
+		templates->length = (int *) 
+			realloc( templates->length, n * sizeof( int ));
+		checkAllocatedPointer(templates->length);
+		templates->sum = (REAL_VALUE *) 
+			realloc( templates->sum, n * sizeof( REAL_VALUE ));
+		checkAllocatedPointer(templates->sum);
+		templates->max_rows = n;
+	}
+
+	if( (long long) templates->num_entries + max_length > templates->max_entries ) {
+		n = growEntryCapacity( templates->max_entries, 
+			(long long) templates->num_entries + max_length );
+		templates->col = (int *) 
+			realloc( templates->col, n * sizeof( int ));
+		checkAllocatedPointer(templates->col);
+		templates->value = (REAL_VALUE *) 
+			realloc( templates->value, n * sizeof( REAL_VALUE ));
+		checkAllocatedPointer(templates->value);
+		templates->max_entries = n;
+	}
+
+	t = templates->num_rows++;
+	templates->start[t] = templates->num_entries;
+	templates->length[t] = 0;
+	templates->sum[t] = 0.0;
+
+	return( t );
+}  /* newRowTemplate */
+/**********************************************************************/
+int addRowTemplate( Row_Templates *templates, int num_cols, 
+				   REAL_VALUE *value ) {
+	/*
+	Adds a template for a row with the num_cols values given.  Values
+	that are zero are left out, as addEntryToIMatrix() would.  Returns
+	the number of the template.
+	*/
+	int t, col, k;
+
+	t = newRowTemplate( templates, num_cols );
+
+	k = templates->num_entries;
+	for( col = 0; col < num_cols; col++ )
+		if( ! IS_ZERO( value[col] )) {
+			templates->col[k] = col;
+			templates->value[k] = value[col];
+			templates->sum[t] += value[col];
+			k++;
+		}
+
+	templates->length[t] = k - templates->start[t];
+	templates->num_entries = k;
+
+	return( t );
+}  /* addRowTemplate */
+/**********************************************************************/
+int uniformRowTemplate( Row_Templates *templates, int num_cols ) {
+	/*
+	Returns the template with 1/num_cols in every column, adding it
+	the first time it is asked for.
+	*/
+	REAL_VALUE prob;
+	int t, col, k;
+
+	if( templates->uniform >= 0 )
+		return( templates->uniform );
+
+	t = newRowTemplate( templates, num_cols );
+
+	prob = 1.0/num_cols;
+	k = templates->num_entries;
+	for( col = 0; col < num_cols; col++ ) {
+		templates->col[k] = col;
+		templates->value[k] = prob;
+		templates->sum[t] += prob;
+		k++;
+	}
 
-	printf( "\n");
-}  /* displayRow */
+	templates->length[t] = num_cols;
+	templates->num_entries = k;
+	templates->uniform = t;
+
+	return( t );
+}  /* uniformRowTemplate */
+/**********************************************************************/
+int appendRowTemplates( Row_Templates *templates, Row_Templates *other ) {
+	/*
+	Adds copies of all of other's templates, e.g. ones made by another
+	thread.  Template t of other becomes template t plus the returned
+	number.
+	*/
+	int base, t, n;
+
+	base = templates->num_rows;
+
+	for( t = 0; t < other->num_rows; t++ ) {
+		n = newRowTemplate( templates, other->length[t] );
+
+		memcpy( templates->col + templates->start[n], 
+			other->col + other->start[t], other->length[t] * sizeof( int ));
+		memcpy( templates->value + templates->start[n], 
+			other->value + other->start[t], 
+			other->length[t] * sizeof( REAL_VALUE ));
+
+		templates->length[n] = other->length[t];
+		templates->sum[n] = other->sum[t];
+		templates->num_entries += other->length[t];
+	}  /* for t */
+
+	if(( templates->uniform < 0 ) && ( other->uniform >= 0 ))
+		templates->uniform = base + other->uniform;
+
+	return( base );
+}  /* appendRowTemplates */
 
 /**********************************************************************/
 /********************  Routines for intermediate matrix    ************/
@@ -217,87 +207,564 @@ I_Matrix newIMatrix( int num_rows ) {
 	checkAllocatedPointer(i_matrix);
 
 	i_matrix->num_rows = num_rows;
+	i_matrix->num_entries = 0;
+	i_matrix->max_entries = 0;
+	i_matrix->num_compacted = 0;
 
-	i_matrix->row = (I_Matrix_Row_Node *)
-		calloc( num_rows, sizeof( *(i_matrix->row) ));
+	i_matrix->entry_row = NULL;
+	i_matrix->entry_col = NULL;
+	i_matrix->entry_value = NULL;
+	i_matrix->entry_op = NULL;
 
+	i_matrix->row_start = (int *) calloc( num_rows, sizeof( int ));
 	i_matrix->row_length = (int *) calloc( num_rows, sizeof( int ));
 
+	i_matrix->row_template = NULL;
+	initRowTemplates( &i_matrix->templates );
+
 	return( i_matrix );
 }  /* newIMatrix */
 /**********************************************************************/
 void destroyIMatrix( I_Matrix i_matrix ) {
-	int i;
 
+	free( i_matrix->entry_row );
+	free( i_matrix->entry_col );
+	free( i_matrix->entry_value );
+	free( i_matrix->entry_op );
+
+	free( i_matrix->row_start );
 	free( i_matrix->row_length );
 
-	for( i = 0; i < i_matrix->num_rows; i++ )
-		destroyRow( i_matrix->row[i] );
-	free( i_matrix->row );
+	free( i_matrix->row_template );
+	freeRowTemplates( &i_matrix->templates );
 
 	free( i_matrix );
 
 }  /* destroyIMatrix */
 /**********************************************************************/
+int growEntryCapacity( int max_entries, long long needed ) {
+	/*
+	Capacity of an entry array that must hold needed entries, found by
+	doubling max_entries. Counts and indices of entries are ints, so a
+	model that needs more than INT_MAX of them cannot be read. Stop with
+	an error then, rather than let the doubling overflow.
+	*/
+	long long n;
+
+	if( needed > INT_MAX ) {
+		fprintf( stderr, 
+			"ERROR: Model needs more than %d matrix entries, "
+			"the most the parser can hold.\n", INT_MAX );
+		exit( EXIT_FAILURE );
+	}
+
+	n = ( max_entries < 64 ) ? 64 : max_entries;
+	while( n < needed )
+		n *= 2;
+
+	return( (int) (( n > INT_MAX ) ? INT_MAX : n ));
+}  /* growEntryCapacity */
+/**********************************************************************/
+void resizeIMatrixEntries( I_Matrix i_matrix, int max_entries ) {
+	/*
+	Reallocates the entry arrays to hold max_entries triples.
+	*/
+	i_matrix->entry_row = (int *) 
+		realloc( i_matrix->entry_row, max_entries * sizeof( int ));
+	checkAllocatedPointer(i_matrix->entry_row);
+	i_matrix->entry_col = (int *) 
+		realloc( i_matrix->entry_col, max_entries * sizeof( int ));
+	checkAllocatedPointer(i_matrix->entry_col);
+	i_matrix->entry_value = (REAL_VALUE *) 
+		realloc( i_matrix->entry_value, max_entries * sizeof( REAL_VALUE ));
+	checkAllocatedPointer(i_matrix->entry_value);
+	i_matrix->entry_op = (char *) 
+		realloc( i_matrix->entry_op, max_entries * sizeof( char ));
+	checkAllocatedPointer(i_matrix->entry_op);
+
+	i_matrix->max_entries = max_entries;
+}  /* resizeIMatrixEntries */
+/**********************************************************************/
+static void makeRoomInIMatrix( I_Matrix i_matrix, int num_entries ) {
+	/*
+	Makes room for num_entries more triples.  Zero writes and
+	overwritten entries are only dropped by compaction, so if the log
+	has doubled since it was last compacted it is compacted first,
+	which keeps it within a constant factor of the live entries, and
+	the arrays are grown only if that did not free enough room.  Each
+	compaction is paid for by the triples appended since the last one,
+	so appending stays amortized O(1).
+	*/
+	if(( i_matrix->num_entries >= I_MATRIX_MIN_LOG_TO_COMPACT )
+		&& ( i_matrix->num_entries >= i_matrix->num_rows )
+		&& ( i_matrix->num_entries / 2 >= i_matrix->num_compacted ))
+		compactIMatrix( i_matrix );
+
+	if( (long long) i_matrix->num_entries + num_entries > i_matrix->max_entries )
+		resizeIMatrixEntries( i_matrix, 
+			growEntryCapacity( i_matrix->max_entries, 
+				(long long) i_matrix->num_entries + num_entries ));
+}  /* makeRoomInIMatrix */
+/**********************************************************************/
+void appendEntryToIMatrix( I_Matrix i_matrix, int row, 
+						  int col, REAL_VALUE value, char op ) {
+	/*
+	Appends one triple to the log, doubling the arrays when they are
+	full so that appending is amortized O(1).
+	*/
+	int n;
+
+	if( i_matrix->num_entries == i_matrix->max_entries )
+		makeRoomInIMatrix( i_matrix, 1 );
+
+	n = i_matrix->num_entries;
+	i_matrix->entry_row[n] = row;
+	i_matrix->entry_col[n] = col;
+	i_matrix->entry_value[n] = value;
+	i_matrix->entry_op[n] = op;
+	i_matrix->num_entries++;
+
+}  /* appendEntryToIMatrix */
+/**********************************************************************/
+void appendEntriesToIMatrix( I_Matrix i_matrix, int num_entries, 
+							int *row, int *col, REAL_VALUE *value, 
+							char *op ) {
+	/*
+	Appends a block of triples, e.g. ones collected by another thread,
+	as if they had been appended one at a time.
+	*/
+	if( num_entries <= 0 )
+		return;
+
+	if( (long long) i_matrix->num_entries + num_entries > i_matrix->max_entries )
+		makeRoomInIMatrix( i_matrix, num_entries );
+
+	memcpy( i_matrix->entry_row + i_matrix->num_entries, row, 
+		num_entries * sizeof( int ));
+	memcpy( i_matrix->entry_col + i_matrix->num_entries, col, 
+		num_entries * sizeof( int ));
+	memcpy( i_matrix->entry_value + i_matrix->num_entries, value, 
+		num_entries * sizeof( REAL_VALUE ));
+	memcpy( i_matrix->entry_op + i_matrix->num_entries, op, 
+		num_entries * sizeof( char ));
+
+	i_matrix->num_entries += num_entries;
+
+}  /* appendEntriesToIMatrix */
+/**********************************************************************/
 int addEntryToIMatrix( I_Matrix i_matrix, int row, 
 					  int col, REAL_VALUE value ) {
+	/*
+	Replaces the value at this row and column.  As with the sparse
+	representation, setting an entry to zero removes it.
+	*/
+	assert(( i_matrix != NULL) 
+		&& (row >=0) && ( row < i_matrix->num_rows ));
 
-						  assert(( i_matrix != NULL) 
-							  && (row >=0) && ( row < i_matrix->num_rows ));
-
-						  i_matrix->row[row] = addEntryToRow( i_matrix->row[row], col, value, 
-							  &(i_matrix->row_length[row]), 0 );
+	if( IS_ZERO( value ) )
+		appendEntryToIMatrix( i_matrix, row, col, 0.0, I_MATRIX_OP_REMOVE );
+	else
+		appendEntryToIMatrix( i_matrix, row, col, value, I_MATRIX_OP_SET );
 
-						  return( 1 );
+	return( 1 );
 }  /* addEntryToIMatrix */
 /**********************************************************************/
 int accumulateEntryInIMatrix( I_Matrix i_matrix, int row, 
 							 int col, REAL_VALUE value ) {
-								 /*
-								 This routine is the same as addEntryToIMatrix() except it will call 
-								 the addEntryToRow() routine with the accumulate flag set.  Thus, if
-								 there is a value already at this row and column, the new value will 
-								 be the sum of the old and the new value.
-								 */
-								 assert(( i_matrix != NULL) 
-									 && (row >=0) && ( row < i_matrix->num_rows ));
-
-								 i_matrix->row[row] = addEntryToRow( i_matrix->row[row], col, value, 
-									 &(i_matrix->row_length[row]), 1 );
-
-								 return( 1 );
-}  /* addEntryToIMatrix */
+	/*
+	This routine is the same as addEntryToIMatrix() except that if
+	there is a value already at this row and column, the new value will 
+	be the sum of the old and the new value.  Accumulating zero is
+	ignored.
+	*/
+	assert(( i_matrix != NULL) 
+		&& (row >=0) && ( row < i_matrix->num_rows ));
+
+	if( ! IS_ZERO( value ) )
+		appendEntryToIMatrix( i_matrix, row, col, value, 
+			I_MATRIX_OP_ACCUMULATE );
+
+	return( 1 );
+}  /* accumulateEntryInIMatrix */
+/**********************************************************************/
+int resetRowInIMatrix( I_Matrix i_matrix, int row, int row_template ) {
+	/*
+	Replaces the whole row by one of the matrix's templates, or
+	empties it for I_MATRIX_EMPTY_ROW.  Entries added afterwards
+	change the row as usual.
+	*/
+	assert(( i_matrix != NULL) 
+		&& (row >=0) && ( row < i_matrix->num_rows )
+		&& ( row_template >= I_MATRIX_EMPTY_ROW )
+		&& ( row_template < i_matrix->templates.num_rows ));
+
+	appendEntryToIMatrix( i_matrix, row, row_template, 0.0, 
+		I_MATRIX_OP_RESET_ROW );
+
+	return( 1 );
+}  /* resetRowInIMatrix */
+/**********************************************************************/
+static int compareEntryKeys( const void *a, const void *b ) {
+	/*
+	Orders the sort keys built by compactIMatrix(), which hold the
+	column of an entry in the high and its position in the log in the
+	low 32 bits, so entries are ordered by column and later triples
+	are applied after earlier ones.  Keeping both in the key lets the
+	comparison work without any state outside the arguments.
+	*/
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return(( x < y ) ? -1 : ( x > y ));
+}  /* compareEntryKeys */
+/**********************************************************************/
+static void applyRowResets( I_Matrix i_matrix ) {
+	/*
+	Records the template of the last reset of each row among the
+	triples added since the last compaction, and removes the resets,
+	and every triple logged for the same row before them, from the
+	log.  The triples that are left keep their order.
+	*/
+	int *last_reset;
+	int row, i, k, n;
+
+	n = i_matrix->num_entries;
+
+	if( i_matrix->row_template == NULL ) {
+		i_matrix->row_template = (int *) 
+			malloc( i_matrix->num_rows * sizeof( int ));
+		checkAllocatedPointer(i_matrix->row_template);
+		for( row = 0; row < i_matrix->num_rows; row++ )
+			i_matrix->row_template[row] = NO_ROW_TEMPLATE;
+	}
+
+	last_reset = (int *) malloc( i_matrix->num_rows * sizeof( int ));
+	checkAllocatedPointer(last_reset);
+	for( row = 0; row < i_matrix->num_rows; row++ )
+		last_reset[row] = -1;
+
+	for( i = i_matrix->num_compacted; i < n; i++ )
+		if( i_matrix->entry_op[i] == I_MATRIX_OP_RESET_ROW ) {
+			row = i_matrix->entry_row[i];
+			last_reset[row] = i;
+			i_matrix->row_template[row] = i_matrix->entry_col[i];
+		}
+
+	k = 0;
+	for( i = 0; i < n; i++ ) {
+
+		if( i <= last_reset[i_matrix->entry_row[i]] )
+			continue;
+
+		i_matrix->entry_row[k] = i_matrix->entry_row[i];
+		i_matrix->entry_col[k] = i_matrix->entry_col[i];
+		i_matrix->entry_value[k] = i_matrix->entry_value[i];
+		i_matrix->entry_op[k] = i_matrix->entry_op[i];
+		k++;
+	}  /* for i */
+
+	free( last_reset );
+
+	i_matrix->num_entries = k;
+
+}  /* applyRowResets */
+/**********************************************************************/
+void compactIMatrix( I_Matrix i_matrix ) {
+	/*
+	Sorts the log by row and column and applies the triples of each
+	entry in the order they were added, leaving at most one triple per
+	entry.  Entries that end up removed are dropped.  Rows are sorted
+	with a stable counting sort, and each row by column.  The triples
+	are then moved into that order, and coalesced, in place, so the
+	only extra memory is one int per triple.  Nothing is done if the
+	log is already compacted.
+	*/
+	int *order;
+	uint64_t *keys;
+	int row, i, j, k, n, col, present, in_template, t, tp, t_end;
+	int max_length;
+	int start_row, start_col;
+	REAL_VALUE value, start_value;
+	char start_op;
+	Row_Templates *templates = &i_matrix->templates;
+
+	if( i_matrix->num_compacted == i_matrix->num_entries )
+		return;
+
+	for( i = i_matrix->num_compacted; i < i_matrix->num_entries; i++ )
+		if( i_matrix->entry_op[i] == I_MATRIX_OP_RESET_ROW ) {
+			applyRowResets( i_matrix );
+			break;
+		}
+
+	n = i_matrix->num_entries;
+
+	/* Counting sort of the log by row. row_start[] is used as the
+	   insertion cursor of each row. */
+	for( row = 0; row < i_matrix->num_rows; row++ )
+		i_matrix->row_length[row] = 0;
+	for( i = 0; i < n; i++ )
+		i_matrix->row_length[i_matrix->entry_row[i]]++;
+
+	k = 0;
+	max_length = 0;
+	for( row = 0; row < i_matrix->num_rows; row++ ) {
+		i_matrix->row_start[row] = k;
+		k += i_matrix->row_length[row];
+		if( i_matrix->row_length[row] > max_length )
+			max_length = i_matrix->row_length[row];
+	}  /* for row */
+
+	order = (int *) malloc( n * sizeof( int ));
+	checkAllocatedPointer(order);
+	for( i = 0; i < n; i++ )
+		order[i_matrix->row_start[i_matrix->entry_row[i]]++] = i;
+
+	/* Sort each row by column */
+	keys = (uint64_t *) malloc(( max_length > 0 ? max_length : 1 ) 
+						 * sizeof( uint64_t ));
+	checkAllocatedPointer(keys);
+	k = 0;
+	for( row = 0; row < i_matrix->num_rows; row++ ) {
+		if( i_matrix->row_length[row] > 1 ) {
+			for( j = 0; j < i_matrix->row_length[row]; j++ )
+				keys[j] = ((uint64_t) i_matrix->entry_col[order[k + j]] << 32)
+					| (uint64_t) order[k + j];
+			qsort( keys, i_matrix->row_length[row], sizeof( uint64_t ),
+				compareEntryKeys );
+			for( j = 0; j < i_matrix->row_length[row]; j++ )
+				order[k + j] = (int) ( keys[j] & 0xffffffffu );
+		}
+		k += i_matrix->row_length[row];
+	}  /* for row */
+	free( keys );
+
+	/* Move triple order[i] to position i by following the cycles of
+	   the permutation.  A position that has been filled is marked by
+	   pointing order[] at itself. */
+	for( i = 0; i < n; i++ ) {
+
+		if( order[i] == i )
+			continue;
+
+		start_row = i_matrix->entry_row[i];
+		start_col = i_matrix->entry_col[i];
+		start_value = i_matrix->entry_value[i];
+		start_op = i_matrix->entry_op[i];
+
+		for( j = i; order[j] != i; j = k ) {
+			k = order[j];
+			i_matrix->entry_row[j] = i_matrix->entry_row[k];
+			i_matrix->entry_col[j] = i_matrix->entry_col[k];
+			i_matrix->entry_value[j] = i_matrix->entry_value[k];
+			i_matrix->entry_op[j] = i_matrix->entry_op[k];
+			order[j] = j;
+		}  /* for each position of the cycle */
+
+		i_matrix->entry_row[j] = start_row;
+		i_matrix->entry_col[j] = start_col;
+		i_matrix->entry_value[j] = start_value;
+		i_matrix->entry_op[j] = start_op;
+		order[j] = j;
+	}  /* for i */
+
+	free( order );
+
+	/* Coalesce the triples of each (row, col) entry.  This mirrors what
+	   addEntryToRow() does one triple at a time: a replace sets the
+	   value, an accumulate adds to it (creating the entry if needed),
+	   and a remove deletes it.  In a row that was reset, entries start
+	   out as they are in its template, and one that ends up removed
+	   but is in the template keeps a remove.  Results are written
+	   behind the triples still being read. */
+	k = 0;
+	i = 0;
+	for( row = 0; row < i_matrix->num_rows; row++ ) {
+		int row_end = i + i_matrix->row_length[row];
+
+		i_matrix->row_start[row] = k;
+
+		t = ( i_matrix->row_template != NULL ) 
+			? i_matrix->row_template[row] : NO_ROW_TEMPLATE;
+		tp = t_end = 0;
+		if( t >= 0 ) {
+			tp = templates->start[t];
+			t_end = tp + templates->length[t];
+		}
+
+		while( i < row_end ) {
+			col = i_matrix->entry_col[i];
+
+			while(( tp < t_end ) && ( templates->col[tp] < col ))
+				tp++;
+			in_template = ( tp < t_end ) && ( templates->col[tp] == col );
+
+			present = in_template;
+			value = in_template ? templates->value[tp] : 0.0;
+
+			for( ; ( i < row_end ) && ( i_matrix->entry_col[i] == col ); i++ ) {
+				switch( i_matrix->entry_op[i] ) {
+				case I_MATRIX_OP_SET:
+					value = i_matrix->entry_value[i];
+					present = 1;
+					break;
+				case I_MATRIX_OP_ACCUMULATE:
+					value = ( present ? value : 0.0 ) + i_matrix->entry_value[i];
+					present = 1;
+					break;
+				default:
+					value = 0.0;
+					present = 0;
+					break;
+				}  /* switch */
+			}  /* for each triple of this entry */
+
+			if( present ) {
+				i_matrix->entry_row[k] = row;
+				i_matrix->entry_col[k] = col;
+				i_matrix->entry_value[k] = value;
+				i_matrix->entry_op[k] = I_MATRIX_OP_SET;
+				k++;
+			}
+			else if( in_template ) {
+				i_matrix->entry_row[k] = row;
+				i_matrix->entry_col[k] = col;
+				i_matrix->entry_value[k] = 0.0;
+				i_matrix->entry_op[k] = I_MATRIX_OP_REMOVE;
+				k++;
+			}
+		}  /* while entries in this row */
+
+		i_matrix->row_length[row] = k - i_matrix->row_start[row];
+	}  /* for row */
+
+	i_matrix->num_entries = k;
+	i_matrix->num_compacted = k;
+
+}  /* compactIMatrix */
 /**********************************************************************/
 int countEntriesInIMatrix( I_Matrix i_matrix ) {
-	int i;
-	int total = 0;
 
-	for( i = 0; i < i_matrix->num_rows; i++ )
-		total += i_matrix->row_length[i];
+	compactIMatrix( i_matrix );
 
-	return( total );
+	return( i_matrix->num_entries );
 }  /* countEntriesInIMatrix */
 /**********************************************************************/
+static int mergeTemplateRow( I_Matrix i_matrix, int row, int *col,
+							REAL_VALUE *value, REAL_VALUE *sum ) {
+	/*
+	Goes through a row of a compacted matrix as it finally is, i.e. its
+	template, if any, with the row's own triples applied, in column
+	order.  The entries are stored in col[] and value[], and added to
+	*sum, for those that are not NULL.  Returns the number of entries.
+	*/
+	Row_Templates *templates = &i_matrix->templates;
+	int t, tp = 0, t_end = 0, j, j_end, n = 0, c;
+	REAL_VALUE v;
+
+	t = ( i_matrix->row_template != NULL ) 
+		? i_matrix->row_template[row] : NO_ROW_TEMPLATE;
+	if( t >= 0 ) {
+		tp = templates->start[t];
+		t_end = tp + templates->length[t];
+	}
+
+	j = i_matrix->row_start[row];
+	j_end = j + i_matrix->row_length[row];
+
+	while(( tp < t_end ) || ( j < j_end )) {
+
+		if(( j < j_end ) 
+			&& (( tp == t_end ) || ( i_matrix->entry_col[j] <= templates->col[tp] ))) {
+
+			/* The row's own triple replaces the template's entry */
+			if(( tp < t_end ) && ( templates->col[tp] == i_matrix->entry_col[j] ))
+				tp++;
+
+			if( i_matrix->entry_op[j] == I_MATRIX_OP_REMOVE ) {
+				j++;
+				continue;
+			}
+
+			c = i_matrix->entry_col[j];
+			v = i_matrix->entry_value[j];
+			j++;
+		}
+		else {
+			c = templates->col[tp];
+			v = templates->value[tp];
+			tp++;
+		}
+
+		if( col != NULL ) {
+			col[n] = c;
+			value[n] = v;
+		}
+		if( sum != NULL )
+			*sum += v;
+		n++;
+	}  /* while */
+
+	return( n );
+}  /* mergeTemplateRow */
+/**********************************************************************/
 REAL_VALUE sumIMatrixRowValues( I_Matrix i_matrix, int row ) {
 	REAL_VALUE sum = 0.0;
-	I_Matrix_Row_Node list;
+	int j, t;
 
-	list = i_matrix->row[row];
+	compactIMatrix( i_matrix );
+
+	if( i_matrix->row_template != NULL ) {
+		t = i_matrix->row_template[row];
+
+		/* Most rows that were reset are still just their template */
+		if(( t >= 0 ) && ( i_matrix->row_length[row] == 0 ))
+			return( i_matrix->templates.sum[t] );
+
+		if( t != NO_ROW_TEMPLATE ) {
+			mergeTemplateRow( i_matrix, row, NULL, NULL, &sum );
+			return( sum );
+		}
+	}
+
+	for( j = i_matrix->row_start[row];
+		j < i_matrix->row_start[row] + i_matrix->row_length[row];
+		j++ )
+		sum += i_matrix->entry_value[j];
 
-	while( list != NULL ) {
-		sum += list->value;
-		list = list->next;
-	}  /* while */
 	return( sum );
 }  /* sumIMatrixRowValues */
 /**********************************************************************/
 void displayIMatrix( I_Matrix i_matrix ) {
-	int i;
+	int i, j, length;
+	int *col;
+	REAL_VALUE *value;
+
+	compactIMatrix( i_matrix );
 
 	for( i = 0; i < i_matrix->num_rows; i++ ) {
-		printf( "(len=%d, sum =%.1f)Row=%d: ", i_matrix->row_length[i], 
+		length = mergeTemplateRow( i_matrix, i, NULL, NULL, NULL );
+
+		printf( "(len=%d, sum =%.1f)Row=%d: ", length, 
 			sumIMatrixRowValues( i_matrix, i ), i );
-		displayRow( i_matrix->row[i] );
+
+		if( length == 0 )
+			printf( "<empty>");
+
+		col = (int *) malloc(( length + 1 ) * sizeof( int ));
+		checkAllocatedPointer(col);
+		value = (REAL_VALUE *) malloc(( length + 1 ) * sizeof( REAL_VALUE ));
+		checkAllocatedPointer(value);
+
+		mergeTemplateRow( i_matrix, i, col, value, NULL );
+
+		for( j = 0; j < length; j++ )
+			printf("[%d] %.3f ", col[j], value[j] );
+
+		free( col );
+		free( value );
+
+		printf( "\n");
 
 	}  /* for i */
 	
@@ -347,43 +814,214 @@ void destroyMatrix( Matrix matrix ) {
 	}
 }  /* destroyMatrix */
 /**********************************************************************/
+void destroySingleMatrix( Single_Matrix matrix ) {
+
+	if(matrix != NULL)
+	{
+		if(matrix->row_length != NULL)
+			free( matrix->row_length );
+		
+		if(matrix->row_start != NULL)
+			free( matrix->row_start );
+		
+		if(matrix->col != NULL)
+			free( matrix->col );
+
+		if(matrix->mat_val != NULL)
+			free( matrix->mat_val );
+
+		free( matrix );
+	}
+}  /* destroySingleMatrix */
+/**********************************************************************/
+static Matrix transformTemplateIMatrix( I_Matrix i_matrix ) {
+	/*
+	transformIMatrix() for a compacted matrix with rows that were
+	reset.  All rows that are still just the same template point at
+	one copy of it, stored where the first of them would have been.
+	The other rows are stored as they finally are.
+	*/
+	Row_Templates *templates = &i_matrix->templates;
+	Matrix matrix;
+	int *template_pos;
+	int row, t, num_stored = 0, k = 0;
+
+	template_pos = (int *) malloc(( templates->num_rows + 1 ) * sizeof( int ));
+	checkAllocatedPointer(template_pos);
+
+	for( t = 0; t < templates->num_rows; t++ )
+		template_pos[t] = -1;
+
+	for( row = 0; row < i_matrix->num_rows; row++ ) {
+		t = i_matrix->row_template[row];
+
+		if(( t >= 0 ) && ( i_matrix->row_length[row] == 0 )) {
+			if( template_pos[t] < 0 ) {
+				template_pos[t] = 0;
+				num_stored += templates->length[t];
+			}
+		}
+		else
+			num_stored += mergeTemplateRow( i_matrix, row, NULL, NULL, NULL );
+	}  /* for row */
+
+	for( t = 0; t < templates->num_rows; t++ )
+		template_pos[t] = -1;
+
+	matrix = newMatrix( i_matrix->num_rows, num_stored );
+
+	for( row = 0; row < i_matrix->num_rows; row++ ) {
+		t = i_matrix->row_template[row];
+
+		if(( t >= 0 ) && ( i_matrix->row_length[row] == 0 )) {
+
+			if( template_pos[t] < 0 ) {
+				template_pos[t] = k;
+				memcpy( matrix->col + k, templates->col + templates->start[t],
+					templates->length[t] * sizeof( int ));
+				memcpy( matrix->mat_val + k, 
+					templates->value + templates->start[t],
+					templates->length[t] * sizeof( REAL_VALUE ));
+				k += templates->length[t];
+			}
+
+			matrix->row_start[row] = template_pos[t];
+			matrix->row_length[row] = templates->length[t];
+		}
+		else {
+			matrix->row_start[row] = k;
+			matrix->row_length[row] = mergeTemplateRow( i_matrix, row, 
+				matrix->col + k, matrix->mat_val + k, NULL );
+			k += matrix->row_length[row];
+		}
+	}  /* for row */
+
+	free( template_pos );
+
+	return( matrix );
+}  /* transformTemplateIMatrix */
+/**********************************************************************/
 Matrix transformIMatrix( I_Matrix i_matrix ) {
 	/*
 	Will convert a matrix object in intermediate form into a sparse
 	representation.  It does not free the memory of the intermediate
-	representation.
+	representation.  Once compacted, the log already holds the entries
+	row by row, so this is a straight copy unless rows were reset.
 	*/
 	Matrix matrix;
 	int row;
-	I_Matrix_Row_Node cur_node;
-	int index = 0;  /* holds the position in the mat_val and col arrays */
+	int index;
+
+	compactIMatrix( i_matrix );
+
+	if( i_matrix->row_template != NULL )
+		return( transformTemplateIMatrix( i_matrix ));
 
 	/* Allocate the appropriate amount of memory */
 	matrix = newMatrix( i_matrix->num_rows, 
 		countEntriesInIMatrix( i_matrix ));
 
-	/* Now go through and set the values */
 	for( row = 0; row < i_matrix->num_rows; row++ ) {
-
-		matrix->row_start[row] = index;
+		matrix->row_start[row] = i_matrix->row_start[row];
 		matrix->row_length[row] = i_matrix->row_length[row];
+	}  /* for row */
 
-		cur_node = i_matrix->row[row];
-		while( cur_node != NULL ) {
+	for( index = 0; index < matrix->num_non_zero; index++ ) {
+		matrix->col[index] = i_matrix->entry_col[index];
+		matrix->mat_val[index] = i_matrix->entry_value[index];
+	}  /* for index */
+
+	return( matrix );
+}  /* transformIMatrix */
+/**********************************************************************/
+Matrix transformAndDestroyIMatrix( I_Matrix i_matrix ) {
+	/*
+	Does what transformIMatrix() followed by destroyIMatrix() would,
+	but without copying the entries.  Once compacted, the column and
+	value arrays of the log are exactly the ones the sparse matrix
+	needs, so they are handed over, and the intermediate and final
+	forms of the matrix are never in memory at the same time.  A
+	matrix with rows that were reset is copied instead, since its rows
+	are not all in the log; its log is short anyway.
+	*/
+	Matrix matrix;
 
-			matrix->col[index] = cur_node->column;
-			matrix->mat_val[index] = cur_node->value;
-			index++;
+	compactIMatrix( i_matrix );
 
-			cur_node = cur_node->next;
-		}  /* while cur_node */
+	if( i_matrix->row_template != NULL ) {
+		matrix = transformTemplateIMatrix( i_matrix );
+		destroyIMatrix( i_matrix );
+		return( matrix );
+	}
 
-	}  /* for row */
+	matrix = (Matrix) malloc( sizeof( *matrix ));
+	checkAllocatedPointer(matrix);
+
+	matrix->num_rows = i_matrix->num_rows;
+	matrix->num_non_zero = i_matrix->num_entries;
+	matrix->row_start = i_matrix->row_start;
+	matrix->row_length = i_matrix->row_length;
+	matrix->col = i_matrix->entry_col;
+	matrix->mat_val = i_matrix->entry_value;
+
+	/* Give back the room the log had for more entries */
+	if(( matrix->num_non_zero > 0 ) 
+		&& ( matrix->num_non_zero < i_matrix->max_entries )) {
+		matrix->col = (int *) 
+			realloc( matrix->col, matrix->num_non_zero * sizeof( int ));
+		checkAllocatedPointer(matrix->col);
+		matrix->mat_val = (REAL_VALUE *) 
+			realloc( matrix->mat_val, matrix->num_non_zero * sizeof( REAL_VALUE ));
+		checkAllocatedPointer(matrix->mat_val);
+	}
 
-	assert( index == matrix->num_non_zero );
+	free( i_matrix->entry_row );
+	free( i_matrix->entry_op );
+	freeRowTemplates( &i_matrix->templates );
+	free( i_matrix );
 
 	return( matrix );
-}  /* transformIMatrix */
+}  /* transformAndDestroyIMatrix */
+/**********************************************************************/
+Single_Matrix transformAndDestroyMatrix( Matrix matrix ) {
+	/*
+	Turns the matrix into its single precision form.  The values are
+	narrowed in place, each one being read before the ones written over
+	it, and only the index arrays are handed over, so the matrix is in
+	memory once, with room for the double values at the most.
+	*/
+	Single_Matrix single;
+	char *values = (char *) matrix->mat_val;
+	REAL_VALUE value;
+	float single_value;
+	int index;
+
+	for( index = 0; index < matrix->num_non_zero; index++ ) {
+		memcpy( &value, values + index * sizeof( REAL_VALUE ), sizeof( value ));
+		single_value = (float) value;
+		memcpy( values + index * sizeof( float ), &single_value, sizeof( single_value ));
+	}  /* for index */
+
+	single = (Single_Matrix) malloc( sizeof( *single ));
+	checkAllocatedPointer(single);
+
+	single->num_rows = matrix->num_rows;
+	single->num_non_zero = matrix->num_non_zero;
+	single->row_start = matrix->row_start;
+	single->row_length = matrix->row_length;
+	single->col = matrix->col;
+	single->mat_val = (float *) values;
+
+	if( single->num_non_zero > 0 ) {
+		single->mat_val = (float *) 
+			realloc( values, single->num_non_zero * sizeof( float ));
+		checkAllocatedPointer(single->mat_val);
+	}
+
+	free( matrix );
+
+	return( single );
+}  /* transformAndDestroyMatrix */
 /**********************************************************************/
 REAL_VALUE sumRowValues( Matrix matrix, int row ) {
 	REAL_VALUE sum = 0.0;
@@ -36,33 +36,97 @@
 
 #define IS_ZERO(X)   ((X < POS_ZERO_TOLERANCE) && ( X > NEG_ZERO_TOLERANCE ))
 
-/*  Each row of the intermediate form of the matrix will consist
-    of a linked list.  This structure is for each node of those linked
-    lists.  The pertinent information is the column number for the
-    entry and the value.  Additionally, this linked list will be kept
-    sorted by column so when adding an element we look for the column
-    and insert it in place. It will be sorted from least to greatest.
-    */ 
-typedef struct I_Matrix_Row_Node_Struct *I_Matrix_Row_Node;
-struct I_Matrix_Row_Node_Struct {
-  int column;
-  REAL_VALUE value;
-  I_Matrix_Row_Node next;
-};
+/*  While a file is read, each matrix is kept in an intermediate form
+    (I_Matrix) that entries can be added to in any order, and it is
+    converted to the final sparse form (Matrix) once all its entries
+    are known.  The intermediate form is a log of (row, column, value)
+    triples that is appended to as statements are read, and sorted and
+    coalesced (compacted) when it is read or has grown too long.
+    Statements that give a whole row at once, such as "uniform" or
+    "reset", log a single triple that points at a row template rather
+    than one triple per entry.
+    */
 
-/*  A matrix in intermediate form will be a linked list for each row
-    and a count of the number of non-zero entries for each row.
+/* What a triple in the intermediate matrix log does to its entry */
+#define I_MATRIX_OP_SET           0   /* replace the value */
+#define I_MATRIX_OP_ACCUMULATE    1   /* add to the value */
+#define I_MATRIX_OP_REMOVE        2   /* remove the entry (value was zero) */
+#define I_MATRIX_OP_RESET_ROW     3   /* replace the whole row by the row
+					 template in the column field */
+
+/* The row template that stands for an empty row */
+#define I_MATRIX_EMPTY_ROW        -1
+
+/* A log shorter than this, or than its number of rows, is not
+   compacted while it is written, so that the pass over every row a
+   compaction makes is paid for by the triples appended since the last
+   one */
+#define I_MATRIX_MIN_LOG_TO_COMPACT 1024
+
+/*  Rows that whole rows of a matrix can be reset to, such as the
+    uniform row of a "uniform" statement or the start distribution of a
+    "reset".  Each is stored once, sorted by column and without zeros,
+    with its entries at [start[t], start[t] + length[t]) of col[] and
+    value[].  A statement that covers every row of a matrix then costs
+    one template and one triple per row instead of one triple per
+    entry, and rows that are left as the template share its storage
+    in the final matrix.
+    */
+typedef struct {
+  int num_rows;
+  int max_rows;
+  int *start;
+  int *length;
+  REAL_VALUE *sum;          /* Sum of each template's values, in column
+			       order */
+  int num_entries;
+  int max_entries;
+  int *col;
+  REAL_VALUE *value;
+  int uniform;              /* The uniform template, -1 until one is
+			       needed */
+} Row_Templates;
+
+/*  A matrix in intermediate form is a log of (row, column, value)
+    triples in growable arrays, in the order they were added.  Each
+    triple records whether it replaces, accumulates into or removes the
+    entry.  The log is sorted by row and column and coalesced only when
+    the matrix is read (compactIMatrix()), so adding an entry is O(1)
+    no matter how long its row is.  The log is also compacted while it
+    is being written, whenever it has grown to twice what the last
+    compaction left, so it holds no more than about twice the live
+    entries however many statements overwrite or remove them.  After
+    compaction the first num_entries triples are unique, sorted, and
+    row r occupies [row_start[r], row_start[r] + row_length[r]).
+
+    A reset triple drops everything logged for its row before it.
+    Compaction records the row's template in row_template[], and the
+    row's triples then only hold the entries that differ from the
+    template: a set for a changed or new value, a remove for an entry
+    of the template that is gone.
     */
 struct I_Matrix_Struct {
   int num_rows;
-  I_Matrix_Row_Node *row;   /* An array of pointers for the head of
-			       each row's linked list */
-  int *row_length;            /* An array for the current lengths of
-			       each row. */
+  int num_entries;          /* Number of triples in the log */
+  int max_entries;          /* Allocated length of the entry arrays */
+  int num_compacted;        /* The log is compacted if this equals
+			       num_entries */
+  int *entry_row;
+  int *entry_col;
+  REAL_VALUE *entry_value;
+  char *entry_op;           /* One of the I_MATRIX_OP_* values */
+  int *row_start;           /* Only valid when compacted */
+  int *row_length;          /* Only valid when compacted */
+  int *row_template;        /* Only valid when compacted, NULL until a
+			       row has been reset */
+  Row_Templates templates;
 };
 typedef struct I_Matrix_Struct *I_Matrix;
 
-/* A matrix will be sparsely represented by a bunch of arrays
+/* A matrix will be sparsely represented by a bunch of arrays.  Rows
+   that were reset to the same template and not changed afterwards all
+   point at one copy of it, so num_non_zero counts the stored entries,
+   which can be fewer than the sum of the row lengths.
    */
 struct Matrix_Struct {
   int num_rows;
@@ -74,6 +138,20 @@ struct Matrix_Struct {
 };
 typedef struct Matrix_Struct *Matrix;
 
+/* The same sparse form with single precision values.  The transition
+   matrices of a model end up in this form, which is the one the solvers
+   compute with, so they can use the arrays as they are instead of
+   making a copy of their own. */
+struct Single_Matrix_Struct {
+  int num_rows;
+  int num_non_zero;
+  float *mat_val;   /* The actual non-zero entries stored row by row. */
+  int *row_start;   /* the position for the start of each row in mat_val */
+  int *row_length;  /* The length of each row in mat_val */
+  int *col;         /* The column number for each entry in mat_val */
+};
+typedef struct Single_Matrix_Struct *Single_Matrix;
+
 /**********************************************************************/
 /******************************  External Routines  *******************/
 /**********************************************************************/
@@ -81,22 +159,33 @@ typedef struct Matrix_Struct *Matrix;
 extern "C" {
 #endif
 
-extern void destroyRow( I_Matrix_Row_Node row );
-extern I_Matrix_Row_Node addEntryToRow( I_Matrix_Row_Node row, 
-				int col, REAL_VALUE value,
-				int *count, int accumulate );
-extern void displayRow( I_Matrix_Row_Node row );
-
 extern int addEntryToIMatrix( I_Matrix i_matrix, int row, 
 			     int col, REAL_VALUE value );
+extern int growEntryCapacity( int max_entries, long long needed );
+extern void appendEntriesToIMatrix( I_Matrix i_matrix, int num_entries,
+				    int *row, int *col, REAL_VALUE *value,
+				    char *op );
 extern int accumulateEntryInIMatrix( I_Matrix i_matrix, int row, 
 				    int col, REAL_VALUE value );
+extern int resetRowInIMatrix( I_Matrix i_matrix, int row, int row_template );
+extern void initRowTemplates( Row_Templates *templates );
+extern void clearRowTemplates( Row_Templates *templates );
+extern void freeRowTemplates( Row_Templates *templates );
+extern int addRowTemplate( Row_Templates *templates, int num_cols,
+			   REAL_VALUE *value );
+extern int uniformRowTemplate( Row_Templates *templates, int num_cols );
+extern int appendRowTemplates( Row_Templates *templates, 
+			       Row_Templates *other );
+extern void compactIMatrix( I_Matrix i_matrix );
 extern void destroyIMatrix( I_Matrix i_matrix );
 extern I_Matrix newIMatrix( int num_rows );
 extern REAL_VALUE sumIMatrixRowValues( I_Matrix i_matrix, int row );
 extern Matrix newMatrix( int num_rows, int num_non_zero );
 extern void destroyMatrix( Matrix matrix );
 extern Matrix transformIMatrix( I_Matrix i_matrix );
+extern Matrix transformAndDestroyIMatrix( I_Matrix i_matrix );
+extern Single_Matrix transformAndDestroyMatrix( Matrix matrix );
+extern void destroySingleMatrix( Single_Matrix matrix );
 extern void displayMatrix( Matrix matrix );
 extern REAL_VALUE sumRowValues( Matrix matrix, int row );
 extern REAL_VALUE getEntryMatrix( Matrix matrix, int row, int col );
@@ -0,0 +1,218 @@
+/*  test_fast_parser.cc
+
+  Checks of the hand written parser in pomdp_spec_fast.cc.  Models are
+  parsed from memory with fastParseMDP() alone, so a model that the
+  hand written parser gives up on fails the check instead of being
+  read by the grammar, which readMDPBuffer() would do without a word.
+  Returns 0 if every check passes.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mdpCassandra.h"
+#include "pomdp_spec_actions.h"
+
+static int gNumFailed = 0;
+
+#define CHECK( condition ) \
+   do { \
+      if( ! ( condition )) { \
+         printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                 #condition ); \
+         gNumFailed++; \
+      } \
+   } while( 0 )
+
+/**********************************************************************/
+static int parseText( MDP_Model *model, const char *text,
+                      int num_threads ) {
+   /*
+   Parses text with the hand written parser only, into model.
+   Returns 1 if it accepted the text.
+   */
+   MDP_Parse_Context context;
+   size_t length = strlen( text );
+   char *buffer;
+   int result;
+
+   /* readMDPBuffer() buffers end with two NUL bytes */
+   buffer = (char *) malloc( length + 2 );
+   checkAllocatedPointer((void *) buffer );
+   memcpy( buffer, text, length );
+   buffer[length] = '\0';
+   buffer[length+1] = '\0';
+
+   initParser( &context, num_threads, 0, 0 );
+   result = fastParseMDP( &context, buffer, length + 2 );
+   if( result )
+      *model = context.model;
+
+   free( buffer );
+
+   return( result );
+}  /* parseText */
+/**********************************************************************/
+static void testStartlessPOMDP() {
+   /* No start: line means a uniform start belief, as in the grammar */
+   static const char *text =
+      "discount: 0.95\n"
+      "values: reward\n"
+      "states: 4\n"
+      "actions: 2\n"
+      "observations: 2\n"
+      "T: * uniform\n"
+      "O: * uniform\n"
+      "R: * : * : * : * 1.0\n";
+   MDP_Model model;
+   int parsed, i;
+
+   parsed = parseText( &model, text, 1 );
+   CHECK( parsed );
+   if( ! parsed )
+      return;
+
+   CHECK( model.problem_type == POMDP_problem_type );
+   for( i = 0; i < model.num_states; i++ )
+      CHECK( fabs( model.initial_belief[i] - 0.25 ) < 1e-12 );
+
+   freeMDPModel( &model );
+
+}  /* testStartlessPOMDP */
+/**********************************************************************/
+static char *startlessPOMDPText( int num_states, int num_actions ) {
+   /*
+   A start-less POMDP with five transitions from every state under
+   every action, several times FAST_CHUNK_SIZE long so that its body
+   is cut into chunks.  The caller frees the text.
+   */
+   size_t size = (size_t) num_states * num_actions * 5 * 48 + 4096;
+   char *text = (char *) malloc( size );
+   char *p = text;
+   unsigned int seed = 1;
+   int a, i, k;
+
+   checkAllocatedPointer((void *) text );
+
+   p += sprintf( p, "discount: 0.9\nvalues: reward\nstates: %d\n"
+                 "actions: %d\nobservations: 2\n",
+                 num_states, num_actions );
+
+   /* Five different next states, as long as there are more than
+      4 * 7919 states */
+   for( a = 0; a < num_actions; a++ )
+      for( i = 0; i < num_states; i++ ) {
+         seed = seed * 1103515245 + 12345;
+         for( k = 0; k < 5; k++ )
+            p += sprintf( p, "T: %d : %d : %d 0.2\n", a, i,
+                          (int) ((( seed >> 8 ) + k * 7919 ) % num_states ));
+      }
+
+   p += sprintf( p, "O: * uniform\n" );
+   for( a = 0; a < num_actions; a++ )
+      for( i = 0; i < num_states; i += 7 )
+         p += sprintf( p, "R: %d : %d : * : * %d.5\n", a, i, ( a + i ) % 10 );
+
+   return( text );
+}  /* startlessPOMDPText */
+/**********************************************************************/
+static int sameMatrixRows( int num_rows, const int *row_start_1,
+                           const int *row_length_1, const int *col_1,
+                           const int *row_start_2, const int *row_length_2,
+                           const int *col_2 ) {
+   int i;
+
+   for( i = 0; i < num_rows; i++ )
+      if(( row_length_1[i] != row_length_2[i] )
+         || memcmp( &col_1[row_start_1[i]], &col_2[row_start_2[i]],
+                    row_length_1[i] * sizeof( int )))
+         return( 0 );
+
+   return( 1 );
+}  /* sameMatrixRows */
+/**********************************************************************/
+static int sameSingleMatrix( Single_Matrix m1, Single_Matrix m2 ) {
+   int i;
+
+   if(( m1->num_rows != m2->num_rows )
+      || ! sameMatrixRows( m1->num_rows, m1->row_start, m1->row_length,
+                           m1->col, m2->row_start, m2->row_length, m2->col ))
+      return( 0 );
+
+   for( i = 0; i < m1->num_rows; i++ )
+      if( memcmp( &m1->mat_val[m1->row_start[i]],
+                  &m2->mat_val[m2->row_start[i]],
+                  m1->row_length[i] * sizeof( float )))
+         return( 0 );
+
+   return( 1 );
+}  /* sameSingleMatrix */
+/**********************************************************************/
+static int sameMatrix( Matrix m1, Matrix m2 ) {
+   int i;
+
+   if(( m1->num_rows != m2->num_rows )
+      || ! sameMatrixRows( m1->num_rows, m1->row_start, m1->row_length,
+                           m1->col, m2->row_start, m2->row_length, m2->col ))
+      return( 0 );
+
+   for( i = 0; i < m1->num_rows; i++ )
+      if( memcmp( &m1->mat_val[m1->row_start[i]],
+                  &m2->mat_val[m2->row_start[i]],
+                  m1->row_length[i] * sizeof( REAL_VALUE )))
+         return( 0 );
+
+   return( 1 );
+}  /* sameMatrix */
+/**********************************************************************/
+static void testParallelStartlessPOMDP() {
+   /* The chunks of a start-less POMDP parsed on several threads give
+      the same model as on one */
+   char *text = startlessPOMDPText( 40000, 3 );
+   MDP_Model serial, parallel;
+   int parsed_serial, parsed_parallel, a;
+
+   parsed_serial = parseText( &serial, text, 1 );
+   parsed_parallel = parseText( &parallel, text, 4 );
+   free( text );
+
+   CHECK( parsed_serial );
+   CHECK( parsed_parallel );
+   if( ! parsed_serial || ! parsed_parallel ) {
+      if( parsed_serial )
+         freeMDPModel( &serial );
+      if( parsed_parallel )
+         freeMDPModel( &parallel );
+      return;
+   }
+
+   CHECK( serial.num_states == parallel.num_states );
+   CHECK( serial.num_actions == parallel.num_actions );
+   CHECK( ! memcmp( serial.initial_belief, parallel.initial_belief,
+                    serial.num_states * sizeof( REAL_VALUE )));
+   for( a = 0; a < serial.num_actions; a++ ) {
+      CHECK( sameSingleMatrix( serial.P[a], parallel.P[a] ));
+      CHECK( sameMatrix( serial.R[a], parallel.R[a] ));
+   }
+   CHECK( sameMatrix( serial.Q, parallel.Q ));
+
+   freeMDPModel( &serial );
+   freeMDPModel( &parallel );
+
+}  /* testParallelStartlessPOMDP */
+/**********************************************************************/
+int main() {
+
+   testStartlessPOMDP();
+   testParallelStartlessPOMDP();
+
+   if( gNumFailed > 0 ) {
+      printf( "%d checks failed\n", gNumFailed );
+      return( 1 );
+   }
+
+   printf( "All checks passed\n" );
+   return( 0 );
+}  /* main */
+/**********************************************************************/
@@ -0,0 +1,459 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BACKUP_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#include "backup_kernels.h"
+#include "utils.h"
+
+static bool s_b_scalar = false;
+static const struct backup_kernels* s_p_kernels = NULL;
+
+// Dense tiling, 0 means untiled, see backup_kernels_set_dense_tiling()
+static uint32_t s_dense_block_states = 0;
+static uint32_t s_dense_col_tile = 0;
+
+// -------------------------------------
+// Scalar reference
+// -------------------------------------
+
+static float dense_dot_scalar(const float* row, const float* value, uint32_t n)
+{
+    float summation = 0.0f;
+    for (uint32_t i=0; i<n; i++)
+    {
+        summation += (row[i] * value[i]);
+    }
+    return summation;
+}
+
+static float sparse_dot_scalar(const float* val, const uint32_t* col_idx, uint32_t n, const float* value)
+{
+    float summation = 0.0f;
+    for (uint32_t j=0; j<n; j++)
+    {
+        summation += val[j] * value[col_idx[j]];
+    }
+    return summation;
+}
+
+// Each row is summed in order, so the sums are the same as the ones of
+// sparse_dot_scalar(). The padding only adds zeros.
+static void sell_slice_scalar(const float* val, const uint32_t* col_idx, uint32_t length, const float* value, float* out)
+{
+    for (uint32_t l=0; l<BACKUP_KERNELS_SELL_C; l++)
+    {
+        out[l] = 0.0f;
+    }
+    for (uint32_t j=0; j<length; j++)
+    {
+        for (uint32_t l=0; l<BACKUP_KERNELS_SELL_C; l++)
+        {
+            out[l] += val[j*BACKUP_KERNELS_SELL_C + l] * value[col_idx[j*BACKUP_KERNELS_SELL_C + l]];
+        }
+    }
+}
+
+static const struct backup_kernels s_scalar_kernels = {"scalar", dense_dot_scalar, sparse_dot_scalar, sell_slice_scalar};
+
+#ifdef BACKUP_KERNELS_X86
+
+// -------------------------------------
+// AVX2 + FMA, 8 floats per vector
+// -------------------------------------
+
+__attribute__((target("avx2,fma")))
+static inline float hsum_avx2(__m256 v)
+{
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuf = _mm_movehdup_ps(sums);
+    sums = _mm_add_ps(sums, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+// Four independent sums hide the latency of the FMAs
+__attribute__((target("avx2,fma")))
+static float dense_dot_avx2(const float* row, const float* value, uint32_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i+32<=n; i+=32)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&row[i]), _mm256_loadu_ps(&value[i]), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&row[i+8]), _mm256_loadu_ps(&value[i+8]), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(&row[i+16]), _mm256_loadu_ps(&value[i+16]), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(&row[i+24]), _mm256_loadu_ps(&value[i+24]), acc3);
+    }
+    for (; i+8<=n; i+=8)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&row[i]), _mm256_loadu_ps(&value[i]), acc0);
+    }
+
+    float summation = hsum_avx2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i<n; i++)
+    {
+        summation += row[i] * value[i];
+    }
+    return summation;
+}
+
+__attribute__((target("avx2,fma")))
+static float sparse_dot_avx2(const float* val, const uint32_t* col_idx, uint32_t n, const float* value)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+
+    uint32_t j = 0;
+    for (; j+16<=n; j+=16)
+    {
+        __m256i idx0 = _mm256_loadu_si256((const __m256i*)&col_idx[j]);
+        __m256i idx1 = _mm256_loadu_si256((const __m256i*)&col_idx[j+8]);
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&val[j]), _mm256_i32gather_ps(value, idx0, 4), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&val[j+8]), _mm256_i32gather_ps(value, idx1, 4), acc1);
+    }
+    for (; j+8<=n; j+=8)
+    {
+        __m256i idx0 = _mm256_loadu_si256((const __m256i*)&col_idx[j]);
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&val[j]), _mm256_i32gather_ps(value, idx0, 4), acc0);
+    }
+
+    float summation = hsum_avx2(_mm256_add_ps(acc0, acc1));
+    for (; j<n; j++)
+    {
+        summation += val[j] * value[col_idx[j]];
+    }
+    return summation;
+}
+
+// One column of the slice, the C rows side by side, per vector
+__attribute__((target("avx2,fma")))
+static void sell_slice_avx2(const float* val, const uint32_t* col_idx, uint32_t length, const float* value, float* out)
+{
+    __m256 acc = _mm256_setzero_ps();
+    for (uint32_t j=0; j<length; j++)
+    {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)&col_idx[j*8]);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(&val[j*8]), _mm256_i32gather_ps(value, idx, 4), acc);
+    }
+    _mm256_storeu_ps(out, acc);
+}
+
+static const struct backup_kernels s_avx2_kernels = {"avx2", dense_dot_avx2, sparse_dot_avx2, sell_slice_avx2};
+
+// -------------------------------------
+// AVX-512, 16 floats per vector. The
+// end of a row is done with a masked
+// load instead of a scalar loop.
+// -------------------------------------
+
+__attribute__((target("avx512f")))
+static float dense_dot_avx512(const float* row, const float* value, uint32_t n)
+{
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i+32<=n; i+=32)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(&row[i]), _mm512_loadu_ps(&value[i]), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(&row[i+16]), _mm512_loadu_ps(&value[i+16]), acc1);
+    }
+    for (; i+16<=n; i+=16)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(&row[i]), _mm512_loadu_ps(&value[i]), acc0);
+    }
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n-i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, &row[i]), _mm512_maskz_loadu_ps(mask, &value[i]), acc1);
+    }
+
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+static float sparse_dot_avx512(const float* val, const uint32_t* col_idx, uint32_t n, const float* value)
+{
+    __m512 acc = _mm512_setzero_ps();
+
+    uint32_t j = 0;
+    for (; j+16<=n; j+=16)
+    {
+        __m512i idx = _mm512_loadu_si512((const void*)&col_idx[j]);
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(&val[j]), _mm512_i32gather_ps(idx, value, 4), acc);
+    }
+    if (j < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n-j)) - 1);
+        __m512i idx = _mm512_maskz_loadu_epi32(mask, (const void*)&col_idx[j]);
+        __m512 gathered = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx, value, 4);
+        acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, &val[j]), gathered, acc);
+    }
+
+    return _mm512_reduce_add_ps(acc);
+}
+
+// Two columns of the slice per vector. The halves are added at the end,
+// and an odd last column is done with AVX2.
+__attribute__((target("avx512f,avx2,fma")))
+static void sell_slice_avx512(const float* val, const uint32_t* col_idx, uint32_t length, const float* value, float* out)
+{
+    __m512 acc = _mm512_setzero_ps();
+
+    uint32_t j = 0;
+    for (; j+2<=length; j+=2)
+    {
+        __m512i idx = _mm512_loadu_si512((const void*)&col_idx[j*8]);
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(&val[j*8]), _mm512_i32gather_ps(idx, value, 4), acc);
+    }
+
+    __m256 sums = _mm256_add_ps(_mm512_castps512_ps256(acc),
+                                _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1)));
+    if (j < length)
+    {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)&col_idx[j*8]);
+        sums = _mm256_fmadd_ps(_mm256_loadu_ps(&val[j*8]), _mm256_i32gather_ps(value, idx, 4), sums);
+    }
+    _mm256_storeu_ps(out, sums);
+}
+
+static const struct backup_kernels s_avx512_kernels = {"avx512", dense_dot_avx512, sparse_dot_avx512, sell_slice_avx512};
+
+#endif // BACKUP_KERNELS_X86
+
+// -------------------------------------
+// Run time selection
+// -------------------------------------
+
+static const struct backup_kernels* select_kernels(void)
+{
+    if (s_b_scalar)
+    {
+        return &s_scalar_kernels;
+    }
+
+#if defined(BACKUP_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma"))
+    {
+        return &s_avx512_kernels;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return &s_avx2_kernels;
+    }
+#endif
+
+    return &s_scalar_kernels;
+}
+
+void backup_kernels_set_scalar(bool b_scalar)
+{
+    s_b_scalar = b_scalar;
+    s_p_kernels = NULL;
+}
+
+const struct backup_kernels* backup_kernels_get(void)
+{
+    if (s_p_kernels == NULL)
+    {
+        s_p_kernels = select_kernels();
+        printf("Backup kernels: %s\n", s_p_kernels->name);
+    }
+    return s_p_kernels;
+}
+
+// -------------------------------------
+// Cache blocked dense backup
+// -------------------------------------
+
+// Below this many states the value function stays in L1 on its own
+#define DENSE_TILING_MIN_NS 4096
+
+// Entries of the table each candidate tiling is timed on
+#define DENSE_TILING_SAMPLE (1u << 23)
+
+static const uint32_t s_block_states_candidates[] = {1, 4, 16};
+static const uint32_t s_col_tile_candidates[] = {0, 8192, 4096, 2048, 1024}; // 0 is untiled
+
+void backup_kernels_dense_block(const float* rows,
+                                uint32_t num_rows,
+                                uint32_t n,
+                                const float* value,
+                                uint32_t col_tile,
+                                float* out)
+{
+    dense_dot_fn dense_dot = backup_kernels_get()->dense_dot;
+
+    if (col_tile >= n)
+    {
+        for (uint32_t r=0; r<num_rows; r++)
+        {
+            out[r] = dense_dot(&rows[(size_t)r*n], value, n);
+        }
+        return;
+    }
+
+    for (uint32_t r=0; r<num_rows; r++)
+    {
+        out[r] = 0.0f;
+    }
+    for (uint32_t col_begin=0; col_begin<n; col_begin+=col_tile)
+    {
+        uint32_t tile_length = (n - col_begin < col_tile) ? (n - col_begin) : col_tile;
+        for (uint32_t r=0; r<num_rows; r++)
+        {
+            out[r] += dense_dot(&rows[(size_t)r*n + col_begin], &value[col_begin], tile_length);
+        }
+    }
+}
+
+// Time of one pass of the tiling over the first sample_states states
+static float time_dense_tiling(const float* stm_lut,
+                               uint32_t Ns,
+                               uint32_t Na,
+                               const float* value,
+                               uint32_t sample_states,
+                               const struct dense_tiling* p_tiling,
+                               float* out)
+{
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    for (uint32_t s_idx=0; s_idx<sample_states; s_idx+=p_tiling->block_states)
+    {
+        backup_kernels_dense_block(&stm_lut[(size_t)s_idx*Na*Ns], p_tiling->block_states*Na,
+                                   Ns, value, p_tiling->col_tile, out);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end_time);
+    return measure_elapsed_time(&start_time, &end_time);
+}
+
+void backup_kernels_set_dense_tiling(uint32_t block_states, uint32_t col_tile)
+{
+    s_dense_block_states = block_states;
+    s_dense_col_tile = col_tile;
+}
+
+void backup_kernels_tune_dense(const float* stm_lut,
+                               uint32_t Ns,
+                               uint32_t Na,
+                               const float* value,
+                               struct dense_tiling* p_tiling)
+{
+    p_tiling->block_states = 1;
+    p_tiling->col_tile = Ns;
+
+    if ((s_dense_block_states == 0) || (s_dense_col_tile == 0))
+    {
+        printf("Dense backup tiling: %u states x %u columns\n", p_tiling->block_states, p_tiling->col_tile);
+        return;
+    }
+
+    if ((s_dense_block_states != BACKUP_KERNELS_DENSE_TILING_AUTO) ||
+        (s_dense_col_tile != BACKUP_KERNELS_DENSE_TILING_AUTO))
+    {
+        p_tiling->block_states = (s_dense_block_states < Ns) ? s_dense_block_states : Ns;
+        p_tiling->col_tile = (s_dense_col_tile < Ns) ? s_dense_col_tile : Ns;
+        printf("Dense backup tiling: %u states x %u columns (fixed)\n", p_tiling->block_states, p_tiling->col_tile);
+        return;
+    }
+
+    // The scalar kernels are the reference and sum each row in order
+    if (backup_kernels_get() == &s_scalar_kernels || Ns < DENSE_TILING_MIN_NS)
+    {
+        printf("Dense backup tiling: %u states x %u columns\n", p_tiling->block_states, p_tiling->col_tile);
+        return;
+    }
+
+    // Enough states that the sample does not fit in the last level cache,
+    // a multiple of the largest block
+    const uint32_t max_block_states = 16;
+    uint64_t sample_states = DENSE_TILING_SAMPLE / ((uint64_t)Na*Ns);
+    if (sample_states < max_block_states)
+    {
+        sample_states = max_block_states;
+    }
+    if (sample_states > Ns)
+    {
+        sample_states = Ns;
+    }
+    sample_states -= sample_states % max_block_states;
+
+    float* out = (float*)malloc(sizeof(float)*max_block_states*Na);
+    assert(out != NULL);
+
+    // Untimed pass so the first candidate does not pay for page faults
+    time_dense_tiling(stm_lut, Ns, Na, value, (uint32_t)sample_states, p_tiling, out);
+
+    float best_time = -1.0f;
+    for (uint32_t b=0; b<sizeof(s_block_states_candidates)/sizeof(s_block_states_candidates[0]); b++)
+    {
+        for (uint32_t c=0; c<sizeof(s_col_tile_candidates)/sizeof(s_col_tile_candidates[0]); c++)
+        {
+            // A tile as wide as the table is the same as no tiling
+            if (s_col_tile_candidates[c] >= Ns)
+            {
+                continue;
+            }
+
+            struct dense_tiling candidate;
+            candidate.block_states = s_block_states_candidates[b];
+            candidate.col_tile = (s_col_tile_candidates[c] == 0) ? Ns : s_col_tile_candidates[c];
+
+            float t = time_dense_tiling(stm_lut, Ns, Na, value, (uint32_t)sample_states, &candidate, out);
+            if (best_time < 0.0f || t < best_time)
+            {
+                best_time = t;
+                *p_tiling = candidate;
+            }
+        }
+    }
+
+    free(out);
+
+    printf("Dense backup tiling: %u states x %u columns (tuned on %u states)\n",
+           p_tiling->block_states, p_tiling->col_tile, (uint32_t)sample_states);
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#ifndef __BACKUP_KERNELS_H__
+#define __BACKUP_KERNELS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The inner loops of the Bellman backups, the dot product of a transition
+// row with the value function, in one version per instruction set. The
+// best version the CPU supports is picked at run time with CPUID on x86,
+// and other CPUs use the scalar versions. The scalar versions are the
+// reference: they add the terms in order, exactly like the loops they
+// replace, while the vector versions keep several partial sums and so
+// round differently.
+
+// Dense row: sum_i row[i] * value[i] for i in [0, n)
+typedef float (*dense_dot_fn)(const float* row, const float* value, uint32_t n);
+
+// Sparse row: sum_j val[j] * value[col_idx[j]] for j in [0, n)
+typedef float (*sparse_dot_fn)(const float* val, const uint32_t* col_idx, uint32_t n, const float* value);
+
+// Slice of BACKUP_KERNELS_SELL_C rows of a SELL-C-sigma matrix, stored
+// column by column and padded to the longest row with zeros:
+// out[l] = sum_j val[j*C + l] * value[col_idx[j*C + l]] for j in [0, length)
+#define BACKUP_KERNELS_SELL_C 8
+typedef void (*sell_slice_fn)(const float* val, const uint32_t* col_idx, uint32_t length, const float* value, float* out);
+
+// Sparse rows shorter than this are summed inline by the caller. Most
+// rows of a sparse MDP have a few entries, and for those the call and
+// the horizontal reduction cost more than the products themselves.
+#define BACKUP_KERNELS_MIN_SPARSE_ROW 16
+
+struct backup_kernels
+{
+    const char* name;
+    dense_dot_fn dense_dot;
+    sparse_dot_fn sparse_dot;
+    sell_slice_fn sell_slice;
+};
+
+// Forces the scalar kernels, e.g. to check results against them
+void backup_kernels_set_scalar(bool b_scalar);
+
+// The kernels to use on this CPU
+const struct backup_kernels* backup_kernels_get(void);
+
+// Cache blocking of the dense backup. Once Ns is in the thousands, a
+// row of the dense table evicts the value function before the next row
+// reads it again. Instead the Na rows of block_states consecutive states
+// are summed together, col_tile next states at a time, so every row of
+// the block reads the same tile of the value function from cache.
+struct dense_tiling
+{
+    uint32_t block_states;
+    uint32_t col_tile;
+};
+
+// Column tiles change the order in which a row is summed, so the values
+// depend on the tiling. By default nothing is tiled and results do not
+// change from run to run.
+#define BACKUP_KERNELS_DENSE_TILING_AUTO UINT32_MAX
+
+// Fixes the tiling. 0 for either means untiled (the default), and
+// BACKUP_KERNELS_DENSE_TILING_AUTO for both means tune it for the model.
+void backup_kernels_set_dense_tiling(uint32_t block_states, uint32_t col_tile);
+
+// Picks the tiling for a state-major Ns x Na x Ns table. When tuning was
+// asked for, each candidate is timed on the first rows of the table and
+// the fastest one is kept, so the choice can vary with machine load.
+// Small tables and the scalar kernels are never tuned. The choice is
+// printed, so a run can be repeated with --dense-tiling.
+void backup_kernels_tune_dense(const float* stm_lut,
+                               uint32_t Ns,
+                               uint32_t Na,
+                               const float* value,
+                               struct dense_tiling* p_tiling);
+
+// out[r] = sum_i rows[r*n + i] * value[i] for r in [0, num_rows),
+// summed one tile of col_tile columns at a time
+void backup_kernels_dense_block(const float* rows,
+                                uint32_t num_rows,
+                                uint32_t n,
+                                const float* value,
+                                uint32_t col_tile,
+                                float* out);
+
+#endif //__BACKUP_KERNELS_H__
@@ -0,0 +1,270 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_bvi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+
+static struct sparse_mdp s_mdp;
+
+static float s_epsilon = 0.5f;
+static float* s_p_out_lower = NULL;
+static float* s_p_out_upper = NULL;
+static float s_gap = 0.0f;
+
+void solver_bvi_set_epsilon(float epsilon)
+{
+    assert(epsilon > 0.0f);
+    s_epsilon = epsilon;
+}
+
+void solver_bvi_set_bound_outputs(float* p_out_lower, float* p_out_upper)
+{
+    s_p_out_lower = p_out_lower;
+    s_p_out_upper = p_out_upper;
+}
+
+float solver_bvi_get_gap(void)
+{
+    return(s_gap);
+}
+
+// This function does one iteration of Bellman backup
+
+// The previous value function is taken from "value"
+// The resulting value function is stored in next_value
+// The resulting policy is stored in next_policy
+static void solver_do_backup(const float* value,
+                             float* next_value,
+                             uint32_t* next_policy)
+{
+    sparse_mdp_prepare_sweep(&s_mdp, value);
+
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        // Initialization on each new starting state
+        float max_value = backup_initial_value<false>();
+        uint32_t best_action = -1;
+
+        // Loop over all candidate actions
+        for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+        {
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+
+            // Is this the new best action?
+            if (value_for_this_action > max_value)
+            {
+                max_value = value_for_this_action;
+                best_action = a_idx;
+            }
+        }
+
+        next_value[s_idx] = max_value;
+        next_policy[s_idx] = best_action;
+    } // end s_idx loop
+}
+
+// Smallest and largest entries of v2-v1
+static void compute_delta_range(const float* v1, const float* v2, uint32_t N,
+                                float* p_min_delta, float* p_max_delta)
+{
+    float min_delta = v2[0]-v1[0];
+    float max_delta = min_delta;
+    for (uint32_t n=1; n<N; n++)
+    {
+        float delta = v2[n]-v1[n];
+        if (delta < min_delta)
+        {
+            min_delta = delta;
+        }
+        if (delta > max_delta)
+        {
+            max_delta = delta;
+        }
+    }
+    *p_min_delta = min_delta;
+    *p_max_delta = max_delta;
+}
+
+// Tightens the bounds with the ones implied by next_value = T(value), and
+// returns the largest remaining gap. With d = T(v)-v, the optimal value
+// function lies between T(v) + discount/(1-discount)*min(d) and
+// T(v) + discount/(1-discount)*max(d). Bounds from earlier sweeps stay
+// valid, so each state keeps the tightest pair seen so far.
+static float update_bounds(const float* value, const float* next_value,
+                           float* lower, float* upper)
+{
+    float min_delta, max_delta;
+    compute_delta_range(value, next_value, s_mdp.Ns, &min_delta, &max_delta);
+
+    float discount_factor = s_mdp.discount_factor;
+    float scale = discount_factor / (1.0f-discount_factor);
+    float lower_offset = scale*min_delta;
+    float upper_offset = scale*max_delta;
+
+    float max_gap = 0.0f;
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        float new_lower = next_value[s_idx] + lower_offset;
+        float new_upper = next_value[s_idx] + upper_offset;
+        if (new_lower > lower[s_idx])
+        {
+            lower[s_idx] = new_lower;
+        }
+        if (new_upper < upper[s_idx])
+        {
+            upper[s_idx] = new_upper;
+        }
+
+        float gap = upper[s_idx] - lower[s_idx];
+        if (gap > max_gap)
+        {
+            max_gap = gap;
+        }
+    }
+    return max_gap;
+}
+
+int solver_bvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    if (s_mdp.discount_factor >= 1.0f)
+    {
+        printf("bvi needs a discount factor below 1 to bound the value function\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+
+    // Allocate storage for temp working value function
+    float* value = p_out_value_func;
+    float* next_value = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(next_value != NULL);
+
+    // Bounds start out unbounded, and are tightened after every sweep
+    float* lower = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(lower != NULL);
+    float* upper = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(upper != NULL);
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        lower[s_idx] = -INFINITY;
+        upper[s_idx] = INFINITY;
+    }
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    bool b_timed_out = false;
+    float gap = INFINITY;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        // Do one Bellman backup iteration
+        solver_do_backup(value, next_value, p_out_policy);
+
+        // Compute stopping criteria
+        gap = update_bounds(value, next_value, lower, upper);
+
+        if (gap < s_epsilon)
+        {
+            b_done = true;
+            printf("Iteration %d: %f < %f (STOP)\n", num_iterations, gap, s_epsilon);
+        }
+        else if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+
+        // The value function computed in this iteration now becomes the "previous" value function.
+        // Swap the buffers instead of copying the whole vector.
+        float* temp = value;
+        value = next_value;
+        next_value = temp;
+    }
+
+    solver_set_num_iterations(num_iterations);
+    s_gap = gap;
+    printf("Bound gap = %f\n", gap);
+
+    // The midpoint of the bounds is within gap/2 of the optimal value function
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        p_out_value_func[s_idx] = 0.5f*(lower[s_idx] + upper[s_idx]);
+    }
+
+    if (s_p_out_lower != NULL)
+    {
+        memcpy(s_p_out_lower, lower, sizeof(float)*s_mdp.Ns);
+    }
+    if (s_p_out_upper != NULL)
+    {
+        memcpy(s_p_out_upper, upper, sizeof(float)*s_mdp.Ns);
+    }
+
+    // De-allocate everything malloc'd in this function. p_out_value_func
+    // now holds the midpoint, so whichever buffer is not it gets freed.
+    if (value != p_out_value_func)
+    {
+        next_value = value;
+    }
+    free(next_value);
+    free(lower);
+    free(upper);
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
@@ -0,0 +1,313 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_csrvi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+
+// Safety margin, relative to the best Q value, added to the elimination
+// gap to cover float round-off and transition rows that only sum to 1
+// within the parser's tolerance
+#define ACTION_ELIM_MARGIN (1e-4f)
+
+static struct sparse_mdp s_mdp;
+static float s_stopping_thresh = 0;
+
+static bool s_b_action_elimination = false;
+
+// Scratch space for the Q values of one state, used by action elimination
+static float* s_q_values = NULL;
+static uint64_t s_num_eliminated = 0;
+
+void solver_csrvi_set_action_elimination(bool b_enable)
+{
+    s_b_action_elimination = b_enable;
+}
+
+// Folds the change in the value of one state into the smallest and
+// largest change of the sweep
+static inline void update_delta_range(float delta, float* p_min_delta, float* p_max_delta)
+{
+    if (delta < *p_min_delta)
+    {
+        *p_min_delta = delta;
+    }
+    if (delta > *p_max_delta)
+    {
+        *p_max_delta = delta;
+    }
+}
+
+// This function does one iteration of Bellman backup. The rows of all
+// actions of a state are next to each other, and the change in the
+// state's value is taken while it is at hand, so the sweep is a single
+// pass over the operator with no separate pass for the stopping criteria.
+
+// The previous value function is taken from "value"
+// The resulting value function is stored in next_value
+// The resulting policy is stored in next_policy
+// The smallest and largest entries of next_value-value are stored in
+// *p_min_delta and *p_max_delta, and the sup norm of it is returned
+// B_MINIMIZE selects a min over actions (cost models) instead of a max
+template <bool B_MINIMIZE>
+static float solver_do_backup(const float* value,
+                              float* next_value,
+                              uint32_t* next_policy,
+                              float* p_min_delta,
+                              float* p_max_delta)
+{
+    sparse_mdp_prepare_sweep(&s_mdp, value);
+
+    float min_delta = INFINITY;
+    float max_delta = -INFINITY;
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        // Initialization on each new starting state
+        float best_value = backup_initial_value<B_MINIMIZE>();
+        uint32_t best_action = -1;
+
+        // Loop over all candidate actions
+        for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+        {
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+
+            // Is this the new best action?
+            if (backup_is_better<B_MINIMIZE>(value_for_this_action, best_value))
+            {
+                best_value = value_for_this_action;
+                best_action = a_idx;
+            }
+        }   // end a_idx loop
+
+        next_value[s_idx] = best_value;
+        next_policy[s_idx] = best_action;
+        update_delta_range(best_value - value[s_idx], &min_delta, &max_delta);
+
+    } // end s_idx loop
+
+    *p_min_delta = min_delta;
+    *p_max_delta = max_delta;
+    return fmaxf(fabsf(min_delta), fabsf(max_delta));
+}
+
+
+// Same as solver_do_backup(), but only the active actions of each state
+// are evaluated. Afterwards any action whose Q value is more than
+// elim_gap below the best one is removed from the state's active list
+// for good. A negative elim_gap disables elimination for this sweep.
+// Only the active rows are read, so they are summed one at a time and
+// not all at once through sparse_mdp_prepare_sweep().
+static float solver_do_backup_action_elim(const float* value,
+                                          float* next_value,
+                                          uint32_t* next_policy,
+                                          float elim_gap,
+                                          float* p_min_delta,
+                                          float* p_max_delta)
+{
+    sparse_mdp_prepare(&s_mdp, value);
+
+    float min_delta = INFINITY;
+    float max_delta = -INFINITY;
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        uint32_t* active_actions = &s_mdp.active_actions[(size_t)s_idx*s_mdp.Na];
+        uint32_t num_active = s_mdp.num_active[s_idx];
+
+        // Initialization on each new starting state
+        float max_value = backup_initial_value<false>();
+        uint32_t best_action = -1;
+
+        // Loop over the candidate actions that are left
+        for (uint32_t k=0; k<num_active; k++)
+        {
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, active_actions[k], value);
+            s_q_values[k] = value_for_this_action;
+
+            // Is this the new best action?
+            if (value_for_this_action > max_value)
+            {
+                max_value = value_for_this_action;
+                best_action = active_actions[k];
+            }
+        }
+
+        next_value[s_idx] = max_value;
+        next_policy[s_idx] = best_action;
+        update_delta_range(max_value - value[s_idx], &min_delta, &max_delta);
+
+        if (elim_gap >= 0.0f)
+        {
+            float elim_thresh = max_value - elim_gap - ACTION_ELIM_MARGIN*(1.0f + fabsf(max_value));
+
+            // Walk backwards so the entry swapped into slot k has already been checked
+            for (uint32_t k=num_active; k-- > 0; )
+            {
+                if (s_q_values[k] < elim_thresh)
+                {
+                    active_actions[k] = active_actions[num_active-1];
+                    num_active--;
+                    s_num_eliminated++;
+                }
+            }
+            s_mdp.num_active[s_idx] = num_active;
+        }
+    } // end s_idx loop
+
+    *p_min_delta = min_delta;
+    *p_max_delta = max_delta;
+    return fmaxf(fabsf(min_delta), fabsf(max_delta));
+}
+
+int solver_csrvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    s_stopping_thresh = solver_stopping_threshold(s_mdp.discount_factor);
+
+    // Action elimination keeps the best actions of a max
+    assert(!(s_b_action_elimination && s_mdp.b_minimize));
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+
+    // Allocate storage for temp working value function
+    float* value = p_out_value_func;
+    float* next_value = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(next_value != NULL);
+
+    if (s_b_action_elimination)
+    {
+        sparse_mdp_enable_action_elimination(&s_mdp);
+        s_q_values = (float*)malloc(sizeof(float)*s_mdp.Na);
+        assert(s_q_values != NULL);
+        s_num_eliminated = 0;
+    }
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    bool b_timed_out = false;
+    float elim_gap = -1.0f;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        // Do one Bellman backup iteration, which also gives the stopping criteria
+        float min_delta, max_delta;
+        float sup_norm;
+        if (s_b_action_elimination)
+        {
+            sup_norm = solver_do_backup_action_elim(value, next_value, p_out_policy, elim_gap,
+                                                    &min_delta, &max_delta);
+        }
+        else if (s_mdp.b_minimize)
+        {
+            sup_norm = solver_do_backup<true>(value, next_value, p_out_policy, &min_delta, &max_delta);
+        }
+        else
+        {
+            sup_norm = solver_do_backup<false>(value, next_value, p_out_policy, &min_delta, &max_delta);
+        }
+
+        // MacQueen bounds: with d = T(v)-v, the optimal value function lies between
+        // T(v) + discount/(1-discount)*min(d) and T(v) + discount/(1-discount)*max(d).
+        // In the next backup (which starts from T(v)), an action whose Q value computed
+        // with the upper bound is below the best Q value computed with the lower bound
+        // can never be optimal. Because every row of P sums to one, that test is
+        // Q(s,a) < max_b Q(s,b) - discount^2/(1-discount) * (max(d)-min(d)).
+        float discount_factor = s_mdp.discount_factor;
+        if (discount_factor < 1.0f)
+        {
+            elim_gap = (discount_factor*discount_factor/(1.0f-discount_factor)) * (max_delta-min_delta);
+        }
+
+        if (sup_norm < s_stopping_thresh)
+        {
+            b_done = true;
+            printf("Iteration %d: %f < %f (STOP)\n", num_iterations, sup_norm, s_stopping_thresh);
+        }
+        else if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+
+        // The value function computed in this iteration now becomes the "previous" value function.
+        // Swap the buffers instead of copying the whole vector.
+        float* temp = value;
+        value = next_value;
+        next_value = temp;
+    }
+
+    solver_set_num_iterations(num_iterations);
+
+    if (s_b_action_elimination)
+    {
+        printf("Eliminated %llu of %llu state-action pairs\n",
+               (unsigned long long)s_num_eliminated, (unsigned long long)s_mdp.Ns*s_mdp.Na);
+        free(s_q_values);
+        s_q_values = NULL;
+    }
+
+    // Done. The most recent value function is in "value" after the final swap
+    if (value != p_out_value_func)
+    {
+        memcpy(p_out_value_func, value, sizeof(float)*s_mdp.Ns);
+        next_value = value;
+    }
+
+    // De-allocate everything malloc'd in this function
+    if (next_value != NULL) {free(next_value);}
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
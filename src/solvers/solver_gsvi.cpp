@@ -0,0 +1,196 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_gsvi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+
+static struct sparse_mdp s_mdp;
+static float s_stopping_thresh = 0;
+
+static enum gsvi_sweep_order s_sweep_order = GSVI_SWEEP_FORWARD;
+static float s_omega = 1.0f;
+
+void solver_gsvi_set_sweep_order(enum gsvi_sweep_order sweep_order)
+{
+    s_sweep_order = sweep_order;
+}
+
+void solver_sorvi_set_omega(float omega)
+{
+    assert((omega > 0.0f) && (omega < 2.0f));
+    s_omega = omega;
+}
+
+// Backs up state s_idx in place and relaxes it by omega.
+// Returns the Bellman residual |T(v)(s) - v(s)| of the state. The change
+// actually made is omega times that, so it is not used for stopping.
+static inline float relaxed_backup(uint32_t s_idx, float omega, float* value, uint32_t* policy)
+{
+    float max_value = backup_initial_value<false>();
+    uint32_t best_action = -1;
+
+    // Loop over all candidate actions
+    for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+    {
+        float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+
+        // Is this the new best action?
+        if (value_for_this_action > max_value)
+        {
+            max_value = value_for_this_action;
+            best_action = a_idx;
+        }
+    }
+
+    float old_value = value[s_idx];
+    float new_value = old_value + omega*(max_value - old_value);
+    sparse_mdp_set_value(&s_mdp, value, s_idx, new_value);
+    policy[s_idx] = best_action;
+
+    return fabsf(max_value - old_value);
+}
+
+// This function does one in-place sweep of Bellman backups over all
+// states, in forward or backward order.
+// Returns the sup norm of the Bellman residual over the sweep.
+static float solver_do_sweep(float* value, uint32_t* policy, bool b_backward, float omega)
+{
+    sparse_mdp_prepare(&s_mdp, value);
+
+    float sup_norm = 0.0f;
+    for (uint32_t n=0; n<s_mdp.Ns; n++)
+    {
+        uint32_t s_idx = b_backward ? (s_mdp.Ns-1-n) : n;
+
+        float abs_delta = relaxed_backup(s_idx, omega, value, policy);
+        if (abs_delta > sup_norm)
+        {
+            sup_norm = abs_delta;
+        }
+    }
+    return sup_norm;
+}
+
+// Shared by gsvi and sorvi, which only differ in omega
+static int solve_in_place(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func,
+                          int max_solver_time_s, float omega)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    s_stopping_thresh = solver_stopping_threshold(s_mdp.discount_factor);
+
+    // The relaxed backup (1-omega)*v + omega*T(v) is only guaranteed to be a
+    // contraction when |1-omega| + omega*discount < 1
+    if (omega >= 2.0f/(1.0f+s_mdp.discount_factor))
+    {
+        printf("Warning: omega = %f >= %f, convergence is not guaranteed for discount %f\n",
+               omega, 2.0f/(1.0f+s_mdp.discount_factor), s_mdp.discount_factor);
+    }
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    bool b_timed_out = false;
+    bool b_diverged = false;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        bool b_backward = (s_sweep_order == GSVI_SWEEP_BACKWARD) ||
+                          ((s_sweep_order == GSVI_SWEEP_ALTERNATING) && ((num_iterations % 2) == 0));
+
+        // Do one in-place sweep, which also gives the stopping criteria
+        float sup_norm = solver_do_sweep(p_out_value_func, p_out_policy, b_backward, omega);
+
+        if (!isfinite(sup_norm))
+        {
+            // Over-relaxation can make the iteration expand instead of contract
+            b_done = true;
+            b_diverged = true;
+            printf("Iteration %d: value function diverged (STOP)\n", num_iterations);
+        }
+        else if (sup_norm < s_stopping_thresh)
+        {
+            b_done = true;
+            printf("Iteration %d: %f < %f (STOP)\n", num_iterations, sup_norm, s_stopping_thresh);
+        }
+        else if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+    }
+
+    solver_set_num_iterations(num_iterations);
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_diverged)
+    {
+        return(2);
+    }
+    else if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
+
+int solver_gsvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    return solve_in_place(p_mdp_obj, p_out_policy, p_out_value_func, max_solver_time_s, 1.0f);
+}
+
+int solver_sorvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    printf("Solver sorvi, omega = %f\n", s_omega);
+    return solve_in_place(p_mdp_obj, p_out_policy, p_out_value_func, max_solver_time_s, s_omega);
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#ifndef __SOLVER_GSVI_H__
+#define __SOLVER_GSVI_H__
+
+#include <stdint.h>
+
+// Gauss-Seidel (gsvi) and successive over-relaxation (sorvi) value
+// iteration on the CPU sparse MDP. Both update the value function in
+// place during a sweep, so states later in the sweep already see the
+// new values of states earlier in the sweep, and no per-iteration
+// vector copy is needed.
+
+// Order in which the states are visited in each sweep
+enum gsvi_sweep_order
+{
+    GSVI_SWEEP_FORWARD = 0,     // 0, 1, ..., Ns-1
+    GSVI_SWEEP_BACKWARD,        // Ns-1, ..., 1, 0
+    GSVI_SWEEP_ALTERNATING      // forward on odd sweeps, backward on even sweeps
+};
+
+// Sets the sweep order used by both gsvi and sorvi. Default is forward.
+void solver_gsvi_set_sweep_order(enum gsvi_sweep_order sweep_order);
+
+// Sets the relaxation factor used by sorvi. Each state moves to
+// (1-omega)*old_value + omega*backed_up_value. omega=1 is plain
+// Gauss-Seidel. Must be in (0,2). Default is 1. Convergence is only
+// guaranteed for omega < 2/(1+discount).
+void solver_sorvi_set_omega(float omega);
+
+// Inputs:
+//   p_mdp_obj : A pointer to some sort of MDP object. Currently only PomdpCassandraWrapper, but
+//               make intentionally void* so we can pass around other types as well.
+//   max_solver_time_s : if 0, run as long as necessary. Otherwise halt after this many seconds
+// Outputs:
+//   p_out_policy : A pointer to an array that is a length NUM_STATES vector of uint32_t's. The policy will be written put here.
+//   p_out_value_func : A pointer to an array that is a length NUM_STATES vector of floats. The value function will be written out here.
+
+// Return arg: 0 if completed, 1 if timed out, 2 if the iteration diverged (sorvi only)
+int solver_gsvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s);
+int solver_sorvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s);
+
+#endif //__SOLVER_GSVI_H__
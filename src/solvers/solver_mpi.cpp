@@ -0,0 +1,264 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_mpi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+// Limits and starting point for the adaptive number of fixed-policy sweeps
+#define MPI_MIN_SWEEPS (1)
+#define MPI_MAX_SWEEPS (100)
+#define MPI_INITIAL_SWEEPS (5)
+
+// The adaptive m is chosen so that the fixed-policy sweeps shrink their
+// own residual by about this factor between two improvement steps
+#define MPI_TARGET_REDUCTION (0.1f)
+
+static struct sparse_mdp s_mdp;
+static float s_stopping_thresh = 0;
+
+// Pinned number of fixed-policy sweeps, 0 for adaptive
+static uint32_t s_num_sweeps_requested = 0;
+
+void solver_mpi_set_num_sweeps(uint32_t num_sweeps)
+{
+    s_num_sweeps_requested = num_sweeps;
+}
+
+// This function does one iteration of Bellman backup (improvement step)
+
+// The previous value function is taken from "value"
+// The resulting value function is stored in next_value
+// The resulting policy is stored in next_policy
+static void solver_do_backup(const float* value,
+                             float* next_value,
+                             uint32_t* next_policy)
+{
+    sparse_mdp_prepare_sweep(&s_mdp, value);
+
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        // Initialization on each new starting state
+        float max_value = backup_initial_value<false>();
+        uint32_t best_action = -1;
+
+        // Loop over all candidate actions
+        for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+        {
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+
+            // Is this the new best action?
+            if (value_for_this_action > max_value)
+            {
+                max_value = value_for_this_action;
+                best_action = a_idx;
+            }
+        }   // end a_idx loop
+
+        next_value[s_idx] = max_value;
+        next_policy[s_idx] = best_action;
+
+    } // end s_idx loop
+}
+
+// This function does one fixed-policy backup. Only the row of the
+// action chosen by "policy" is visited for each state, so it costs
+// about 1/Na of solver_do_backup().
+static void solver_do_policy_backup(const float* value,
+                                    float* next_value,
+                                    const uint32_t* policy)
+{
+    sparse_mdp_prepare(&s_mdp, value);
+
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        next_value[s_idx] = sparse_mdp_q_value(&s_mdp, s_idx, policy[s_idx], value);
+    }
+}
+
+static float compute_sup_norm(const float* v1, const float* v2, uint32_t N)
+{
+    float max_abs_delta = 0.0f;
+    float abs_delta;
+    for (uint32_t n=0; n<N; n++)
+    {
+        abs_delta = fabsf(v1[n]-v2[n]);
+        if (abs_delta > max_abs_delta)
+        {
+            max_abs_delta = abs_delta;
+        }
+    }
+    return max_abs_delta;
+}
+
+// Picks the number of fixed-policy sweeps needed to reduce the
+// fixed-policy residual by MPI_TARGET_REDUCTION, given that each sweep
+// was observed to shrink it by contraction_rate.
+static uint32_t adapt_num_sweeps(float contraction_rate)
+{
+    if (!(contraction_rate > 0.0f))
+    {
+        // Residual vanished, the policy's values are already exact
+        return MPI_MIN_SWEEPS;
+    }
+    if (contraction_rate >= 1.0f)
+    {
+        return MPI_MAX_SWEEPS;
+    }
+
+    float num_sweeps = ceilf(logf(MPI_TARGET_REDUCTION) / logf(contraction_rate));
+    if (num_sweeps < MPI_MIN_SWEEPS)
+    {
+        return MPI_MIN_SWEEPS;
+    }
+    if (num_sweeps > MPI_MAX_SWEEPS)
+    {
+        return MPI_MAX_SWEEPS;
+    }
+    return (uint32_t)num_sweeps;
+}
+
+int solver_mpi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    s_stopping_thresh = solver_stopping_threshold(s_mdp.discount_factor);
+
+    bool b_adaptive = (s_num_sweeps_requested == 0);
+    uint32_t num_sweeps = b_adaptive ? MPI_INITIAL_SWEEPS : s_num_sweeps_requested;
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+
+    // Allocate storage for temp working value function
+    float* value = p_out_value_func;
+    float* next_value = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(next_value != NULL);
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    uint64_t num_policy_sweeps = 0;
+    bool b_timed_out = false;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        // Improvement: one full Bellman backup
+        solver_do_backup(value, next_value, p_out_policy);
+
+        // The Bellman residual gives the same stopping criteria as vi
+        float sup_norm = compute_sup_norm(value, next_value, s_mdp.Ns);
+
+        float* temp = value;
+        value = next_value;
+        next_value = temp;
+
+        if (sup_norm < s_stopping_thresh)
+        {
+            b_done = true;
+            printf("Iteration %d: %f < %f (STOP)\n", num_iterations, sup_norm, s_stopping_thresh);
+            break;
+        }
+
+        // Partial evaluation: m fixed-policy sweeps
+        float prev_delta = 0.0f;
+        float contraction_rate = 0.0f;
+        for (uint32_t m=0; m<num_sweeps; m++)
+        {
+            solver_do_policy_backup(value, next_value, p_out_policy);
+            float delta = compute_sup_norm(value, next_value, s_mdp.Ns);
+
+            temp = value;
+            value = next_value;
+            next_value = temp;
+
+            if (m > 0)
+            {
+                contraction_rate = (prev_delta > 0.0f) ? (delta / prev_delta) : 0.0f;
+            }
+            prev_delta = delta;
+        }
+        num_policy_sweeps += num_sweeps;
+
+        if (b_adaptive && (num_sweeps > 1))
+        {
+            num_sweeps = adapt_num_sweeps(contraction_rate);
+        }
+        else if (b_adaptive)
+        {
+            // A single sweep gives no rate estimate. Try one more next time.
+            num_sweeps = 2;
+        }
+
+        if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+    }
+
+    printf("Fixed-policy sweeps = %llu, final m = %u\n", (unsigned long long)num_policy_sweeps, num_sweeps);
+    solver_set_num_iterations(num_iterations);
+
+    // Done. The most recent value function is in "value" after the final swap
+    if (value != p_out_value_func)
+    {
+        memcpy(p_out_value_func, value, sizeof(float)*s_mdp.Ns);
+        next_value = value;
+    }
+
+    // De-allocate everything malloc'd in this function
+    if (next_value != NULL) {free(next_value);}
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
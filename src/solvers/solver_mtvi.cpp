@@ -0,0 +1,380 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Solver// File parser interfaces
+#include "pomdpCassandraWrapper.h"
+
+// Solver interfaces
+#include "solver_mtvi.h"
+#include "backup_kernels.h"
+
+// Misc files
+#include "utils.h"
+
+
+// TEMP - Load these into ram for now
+static float* s_STMs_lut = NULL;
+static float* s_R_2D_lut = NULL;
+static uint32_t s_Na = 0;
+static uint32_t s_Ns = 0;
+static float s_discount_factor = 0;
+static float s_stopping_thresh = 0;
+static struct dense_tiling s_tiling;   // Cache blocking of the backup
+
+// Requested thread count. 0 means "one per online core".
+static uint32_t s_num_threads_requested = 0;
+
+// State shared between the worker threads while solving
+static uint32_t s_num_threads = 0;
+static pthread_barrier_t s_sweep_barrier;
+static float* s_value = NULL;          // Previous value function
+static float* s_next_value = NULL;     // Value function being computed this sweep
+static uint32_t* s_policy = NULL;
+static float* s_thread_sup_norm = NULL; // One partial sup norm per thread
+static volatile bool s_b_done = false;
+static bool s_b_timed_out = false;
+static uint32_t s_num_iterations = 0;
+static int s_max_solver_time_s = 0;
+static struct timespec s_start_time;
+
+// Each thread owns the half-open range of states [s_begin, s_end)
+struct mtvi_thread_args
+{
+    uint32_t thread_idx;
+    uint32_t s_begin;
+    uint32_t s_end;
+    float* block_sums;  // Q sums of one block of states
+};
+
+void solver_mtvi_set_num_threads(uint32_t num_threads)
+{
+    s_num_threads_requested = num_threads;
+}
+
+// This function does one iteration of Bellman backup over the states
+// [s_begin, s_end). It is identical to the vi backup, restricted to a
+// partition of the state space. With the state-major table each thread
+// reads one contiguous block of it, s_tiling.block_states states at a
+// time.
+
+// The previous value function is taken from "value"
+// The resulting value function is stored in next_value
+// The resulting policy is stored in next_policy
+// block_sums holds the Q sums of one block of states
+// Returns the sup norm of next_value-value over the partition
+static float solver_do_backup(const float* value,
+                              float* next_value,
+                              uint32_t* next_policy,
+                              uint32_t s_begin,
+                              uint32_t s_end,
+                              float* block_sums)
+{
+    float max_value;
+    uint32_t best_action;
+    float summation;
+    float sup_norm = 0.0f;
+    for (uint32_t block_begin=s_begin; block_begin<s_end; block_begin+=s_tiling.block_states)
+    {
+        uint32_t block_end = block_begin + s_tiling.block_states;
+        if (block_end > s_end)
+        {
+            block_end = s_end;
+        }
+
+        // Compute entire summations of the block
+        backup_kernels_dense_block(&s_STMs_lut[(size_t)block_begin*s_Na*s_Ns], (block_end-block_begin)*s_Na,
+                                   s_Ns, value, s_tiling.col_tile, block_sums);
+
+        for (uint32_t s_idx=block_begin; s_idx<block_end; s_idx++)
+        {
+            // Initialization on each new starting state
+            max_value = backup_initial_value<false>();
+            best_action = -1;
+
+            const float* sums = &block_sums[(size_t)(s_idx-block_begin)*s_Na];
+            const float* rewards = &s_R_2D_lut[(size_t)s_idx*s_Na];
+
+            // Loop over all candidate actions
+            for (uint32_t a_idx=0; a_idx<s_Na; a_idx++)
+            {
+                summation = sums[a_idx];
+
+                // Add immediate reward of (s,a)
+                float immediate_reward = rewards[a_idx];
+                float value_for_this_action = immediate_reward + s_discount_factor*summation;
+
+                // Is this the new best action?
+                if (value_for_this_action > max_value)
+                {
+                    max_value = value_for_this_action;
+                    best_action = a_idx;
+                }
+            }   // end a_idx loop
+
+            next_value[s_idx] = max_value;
+            next_policy[s_idx] = best_action;
+
+            float abs_delta = fabsf(max_value - value[s_idx]);
+            if (abs_delta > sup_norm)
+            {
+                sup_norm = abs_delta;
+            }
+
+        } // end s_idx loop
+    } // end block loop
+
+    return sup_norm;
+}
+
+// Runs on thread 0 only, between the two barriers of a sweep.
+// Reduces the per-thread sup norms, applies the stopping criteria and
+// makes the value function computed in this sweep the "previous" one.
+static void solver_end_of_sweep(void)
+{
+    s_num_iterations++;
+
+    float sup_norm = 0.0f;
+    for (uint32_t t=0; t<s_num_threads; t++)
+    {
+        if (s_thread_sup_norm[t] > sup_norm)
+        {
+            sup_norm = s_thread_sup_norm[t];
+        }
+    }
+
+    if (sup_norm < s_stopping_thresh)
+    {
+        s_b_done = true;
+        printf("Iteration %d: %f < %f (STOP)\n", s_num_iterations, sup_norm, s_stopping_thresh);
+    }
+    else if (solver_timed_out(&s_start_time, s_max_solver_time_s))
+    {
+        s_b_done = true;
+        s_b_timed_out = true;
+    }
+
+    // Swap instead of copying the whole vector
+    float* temp = s_value;
+    s_value = s_next_value;
+    s_next_value = temp;
+}
+
+static void* solver_thread_main(void* p_arg)
+{
+    const struct mtvi_thread_args* p_args = (const struct mtvi_thread_args*)p_arg;
+    uint32_t s_begin = p_args->s_begin;
+    uint32_t s_end = p_args->s_end;
+
+    while (true)
+    {
+        // Do one Bellman backup iteration over this thread's partition,
+        // which also gives the partial stopping criteria
+        s_thread_sup_norm[p_args->thread_idx] =
+                solver_do_backup(s_value, s_next_value, s_policy, s_begin, s_end, p_args->block_sums);
+
+        pthread_barrier_wait(&s_sweep_barrier);
+
+        if (p_args->thread_idx == 0)
+        {
+            solver_end_of_sweep();
+        }
+
+        pthread_barrier_wait(&s_sweep_barrier);
+
+        if (s_b_done)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// This function currently assumes that the input format is the cassandra format
+// It converts the cassandra format to the MDP format that this solver uses
+// The converted mdp variables have file scope.
+// The intention is to handle other incoming formats here as well
+static void change_mdp_format(void* p_mdp_obj)
+{
+    PomdpCassandraWrapper* p_mdp = (PomdpCassandraWrapper*)p_mdp_obj;
+    s_discount_factor = p_mdp->getDiscount();
+    s_Ns = p_mdp->getNumStates();
+    s_Na = p_mdp->getNumActions();
+
+    s_stopping_thresh = solver_stopping_threshold(s_discount_factor);
+
+    s_STMs_lut = (float*)malloc(sizeof(float)*s_Ns*s_Ns*s_Na);
+    s_R_2D_lut = (float*)malloc(sizeof(float)*s_Ns*s_Na);
+    assert(s_STMs_lut != NULL);
+    assert(s_R_2D_lut != NULL);
+
+    memset(s_STMs_lut, 0, sizeof(float)*s_Ns*s_Na*s_Ns);
+    memset(s_R_2D_lut, 0, sizeof(float)*s_Ns*s_Na);
+
+    // Both tables are state-major, like the ones of the vi solver.
+    // Scatter the non-zero entries of each sparse row into the dense table
+    for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
+    {
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
+        for(uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
+        {
+            float* stm_row = &s_STMs_lut[(size_t)s_idx*s_Na*s_Ns + (size_t)a_idx*s_Ns];
+            int row_begin = single_stm->row_start[s_idx];
+            int row_end = row_begin + single_stm->row_length[s_idx];
+            for (int j=row_begin; j<row_end; j++)
+            {
+                stm_row[single_stm->col[j]] = single_stm->mat_val[j];
+            }
+        }
+    }
+
+    CassandraMatrix cassandra_RTranspose = p_mdp->getRTranspose();
+    for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
+    {
+        int row_begin = cassandra_RTranspose->row_start[a_idx];
+        int row_end = row_begin + cassandra_RTranspose->row_length[a_idx];
+        for (int j=row_begin; j<row_end; j++)
+        {
+            s_R_2D_lut[(size_t)cassandra_RTranspose->col[j]*s_Na + a_idx] = cassandra_RTranspose->mat_val[j];
+        }
+    }
+}
+
+int solver_mtvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    change_mdp_format(p_mdp_obj);
+
+    s_num_threads = s_num_threads_requested;
+    if (s_num_threads == 0)
+    {
+        long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        s_num_threads = (num_cores > 0) ? (uint32_t)num_cores : 1;
+    }
+    // No more threads than states, but at least one, since
+    // pthread_barrier_init() rejects a count of zero
+    if (s_num_threads > s_Ns)
+    {
+        s_num_threads = s_Ns;
+    }
+    if (s_num_threads == 0)
+    {
+        s_num_threads = 1;
+    }
+    printf("Solver mtvi, %d threads\n", s_num_threads);
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_Ns);
+
+    // Allocate storage for temp working value function and per-thread results
+    s_value = p_out_value_func;
+    s_next_value = (float*)malloc(sizeof(float)*s_Ns);
+    s_policy = p_out_policy;
+    s_thread_sup_norm = (float*)malloc(sizeof(float)*s_num_threads);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t)*s_num_threads);
+    struct mtvi_thread_args* thread_args =
+            (struct mtvi_thread_args*)malloc(sizeof(struct mtvi_thread_args)*s_num_threads);
+    assert(s_next_value != NULL);
+    assert(s_thread_sup_norm != NULL);
+    assert(threads != NULL);
+    assert(thread_args != NULL);
+
+    s_b_done = false;
+    s_b_timed_out = false;
+    s_num_iterations = 0;
+    s_max_solver_time_s = max_solver_time_s;
+
+    backup_kernels_tune_dense(s_STMs_lut, s_Ns, s_Na, s_value, &s_tiling);
+
+    int ret = pthread_barrier_init(&s_sweep_barrier, NULL, s_num_threads);
+    assert(ret == 0);
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &s_start_time);
+
+    // Split the state space into equally sized contiguous partitions
+    for (uint32_t t=0; t<s_num_threads; t++)
+    {
+        thread_args[t].thread_idx = t;
+        thread_args[t].s_begin = (uint32_t)(((uint64_t)s_Ns * t) / s_num_threads);
+        thread_args[t].s_end = (uint32_t)(((uint64_t)s_Ns * (t+1)) / s_num_threads);
+        thread_args[t].block_sums = (float*)malloc(sizeof(float)*s_tiling.block_states*s_Na);
+        assert(thread_args[t].block_sums != NULL);
+
+        ret = pthread_create(&threads[t], NULL, solver_thread_main, (void*)&thread_args[t]);
+        assert(ret == 0);
+    }
+
+    for (uint32_t t=0; t<s_num_threads; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+
+    pthread_barrier_destroy(&s_sweep_barrier);
+
+    solver_set_num_iterations(s_num_iterations);
+
+    // Done. The most recent value function is in s_value after the final swap
+    if (s_value != p_out_value_func)
+    {
+        memcpy(p_out_value_func, s_value, sizeof(float)*s_Ns);
+        s_next_value = s_value;
+    }
+
+    // De-allocate everything malloc'd in this function
+    for (uint32_t t=0; t<s_num_threads; t++)
+    {
+        free(thread_args[t].block_sums);
+    }
+    if (thread_args != NULL) {free(thread_args);}
+    if (threads != NULL) {free(threads);}
+    if (s_thread_sup_norm != NULL) {free(s_thread_sup_norm);}
+    if (s_next_value != NULL) {free(s_next_value);}
+
+    if (s_STMs_lut != NULL) {free(s_STMs_lut);}
+    if (s_R_2D_lut != NULL) {free(s_R_2D_lut);}
+
+    if (s_b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
@@ -0,0 +1,221 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_pi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+// An action only replaces the current one if it is better by more than
+// this (relative) amount. Without it, float round-off between equally
+// good actions can keep the policy from ever becoming stable.
+#define PI_IMPROVEMENT_TOL (1e-5f)
+
+static struct sparse_mdp s_mdp;
+static float s_stopping_thresh = 0;
+
+// Evaluates the fixed policy "policy" by Gauss-Seidel iteration on
+//   (I - discount*P_pi) v = r_pi
+// Only the row of the chosen action is visited for each state. The
+// diagonal term P_pi(s,s) is solved for directly, which makes states
+// with self loops converge in one step. "value" holds the starting
+// guess (normally the previous policy's values) and the result.
+// Returns the number of sweeps, or 0 if timed out.
+static uint32_t evaluate_policy(const uint32_t* policy, float* value,
+                                const struct timespec* p_start_time, int max_solver_time_s)
+{
+    uint32_t num_sweeps = 0;
+    float discount_factor = s_mdp.discount_factor;
+
+    while (true)
+    {
+        num_sweeps++;
+
+        sparse_mdp_prepare(&s_mdp, value);
+
+        float sup_norm = 0.0f;
+        for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+        {
+            uint32_t row = sparse_mdp_row(&s_mdp, s_idx, policy[s_idx]);
+
+            float summation = 0.0f;
+            float self_prob = 0.0f;
+            const float* row_val;
+            const uint32_t* row_col_idx;
+            uint32_t row_length = sparse_mdp_row_entries(&s_mdp, s_idx, policy[s_idx], &row_val, &row_col_idx);
+            for (uint32_t j=0; j<row_length; j++)
+            {
+                uint32_t next_s_idx = row_col_idx[j];
+                if (next_s_idx == s_idx)
+                {
+                    self_prob += row_val[j];
+                }
+                else
+                {
+                    summation += row_val[j] * value[next_s_idx];
+                }
+            }
+
+            uint8_t row_kind = sparse_mdp_row_kind(&s_mdp, row);
+            if (row_kind == SPARSE_ROW_UNIFORM)
+            {
+                self_prob = s_mdp.uniform_prob;
+                summation = (float)(s_mdp.uniform_prob*(s_mdp.value_sum - value[s_idx]));
+            }
+            else if (row_kind == SPARSE_ROW_IDENTITY)
+            {
+                self_prob = 1.0f;
+            }
+
+            float new_value = (s_mdp.R[row] + discount_factor*summation) / (1.0f - discount_factor*self_prob);
+            float abs_delta = fabsf(new_value - value[s_idx]);
+            if (abs_delta > sup_norm)
+            {
+                sup_norm = abs_delta;
+            }
+            sparse_mdp_set_value(&s_mdp, value, s_idx, new_value);
+        }
+
+        if (sup_norm < s_stopping_thresh)
+        {
+            return num_sweeps;
+        }
+        if (solver_timed_out(p_start_time, max_solver_time_s))
+        {
+            return 0;
+        }
+    }
+}
+
+// Greedy policy improvement with respect to "value".
+// Returns the number of states whose action changed.
+static uint32_t improve_policy(uint32_t* policy, const float* value)
+{
+    sparse_mdp_prepare_sweep(&s_mdp, value);
+
+    uint32_t num_changed = 0;
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        uint32_t best_action = policy[s_idx];
+        float max_value = sparse_mdp_q_value(&s_mdp, s_idx, best_action, value);
+        float current_value = max_value;
+
+        for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+        {
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+            if (value_for_this_action > max_value)
+            {
+                max_value = value_for_this_action;
+                best_action = a_idx;
+            }
+        }
+
+        if ((best_action != policy[s_idx]) &&
+            ((max_value - current_value) > PI_IMPROVEMENT_TOL*(1.0f + fabsf(current_value))))
+        {
+            policy[s_idx] = best_action;
+            num_changed++;
+        }
+    }
+    return num_changed;
+}
+
+int solver_pi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    s_stopping_thresh = solver_stopping_threshold(s_mdp.discount_factor);
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    // Start from the policy that is greedy for a zero value function,
+    // i.e. the action with the best immediate reward
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        p_out_policy[s_idx] = 0;
+    }
+    improve_policy(p_out_policy, p_out_value_func);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    uint64_t num_eval_sweeps = 0;
+    bool b_timed_out = false;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        uint32_t num_sweeps = evaluate_policy(p_out_policy, p_out_value_func, &start_time, max_solver_time_s);
+        if (num_sweeps == 0)
+        {
+            b_done = true;
+            b_timed_out = true;
+            break;
+        }
+        num_eval_sweeps += num_sweeps;
+
+        uint32_t num_changed = improve_policy(p_out_policy, p_out_value_func);
+        if (num_changed == 0)
+        {
+            b_done = true;
+            printf("Iteration %d: policy stable (STOP)\n", num_iterations);
+        }
+        else if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+    }
+
+    printf("Policy evaluation sweeps = %llu\n", (unsigned long long)num_eval_sweeps);
+    solver_set_num_iterations(num_iterations);
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
@@ -0,0 +1,240 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_rvi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+
+// Weight of P in the aperiodicity transform P' = tau*P + (1-tau)*I
+#define RVI_APERIODICITY_TAU (0.9f)
+
+// State whose value is pinned to 0 after every sweep
+#define RVI_REFERENCE_STATE (0)
+
+static struct sparse_mdp s_mdp;
+
+static float s_epsilon = 1e-3f;
+static float* s_p_out_gain = NULL;
+static float s_gain = 0.0f;
+
+void solver_rvi_set_epsilon(float epsilon)
+{
+    assert(epsilon > 0.0f);
+    s_epsilon = epsilon;
+}
+
+void solver_rvi_set_gain_output(float* p_out_gain)
+{
+    s_p_out_gain = p_out_gain;
+}
+
+float solver_rvi_get_gain(void)
+{
+    return(s_gain);
+}
+
+// This function does one iteration of the transformed Bellman backup
+
+// The previous (relative) value function is taken from "value"
+// The resulting value function is stored in next_value
+// The resulting policy is stored in next_policy
+static void solver_do_backup(const float* value,
+                             float* next_value,
+                             uint32_t* next_policy)
+{
+    sparse_mdp_prepare_sweep(&s_mdp, value);
+
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        // Initialization on each new starting state
+        float max_value = backup_initial_value<false>();
+        uint32_t best_action = -1;
+
+        // Loop over all candidate actions
+        for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+        {
+            // discount_factor holds tau, so this is R(s,a) + tau * sum_s' P(s'|s,a) * value[s']
+            float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+
+            // Is this the new best action?
+            if (value_for_this_action > max_value)
+            {
+                max_value = value_for_this_action;
+                best_action = a_idx;
+            }
+        }
+
+        // The (1-tau)*I part of the transform is the same for every action
+        next_value[s_idx] = max_value + (1.0f-RVI_APERIODICITY_TAU)*value[s_idx];
+        next_policy[s_idx] = best_action;
+    } // end s_idx loop
+}
+
+// Smallest and largest entries of v2-v1
+static void compute_delta_range(const float* v1, const float* v2, uint32_t N,
+                                float* p_min_delta, float* p_max_delta)
+{
+    float min_delta = v2[0]-v1[0];
+    float max_delta = min_delta;
+    for (uint32_t n=1; n<N; n++)
+    {
+        float delta = v2[n]-v1[n];
+        if (delta < min_delta)
+        {
+            min_delta = delta;
+        }
+        if (delta > max_delta)
+        {
+            max_delta = delta;
+        }
+    }
+    *p_min_delta = min_delta;
+    *p_max_delta = max_delta;
+}
+
+int solver_rvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    if (s_mdp.discount_factor < 1.0f)
+    {
+        printf("rvi solves the average-reward problem, ignoring discount factor %f\n", s_mdp.discount_factor);
+    }
+
+    // The backup scales the expected next value by the discount factor,
+    // so storing tau there applies the aperiodicity transform
+    s_mdp.discount_factor = RVI_APERIODICITY_TAU;
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+
+    // Allocate storage for temp working value function
+    float* value = p_out_value_func;
+    float* next_value = (float*)malloc(sizeof(float)*s_mdp.Ns);
+    assert(next_value != NULL);
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    bool b_done = false;
+    uint32_t num_iterations = 0;
+    bool b_timed_out = false;
+    float min_delta = 0.0f;
+    float max_delta = 0.0f;
+    while(!b_done)
+    {
+        num_iterations++;
+
+        // Do one Bellman backup iteration
+        solver_do_backup(value, next_value, p_out_policy);
+
+        // The optimal gain lies between the smallest and largest change
+        // of this sweep, so the span bounds the error in the gain
+        compute_delta_range(value, next_value, s_mdp.Ns, &min_delta, &max_delta);
+        float span = max_delta - min_delta;
+
+        // Keep the values bounded by pinning the reference state to 0
+        float reference_value = next_value[RVI_REFERENCE_STATE];
+        for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+        {
+            next_value[s_idx] -= reference_value;
+        }
+
+        if (span < s_epsilon)
+        {
+            b_done = true;
+            printf("Iteration %d: %f < %f (STOP)\n", num_iterations, span, s_epsilon);
+        }
+        else if (solver_timed_out(&start_time, max_solver_time_s))
+        {
+            b_done = true;
+            b_timed_out = true;
+        }
+
+        // Save the per-state gain estimates of the final sweep before the
+        // buffers are swapped
+        if ((b_done) && (s_p_out_gain != NULL))
+        {
+            for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+            {
+                s_p_out_gain[s_idx] = next_value[s_idx] + reference_value - value[s_idx];
+            }
+        }
+
+        // The value function computed in this iteration now becomes the "previous" value function.
+        // Swap the buffers instead of copying the whole vector.
+        float* temp = value;
+        value = next_value;
+        next_value = temp;
+    }
+
+    solver_set_num_iterations(num_iterations);
+    s_gain = 0.5f*(min_delta + max_delta);
+    printf("Gain = %f (between %f and %f)\n", s_gain, min_delta, max_delta);
+
+    // Done. The most recent value function is in "value" after the final swap
+    if (value != p_out_value_func)
+    {
+        memcpy(p_out_value_func, value, sizeof(float)*s_mdp.Ns);
+        next_value = value;
+    }
+
+    // The transformed problem has bias h/tau, so scale back to the bias of the original MDP
+    for (uint32_t s_idx=0; s_idx<s_mdp.Ns; s_idx++)
+    {
+        p_out_value_func[s_idx] *= RVI_APERIODICITY_TAU;
+    }
+
+    // De-allocate everything malloc'd in this function
+    if (next_value != NULL) {free(next_value);}
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
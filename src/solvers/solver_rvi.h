@@ -0,0 +1,67 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#ifndef __SOLVER_RVI_H__
+#define __SOLVER_RVI_H__
+
+#include <stdint.h>
+
+// Relative value iteration for average-reward (undiscounted) problems on
+// the CPU sparse MDP. The discount factor of the model is ignored. After
+// each sweep the value of a reference state is subtracted, so the values
+// stay bounded and converge to the bias vector. The solver stops once
+// the span seminorm of the change in a sweep is below epsilon, which
+// also brackets the optimal gain to within epsilon.
+//
+// The MDP is assumed to be unichain. To handle periodic chains, the
+// sweeps use the aperiodicity transform P' = tau*P + (1-tau)*I, which
+// leaves the gain and the optimal policy unchanged.
+
+// Sets the largest span of a sweep's change at which to stop. Default is 1e-3.
+void solver_rvi_set_epsilon(float epsilon);
+
+// Optional length NUM_STATES array that receives the gain estimate of
+// each state when the solver returns. May be NULL.
+void solver_rvi_set_gain_output(float* p_out_gain);
+
+// Optimal gain (average reward per step) found by the most recent solve
+float solver_rvi_get_gain(void);
+
+// Inputs:
+//   p_mdp_obj : A pointer to some sort of MDP object. Currently only PomdpCassandraWrapper, but
+//               make intentionally void* so we can pass around other types as well.
+//   max_solver_time_s : if 0, run as long as necessary. Otherwise halt after this many seconds
+// Outputs:
+//   p_out_policy : A pointer to an array that is a length NUM_STATES vector of uint32_t's. The policy will be written put here.
+//   p_out_value_func : A pointer to an array that is a length NUM_STATES vector of floats. The bias (relative value) vector
+//                      will be written out here, with the reference state at 0.
+
+// Return arg: 0 if completed, 1 if timed out
+int solver_rvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s);
+
+#endif //__SOLVER_RVI_H__
@@ -28,6 +28,7 @@ ENHANCEMENTS, OR MODIFICATIONS.
 
 // C
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -52,6 +53,10 @@ ENHANCEMENTS, OR MODIFICATIONS.
 
 // #define ALLOW_PRINTS
 
+// Transitions copied to the GPU at a time. The entries are gathered from
+// the model into a buffer this big rather than into a host copy of all of P.
+#define SPVI_UPLOAD_ENTRIES (1 << 20)
+
 // TEMP - Load these into ram for now
 
 static int    s_nnz = 0;
@@ -61,11 +66,7 @@ static size_t s_NsNa = 0;     // Shorthand for "Ns times Na"
 static size_t s_Ns2Na = 0;    // Shorthand for "Ns squared times Na"
 static float s_discount_factor = 0;
 static float s_stopping_thresh = 0;
-
-// Pointers to buffers in CPU RAM
-static int*   s_host_cooRowIndex = NULL;
-static int*   s_host_cooColIndex = NULL;
-static float* s_host_cooVal = NULL;
+static bool s_b_minimize = false;   // true for cost models
 
 // Pointers to buffers in GPU
 static float* s_dev_PV;
@@ -73,9 +74,8 @@ static float* s_dev_CV;
 static int*   s_dev_CP;
 static float* s_dev_Q;
 static float* s_dev_R;
-static int*   s_dev_cooRowIndex;
-static int*   s_dev_cooColIndex;
-static float* s_dev_cooVal;
+static int*   s_dev_csrColIndex;
+static float* s_dev_csrVal;
 static int*   s_dev_csrRowPtr=0;
 
 static cusparseHandle_t s_handle = 0;
@@ -88,6 +88,8 @@ static cusparseMatDescr_t s_stms_descr=0;
 static float* s_h_reduce_out_vec = NULL;
 static float* s_d_reduce_out_vec = NULL;
 
+// B_MINIMIZE selects a min over actions (cost models) instead of a max
+template <bool B_MINIMIZE>
 __global__
 void select_best_action(int num_states, int num_actions, const float *dev_Q, float *dev_CV, int* dev_CP)
 {
@@ -96,7 +98,7 @@ void select_best_action(int num_states, int num_actions, const float *dev_Q, flo
     // More kernels than states will be launched, dont go out of bounds
     if (n < num_states)
     {
-        float max_value = -1e6;
+        float best_value = backup_initial_value<B_MINIMIZE>();
         int32_t best_action = -1;
 
         for (int a_idx=0; a_idx<num_actions; a_idx++)
@@ -107,14 +109,14 @@ void select_best_action(int num_states, int num_actions, const float *dev_Q, flo
             float value_for_this_action = dev_Q[q_index];
 
             // Is this the new best action?
-            if (value_for_this_action > max_value)
+            if (backup_is_better<B_MINIMIZE>(value_for_this_action, best_value))
             {
-                max_value = value_for_this_action;
+                best_value = value_for_this_action;
                 best_action = a_idx;
             }
         }
 
-        dev_CV[n] = max_value;
+        dev_CV[n] = best_value;
         dev_CP[n] = best_action;
     }
 }
@@ -196,9 +198,9 @@ static void solver_do_backup(
             s_nnz,                      // int nnz, # of Non-Zero elements in Matrix
             &alpha,                     // const float *alpha, // Addition constant
             s_stms_descr,               // const cusparseMatDescr_t descrA, // Matrix descriptor
-            s_dev_cooVal,                 // const float *csrValA, // Values
+            s_dev_csrVal,                 // const float *csrValA, // Values
             s_dev_csrRowPtr,              // const int *csrRowPtrA, // CSR format row pointer
-            s_dev_cooColIndex,            // const int *csrColIndA, // CSR format col indicies
+            s_dev_csrColIndex,            // const int *csrColIndA, // CSR format col indicies
             &dev_PV[0],                 // const float *x,
             &fOne,                      // const float *beta,   // Addition constant
             &dev_Q[0]);                 // float *y);   //
@@ -207,7 +209,14 @@ static void solver_do_backup(
     // Select best action using CUDA kernel
     // Launch 1 kernel per MDP state
     // Use thread blocks with 256 threads per thread block
-    select_best_action<<<(s_Ns+255)/256, 256>>>(s_Ns, s_Na, dev_Q, dev_CV,dev_CP);
+    if (s_b_minimize)
+    {
+        select_best_action<true><<<(s_Ns+255)/256, 256>>>(s_Ns, s_Na, dev_Q, dev_CV,dev_CP);
+    }
+    else
+    {
+        select_best_action<false><<<(s_Ns+255)/256, 256>>>(s_Ns, s_Na, dev_Q, dev_CV,dev_CP);
+    }
 
     cudaDeviceSynchronize();
 }
@@ -216,83 +225,66 @@ float compute_sup_norm(const float* dev_v1,
                        const float* dev_v2,
                        uint32_t N)
 {
-//    static int kernel_num_blocks = (N+255)/256;
-    static int kernel_num_blocks = (N+255)/(256*2); // Need half the blocks due to optimization in kernel
+    // Each block covers two blocks' worth of entries due to optimization in kernel
     static int kernel_num_threads = 256;
+    static int kernel_num_blocks = (N+2*kernel_num_threads-1)/(2*kernel_num_threads);
 
     cudaError_t cudaErr;
 
-    // #warning "Temp hack using CPU Sup Norm!"
+    // USE GPU VERSION
+    if (s_h_reduce_out_vec == NULL)
+    {
+        #ifdef ALLOW_PRINTS
+        printf("N = %d, NB = %d, NT = %d\n", N, kernel_num_blocks, kernel_num_threads);
+        #endif
 
-    // USE CPU version for now
-    if (kernel_num_blocks == 0)
+        s_h_reduce_out_vec = (float*)malloc(sizeof(float)*kernel_num_blocks);
+        assert(s_h_reduce_out_vec != NULL);
+    }
+    if (s_d_reduce_out_vec == NULL)
     {
-        // N here is <= 256
-        float host_v1[N];
-        float host_v2[N];
 
-        cudaErr = cudaMemcpy(host_v1, dev_v1, (size_t)(N*sizeof(float)), cudaMemcpyDeviceToHost);
-        assert(cudaErr == cudaSuccess);
-        cudaErr = cudaMemcpy(host_v2, dev_v2, (size_t)(N*sizeof(float)), cudaMemcpyDeviceToHost);
+        cudaErr = cudaMalloc((void**)&s_d_reduce_out_vec, kernel_num_blocks*sizeof(float));
         assert(cudaErr == cudaSuccess);
-
-        float max_abs_delta = 0.0f;
-        float abs_delta;
-        for (uint32_t n=0; n<N; n++)
-        {
-            abs_delta = fabsf(host_v1[n]-host_v2[n]);
-            if (abs_delta > max_abs_delta)
-            {
-                // printf("[%d] %f > %f, new_max_abs_delta\n", n, abs_delta, max_abs_delta);
-                max_abs_delta = abs_delta;
-            }
-        }
-        return max_abs_delta;
     }
-    else
-    {
-        // USE GPU VERSION
-        if (s_h_reduce_out_vec == NULL)
-        {
-            // TODO - We could allocate these earlier. Doing them here since size is a function of
-            // kernel_num_blocks
 
-            #ifdef ALLOW_PRINTS
-            printf("N = %d, NB = %d, NT = %d\n", N, kernel_num_blocks, kernel_num_threads);
-            #endif
+    // Do first stage reduction using CUDA kernel
+    // This leaves a length kernel_num_blocks array that needs to still be reduced
+    reduce_sup_norm<<<kernel_num_blocks, kernel_num_threads, kernel_num_threads*sizeof(float)>>>(dev_v1, dev_v2, s_d_reduce_out_vec, N);
+    cudaDeviceSynchronize();
 
-            s_h_reduce_out_vec = (float*)malloc(sizeof(float)*kernel_num_blocks);
-            assert(s_h_reduce_out_vec != NULL);
-        }
-        if (s_d_reduce_out_vec == NULL)
-        {
+    cudaErr = cudaMemcpy(s_h_reduce_out_vec, s_d_reduce_out_vec, (size_t)(kernel_num_blocks*sizeof(float)), cudaMemcpyDeviceToHost);
+    checkCudaErrors(cudaErr);
+    assert(cudaErr == cudaSuccess);
 
-            cudaErr = cudaMalloc((void**)&s_d_reduce_out_vec, kernel_num_blocks*sizeof(float));
-            assert(cudaErr == cudaSuccess);
+    float temp_max = 0.0f;
+    for (int n=0; n<kernel_num_blocks; n++)
+    {
+        if (s_h_reduce_out_vec[n] > temp_max)
+        {
+            temp_max = s_h_reduce_out_vec[n];
         }
+    }
 
-        // Do first stage reduction using CUDA kernel
-        // This leaves a length kernel_num_blocks array that needs to still be reduced
-        reduce_sup_norm<<<kernel_num_blocks, kernel_num_threads, kernel_num_threads*sizeof(float)>>>(dev_v1, dev_v2, s_d_reduce_out_vec, N);
-        cudaDeviceSynchronize();
-
-        cudaErr = cudaMemcpy(s_h_reduce_out_vec, s_d_reduce_out_vec, (size_t)(kernel_num_blocks*sizeof(float)), cudaMemcpyDeviceToHost);
-        checkCudaErrors(cudaErr);
-        assert(cudaErr == cudaSuccess);
+    //printf("CPU,CUDA sup_norm = %f %f\t", max_abs_delta, temp_max);
+    return temp_max;
+}
 
-        float temp_max = 0.0f;
-        for (int n=0; n<kernel_num_blocks; n++)
-        {
-            if (s_h_reduce_out_vec[n] > temp_max)
-            {
-                temp_max = s_h_reduce_out_vec[n];
-            }
-        }
+// Copies num_entries staged transitions to entry offset of the CSR arrays on the GPU
+static void upload_entries(const int* host_col, const float* host_val, size_t offset, size_t num_entries)
+{
+    cudaError_t cudaStat;
 
-        //printf("CPU,CUDA sup_norm = %f %f\t", max_abs_delta, temp_max);
-        return temp_max;
+    if (num_entries == 0)
+    {
+        return;
     }
 
+    cudaStat = cudaMemcpy(&s_dev_csrColIndex[offset], host_col, num_entries*sizeof(int), cudaMemcpyHostToDevice);
+    assert(cudaStat == cudaSuccess);
+
+    cudaStat = cudaMemcpy(&s_dev_csrVal[offset], host_val, num_entries*sizeof(float), cudaMemcpyHostToDevice);
+    assert(cudaStat == cudaSuccess);
 }
 
 // This function currently assumes that the input format is the cassandra format
@@ -305,70 +297,63 @@ static void change_mdp_format(void* p_mdp_obj)
     s_discount_factor = p_mdp->getDiscount();
     s_Ns = p_mdp->getNumStates();
     s_Na = p_mdp->getNumActions();
+    s_b_minimize = p_mdp->isCost();
 
     s_NsNa = s_Ns*s_Na;
     s_Ns2Na = s_Ns*s_Ns*s_Na;
 
-    float eps = 0.5f;
-    s_stopping_thresh = (eps * (1-s_discount_factor)) / (2*s_discount_factor);
+    s_stopping_thresh = solver_stopping_threshold(s_discount_factor);
 
     // -------------------------------------
-    // Load MDP STM,R into Host RAM
+    // Count the transitions
     // -------------------------------------
-    // Populate STMs in COO format
+    // The STMs go to the GPU in CSR format. Row a*Ns + s holds P(.|s,a),
+    // the row of (s,a) in Q. Only the row pointers are built on the host;
+    // the entries are read straight from the single precision matrices of
+    // the model.
 
-    s_nnz = 0;
-    for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
-    {
-        CassandraMatrix single_stm = p_mdp->getT(a_idx);
-        s_nnz += single_stm->num_non_zero;
-    }
+    int* host_csrRowPtr = (int*)malloc((s_NsNa+1)*sizeof(int));
+    assert(host_csrRowPtr != NULL);
 
-    printf("Total non-zero entries = %d / %lu (= %.3f %% Sparse)\n",
-           s_nnz, s_Ns2Na, 100.0f*((float)(s_Ns2Na-s_nnz))/(float(s_Ns2Na)));
-
-    s_host_cooRowIndex = (int*)malloc(s_nnz*sizeof(int));
-    s_host_cooColIndex = (int*)malloc(s_nnz*sizeof(int));
-    s_host_cooVal =    (float*)malloc(s_nnz*sizeof(float));
-
-    uint32_t count = 0;
+    size_t count = 0;
     for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
     {
-        CassandraMatrix single_stm = p_mdp->getT(a_idx);
-        // displayMatrix(single_stm);
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
         for (uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
         {
-            for (uint32_t next_s_idx=0; next_s_idx<s_Ns; next_s_idx++)
+            // Rows may share storage, so count the entries of each row
+            host_csrRowPtr[a_idx*s_Ns + s_idx] = (int)count;
+            int row_begin = single_stm->row_start[s_idx];
+            int row_end = row_begin + single_stm->row_length[s_idx];
+            for (int j=row_begin; j<row_end; j++)
             {
-                float transition_prob = getEntryMatrix(single_stm, s_idx, next_s_idx);
-                if (transition_prob > 0.0f)
+                if (single_stm->mat_val[j] > 0.0f)
                 {
-                    assert(count < s_nnz);
-                    s_host_cooRowIndex[count] = s_idx + a_idx*s_Ns;
-                    s_host_cooColIndex[count] = next_s_idx;
-                    s_host_cooVal[count] = transition_prob;
                     count++;
                 }
             }
         }
     }
-    assert(count == s_nnz);
+    assert(count <= INT_MAX);
+    host_csrRowPtr[s_NsNa] = (int)count;
+    s_nnz = (int)count;
 
-    // Populate R in full matrix format
+    printf("Total non-zero entries = %d / %lu (= %.3f %% Sparse)\n",
+           s_nnz, s_Ns2Na, 100.0f*((float)(s_Ns2Na-s_nnz))/(float(s_Ns2Na)));
+
+    // Populate R in full matrix format, in the same order as the rows
     float* R_2D_lut = (float*)malloc(sizeof(float)*s_NsNa);
     memset(R_2D_lut, 0, sizeof(float)*s_NsNa);
 
-    uint32_t r_idx = 0;
     CassandraMatrix cassandra_RTranspose = p_mdp->getRTranspose();
     // displayMatrix(cassandra_RTranspose);
     for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
     {
-        for(uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
+        int row_begin = cassandra_RTranspose->row_start[a_idx];
+        int row_end = row_begin + cassandra_RTranspose->row_length[a_idx];
+        for (int j=row_begin; j<row_end; j++)
         {
-            float reward = getEntryMatrix(cassandra_RTranspose, a_idx, s_idx);
-            R_2D_lut[r_idx] = reward;
-            // printf("[%d] : R(%d, %d) <= %f\n", r_idx, a_idx, s_idx, reward);
-            r_idx++;
+            R_2D_lut[a_idx*s_Ns + cassandra_RTranspose->col[j]] = cassandra_RTranspose->mat_val[j];
         }
     }
 
@@ -381,7 +366,7 @@ static void change_mdp_format(void* p_mdp_obj)
     cudaStat = cudaMalloc((void**)&s_dev_PV, s_Ns*sizeof(float));
     assert(cudaStat == cudaSuccess);
 
-    cudaStat = cudaMemset(s_dev_PV, 0, s_Ns);
+    cudaStat = cudaMemset(s_dev_PV, 0, s_Ns*sizeof(float));
     assert(cudaStat == cudaSuccess);
 
     cudaStat = cudaMalloc((void**)&s_dev_CV, s_Ns*sizeof(float));
@@ -398,31 +383,62 @@ static void change_mdp_format(void* p_mdp_obj)
     assert(cudaStat == cudaSuccess);
 
     // STMs
-    cudaStat = cudaMalloc((void**)&s_dev_cooRowIndex, s_nnz*sizeof(int));
-    assert(cudaStat == cudaSuccess);
-
-    cudaStat = cudaMalloc((void**)&s_dev_cooColIndex, s_nnz*sizeof(int));
+    cudaStat = cudaMalloc((void**)&s_dev_csrColIndex, count*sizeof(int));
     assert(cudaStat == cudaSuccess);
 
-    cudaStat = cudaMalloc((void**)&s_dev_cooVal, s_nnz*sizeof(float));
+    cudaStat = cudaMalloc((void**)&s_dev_csrVal, count*sizeof(float));
     assert(cudaStat == cudaSuccess);
 
-    cudaStat = cudaMalloc((void**)&s_dev_csrRowPtr,(s_Ns+1)*sizeof(int));
+    cudaStat = cudaMalloc((void**)&s_dev_csrRowPtr,(s_NsNa+1)*sizeof(int));
     assert(cudaStat == cudaSuccess);
 
     // -------------------------------------
     // Copy data to device
     // -------------------------------------
 
-    // Copy STM from host to device
-    cudaStat = cudaMemcpy(s_dev_cooRowIndex, s_host_cooRowIndex, (size_t)(count*sizeof(int)), cudaMemcpyHostToDevice);
+    // Copy STM from host to device, SPVI_UPLOAD_ENTRIES entries at a time
+    cudaStat = cudaMemcpy(s_dev_csrRowPtr, host_csrRowPtr, (size_t)((s_NsNa+1)*sizeof(int)), cudaMemcpyHostToDevice);
     assert(cudaStat == cudaSuccess);
 
-    cudaStat = cudaMemcpy(s_dev_cooColIndex, s_host_cooColIndex, (size_t)(count*sizeof(int)), cudaMemcpyHostToDevice);
-    assert(cudaStat == cudaSuccess);
+    int* host_col = (int*)malloc(SPVI_UPLOAD_ENTRIES*sizeof(int));
+    float* host_val = (float*)malloc(SPVI_UPLOAD_ENTRIES*sizeof(float));
+    assert((host_col != NULL) && (host_val != NULL));
 
-    cudaStat = cudaMemcpy(s_dev_cooVal, s_host_cooVal, (size_t)(count*sizeof(float)), cudaMemcpyHostToDevice);
-    assert(cudaStat == cudaSuccess);
+    size_t num_uploaded = 0;
+    size_t num_staged = 0;
+    for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
+    {
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
+        for (uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
+        {
+            int row_begin = single_stm->row_start[s_idx];
+            int row_end = row_begin + single_stm->row_length[s_idx];
+            for (int j=row_begin; j<row_end; j++)
+            {
+                float transition_prob = single_stm->mat_val[j];
+                if (transition_prob > 0.0f)
+                {
+                    host_col[num_staged] = single_stm->col[j];
+                    host_val[num_staged] = transition_prob;
+                    num_staged++;
+                }
+
+                if (num_staged == SPVI_UPLOAD_ENTRIES)
+                {
+                    upload_entries(host_col, host_val, num_uploaded, num_staged);
+                    num_uploaded += num_staged;
+                    num_staged = 0;
+                }
+            }
+        }
+    }
+    upload_entries(host_col, host_val, num_uploaded, num_staged);
+    num_uploaded += num_staged;
+    assert(num_uploaded == count);
+
+    free(host_col);
+    free(host_val);
+    free(host_csrRowPtr);
 
     // Copy rewards from host to device
     const float* host_R = R_2D_lut;
@@ -430,7 +446,7 @@ static void change_mdp_format(void* p_mdp_obj)
     assert(cudaStat == cudaSuccess);
 
     // Dont need this anymore. Free it.
-    if (R_2D_lut != NULL) {free(s_h_reduce_out_vec);}
+    if (R_2D_lut != NULL) {free(R_2D_lut);}
 
     // -------------------------------------
     // Init cuSpare library and structures
@@ -451,15 +467,6 @@ static void change_mdp_format(void* p_mdp_obj)
     }
     cusparseSetMatType(s_stms_descr,CUSPARSE_MATRIX_TYPE_GENERAL);
     cusparseSetMatIndexBase(s_stms_descr,CUSPARSE_INDEX_BASE_ZERO);
-
-    // Transform STMs from COO to CSR format
-    status = cusparseXcoo2csr(s_handle,
-            s_dev_cooRowIndex,
-            count,
-            s_Ns,
-            s_dev_csrRowPtr,
-            CUSPARSE_INDEX_BASE_ZERO);
-    assert(status == CUSPARSE_STATUS_SUCCESS);
 }
 
 int solver_spvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
@@ -483,6 +490,7 @@ int solver_spvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_valu
     while(!b_done)
     {
         num_iterations++;
+
         solver_do_backup(
                 s_dev_R,
                 s_dev_PV,
@@ -523,24 +531,25 @@ int solver_spvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_valu
         //        if (num_iterations == 2) b_done = true;
 
         // The value function computed in this iteration now becomes the "previous" value function.
-        cudaError_t cudaErr;
-        cudaErr = cudaMemcpy(s_dev_PV, s_dev_CV, (size_t)(s_Ns*sizeof(float)), cudaMemcpyDeviceToDevice);
-        assert(cudaErr == cudaSuccess);
+        // Swap the buffers instead of copying the whole vector.
+        float* temp = s_dev_PV;
+        s_dev_PV = s_dev_CV;
+        s_dev_CV = temp;
     }
 
+    solver_set_num_iterations(num_iterations);
+
     // Done. Save off policy and value
     cudaError_t cudaErr;
     cudaErr = cudaMemcpy(p_out_policy, s_dev_CP, (size_t)(s_Ns*sizeof(int)), cudaMemcpyDeviceToHost);
     assert(cudaErr == cudaSuccess);
 
-    cudaErr = cudaMemcpy(p_out_value_func, s_dev_CV, (size_t)(s_Ns*sizeof(float)), cudaMemcpyDeviceToHost);
+    // The most recent value function is in s_dev_PV after the final swap
+    cudaErr = cudaMemcpy(p_out_value_func, s_dev_PV, (size_t)(s_Ns*sizeof(float)), cudaMemcpyDeviceToHost);
     assert(cudaErr == cudaSuccess);
 
 
     // Free any CPU RAM that was malloc'd in this function
-    if (s_host_cooRowIndex != NULL) {free(s_host_cooRowIndex);}
-    if (s_host_cooColIndex != NULL) {free(s_host_cooColIndex);}
-    if (s_host_cooVal != NULL) {free(s_host_cooVal);}
     if (s_h_reduce_out_vec != NULL) {free(s_h_reduce_out_vec);}
 
 
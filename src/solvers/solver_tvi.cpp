@@ -0,0 +1,374 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Solver interfaces
+#include "solver_tvi.h"
+#include "sparse_mdp.h"
+
+// Misc files
+#include "utils.h"
+
+#define TVI_UNVISITED (0xFFFFFFFFu)
+
+static struct sparse_mdp s_mdp;
+static float s_stopping_thresh = 0;
+
+// Strongly connected components, stored as a list of states grouped by
+// component. Component k holds s_scc_states[s_scc_start[k] .. s_scc_start[k+1]-1].
+// Components are stored in the order Tarjan's algorithm emits them, which
+// is reverse topological order: every component only has edges into
+// itself or into components stored before it.
+static uint32_t s_num_sccs = 0;
+static uint32_t* s_scc_states = NULL;
+static uint32_t* s_scc_start = NULL;
+
+// Uniform rows are not stored, so instead of Ns edges each, a state with
+// a uniform row gets a single edge to an extra "hub" node (number Ns),
+// and the hub has an edge to every state. The hub never shows up in the
+// components.
+
+// Moves the cursor of state v to the start of the row of its next action
+static void next_row(uint32_t v, uint32_t* cur_action, uint32_t* cur_pos)
+{
+    cur_action[v]++;
+    cur_pos[v] = 0;
+}
+
+// Finds the next successor of state v, using (cur_action[v], cur_pos[v])
+// as a cursor over the rows of all actions, cur_pos[v] being the position
+// within the row. Returns false when all of v's edges have been visited.
+static bool next_successor(uint32_t v, uint32_t* cur_action, uint32_t* cur_pos, uint32_t* p_w)
+{
+    uint32_t hub = s_mdp.Ns;
+    if (v == hub)
+    {
+        if (cur_pos[v] < s_mdp.Ns)
+        {
+            *p_w = cur_pos[v]++;
+            return true;
+        }
+        return false;
+    }
+
+    while (cur_action[v] < s_mdp.Na)
+    {
+        uint32_t row = sparse_mdp_row(&s_mdp, v, cur_action[v]);
+        uint8_t row_kind = sparse_mdp_row_kind(&s_mdp, row);
+        if (row_kind != SPARSE_ROW_EXPLICIT)
+        {
+            *p_w = (row_kind == SPARSE_ROW_UNIFORM) ? hub : v;
+            next_row(v, cur_action, cur_pos);
+            return true;
+        }
+
+        const float* row_val;
+        const uint32_t* row_col_idx;
+        uint32_t row_length = sparse_mdp_row_entries(&s_mdp, v, cur_action[v], &row_val, &row_col_idx);
+        if (cur_pos[v] < row_length)
+        {
+            *p_w = row_col_idx[cur_pos[v]];
+            cur_pos[v]++;
+            return true;
+        }
+
+        next_row(v, cur_action, cur_pos);
+    }
+    return false;
+}
+
+// Iterative version of Tarjan's SCC algorithm. An explicit call stack is
+// used instead of recursion so that long chains of states cannot overflow
+// the program stack.
+static void compute_sccs(void)
+{
+    uint32_t Ns = s_mdp.Ns;
+    uint32_t hub = Ns;
+
+    // One more node for the hub
+    uint32_t* index = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    uint32_t* lowlink = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    uint32_t* cur_action = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    uint32_t* cur_pos = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    uint32_t* call_stack = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    uint32_t* scc_stack = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    bool* on_stack = (bool*)malloc(sizeof(bool)*(Ns+1));
+    assert((index != NULL) && (lowlink != NULL) && (cur_action != NULL) && (cur_pos != NULL));
+    assert((call_stack != NULL) && (scc_stack != NULL) && (on_stack != NULL));
+
+    s_scc_states = (uint32_t*)malloc(sizeof(uint32_t)*Ns);
+    s_scc_start = (uint32_t*)malloc(sizeof(uint32_t)*(Ns+1));
+    assert((s_scc_states != NULL) && (s_scc_start != NULL));
+
+    for (uint32_t v=0; v<=Ns; v++)
+    {
+        index[v] = TVI_UNVISITED;
+        on_stack[v] = false;
+    }
+
+    uint32_t next_index = 0;
+    uint32_t call_depth = 0;
+    uint32_t scc_depth = 0;
+    uint32_t num_emitted = 0;
+    s_num_sccs = 0;
+
+    for (uint32_t root=0; root<Ns; root++)
+    {
+        if (index[root] != TVI_UNVISITED)
+        {
+            continue;
+        }
+
+        // "Call" root
+        index[root] = lowlink[root] = next_index++;
+        cur_action[root] = 0;
+        cur_pos[root] = 0;
+        scc_stack[scc_depth++] = root;
+        on_stack[root] = true;
+        call_stack[call_depth++] = root;
+
+        while (call_depth > 0)
+        {
+            uint32_t v = call_stack[call_depth-1];
+            uint32_t w;
+
+            if (next_successor(v, cur_action, cur_pos, &w))
+            {
+                if (index[w] == TVI_UNVISITED)
+                {
+                    // "Call" w
+                    index[w] = lowlink[w] = next_index++;
+                    cur_action[w] = 0;
+                    cur_pos[w] = 0;
+                    scc_stack[scc_depth++] = w;
+                    on_stack[w] = true;
+                    call_stack[call_depth++] = w;
+                }
+                else if (on_stack[w] && (index[w] < lowlink[v]))
+                {
+                    lowlink[v] = index[w];
+                }
+            }
+            else
+            {
+                // All successors of v done, "return" from v
+                call_depth--;
+
+                if (lowlink[v] == index[v])
+                {
+                    // v is the root of a component. Pop it off the stack.
+                    uint32_t scc_begin = num_emitted;
+                    uint32_t u;
+                    do
+                    {
+                        u = scc_stack[--scc_depth];
+                        on_stack[u] = false;
+                        if (u != hub)
+                        {
+                            s_scc_states[num_emitted++] = u;
+                        }
+                    } while (u != v);
+
+                    if (num_emitted > scc_begin)
+                    {
+                        s_scc_start[s_num_sccs++] = scc_begin;
+                    }
+                }
+
+                if (call_depth > 0)
+                {
+                    uint32_t parent = call_stack[call_depth-1];
+                    if (lowlink[v] < lowlink[parent])
+                    {
+                        lowlink[parent] = lowlink[v];
+                    }
+                }
+            }
+        }
+    }
+    assert(num_emitted == Ns);
+    s_scc_start[s_num_sccs] = num_emitted;
+
+    free(index);
+    free(lowlink);
+    free(cur_action);
+    free(cur_pos);
+    free(call_stack);
+    free(scc_stack);
+    free(on_stack);
+}
+
+// True if any action of state s_idx can transition back to s_idx
+static bool has_self_loop(uint32_t s_idx)
+{
+    for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+    {
+        uint32_t row = sparse_mdp_row(&s_mdp, s_idx, a_idx);
+        if (sparse_mdp_row_kind(&s_mdp, row) != SPARSE_ROW_EXPLICIT)
+        {
+            return true;
+        }
+        const float* row_val;
+        const uint32_t* row_col_idx;
+        uint32_t row_length = sparse_mdp_row_entries(&s_mdp, s_idx, a_idx, &row_val, &row_col_idx);
+        for (uint32_t j=0; j<row_length; j++)
+        {
+            if (row_col_idx[j] == s_idx)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Bellman backup of a single state, in place. Returns |new - old| value.
+static float backup_state(uint32_t s_idx, float* value, uint32_t* policy)
+{
+    float max_value = backup_initial_value<false>();
+    uint32_t best_action = -1;
+
+    for (uint32_t a_idx=0; a_idx<s_mdp.Na; a_idx++)
+    {
+        float value_for_this_action = sparse_mdp_q_value(&s_mdp, s_idx, a_idx, value);
+        if (value_for_this_action > max_value)
+        {
+            max_value = value_for_this_action;
+            best_action = a_idx;
+        }
+    }
+
+    float abs_delta = fabsf(max_value - value[s_idx]);
+    sparse_mdp_set_value(&s_mdp, value, s_idx, max_value);
+    policy[s_idx] = best_action;
+    return abs_delta;
+}
+
+int solver_tvi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_func, int max_solver_time_s)
+{
+    // Load in MDP from external format
+    sparse_mdp_load(&s_mdp, p_mdp_obj);
+
+    s_stopping_thresh = solver_stopping_threshold(s_mdp.discount_factor);
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start_time);
+
+    compute_sccs();
+
+    uint32_t largest_scc = 0;
+    for (uint32_t k=0; k<s_num_sccs; k++)
+    {
+        uint32_t scc_size = s_scc_start[k+1] - s_scc_start[k];
+        if (scc_size > largest_scc)
+        {
+            largest_scc = scc_size;
+        }
+    }
+    printf("%u strongly connected components, largest has %u states\n", s_num_sccs, largest_scc);
+
+    // Set value func to all zeros
+    memset(p_out_value_func, 0, sizeof(float)*s_mdp.Ns);
+    sparse_mdp_prepare(&s_mdp, p_out_value_func);
+
+    // Solve components downstream first. Values of the components a
+    // component depends on are already final when it is reached, so each
+    // component is iterated (in place) until it alone has converged.
+    // Iterations are the sweeps over components, summed over all of them
+    uint64_t num_state_backups = 0;
+    uint32_t num_iterations = 0;
+    bool b_timed_out = false;
+    for (uint32_t k=0; (k<s_num_sccs) && !b_timed_out; k++)
+    {
+        const uint32_t* scc_states = &s_scc_states[s_scc_start[k]];
+        uint32_t scc_size = s_scc_start[k+1] - s_scc_start[k];
+
+        // A single state that cannot reach itself only depends on final
+        // values, so one backup is exact.
+        if ((scc_size == 1) && !has_self_loop(scc_states[0]))
+        {
+            backup_state(scc_states[0], p_out_value_func, p_out_policy);
+            num_state_backups++;
+            num_iterations++;
+            continue;
+        }
+
+        bool b_done = false;
+        while (!b_done)
+        {
+            float sup_norm = 0.0f;
+            for (uint32_t n=0; n<scc_size; n++)
+            {
+                float abs_delta = backup_state(scc_states[n], p_out_value_func, p_out_policy);
+                if (abs_delta > sup_norm)
+                {
+                    sup_norm = abs_delta;
+                }
+            }
+            num_state_backups += scc_size;
+            num_iterations++;
+
+            if (sup_norm < s_stopping_thresh)
+            {
+                b_done = true;
+            }
+            else if (solver_timed_out(&start_time, max_solver_time_s))
+            {
+                b_done = true;
+                b_timed_out = true;
+            }
+        }
+    }
+
+    printf("State backups = %llu (%.1f full sweeps)\n",
+           (unsigned long long)num_state_backups, (double)num_state_backups/(double)s_mdp.Ns);
+    solver_set_num_iterations(num_iterations);
+
+    // De-allocate everything malloc'd in this function
+    if (s_scc_states != NULL) {free(s_scc_states); s_scc_states = NULL;}
+    if (s_scc_start != NULL) {free(s_scc_start); s_scc_start = NULL;}
+
+    sparse_mdp_free(&s_mdp);
+
+    if (b_timed_out)
+    {
+        return(1);
+    }
+    else
+    {
+        return(0);
+    }
+}
@@ -40,6 +40,7 @@ ENHANCEMENTS, OR MODIFICATIONS.
 
 // Solver interfaces
 #include "solver_vi.h"
+#include "backup_kernels.h"
 
 // Misc files
 #include "utils.h"
@@ -52,85 +53,85 @@ static uint32_t s_Na = 0;
 static uint32_t s_Ns = 0;
 static float s_discount_factor = 0;
 static float s_stopping_thresh = 0;
+static bool s_b_minimize = false;   // true for cost models
 
-// This function does one iteration of Bellman backup
+// Cache blocking of the backup, and the Q sums of one block of states
+static struct dense_tiling s_tiling;
+static float* s_block_sums = NULL;
+
+// This function does one iteration of Bellman backup. The table is
+// state-major, so the Na rows of a state are one contiguous block that
+// is read front to back, and the best Q value and the change in the
+// state's value are taken in the same pass. Q is never stored.
+// States are backed up s_tiling.block_states at a time: the sums of all
+// their rows are finished tile by tile first, then the best action of
+// each state is picked from them.
 
 // The previous value function is taken from "value"
 // The resulting value function is stored in next_value
 // The resulting policy is stored in next_policy
-static void solver_do_backup(float* value,
-                             float* next_value,
-                             uint32_t* next_policy)
+// Returns the sup norm of next_value-value
+// B_MINIMIZE selects a min over actions (cost models) instead of a max
+template <bool B_MINIMIZE>
+static float solver_do_backup(const float* value,
+                              float* next_value,
+                              uint32_t* next_policy)
 {
-    float max_value;
+    float best_value;
     uint32_t best_action;
     float summation;
-    for (uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
+    float sup_norm = 0.0f;
+    for (uint32_t block_begin=0; block_begin<s_Ns; block_begin+=s_tiling.block_states)
     {
-        // Initialization on each new starting state
-        max_value = -1e6;
-        best_action = -1;
+        uint32_t block_end = block_begin + s_tiling.block_states;
+        if (block_end > s_Ns)
+        {
+            block_end = s_Ns;
+        }
 
-        // Loop over all candidate actions
-        for (uint32_t a_idx=0; a_idx<s_Na; a_idx++)
+        // Compute entire summations of the block
+        backup_kernels_dense_block(&s_STMs_lut[(size_t)block_begin*s_Na*s_Ns], (block_end-block_begin)*s_Na,
+                                   s_Ns, value, s_tiling.col_tile, s_block_sums);
+
+        for (uint32_t s_idx=block_begin; s_idx<block_end; s_idx++)
         {
-            // Compute entire summation
-            summation = 0.0f;
-            for (uint32_t next_s_idx=0; next_s_idx<s_Ns; next_s_idx++)
+            // Initialization on each new starting state
+            best_value = backup_initial_value<B_MINIMIZE>();
+            best_action = -1;
+
+            const float* sums = &s_block_sums[(size_t)(s_idx-block_begin)*s_Na];
+            const float* rewards = &s_R_2D_lut[(size_t)s_idx*s_Na];
+
+            // Loop over all candidate actions
+            for (uint32_t a_idx=0; a_idx<s_Na; a_idx++)
             {
-//                if (p_params->alg == SOLVER_ALG_VI)
-#if 1
-                uint32_t stm_index = a_idx*(s_Ns*s_Ns) + (s_idx*s_Ns) + next_s_idx;
-                float p = s_STMs_lut[stm_index];
-                summation += (p * value[next_s_idx]);
-#else
-                float p = p_mdp->STM(s_idx, a_idx, next_s_idx);
-                if (p>0.0f)
+                summation = sums[a_idx];
+
+                // Add immediate reward of (s,a)
+                float value_for_this_action = rewards[a_idx] + s_discount_factor*summation;
+
+                // Is this the new best action?
+                if (backup_is_better<B_MINIMIZE>(value_for_this_action, best_value))
                 {
-                    summation += (p * value[next_s_idx]);
+                    best_value = value_for_this_action;
+                    best_action = a_idx;
+
                 }
-#endif
-            }
+            }   // end a_idx loop
 
-            // Add immediate reward of (s,a)
-            float immediate_reward;
-#if 1
-                uint32_t r_index = a_idx*s_Ns + s_idx;
-                immediate_reward = s_R_2D_lut[r_index];
-#else
-                immediate_reward = p_mdp->R(s_idx, a_idx);
-#endif
-            float value_for_this_action = immediate_reward + s_discount_factor*summation;
-
-            // Is this the new best action?
-            if (value_for_this_action > max_value)
-            {
-                max_value = value_for_this_action;
-                best_action = a_idx;
+            next_value[s_idx] = best_value;
+            next_policy[s_idx] = best_action;
 
+            float abs_delta = fabsf(best_value - value[s_idx]);
+            if (abs_delta > sup_norm)
+            {
+                sup_norm = abs_delta;
             }
-        }   // end a_idx loop
 
-        next_value[s_idx] = max_value;
-        next_policy[s_idx] = best_action;
+        } // end s_idx loop
+    } // end block loop
 
-    } // end s_idx loop
-}
-
-
-static float compute_sup_norm(float* v1, float* v2, uint32_t N)
-{
-    float max_abs_delta = 0.0f;
-    float abs_delta;
-    for (uint32_t n=0; n<N; n++)
-    {
-        abs_delta = fabsf(v1[n]-v2[n]);
-        if (abs_delta > max_abs_delta)
-        {
-            max_abs_delta = abs_delta;
-        }
-    }
-    return max_abs_delta;
+    return sup_norm;
 }
 
 // This function currently assumes that the input format is the cassandra format
@@ -143,45 +144,42 @@ static void change_mdp_format(void* p_mdp_obj)
     s_discount_factor = p_mdp->getDiscount();
     s_Ns = p_mdp->getNumStates();
     s_Na = p_mdp->getNumActions();
+    s_b_minimize = p_mdp->isCost();
 
-    float eps = 0.5f;
-    s_stopping_thresh = (0.5f * (1-s_discount_factor)) / (2*s_discount_factor);
+    s_stopping_thresh = solver_stopping_threshold(s_discount_factor);
 
+    // Both tables are state-major: STM(s,a,s') is at s*Na*Ns + a*Ns + s'
+    // and R(s,a) is at s*Na + a
     s_STMs_lut = (float*)malloc(sizeof(float)*s_Ns*s_Ns*s_Na);
     s_R_2D_lut = (float*)malloc(sizeof(float)*s_Ns*s_Na);
 
     memset(s_STMs_lut, 0, sizeof(float)*s_Ns*s_Na*s_Ns);
     memset(s_R_2D_lut, 0, sizeof(float)*s_Ns*s_Na);
 
-    uint32_t stm_idx = 0;
+    // Scatter the non-zero entries of each sparse row into the dense table
     for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
     {
-        CassandraMatrix single_stm = p_mdp->getT(a_idx);
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
         for(uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
         {
-            for(uint32_t next_s_idx=0; next_s_idx<s_Ns; next_s_idx++)
+            float* stm_row = &s_STMs_lut[(size_t)s_idx*s_Na*s_Ns + (size_t)a_idx*s_Ns];
+            int row_begin = single_stm->row_start[s_idx];
+            int row_end = row_begin + single_stm->row_length[s_idx];
+            for (int j=row_begin; j<row_end; j++)
             {
-                float transition_prob = getEntryMatrix(single_stm, s_idx, next_s_idx);
-                s_STMs_lut[stm_idx] = transition_prob;
-//                printf("[%d] : STM(%d, %d) <= %f\n", stm_idx, s_idx, next_s_idx, transition_prob);
-
-                stm_idx++;
+                stm_row[single_stm->col[j]] = single_stm->mat_val[j];
             }
         }
     }
 
-    uint32_t r_idx = 0;
     CassandraMatrix cassandra_RTranspose = p_mdp->getRTranspose();
-//    displayMatrix(cassandra_RTranspose);
     for(uint32_t a_idx=0; a_idx<s_Na; a_idx++)
     {
-        for(uint32_t s_idx=0; s_idx<s_Ns; s_idx++)
+        int row_begin = cassandra_RTranspose->row_start[a_idx];
+        int row_end = row_begin + cassandra_RTranspose->row_length[a_idx];
+        for (int j=row_begin; j<row_end; j++)
         {
-            float reward = getEntryMatrix(cassandra_RTranspose, a_idx, s_idx);
-            s_R_2D_lut[r_idx] = reward;
-//            printf("[%d] : R(%d, %d) <= %f\n", r_idx, a_idx, s_idx, reward);
-
-            r_idx++;
+            s_R_2D_lut[(size_t)cassandra_RTranspose->col[j]*s_Na + a_idx] = cassandra_RTranspose->mat_val[j];
         }
     }
 }
@@ -194,9 +192,12 @@ int solver_vi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_
     // Set value func to all zeros
     memset(p_out_value_func, 0, sizeof(float)*s_Ns);
 
-    // Allocate storage for temp working value function and policy
+    // Allocate storage for temp working value function
+    float* value = p_out_value_func;
     float* next_value = (float*)malloc(sizeof(float)*s_Ns);
-    uint32_t* next_policy = (uint32_t*)malloc(sizeof(uint32_t)*s_Ns);
+
+    backup_kernels_tune_dense(s_STMs_lut, s_Ns, s_Na, value, &s_tiling);
+    s_block_sums = (float*)malloc(sizeof(float)*s_tiling.block_states*s_Na);
 
 //    printf("Starting Value Iteration\n");
 
@@ -210,11 +211,16 @@ int solver_vi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_
     {
         num_iterations++;
 
-        // Do one Bellman backup iteration
-        solver_do_backup(p_out_value_func, next_value, next_policy);
-
-        // Compute stopping criteria
-        float sup_norm = compute_sup_norm(p_out_value_func, next_value, s_Ns);
+        // Do one Bellman backup iteration, which also gives the stopping criteria
+        float sup_norm;
+        if (s_b_minimize)
+        {
+            sup_norm = solver_do_backup<true>(value, next_value, p_out_policy);
+        }
+        else
+        {
+            sup_norm = solver_do_backup<false>(value, next_value, p_out_policy);
+        }
 
         if (sup_norm < s_stopping_thresh)
         {
@@ -245,16 +251,25 @@ int solver_vi_solve(void* p_mdp_obj, uint32_t* p_out_policy, float* p_out_value_
 //        if (num_iterations == 2) b_done = true;
 
         // The value function computed in this iteration now becomes the "previous" value function.
-        memcpy(p_out_value_func, next_value, sizeof(float)*s_Ns);
+        // Swap the buffers instead of copying the whole vector.
+        float* temp = value;
+        value = next_value;
+        next_value = temp;
     }
 
-    // Done. Save off policy
-    memcpy(p_out_policy, next_policy, sizeof(uint32_t)*s_Ns);
+    solver_set_num_iterations(num_iterations);
+
+    // Done. The most recent value function is in "value" after the final swap
+    if (value != p_out_value_func)
+    {
+        memcpy(p_out_value_func, value, sizeof(float)*s_Ns);
+        next_value = value;
+    }
 
     // De-allocate everything malloc'd in this function
-    if(next_policy != NULL) {free(next_policy);}
     if(next_value != NULL) {free(next_value);}
 
+    if (s_block_sums != NULL) {free(s_block_sums);}
     if (s_STMs_lut != NULL) {free(s_STMs_lut);}
     if (s_R_2D_lut != NULL) {free(s_R_2D_lut);}
 
@@ -0,0 +1,418 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File parser interfaces
+#include "pomdpCassandraWrapper.h"
+
+#include "sparse_mdp.h"
+
+static uint8_t s_layout = SPARSE_LAYOUT_CSR;
+
+void sparse_mdp_set_layout(uint8_t layout)
+{
+    s_layout = layout;
+}
+
+// Kind of row s_idx of a Cassandra transition matrix. Rows that a model
+// resets to the same template (e.g. with "uniform") share their entries,
+// so once a row has been checked to be uniform, uniform_begin remembers
+// where it is stored and rows that share it are recognized in O(1).
+static uint8_t classify_row(CassandraSingleMatrix single_stm, uint32_t s_idx, uint32_t Ns,
+                            int* p_uniform_begin, float* p_uniform_prob)
+{
+    int row_begin = single_stm->row_start[s_idx];
+    int row_length = single_stm->row_length[s_idx];
+
+    if ((row_length == 1) && (single_stm->col[row_begin] == (int)s_idx) &&
+        (single_stm->mat_val[row_begin] == 1.0f))
+    {
+        return SPARSE_ROW_IDENTITY;
+    }
+
+    if ((row_length != (int)Ns) || (Ns < 2))
+    {
+        return SPARSE_ROW_EXPLICIT;
+    }
+
+    if (row_begin == *p_uniform_begin)
+    {
+        return SPARSE_ROW_UNIFORM;
+    }
+
+    // All rows of this kind must have the same probability, so the first
+    // one decides it
+    float prob = single_stm->mat_val[row_begin];
+    if ((*p_uniform_begin != -1) && (prob != *p_uniform_prob))
+    {
+        return SPARSE_ROW_EXPLICIT;
+    }
+    for (int j=row_begin+1; j<row_begin+row_length; j++)
+    {
+        if (single_stm->mat_val[j] != prob)
+        {
+            return SPARSE_ROW_EXPLICIT;
+        }
+    }
+
+    *p_uniform_begin = row_begin;
+    *p_uniform_prob = prob;
+    return SPARSE_ROW_UNIFORM;
+}
+
+// Length and index of a row, for sorting the rows of a SELL window
+struct sell_row
+{
+    uint32_t length;
+    uint32_t row;
+};
+
+// Longest first, and in row order among rows of the same length
+static int compare_sell_rows(const void* p_a, const void* p_b)
+{
+    const struct sell_row* p_row_a = (const struct sell_row*)p_a;
+    const struct sell_row* p_row_b = (const struct sell_row*)p_b;
+    if (p_row_a->length != p_row_b->length)
+    {
+        return (p_row_a->length > p_row_b->length) ? -1 : 1;
+    }
+    return (p_row_a->row < p_row_b->row) ? -1 : (p_row_a->row > p_row_b->row);
+}
+
+// Builds the SELL-C-sigma copy of the CSR rows that have entries
+static void build_sell(struct sparse_mdp* p_sparse_mdp)
+{
+    const uint32_t C = BACKUP_KERNELS_SELL_C;
+    uint32_t num_rows = p_sparse_mdp->Ns*p_sparse_mdp->Na;
+
+    struct sell_row* rows = (struct sell_row*)malloc(sizeof(struct sell_row)*((size_t)num_rows+1));
+    assert(rows != NULL);
+    uint32_t n = 0;
+    for (uint32_t row=0; row<num_rows; row++)
+    {
+        const float* row_val;
+        const uint32_t* row_col_idx;
+        uint32_t length = sparse_mdp_row_entries(p_sparse_mdp, row/p_sparse_mdp->Na, row%p_sparse_mdp->Na,
+                                                 &row_val, &row_col_idx);
+        if (length > 0)
+        {
+            rows[n].length = length;
+            rows[n].row = row;
+            n++;
+        }
+    }
+
+    // Sorting only within a window keeps the rows of nearby states, and
+    // so the parts of the value vector they read, close together
+    for (uint32_t window_begin=0; window_begin<n; window_begin+=SPARSE_SELL_SIGMA)
+    {
+        uint32_t window_length = (n - window_begin < SPARSE_SELL_SIGMA) ? (n - window_begin) : SPARSE_SELL_SIGMA;
+        qsort(&rows[window_begin], window_length, sizeof(struct sell_row), compare_sell_rows);
+    }
+
+    // The window is a multiple of C, so the first row of a slice is its longest
+    uint32_t num_slices = (n + C - 1)/C;
+    p_sparse_mdp->sell_slice_ptr = (uint32_t*)malloc(sizeof(uint32_t)*((size_t)num_slices+1));
+    assert(p_sparse_mdp->sell_slice_ptr != NULL);
+    uint64_t total = 0;
+    for (uint32_t k=0; k<num_slices; k++)
+    {
+        p_sparse_mdp->sell_slice_ptr[k] = (uint32_t)total;
+        total += (uint64_t)rows[k*C].length*C;
+    }
+    assert(total <= UINT32_MAX);
+    p_sparse_mdp->sell_slice_ptr[num_slices] = (uint32_t)total;
+
+    p_sparse_mdp->sell_num_rows = n;
+    p_sparse_mdp->sell_num_slices = num_slices;
+    p_sparse_mdp->sell_perm = (uint32_t*)malloc(sizeof(uint32_t)*((size_t)n+1));
+    p_sparse_mdp->sell_val = (float*)malloc(sizeof(float)*((size_t)total+1));
+    p_sparse_mdp->sell_col_idx = (uint32_t*)malloc(sizeof(uint32_t)*((size_t)total+1));
+    assert(p_sparse_mdp->sell_perm != NULL);
+    assert(p_sparse_mdp->sell_val != NULL);
+    assert(p_sparse_mdp->sell_col_idx != NULL);
+
+    for (uint32_t k=0; k<num_slices; k++)
+    {
+        uint32_t slice_begin = p_sparse_mdp->sell_slice_ptr[k];
+        uint32_t slice_length = (p_sparse_mdp->sell_slice_ptr[k+1] - slice_begin)/C;
+        for (uint32_t l=0; l<C; l++)
+        {
+            uint32_t i = k*C + l;
+            uint32_t length = 0;
+            const float* row_val = NULL;
+            const uint32_t* row_col_idx = NULL;
+            if (i < n)
+            {
+                p_sparse_mdp->sell_perm[i] = rows[i].row;
+                length = sparse_mdp_row_entries(p_sparse_mdp, rows[i].row/p_sparse_mdp->Na,
+                                                rows[i].row%p_sparse_mdp->Na, &row_val, &row_col_idx);
+            }
+
+            // Padding repeats the last column of the row with a zero
+            // probability, so it reads a value that is already in cache
+            for (uint32_t j=0; j<slice_length; j++)
+            {
+                uint32_t pos = slice_begin + j*C + l;
+                if (j < length)
+                {
+                    p_sparse_mdp->sell_val[pos] = row_val[j];
+                    p_sparse_mdp->sell_col_idx[pos] = row_col_idx[j];
+                }
+                else
+                {
+                    p_sparse_mdp->sell_val[pos] = 0.0f;
+                    p_sparse_mdp->sell_col_idx[pos] = (length > 0) ? row_col_idx[length - 1] : 0;
+                }
+            }
+        }
+    }
+
+    free(rows);
+
+    p_sparse_mdp->row_sums = (float*)malloc(sizeof(float)*(size_t)num_rows);
+    assert(p_sparse_mdp->row_sums != NULL);
+    memset(p_sparse_mdp->row_sums, 0, sizeof(float)*(size_t)num_rows);
+
+    printf("SELL-%u-%u layout: %u slices, %.1f %% padding\n", C, SPARSE_SELL_SIGMA, num_slices,
+           (total > 0) ? 100.0*(double)(total - p_sparse_mdp->nnz)/(double)total : 0.0);
+}
+
+// This function currently assumes that the input format is the cassandra format.
+// The row_start/row_length/col/mat_val arrays of each P[a] are used as they
+// are, so the transitions are in memory once, in the model. Only R and the
+// kind of each row are built here.
+void sparse_mdp_load(struct sparse_mdp* p_sparse_mdp, void* p_mdp_obj)
+{
+    PomdpCassandraWrapper* p_mdp = (PomdpCassandraWrapper*)p_mdp_obj;
+
+    uint32_t Ns = p_mdp->getNumStates();
+    uint32_t Na = p_mdp->getNumActions();
+    p_sparse_mdp->Ns = Ns;
+    p_sparse_mdp->Na = Na;
+    p_sparse_mdp->discount_factor = p_mdp->getDiscount();
+    p_sparse_mdp->b_minimize = p_mdp->isCost();
+    p_sparse_mdp->sparse_dot = backup_kernels_get()->sparse_dot;
+    p_sparse_mdp->sell_slice = backup_kernels_get()->sell_slice;
+
+    p_sparse_mdp->row_kind = (uint8_t*)malloc(sizeof(uint8_t)*(size_t)Ns*Na);
+    assert(p_sparse_mdp->row_kind != NULL);
+    p_sparse_mdp->num_uniform_rows = 0;
+    p_sparse_mdp->num_identity_rows = 0;
+    p_sparse_mdp->uniform_prob = 0.0f;
+    p_sparse_mdp->value_sum = 0.0;
+
+    // Classify the rows. Only the entries of explicit ones are read.
+    int uniform_begin = -1;
+    uint64_t nnz = 0;
+    for (uint32_t a_idx=0; a_idx<Na; a_idx++)
+    {
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
+        if (p_sparse_mdp->num_uniform_rows == 0)
+        {
+            uniform_begin = -1;
+        }
+        else
+        {
+            // Only the probability carries over to the other matrices
+            uniform_begin = -2;
+        }
+        for (uint32_t s_idx=0; s_idx<Ns; s_idx++)
+        {
+            uint8_t kind = classify_row(single_stm, s_idx, Ns, &uniform_begin, &p_sparse_mdp->uniform_prob);
+            p_sparse_mdp->row_kind[sparse_mdp_row(p_sparse_mdp, s_idx, a_idx)] = kind;
+            if (kind == SPARSE_ROW_UNIFORM)
+            {
+                p_sparse_mdp->num_uniform_rows++;
+            }
+            else if (kind == SPARSE_ROW_IDENTITY)
+            {
+                p_sparse_mdp->num_identity_rows++;
+            }
+            else
+            {
+                nnz += single_stm->row_length[s_idx];
+            }
+        }
+    }
+    assert(nnz <= UINT32_MAX);
+    p_sparse_mdp->nnz = (uint32_t)nnz;
+
+    double Ns2Na = (double)Ns*(double)Ns*(double)Na;
+    printf("Total non-zero entries = %u / %.0f (= %.3f %% Sparse)\n",
+           p_sparse_mdp->nnz, Ns2Na, 100.0*(Ns2Na-(double)nnz)/Ns2Na);
+
+    if ((p_sparse_mdp->num_uniform_rows == 0) && (p_sparse_mdp->num_identity_rows == 0))
+    {
+        free(p_sparse_mdp->row_kind);
+        p_sparse_mdp->row_kind = NULL;
+    }
+    else
+    {
+        printf("Uniform rows = %u, identity rows = %u (not read)\n",
+               p_sparse_mdp->num_uniform_rows, p_sparse_mdp->num_identity_rows);
+    }
+
+    p_sparse_mdp->row_start = (const int**)malloc(sizeof(int*)*Na);
+    p_sparse_mdp->row_length = (const int**)malloc(sizeof(int*)*Na);
+    p_sparse_mdp->col_idx = (const uint32_t**)malloc(sizeof(uint32_t*)*Na);
+    p_sparse_mdp->val = (const float**)malloc(sizeof(float*)*Na);
+    p_sparse_mdp->R = (float*)malloc(sizeof(float)*(size_t)Ns*Na);
+    p_sparse_mdp->active_actions = NULL;
+    p_sparse_mdp->num_active = NULL;
+    assert((p_sparse_mdp->row_start != NULL) && (p_sparse_mdp->row_length != NULL));
+    assert((p_sparse_mdp->col_idx != NULL) && (p_sparse_mdp->val != NULL));
+    assert(p_sparse_mdp->R != NULL);
+
+    // The column indices were checked to be states when the model was
+    // read, so they can be used as unsigned
+    for (uint32_t a_idx=0; a_idx<Na; a_idx++)
+    {
+        CassandraSingleMatrix single_stm = p_mdp->getT(a_idx);
+        p_sparse_mdp->row_start[a_idx] = single_stm->row_start;
+        p_sparse_mdp->row_length[a_idx] = single_stm->row_length;
+        p_sparse_mdp->col_idx[a_idx] = (const uint32_t*)single_stm->col;
+        p_sparse_mdp->val[a_idx] = single_stm->mat_val;
+    }
+
+    // Populate R in full matrix format. Missing entries are zero rewards.
+    memset(p_sparse_mdp->R, 0, sizeof(float)*(size_t)Ns*Na);
+    CassandraMatrix cassandra_RTranspose = p_mdp->getRTranspose();
+    for (uint32_t a_idx=0; a_idx<Na; a_idx++)
+    {
+        int row_begin = cassandra_RTranspose->row_start[a_idx];
+        int row_end = row_begin + cassandra_RTranspose->row_length[a_idx];
+        for (int j=row_begin; j<row_end; j++)
+        {
+            uint32_t row = sparse_mdp_row(p_sparse_mdp, (uint32_t)cassandra_RTranspose->col[j], a_idx);
+            p_sparse_mdp->R[row] = cassandra_RTranspose->mat_val[j];
+        }
+    }
+
+    p_sparse_mdp->sell_num_rows = 0;
+    p_sparse_mdp->sell_num_slices = 0;
+    p_sparse_mdp->sell_slice_ptr = NULL;
+    p_sparse_mdp->sell_perm = NULL;
+    p_sparse_mdp->sell_val = NULL;
+    p_sparse_mdp->sell_col_idx = NULL;
+    p_sparse_mdp->row_sums = NULL;
+    p_sparse_mdp->b_row_sums_valid = false;
+    if (s_layout == SPARSE_LAYOUT_SELL)
+    {
+        build_sell(p_sparse_mdp);
+    }
+}
+
+void sparse_mdp_enable_action_elimination(struct sparse_mdp* p_sparse_mdp)
+{
+    uint32_t Ns = p_sparse_mdp->Ns;
+    uint32_t Na = p_sparse_mdp->Na;
+
+    p_sparse_mdp->active_actions = (uint32_t*)malloc(sizeof(uint32_t)*(size_t)Ns*Na);
+    p_sparse_mdp->num_active = (uint32_t*)malloc(sizeof(uint32_t)*Ns);
+    assert(p_sparse_mdp->active_actions != NULL);
+    assert(p_sparse_mdp->num_active != NULL);
+
+    for (uint32_t s_idx=0; s_idx<Ns; s_idx++)
+    {
+        for (uint32_t a_idx=0; a_idx<Na; a_idx++)
+        {
+            p_sparse_mdp->active_actions[(size_t)s_idx*Na + a_idx] = a_idx;
+        }
+        p_sparse_mdp->num_active[s_idx] = Na;
+    }
+}
+
+void sparse_mdp_prepare(struct sparse_mdp* p_sparse_mdp, const float* value)
+{
+    p_sparse_mdp->b_row_sums_valid = false;
+
+    if (p_sparse_mdp->num_uniform_rows == 0)
+    {
+        return;
+    }
+
+    double value_sum = 0.0;
+    for (uint32_t s_idx=0; s_idx<p_sparse_mdp->Ns; s_idx++)
+    {
+        value_sum += value[s_idx];
+    }
+    p_sparse_mdp->value_sum = value_sum;
+}
+
+void sparse_mdp_prepare_sweep(struct sparse_mdp* p_sparse_mdp, const float* value)
+{
+    sparse_mdp_prepare(p_sparse_mdp, value);
+
+    if (p_sparse_mdp->sell_val == NULL)
+    {
+        return;
+    }
+
+    const uint32_t C = BACKUP_KERNELS_SELL_C;
+    float sums[BACKUP_KERNELS_SELL_C];
+    for (uint32_t k=0; k<p_sparse_mdp->sell_num_slices; k++)
+    {
+        uint32_t slice_begin = p_sparse_mdp->sell_slice_ptr[k];
+        uint32_t slice_length = (p_sparse_mdp->sell_slice_ptr[k+1] - slice_begin)/C;
+        p_sparse_mdp->sell_slice(&p_sparse_mdp->sell_val[slice_begin], &p_sparse_mdp->sell_col_idx[slice_begin],
+                                 slice_length, value, sums);
+
+        // Back to row order. Only the last slice can have unused lanes.
+        uint32_t num_lanes = (p_sparse_mdp->sell_num_rows - k*C < C) ? (p_sparse_mdp->sell_num_rows - k*C) : C;
+        for (uint32_t l=0; l<num_lanes; l++)
+        {
+            p_sparse_mdp->row_sums[p_sparse_mdp->sell_perm[k*C + l]] = sums[l];
+        }
+    }
+    p_sparse_mdp->b_row_sums_valid = true;
+}
+
+void sparse_mdp_free(struct sparse_mdp* p_sparse_mdp)
+{
+    if (p_sparse_mdp->row_start != NULL) {free((void*)p_sparse_mdp->row_start);}
+    if (p_sparse_mdp->row_length != NULL) {free((void*)p_sparse_mdp->row_length);}
+    if (p_sparse_mdp->col_idx != NULL) {free((void*)p_sparse_mdp->col_idx);}
+    if (p_sparse_mdp->val != NULL) {free((void*)p_sparse_mdp->val);}
+    if (p_sparse_mdp->R != NULL) {free(p_sparse_mdp->R);}
+    if (p_sparse_mdp->row_kind != NULL) {free(p_sparse_mdp->row_kind);}
+    if (p_sparse_mdp->active_actions != NULL) {free(p_sparse_mdp->active_actions);}
+    if (p_sparse_mdp->num_active != NULL) {free(p_sparse_mdp->num_active);}
+    if (p_sparse_mdp->sell_slice_ptr != NULL) {free(p_sparse_mdp->sell_slice_ptr);}
+    if (p_sparse_mdp->sell_perm != NULL) {free(p_sparse_mdp->sell_perm);}
+    if (p_sparse_mdp->sell_val != NULL) {free(p_sparse_mdp->sell_val);}
+    if (p_sparse_mdp->sell_col_idx != NULL) {free(p_sparse_mdp->sell_col_idx);}
+    if (p_sparse_mdp->row_sums != NULL) {free(p_sparse_mdp->row_sums);}
+
+    memset(p_sparse_mdp, 0, sizeof(*p_sparse_mdp));
+}
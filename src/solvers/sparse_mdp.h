@@ -0,0 +1,237 @@
+/*******************************************************************************
+@ddblock_begin copyright
+
+Copyright (c) 1997-2019
+Maryland DSPCAD Research Group, The University of Maryland at College Park 
+
+Permission is hereby granted, without written agreement and without license or
+royalty fees, to use, copy, modify, and distribute this software and its
+documentation for any purpose other than its incorporation into a commercial
+product, provided that the above copyright notice and the following two
+paragraphs appear in all copies of this software.
+
+IN NO EVENT SHALL THE UNIVERSITY OF MARYLAND BE LIABLE TO ANY PARTY
+FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES
+ARISING OUT OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF
+THE UNIVERSITY OF MARYLAND HAS BEEN ADVISED OF THE POSSIBILITY OF
+SUCH DAMAGE.
+
+THE UNIVERSITY OF MARYLAND SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE. THE SOFTWARE
+PROVIDED HEREUNDER IS ON AN "AS IS" BASIS, AND THE UNIVERSITY OF
+MARYLAND HAS NO OBLIGATION TO PROVIDE MAINTENANCE, SUPPORT, UPDATES,
+ENHANCEMENTS, OR MODIFICATIONS.
+
+@ddblock_end copyright
+*******************************************************************************/
+
+#ifndef __SPARSE_MDP_H__
+#define __SPARSE_MDP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "backup_kernels.h"
+
+// Kinds of rows of the transition operator. Only explicit rows have CSR
+// entries. A uniform row moves to every state with probability
+// uniform_prob, and an identity row stays in the same state, so the
+// backup of either is O(1).
+enum sparse_mdp_row_kind
+{
+    SPARSE_ROW_EXPLICIT = 0,
+    SPARSE_ROW_UNIFORM = 1,
+    SPARSE_ROW_IDENTITY = 2
+};
+
+// Storage of the explicit rows, picked for all the sparse CPU solvers
+// with sparse_mdp_set_layout() before they load the model. The CSR rows
+// of the model are always kept. SPARSE_LAYOUT_SELL adds a SELL-C-sigma
+// copy: the rows are sorted by length within windows of SPARSE_SELL_SIGMA
+// rows and cut into slices of BACKUP_KERNELS_SELL_C rows, which are
+// padded to their longest row and stored column by column. A slice is
+// then summed with one vector lane per row, so the many rows with one to
+// three entries are done C at a time instead of one short loop each.
+// Only sparse_mdp_prepare_sweep() reads the copy, so it is no use to the
+// solvers that back up states in place or one row at a time.
+enum
+{
+    SPARSE_LAYOUT_CSR = 0,
+    SPARSE_LAYOUT_SELL = 1
+};
+#define SPARSE_SELL_SIGMA 4096
+
+void sparse_mdp_set_layout(uint8_t layout);
+
+// An MDP as the sparse CPU solvers see it. The transitions are not
+// copied: the model already holds them in single precision, one CSR
+// matrix per action, and the solvers read those arrays in place. Row
+// s*Na + a of the operator, which is also the index of (s,a) in R and
+// the other per row arrays, is row s of the matrix of action a.
+// Memory is O(Ns*Na) on top of the model rather than O(Ns*Ns*Na).
+struct sparse_mdp
+{
+    uint32_t Ns;
+    uint32_t Na;
+    uint32_t nnz;       // Entries of the explicit rows
+    float discount_factor;
+    bool b_minimize;    // true for cost models, where R holds costs to be minimized
+
+    // Na entries each, pointing into the model. Row s of action a is
+    // entries [row_start[a][s], row_start[a][s] + row_length[a][s]) of
+    // val[a] and col_idx[a]. Rows that are not explicit are never read
+    // there, see sparse_mdp_row_entries().
+    const int** row_start;
+    const int** row_length;
+    const uint32_t** col_idx;   // next state of each transition
+    const float** val;          // probability of each transition
+    float* R;           // Ns*Na entries, R[s*Na + a] is the expected reward of (s,a)
+
+    // Dot product of a row with the value function, see backup_kernels.h
+    sparse_dot_fn sparse_dot;
+
+    // Kind of each of the Ns*Na rows, NULL if they are all explicit
+    uint8_t* row_kind;
+    uint32_t num_uniform_rows;
+    uint32_t num_identity_rows;
+    float uniform_prob;
+
+    // Sum of the value vector that uniform rows are backed up against.
+    // See sparse_mdp_prepare() and sparse_mdp_set_value().
+    double value_sum;
+
+    // SELL-C-sigma copy of the explicit rows, NULL with the CSR layout.
+    // Slice k is [sell_slice_ptr[k], sell_slice_ptr[k+1]) of sell_val and
+    // sell_col_idx, and its lane l holds row sell_perm[k*C + l].
+    uint32_t sell_num_rows;     // Rows that have entries, in the slices
+    uint32_t sell_num_slices;
+    uint32_t* sell_slice_ptr;
+    uint32_t* sell_perm;
+    float* sell_val;
+    uint32_t* sell_col_idx;
+    sell_slice_fn sell_slice;
+
+    // Sums of the explicit rows against the value vector of the last
+    // sparse_mdp_prepare_sweep(), Ns*Na entries
+    float* row_sums;
+    bool b_row_sums_valid;
+
+    // Per-state lists of actions that have not been eliminated. The
+    // active actions of state s are active_actions[s*Na .. s*Na + num_active[s] - 1].
+    // Both are NULL unless sparse_mdp_enable_action_elimination() was called.
+    uint32_t* active_actions;
+    uint32_t* num_active;
+};
+
+// Builds a sparse_mdp from the MDP object passed to the solvers.
+// Currently only PomdpCassandraWrapper is supported.
+void sparse_mdp_load(struct sparse_mdp* p_sparse_mdp, void* p_mdp_obj);
+
+// Frees everything allocated by sparse_mdp_load(). The transitions stay
+// with the model, which must outlive the sparse_mdp.
+void sparse_mdp_free(struct sparse_mdp* p_sparse_mdp);
+
+// Sets up the active action lists with every action active in every state
+void sparse_mdp_enable_action_elimination(struct sparse_mdp* p_sparse_mdp);
+
+// Must be called before sparse_mdp_q_value() is used with a value vector
+// that was changed other than through sparse_mdp_set_value(), e.g. at the
+// start of each sweep from one vector into another. O(Ns) if the model
+// has uniform rows, free otherwise.
+void sparse_mdp_prepare(struct sparse_mdp* p_sparse_mdp, const float* value);
+
+// sparse_mdp_prepare() for solvers that back up every state from the same
+// value vector. With the SELL layout it also sums all the explicit rows
+// at once, and sparse_mdp_q_value() reads those sums until the next
+// sparse_mdp_prepare() or sparse_mdp_set_value(). value must then be the
+// vector that is passed to sparse_mdp_q_value().
+void sparse_mdp_prepare_sweep(struct sparse_mdp* p_sparse_mdp, const float* value);
+
+// Row of the operator (and index into R) that holds (s,a)
+static inline uint32_t sparse_mdp_row(const struct sparse_mdp* p_sparse_mdp, uint32_t s_idx, uint32_t a_idx)
+{
+    return s_idx*p_sparse_mdp->Na + a_idx;
+}
+
+static inline uint8_t sparse_mdp_row_kind(const struct sparse_mdp* p_sparse_mdp, uint32_t row)
+{
+    return (p_sparse_mdp->row_kind == NULL) ? (uint8_t)SPARSE_ROW_EXPLICIT : p_sparse_mdp->row_kind[row];
+}
+
+// Points *p_val and *p_col_idx at the entries of (s,a) and returns how
+// many there are. Rows that are not explicit have none.
+static inline uint32_t sparse_mdp_row_entries(const struct sparse_mdp* p_sparse_mdp,
+                                              uint32_t s_idx,
+                                              uint32_t a_idx,
+                                              const float** p_val,
+                                              const uint32_t** p_col_idx)
+{
+    uint32_t row = sparse_mdp_row(p_sparse_mdp, s_idx, a_idx);
+    int row_begin = p_sparse_mdp->row_start[a_idx][s_idx];
+    *p_val = &p_sparse_mdp->val[a_idx][row_begin];
+    *p_col_idx = &p_sparse_mdp->col_idx[a_idx][row_begin];
+    if (sparse_mdp_row_kind(p_sparse_mdp, row) != SPARSE_ROW_EXPLICIT)
+    {
+        return 0;
+    }
+    return (uint32_t)p_sparse_mdp->row_length[a_idx][s_idx];
+}
+
+// Updates value[s_idx] in place, for solvers that back up states in place
+static inline void sparse_mdp_set_value(struct sparse_mdp* p_sparse_mdp,
+                                        float* value,
+                                        uint32_t s_idx,
+                                        float new_value)
+{
+    p_sparse_mdp->value_sum += (double)new_value - (double)value[s_idx];
+    p_sparse_mdp->b_row_sums_valid = false;
+    value[s_idx] = new_value;
+}
+
+// Expected value of taking action a_idx in state s_idx, i.e.
+// R(s,a) + discount * sum_s' P(s'|s,a) * value[s']
+static inline float sparse_mdp_q_value(const struct sparse_mdp* p_sparse_mdp,
+                                       uint32_t s_idx,
+                                       uint32_t a_idx,
+                                       const float* value)
+{
+    uint32_t row = sparse_mdp_row(p_sparse_mdp, s_idx, a_idx);
+    float summation = 0.0f;
+
+    // Empty for the rows that are not explicit
+    const float* row_val;
+    const uint32_t* row_col_idx;
+    uint32_t row_length = sparse_mdp_row_entries(p_sparse_mdp, s_idx, a_idx, &row_val, &row_col_idx);
+    if (p_sparse_mdp->b_row_sums_valid)
+    {
+        summation = p_sparse_mdp->row_sums[row];
+    }
+    else if (row_length >= BACKUP_KERNELS_MIN_SPARSE_ROW)
+    {
+        summation = p_sparse_mdp->sparse_dot(row_val, row_col_idx, row_length, value);
+    }
+    else
+    {
+        for (uint32_t j = 0; j < row_length; j++)
+        {
+            summation += row_val[j] * value[row_col_idx[j]];
+        }
+    }
+
+    if (p_sparse_mdp->row_kind != NULL)
+    {
+        if (p_sparse_mdp->row_kind[row] == SPARSE_ROW_UNIFORM)
+        {
+            summation = (float)(p_sparse_mdp->uniform_prob*p_sparse_mdp->value_sum);
+        }
+        else if (p_sparse_mdp->row_kind[row] == SPARSE_ROW_IDENTITY)
+        {
+            summation = value[s_idx];
+        }
+    }
+
+    return p_sparse_mdp->R[row] + p_sparse_mdp->discount_factor*summation;
+}
+
+#endif //__SPARSE_MDP_H__
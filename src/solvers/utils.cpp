@@ -28,6 +28,12 @@ ENHANCEMENTS, OR MODIFICATIONS.
 
 #include "utils.h"
 
+// Iteration count of the most recent solve
+static uint32_t s_num_iterations = 0;
+
+static bool s_b_ssp = false;
+static float s_ssp_epsilon = SOLVER_SSP_DEFAULT_EPSILON;
+
 // Computes elapsed time in floating point seconds,
 // from two <time.h> struct timespec objects
 float measure_elapsed_time(const struct timespec* p_start_time,
@@ -52,3 +58,52 @@ float measure_elapsed_time(const struct timespec* p_start_time,
 
     return(f_diff_time);
 }
+
+// Returns true if max_solver_time_s seconds have passed since p_start_time.
+// A max_solver_time_s of 0 means "no time limit" and never times out.
+bool solver_timed_out(const struct timespec* p_start_time, int max_solver_time_s)
+{
+    if (max_solver_time_s == 0)
+    {
+        return(false);
+    }
+
+    struct timespec now_time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now_time);
+
+    float solver_elapsed_time = measure_elapsed_time(p_start_time, (const struct timespec*)&now_time);
+
+    return((int)solver_elapsed_time >= max_solver_time_s);
+}
+
+void solver_set_num_iterations(uint32_t num_iterations)
+{
+    s_num_iterations = num_iterations;
+}
+
+uint32_t solver_get_num_iterations(void)
+{
+    return(s_num_iterations);
+}
+
+void solver_set_ssp_mode(bool b_ssp, float epsilon)
+{
+    s_b_ssp = b_ssp;
+    s_ssp_epsilon = (epsilon > 0.0f) ? epsilon : SOLVER_SSP_DEFAULT_EPSILON;
+}
+
+bool solver_get_ssp_mode(void)
+{
+    return(s_b_ssp);
+}
+
+float solver_stopping_threshold(float discount_factor)
+{
+    if (s_b_ssp)
+    {
+        return(s_ssp_epsilon);
+    }
+
+    float eps = 0.5f;
+    return((eps * (1-discount_factor)) / (2*discount_factor));
+}
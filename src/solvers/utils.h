@@ -29,6 +29,9 @@ ENHANCEMENTS, OR MODIFICATIONS.
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 // Computes elapsed time in floating point seconds,
@@ -36,5 +39,51 @@ ENHANCEMENTS, OR MODIFICATIONS.
 float measure_elapsed_time(const struct timespec* p_start_time,
                            const struct timespec* p_end_time);
 
+// Returns true if max_solver_time_s seconds have passed since p_start_time.
+// A max_solver_time_s of 0 means "no time limit" and never times out.
+bool solver_timed_out(const struct timespec* p_start_time, int max_solver_time_s);
+
+// Number of iterations (sweeps) the most recent solve ran for. Solvers
+// record it with solver_set_num_iterations() and main() prints it next
+// to the solve time. 0 means the solver did not report it.
+void solver_set_num_iterations(uint32_t num_iterations);
+uint32_t solver_get_num_iterations(void);
+
+// Stochastic shortest path mode. Discounted models stop once the sup norm
+// of a sweep's change is below (eps*(1-discount))/(2*discount), which is 0
+// for the undiscounted models SSP problems usually are. In SSP mode the
+// solvers instead stop once the change is below epsilon. If epsilon is 0,
+// SOLVER_SSP_DEFAULT_EPSILON is used.
+#define SOLVER_SSP_DEFAULT_EPSILON (1e-3f)
+void solver_set_ssp_mode(bool b_ssp, float epsilon);
+bool solver_get_ssp_mode(void);
+
+// Sup norm of a sweep's change below which a value iteration solver stops
+float solver_stopping_threshold(float discount_factor);
+
+// Bellman backups are compiled once for each optimization direction, so
+// there is no branch on it in the inner loops. B_MINIMIZE is false for
+// reward models (max over actions) and true for cost models (min).
+#ifdef __CUDACC__
+#define SOLVER_HOST_DEVICE __host__ __device__
+#else
+#define SOLVER_HOST_DEVICE
+#endif
+
+// Starting value of the best-action search. Every finite Q value beats
+// it, so an action is always chosen however large the values get.
+template <bool B_MINIMIZE>
+static inline SOLVER_HOST_DEVICE float backup_initial_value(void)
+{
+    return B_MINIMIZE ? INFINITY : -INFINITY;
+}
+
+// True if candidate is strictly better than best
+template <bool B_MINIMIZE>
+static inline SOLVER_HOST_DEVICE bool backup_is_better(float candidate, float best)
+{
+    return B_MINIMIZE ? (candidate < best) : (candidate > best);
+}
+
 
 #endif //__UTILS_H__